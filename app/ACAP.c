@@ -36,10 +36,10 @@
 // Global variables
 static cJSON* app = NULL;
 static cJSON* status_container = NULL;
+static pthread_mutex_t app_mutex = PTHREAD_MUTEX_INITIALIZER; // The app and settings endpoints may run on several workers
 
 cJSON* 		ACAP_STATUS(void);
 int			ACAP_HTTP(void);
-void		ACAP_HTTP_Process(void);
 void		ACAP_HTTP_Cleanup(void);
 cJSON*		ACAP_EVENTS(void);
 int 		ACAP_FILE_Init(void);
@@ -161,7 +161,9 @@ ACAP_ENDPOINT_app(const ACAP_HTTP_Response response, const ACAP_HTTP_Request req
         return;
     }
 	
+    pthread_mutex_lock(&app_mutex);
     ACAP_HTTP_Respond_JSON(response, app);
+    pthread_mutex_unlock(&app_mutex);
 }
 
 static void
@@ -175,7 +177,9 @@ ACAP_ENDPOINT_settings(const ACAP_HTTP_Response response, const ACAP_HTTP_Reques
 
     // Handle GET request - return current settings
     if (strcmp(method, "GET") == 0) {
+        pthread_mutex_lock(&app_mutex);
         ACAP_HTTP_Respond_JSON(response, cJSON_GetObjectItem(app, "settings"));
+        pthread_mutex_unlock(&app_mutex);
         return;
     }
 
@@ -204,6 +208,7 @@ ACAP_ENDPOINT_settings(const ACAP_HTTP_Response response, const ACAP_HTTP_Reques
         LOG_TRACE("%s: %s\n", __func__, request->postData);
 
         // Update settings
+        pthread_mutex_lock(&app_mutex);
         cJSON* settings = cJSON_GetObjectItem(app, "settings");
         cJSON* param = params->child;
         while (param) {
@@ -223,6 +228,7 @@ ACAP_ENDPOINT_settings(const ACAP_HTTP_Response response, const ACAP_HTTP_Reques
         if (ACAP_UpdateCallback) {
             ACAP_UpdateCallback("settings", settings);
         }
+        pthread_mutex_unlock(&app_mutex);
 
         ACAP_HTTP_Respond_Text(response, "Settings updated successfully");
         return;
@@ -258,36 +264,74 @@ ACAP_Get_Config(const char* service) {
 	return reqestedService;
 }
 
+// For threads other than the settings endpoint, which rewrites the tree under app_mutex.
+// Not from the update callback, which already holds it.
+cJSON*
+ACAP_Copy_Config(const char* service) {
+	pthread_mutex_lock(&app_mutex);
+	cJSON* reqestedService = cJSON_GetObjectItem(app, service );
+	cJSON* copy = reqestedService ? cJSON_Duplicate(reqestedService, 1) : NULL;
+	pthread_mutex_unlock(&app_mutex);
+	return copy;
+}
+
 /*------------------------------------------------------------------
  * HTTP Request Processing Implementation
  *------------------------------------------------------------------*/
 
-static pthread_t http_thread;
+static pthread_t http_threads[ACAP_HTTP_WORKERS];
+static int http_thread_count = 0;
 static int http_thread_running = 0; // Flag to track thread state
 static pthread_mutex_t http_nodes_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t http_accept_mutex = PTHREAD_MUTEX_INITIALIZER; // One worker in accept at a time
 
 typedef struct {
     char path[ACAP_MAX_PATH_LENGTH];
     ACAP_HTTP_Callback callback;
 } HTTPNode;
 
-// Thread function for FastCGI processing
-void* fastcgi_thread_func(void* arg) {
-    while (http_thread_running) {
-        ACAP_HTTP_Process(); // Process FastCGI requests
-    }
-	LOG_TRACE("%s: Exit\n",__func__);
-    return NULL;
-}
-
 static int initialized = 0;
 static int fcgi_sock = -1;
 static HTTPNode http_nodes[ACAP_MAX_HTTP_NODES];
 static int http_node_count = 0;
 
+static void http_handle(FCGX_Request* request);
+
+static void http_accept_unlock(void* arg) {
+    pthread_mutex_unlock(&http_accept_mutex);
+}
+
+// Worker thread. Each worker owns one request; the workers take turns
+// accepting on the shared socket and handle their requests in parallel.
+void* fastcgi_thread_func(void* arg) {
+    FCGX_Request request;
+    if (FCGX_InitRequest(&request, fcgi_sock, 0) != 0) {
+        LOG_WARN("FCGX_InitRequest failed\n");
+        return NULL;
+    }
+
+    while (http_thread_running) {
+        int accepted;
+        pthread_cleanup_push(http_accept_unlock, NULL);
+        pthread_mutex_lock(&http_accept_mutex);
+        accepted = FCGX_Accept_r(&request);
+        pthread_cleanup_pop(1);
+        if (accepted != 0)
+            continue;
+
+        // A request that has been accepted is completed before the worker can be cancelled
+        int state;
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+        http_handle(&request);
+        FCGX_Finish_r(&request);
+        pthread_setcancelstate(state, NULL);
+    }
+    FCGX_Free(&request, 0);
+	LOG_TRACE("%s: Exit\n",__func__);
+    return NULL;
+}
 
-static const char* get_path_without_query(const char* uri) {
-    static char path[ACAP_MAX_PATH_LENGTH];
+static const char* get_path_without_query(const char* uri, char* path) {
     const char* query = strchr(uri, '?');
     
     if (query) {
@@ -309,12 +353,35 @@ int ACAP_HTTP() {
             LOG_WARN("Failed to initialize FCGI\n");
             return 0;
         }
+
+        // All workers accept on the same socket
+        const char* socket_path = getenv("FCGI_SOCKET_NAME");
+        if (!socket_path) {
+            LOG_WARN("Failed to get FCGI_SOCKET_NAME\n");
+            return 0;
+        }
+        fcgi_sock = FCGX_OpenSocket(socket_path, 5);
+        if (fcgi_sock < 0) {
+            LOG_WARN("Failed to open FCGI socket\n");
+            fcgi_sock = -1;
+            return 0;
+        }
+        chmod(socket_path, 0777);
         initialized = 1;
 
-        // Start the FastCGI thread
+        // Start the FastCGI workers
         http_thread_running = 1;
-        if (pthread_create(&http_thread, NULL, fastcgi_thread_func, NULL) != 0) {
-            LOG_WARN("Failed to create FastCGI thread\n");
+        for (int i = 0; i < ACAP_HTTP_WORKERS; i++) {
+            if (pthread_create(&http_threads[i], NULL, fastcgi_thread_func, NULL) != 0) {
+                LOG_WARN("Failed to create FastCGI thread %d\n", i);
+                break;
+            }
+            http_thread_count++;
+        }
+        if (http_thread_count == 0) {
+            http_thread_running = 0;
+            close(fcgi_sock);
+            fcgi_sock = -1;
             initialized = 0; // Roll back initialization
             return 0;
         }
@@ -334,11 +401,14 @@ void ACAP_HTTP_Cleanup() {
         fcgi_sock = -1;
     }
 
-    // Stop the FastCGI thread
+    // Stop the FastCGI workers; a worker in a request finishes it first
     if (http_thread_running) {
-        http_thread_running = 0; // Signal the thread to stop
-		pthread_cancel(http_thread); // Request cancellation
-        pthread_join(http_thread, NULL); // Wait for the thread to finish
+        http_thread_running = 0; // Signal the workers to stop
+        for (int i = 0; i < http_thread_count; i++)
+            pthread_cancel(http_threads[i]); // Request cancellation
+        for (int i = 0; i < http_thread_count; i++)
+            pthread_join(http_threads[i], NULL); // Wait for the workers to finish
+        http_thread_count = 0;
     }
     initialized = 0;
 }
@@ -403,47 +473,14 @@ int ACAP_HTTP_Node(const char *nodename, ACAP_HTTP_Callback callback) {
 
 
 
-void ACAP_HTTP_Process() {
-	FCGX_Request request;
+// Handle one accepted request; runs on the worker that accepted it
+static void http_handle(FCGX_Request* request) {
     ACAP_HTTP_Request_DATA requestData = {0};
-    char* socket_path = NULL;
-
-    if (!initialized)
-		return;
-
-    // Get socket path
-    socket_path = getenv("FCGI_SOCKET_NAME");
-    if (!socket_path) {
-        LOG_WARN("Failed to get FCGI_SOCKET_NAME\n");
-        return;
-    }
-
-    // Open socket if not already open
-    if (fcgi_sock == -1) {
-        fcgi_sock = FCGX_OpenSocket(socket_path, 5);
-        if (fcgi_sock < 0) {
-            LOG_WARN("Failed to open FCGI socket\n");
-            return;
-        }
-        chmod(socket_path, 0777);
-    }
-
-    // Initialize request
-    if (FCGX_InitRequest(&request, fcgi_sock, 0) != 0) {
-        LOG_WARN("FCGX_InitRequest failed\n");
-        return;
-    }
-
-    // Accept the request
-    if (FCGX_Accept_r(&request) != 0) {
-        FCGX_Free(&request, 1);
-        return;
-    }
 
     // Setup request data structure
-    requestData.request = &request;
-    requestData.method = FCGX_GetParam("REQUEST_METHOD", request.envp);
-    requestData.contentType = FCGX_GetParam("CONTENT_TYPE", request.envp);
+    requestData.request = request;
+    requestData.method = FCGX_GetParam("REQUEST_METHOD", request->envp);
+    requestData.contentType = FCGX_GetParam("CONTENT_TYPE", request->envp);
     
     // Handle POST data
     if (requestData.method && strcmp(requestData.method, "POST") == 0) {
@@ -451,7 +488,7 @@ void ACAP_HTTP_Process() {
         if (contentLength > 0 && contentLength < ACAP_MAX_BUFFER_SIZE) {
             char* postData = malloc(contentLength + 1);
 				if (postData) {
-					size_t bytesRead = FCGX_GetStr(postData, contentLength, request.in);
+					size_t bytesRead = FCGX_GetStr(postData, contentLength, request->in);
 					if (bytesRead < contentLength) {
 						free(postData);
 						goto cleanup;
@@ -464,37 +501,38 @@ void ACAP_HTTP_Process() {
     }
 
     // Process the request
-    const char* uriString = FCGX_GetParam("REQUEST_URI", request.envp);
+    const char* uriString = FCGX_GetParam("REQUEST_URI", request->envp);
     if (!uriString) {
-        ACAP_HTTP_Respond_Error(&request, 400, "Invalid URI");
+        ACAP_HTTP_Respond_Error(request, 400, "Invalid URI");
         goto cleanup;
     }
 
     //LOG_TRACE("%s: Processing URI: %s\n", __func__, uriString);
 
     // Find and execute matching callback
-    const char* pathOnly = get_path_without_query(uriString);
+    char path[ACAP_MAX_PATH_LENGTH];
+    const char* pathOnly = get_path_without_query(uriString, path);
     ACAP_HTTP_Callback matching_callback = NULL;
 
+    pthread_mutex_lock(&http_nodes_mutex);
     for (int i = 0; i < http_node_count; i++) {
         if (strcmp(http_nodes[i].path, pathOnly) == 0) {
             matching_callback = http_nodes[i].callback;
             break;
         }
     }
+    pthread_mutex_unlock(&http_nodes_mutex);
 
     if (matching_callback) {
-        matching_callback(&request, &requestData);
+        matching_callback(request, &requestData);
     } else {
-        ACAP_HTTP_Respond_Error(&request, 404, "Not Found");
+        ACAP_HTTP_Respond_Error(request, 404, "Not Found");
     }
 
 cleanup:
     if (requestData.postData) {
         free((void*)requestData.postData);
     }
-    FCGX_Finish_r(&request);
-    return;
 }
 
 /*------------------------------------------------------------------
@@ -649,23 +687,107 @@ int ACAP_HTTP_Respond_String(ACAP_HTTP_Response response, const char *fmt, ...)
     return FCGX_PutStr(buffer, written, response->out) == written;
 }
 
-int ACAP_HTTP_Respond_JSON(ACAP_HTTP_Response response, cJSON* object) {
-    if (!response || !object) {
+static int put_json(ACAP_HTTP_Response response, const char* data, size_t length) {
+    return length == 0 || FCGX_PutStr(data, (int)length, response->out) == (int)length;
+}
+
+int ACAP_HTTP_Write_JSON_String(ACAP_HTTP_Response response, const char* string) {
+    if (!response || !response->out) {
         return 0;
     }
+    if (!string) {
+        string = "";
+    }
+
+    // Runs of plain characters are written in one call, escapes as cJSON prints them
+    int ok = put_json(response, "\"", 1);
+    const char* run = string;
+    const char* c;
+    for (c = string; *c; c++) {
+        unsigned char ch = (unsigned char)*c;
+        const char* escape = NULL;
+        char code[8];
+        switch (ch) {
+            case '"':  escape = "\\\""; break;
+            case '\\': escape = "\\\\"; break;
+            case '\b': escape = "\\b"; break;
+            case '\f': escape = "\\f"; break;
+            case '\n': escape = "\\n"; break;
+            case '\r': escape = "\\r"; break;
+            case '\t': escape = "\\t"; break;
+            default:
+                if (ch < 32) {
+                    snprintf(code, sizeof(code), "\\u%04x", ch);
+                    escape = code;
+                }
+                break;
+        }
+        if (!escape)
+            continue;
+        ok = ok && put_json(response, run, c - run) && put_json(response, escape, strlen(escape));
+        run = c + 1;
+    }
+    return ok && put_json(response, run, c - run) && put_json(response, "\"", 1);
+}
 
-    char* jsonString = cJSON_PrintUnformatted(object);
-    if (!jsonString) {
+static int write_json_number(ACAP_HTTP_Response response, const cJSON* item) {
+    char number[32];
+    double d = item->valuedouble;
+    int length;
+
+    // Same format as cJSON_Print
+    if (isnan(d) || isinf(d)) {
+        length = snprintf(number, sizeof(number), "null");
+    } else if (d == (double)item->valueint) {
+        length = snprintf(number, sizeof(number), "%d", item->valueint);
+    } else {
+        double test = 0;
+        length = snprintf(number, sizeof(number), "%1.15g", d);
+        if (sscanf(number, "%lg", &test) != 1 || test != d)
+            length = snprintf(number, sizeof(number), "%1.17g", d);
+    }
+    return length > 0 && put_json(response, number, (size_t)length);
+}
+
+int ACAP_HTTP_Write_JSON(ACAP_HTTP_Response response, const cJSON* item) {
+    if (!response || !response->out || !item) {
         return 0;
     }
-    
+
+    switch (item->type & 0xFF) {
+        case cJSON_NULL:   return put_json(response, "null", 4);
+        case cJSON_False:  return put_json(response, "false", 5);
+        case cJSON_True:   return put_json(response, "true", 4);
+        case cJSON_Number: return write_json_number(response, item);
+        case cJSON_String: return ACAP_HTTP_Write_JSON_String(response, item->valuestring);
+        case cJSON_Raw:    return item->valuestring && put_json(response, item->valuestring, strlen(item->valuestring));
+        case cJSON_Array:
+        case cJSON_Object: {
+            int object = (item->type & 0xFF) == cJSON_Object;
+            int ok = put_json(response, object ? "{" : "[", 1);
+            for (const cJSON* child = item->child; child && ok; child = child->next) {
+                if (child != item->child)
+                    ok = put_json(response, ",", 1);
+                if (ok && object)
+                    ok = ACAP_HTTP_Write_JSON_String(response, child->string) && put_json(response, ":", 1);
+                if (ok)
+                    ok = ACAP_HTTP_Write_JSON(response, child);
+            }
+            return ok && put_json(response, object ? "}" : "]", 1);
+        }
+        default:
+            return 0;
+    }
+}
+
+int ACAP_HTTP_Respond_JSON(ACAP_HTTP_Response response, cJSON* object) {
+    if (!response || !object) {
+        return 0;
+    }
+
+    // Written straight to the FastCGI stream; no string of the whole tree is built
     ACAP_HTTP_Header_JSON(response);
-    
-    size_t json_len = strlen(jsonString);
-    int result = FCGX_PutStr(jsonString, json_len, response->out) == (int)json_len;
-    
-    free(jsonString);
-    return result;
+    return ACAP_HTTP_Write_JSON(response, object);
 }
 
 int ACAP_HTTP_Respond_Data(ACAP_HTTP_Response response, size_t count, const void* data) {
@@ -21,6 +21,7 @@ extern "C" {
 #define ACAP_MAX_PATH_LENGTH 128
 #define ACAP_MAX_PACKAGE_NAME 30
 #define ACAP_MAX_BUFFER_SIZE 4096
+#define ACAP_HTTP_WORKERS 4		// FastCGI worker threads; HTTP callbacks may run concurrently
 
 
 // Return types
@@ -61,6 +62,7 @@ cJSON*		ACAP(const char* package, ACAP_Config_Update updateCallback);
 const char* ACAP_Name(void);
 int 		ACAP_Set_Config(const char* service, cJSON* serviceSettings);
 cJSON* 		ACAP_Get_Config(const char* service);
+cJSON* 		ACAP_Copy_Config(const char* service);	// Deep copy taken under the settings lock; caller deletes it
 void		ACAP_Cleanup(void);
 
 /*-----------------------------------------------------
@@ -85,6 +87,9 @@ int 		ACAP_HTTP_Header_FILE(ACAP_HTTP_Response response, const char* filename,
 // HTTP Response functions
 int 		ACAP_HTTP_Respond_String(ACAP_HTTP_Response response, const char* fmt, ...);
 int 		ACAP_HTTP_Respond_JSON(ACAP_HTTP_Response response, cJSON* object);
+// Streaming JSON: write a value or an escaped string without headers
+int 		ACAP_HTTP_Write_JSON(ACAP_HTTP_Response response, const cJSON* item);
+int 		ACAP_HTTP_Write_JSON_String(ACAP_HTTP_Response response, const char* string);
 int 		ACAP_HTTP_Respond_Data(ACAP_HTTP_Response response, size_t count, const void* data);
 int 		ACAP_HTTP_Respond_Error(ACAP_HTTP_Response response, int code, const char* message);
 int 		ACAP_HTTP_Respond_Text(ACAP_HTTP_Response response, const char* message);
@@ -0,0 +1,86 @@
+/**
+ * @file arena.c
+ * @brief Implementation of the frame arena.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <syslog.h>
+#include <glib.h>
+#include "ACAP.h"
+#include "cJSON.h"
+#include "Arena.h"
+
+#define ARENA_ALIGN           16
+#define ARENA_STATUS_INTERVAL 1000      // ms
+
+static unsigned char* block = NULL;
+static size_t used = 0;
+static size_t peak = 0;
+static uint64_t frames = 0;
+static uint64_t total = 0;              // Bytes used, summed over frames
+static unsigned overflows = 0;
+static __thread unsigned scope = 0;     // Scope depth of this thread
+
+static int owned(const void* ptr) {
+    return block && (const unsigned char*)ptr >= block && (const unsigned char*)ptr < block + ARENA_SIZE;
+}
+
+void* Arena_Alloc(size_t size) {
+    size_t offset = (used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (!block || size > ARENA_SIZE - offset) {
+        if (block)
+            overflows++;
+        return malloc(size);
+    }
+    used = offset + size;
+    return block + offset;
+}
+
+void Arena_Free(void* ptr) {
+    if (ptr && !owned(ptr))
+        free(ptr);
+}
+
+static void* hook_malloc(size_t size) {
+    return scope ? Arena_Alloc(size) : malloc(size);
+}
+
+void Arena_Begin(void) {
+    scope++;
+}
+
+void Arena_End(void) {
+    if (scope)
+        scope--;
+}
+
+void Arena_Reset(void) {
+    if (used > peak)
+        peak = used;
+    total += used;
+    frames++;
+    used = 0;
+}
+
+static gboolean status(gpointer data) {
+    ACAP_STATUS_SetNumber("arena", "size", ARENA_SIZE);
+    ACAP_STATUS_SetNumber("arena", "peak", peak);
+    ACAP_STATUS_SetNumber("arena", "average", frames ? (double)(total / frames) : 0);
+    ACAP_STATUS_SetNumber("arena", "overflows", overflows);
+    return G_SOURCE_CONTINUE;
+}
+
+void Arena_Init(void) {
+    if (!block) {
+        block = malloc(ARENA_SIZE);
+        if (!block) {
+            syslog(LOG_WARNING, "Arena_Init: Out of memory, frame payloads use the heap");
+            return;
+        }
+        // Frees of heap pointers still go to free(), from any thread
+        cJSON_Hooks hooks = { hook_malloc, Arena_Free };
+        cJSON_InitHooks(&hooks);
+        g_timeout_add(ARENA_STATUS_INTERVAL, status, NULL);
+    }
+}
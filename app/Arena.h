@@ -0,0 +1,70 @@
+/**
+ * @file arena.h
+ * @brief Frame-scoped bump allocator for the per-frame cJSON payloads.
+ *
+ * The per-frame output builds and prints a few small cJSON trees (detections,
+ * event and track payloads, the MQTT print buffer) and frees them again a few
+ * microseconds later. Between Arena_Begin() and Arena_End() on the main loop,
+ * cJSON allocations are bumped out of one fixed block instead of the heap,
+ * and the whole block is released in one step by Arena_Reset() at the end of
+ * the frame (Model_Reset()). Freeing an arena pointer is a no-op, so
+ * cJSON_Delete() and cJSON_free() work as before.
+ *
+ * Only the thread inside a scope uses the arena; the HTTP workers, the MQTT
+ * thread and all code outside a scope stay on the normal heap. Nothing
+ * allocated in a scope may outlive the frame, so settings, status and event
+ * state must not be modified inside one. A request that does not fit falls
+ * back to malloc and is counted.
+ *
+ * Status group "arena": size, peak and average (bytes used per frame),
+ * overflows (allocations that went to the heap).
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARENA_SIZE (256 * 1024)
+
+/**
+ * @brief Allocate the block, install the cJSON hooks and start the status timer.
+ */
+void Arena_Init(void);
+
+/**
+ * @brief Route cJSON allocations on this thread to the arena. Scopes nest.
+ */
+void Arena_Begin(void);
+
+/**
+ * @brief End the innermost scope. Arena memory stays valid until Arena_Reset().
+ */
+void Arena_End(void);
+
+/**
+ * @brief Allocate from the arena, or from the heap if it is full or not initialized.
+ *
+ * Main loop only. Release with Arena_Free().
+ */
+void* Arena_Alloc(size_t size);
+
+/**
+ * @brief Free a pointer from Arena_Alloc() or the heap; arena pointers are ignored.
+ */
+void Arena_Free(void* ptr);
+
+/**
+ * @brief Release everything in the arena and record the frame's usage.
+ */
+void Arena_Reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ARENA_H
@@ -0,0 +1,135 @@
+/**
+ * @file detections.c
+ * @brief Implementation of the fixed-capacity detection list.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include "Detections.h"
+
+static const char* labelTable[DETECTIONS_MAX_CLASSES];
+static int labelCount = 0;
+
+void Detections_Clear(DetectionList* list)
+{
+    if (list)
+        list->count = 0;
+}
+
+int Detections_Add(DetectionList* list,
+                   float x, float y, float w, float h,
+                   float confidence, int label, int refId, double timestamp)
+{
+    if (!list || list->count >= DETECTIONS_MAX)
+        return -1;
+    unsigned i = list->count++;
+    list->x[i] = x;
+    list->y[i] = y;
+    list->w[i] = w;
+    list->h[i] = h;
+    list->c[i] = confidence;
+    list->label[i] = label;
+    list->refId[i] = refId;
+    list->track[i] = 0;
+    list->timestamp[i] = timestamp;
+    return (int)i;
+}
+
+int Detections_Copy(DetectionList* dst, const DetectionList* src, unsigned from)
+{
+    if (!src || from >= src->count)
+        return -1;
+    int i = Detections_Add(dst, src->x[from], src->y[from], src->w[from], src->h[from],
+                           src->c[from], src->label[from], src->refId[from], src->timestamp[from]);
+    if (i >= 0)
+        dst->track[i] = src->track[from];
+    return i;
+}
+
+void Detections_Compact(DetectionList* list, const unsigned char* keep)
+{
+    if (!list || !keep)
+        return;
+    unsigned n = 0;
+    for (unsigned i = 0; i < list->count; i++) {
+        if (!keep[i])
+            continue;
+        if (n != i) {
+            list->x[n] = list->x[i];
+            list->y[n] = list->y[i];
+            list->w[n] = list->w[i];
+            list->h[n] = list->h[i];
+            list->c[n] = list->c[i];
+            list->label[n] = list->label[i];
+            list->refId[n] = list->refId[i];
+            list->track[n] = list->track[i];
+            list->timestamp[n] = list->timestamp[i];
+        }
+        n++;
+    }
+    list->count = n;
+}
+
+void Detections_Set_Labels(cJSON* labels)
+{
+    labelCount = 0;
+    cJSON* label = labels ? labels->child : NULL;
+    while (label && labelCount < DETECTIONS_MAX_CLASSES) {
+        labelTable[labelCount++] = cJSON_IsString(label) ? label->valuestring : "Undefined";
+        label = label->next;
+    }
+    if (label)
+        syslog(LOG_WARNING, "Detections: %d labels, classes from %d on are not supported",
+               cJSON_GetArraySize(labels), DETECTIONS_MAX_CLASSES);
+}
+
+int Detections_Label_Count(void)
+{
+    return labelCount;
+}
+
+const char* Detections_Label(int classId)
+{
+    if (classId < 0 || classId >= labelCount)
+        return "Undefined";
+    return labelTable[classId];
+}
+
+int Detections_Label_Id(const char* label)
+{
+    if (!label)
+        return -1;
+    for (int i = 0; i < labelCount; i++)
+        if (strcmp(labelTable[i], label) == 0)
+            return i;
+    return -1;
+}
+
+cJSON* Detections_Item_JSON(const DetectionList* list, unsigned index)
+{
+    cJSON* item = cJSON_CreateObject();
+    if (!list || index >= list->count)
+        return item;
+    cJSON_AddStringToObject(item, "label", Detections_Label(list->label[index]));
+    cJSON_AddNumberToObject(item, "c", list->c[index]);
+    cJSON_AddNumberToObject(item, "x", list->x[index]);
+    cJSON_AddNumberToObject(item, "y", list->y[index]);
+    cJSON_AddNumberToObject(item, "w", list->w[index]);
+    cJSON_AddNumberToObject(item, "h", list->h[index]);
+    cJSON_AddNumberToObject(item, "timestamp", list->timestamp[index]);
+    cJSON_AddNumberToObject(item, "refId", list->refId[index]);
+    if (list->track[index])
+        cJSON_AddNumberToObject(item, "track", list->track[index]);
+    return item;
+}
+
+cJSON* Detections_JSON(const DetectionList* list)
+{
+    cJSON* arr = cJSON_CreateArray();
+    if (!list)
+        return arr;
+    for (unsigned i = 0; i < list->count; i++)
+        cJSON_AddItemToArray(arr, Detections_Item_JSON(list, i));
+    return arr;
+}
@@ -0,0 +1,203 @@
+/**
+ * @file detections.h
+ * @brief Fixed-capacity detection list passed from Model through filtering to Output.
+ *
+ * The list is a struct-of-arrays reused across frames, so the frame pipeline
+ * does not allocate per detection. Labels are carried as class indexes into
+ * the model labels. cJSON is only produced at the edges (status, MQTT, HTTP)
+ * with Detections_JSON() and Detections_Item_JSON().
+ */
+
+#ifndef DETECTIONS_H
+#define DETECTIONS_H
+
+#include <stdint.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of detections a list can hold. Can be overridden at build
+ * time (the NMS bench uses a larger list).
+ */
+#ifndef DETECTIONS_MAX
+#define DETECTIONS_MAX 1024
+#endif
+
+/**
+ * Maximum number of model classes (labels). Covers COCO (80) with room for
+ * larger label sets; labels beyond it are dropped by Detections_Set_Labels()
+ * with a warning.
+ */
+#define DETECTIONS_MAX_CLASSES 128
+
+/** Words of a class bitset. */
+#define DETECTIONS_CLASS_WORDS ((DETECTIONS_MAX_CLASSES + 63) / 64)
+
+/**
+ * @brief Bitset of class ids, for the ignore list, the event gate and the tracker presence.
+ */
+typedef struct {
+    uint64_t bits[DETECTIONS_CLASS_WORDS];
+} DetectionClasses;
+
+/**
+ * @brief Add a class id to a set. Ids out of range are ignored.
+ */
+static inline void Detections_Class_Set(DetectionClasses* set, int classId)
+{
+    if (classId >= 0 && classId < DETECTIONS_MAX_CLASSES)
+        set->bits[classId / 64] |= (uint64_t)1 << (classId % 64);
+}
+
+/**
+ * @brief Remove a class id from a set.
+ */
+static inline void Detections_Class_Clear(DetectionClasses* set, int classId)
+{
+    if (classId >= 0 && classId < DETECTIONS_MAX_CLASSES)
+        set->bits[classId / 64] &= ~((uint64_t)1 << (classId % 64));
+}
+
+/**
+ * @brief True if the class id is in the set.
+ */
+static inline int Detections_Class_Test(const DetectionClasses* set, int classId)
+{
+    return classId >= 0 && classId < DETECTIONS_MAX_CLASSES && (set->bits[classId / 64] >> (classId % 64)) & 1;
+}
+
+/**
+ * @brief Remove and return the lowest class id of a set.
+ *
+ * @return Class id, or -1 if the set is empty.
+ */
+static inline int Detections_Class_Pop(DetectionClasses* set)
+{
+    for (int w = 0; w < DETECTIONS_CLASS_WORDS; w++) {
+        if (set->bits[w]) {
+            int bit = __builtin_ctzll(set->bits[w]);
+            set->bits[w] &= set->bits[w] - 1;
+            return w * 64 + bit;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Add the class ids of src to dst.
+ */
+static inline void Detections_Class_Merge(DetectionClasses* dst, const DetectionClasses* src)
+{
+    for (int w = 0; w < DETECTIONS_CLASS_WORDS; w++)
+        dst->bits[w] |= src->bits[w];
+}
+
+/**
+ * @brief Number of class ids in a set.
+ */
+static inline int Detections_Class_Count(const DetectionClasses* set)
+{
+    int count = 0;
+    for (int w = 0; w < DETECTIONS_CLASS_WORDS; w++)
+        count += __builtin_popcountll(set->bits[w]);
+    return count;
+}
+
+/**
+ * @brief A list of detections.
+ *
+ * Units depend on the producer:
+ *   - Model_Inference: x/y/w/h normalized 0..1, confidence 0..1.
+ *   - After filtering in main.c: x/y/w/h 0..1000, confidence 0..100.
+ * x/y is the top left corner of the box.
+ */
+typedef struct {
+    unsigned count;
+    float x[DETECTIONS_MAX];
+    float y[DETECTIONS_MAX];
+    float w[DETECTIONS_MAX];
+    float h[DETECTIONS_MAX];
+    float c[DETECTIONS_MAX];            ///< Confidence
+    int label[DETECTIONS_MAX];          ///< Class index into model labels
+    int refId[DETECTIONS_MAX];          ///< Valid until the next Model_Reset()
+    unsigned track[DETECTIONS_MAX];     ///< Tracker id, stable across frames; 0 if not tracked
+    double timestamp[DETECTIONS_MAX];   ///< Epoch ms
+} DetectionList;
+
+/**
+ * @brief Remove all detections from a list.
+ */
+void Detections_Clear(DetectionList* list);
+
+/**
+ * @brief Append a detection. The track id starts at 0.
+ *
+ * @return Index of the new entry, or -1 if the list is full.
+ */
+int Detections_Add(DetectionList* list,
+                   float x, float y, float w, float h,
+                   float confidence, int label, int refId, double timestamp);
+
+/**
+ * @brief Copy entry 'from' of src to the end of dst.
+ *
+ * @return Index of the new entry, or -1 if dst is full.
+ */
+int Detections_Copy(DetectionList* dst, const DetectionList* src, unsigned from);
+
+/**
+ * @brief Remove entries, keeping order of the remaining ones.
+ *
+ * @param keep One flag per entry; entries with keep[i] == 0 are removed.
+ */
+void Detections_Compact(DetectionList* list, const unsigned char* keep);
+
+/**
+ * @brief Set the label table used to translate class indexes.
+ *
+ * Only the first DETECTIONS_MAX_CLASSES labels are used; a longer list is
+ * logged as a warning, since those classes would be reported as "Undefined".
+ *
+ * @param labels cJSON array of strings (model.json "labels"). The strings are
+ *               referenced, not copied, and must outlive the detection lists.
+ */
+void Detections_Set_Labels(cJSON* labels);
+
+/**
+ * @brief Number of labels in the label table.
+ */
+int Detections_Label_Count(void);
+
+/**
+ * @brief Label text for a class index, "Undefined" if out of range.
+ */
+const char* Detections_Label(int classId);
+
+/**
+ * @brief Class index for a label text, -1 if not found.
+ */
+int Detections_Label_Id(const char* label);
+
+/**
+ * @brief Build a cJSON object for one detection.
+ *
+ * Fields: label, c, x, y, w, h, timestamp, refId, and track when tracked.
+ * @return New cJSON object. Caller must cJSON_Delete().
+ */
+cJSON* Detections_Item_JSON(const DetectionList* list, unsigned index);
+
+/**
+ * @brief Build a cJSON array of all detections in the list.
+ *
+ * @return New cJSON array (empty if list is NULL). Caller must cJSON_Delete().
+ */
+cJSON* Detections_JSON(const DetectionList* list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DETECTIONS_H
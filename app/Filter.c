@@ -0,0 +1,49 @@
+/**
+ * @file filter.c
+ * @brief Implementation of the detection filters.
+ */
+
+#include "Filter.h"
+
+void Filter_Detections(const Settings* settings,
+                       unsigned view,
+                       const DetectionList* detections,
+                       double timestamp,
+                       DetectionList* out)
+{
+	Detections_Clear(out);
+	const ViewSettings* aoi = Settings_View( settings, view );
+	int x1 = aoi->aoiX1;
+	int y1 = aoi->aoiY1;
+	int x2 = aoi->aoiX2;
+	int y2 = aoi->aoiY2;
+	int minWidth = settings->minWidth;
+	int minHeight = settings->minHeight;
+	int confidenceThreshold = settings->confidence;
+
+	unsigned count = detections ? detections->count : 0;
+	for( unsigned i = 0; i < count; i++ ) {
+		// Model output is 0..1, the rest of the pipeline uses 0..1000 and confidence 0..100
+		int c = detections->c[i] * 100;
+		int x = detections->x[i] * 1000;
+		int y = detections->y[i] * 1000;
+		int width = detections->w[i] * 1000;
+		int height = detections->h[i] * 1000;
+		int cx = x + width / 2;
+		int cy = y + height / 2;
+
+		//FILTER DETECTIONS
+		int insert = 0;
+		if( c >= confidenceThreshold && cx >= x1 && cx <= x2 && cy >= y1 && cy <= y2 )
+			insert = 1;
+		if( width < minWidth || height < minHeight )
+			insert = 0;
+		if( insert && Settings_Ignored( settings, detections->label[i] ) )
+			insert = 0;
+		//Add custom filter here.  Set "insert = 0" if you want to exclude the detection
+
+		if( insert )
+			Detections_Add( out, x, y, width, height, c,
+			                detections->label[i], detections->refId[i], timestamp );
+	}
+}
@@ -0,0 +1,39 @@
+/**
+ * @file filter.h
+ * @brief User filters applied to the model detections before Output.
+ *
+ * Converts model units (0..1, confidence 0..1) to the units used by the rest
+ * of the pipeline (0..1000, confidence 0..100) and keeps detections that pass
+ * the confidence, AOI (detection center), minimum size and ignore filters.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "Detections.h"
+#include "Settings.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Filter model detections into out.
+ *
+ * @param settings   Compiled settings.
+ * @param view       View the frame came from; selects the AOI.
+ * @param detections Model detections (may be NULL).
+ * @param timestamp  Epoch ms stored in the kept detections.
+ * @param out        Cleared and filled with the detections that pass.
+ */
+void Filter_Detections(const Settings* settings,
+                       unsigned view,
+                       const DetectionList* detections,
+                       double timestamp,
+                       DetectionList* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FILTER_H
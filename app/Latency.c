@@ -0,0 +1,215 @@
+/**
+ * @file latency.c
+ * @brief Implementation of the latency budget controller.
+ */
+
+#include <stdio.h>
+#include <syslog.h>
+#include <glib.h>
+#include "ACAP.h"
+#include "MQTT.h"
+#include "Model.h"
+#include "Settings.h"
+#include "Latency.h"
+
+#define LOG(fmt, args...)    { syslog(LOG_INFO, fmt, ## args); printf(fmt, ## args);}
+
+#define LATENCY_WINDOW 20           // Frames averaged per decision
+#define LATENCY_RECOVER 0.7         // Fraction of the budget to stay under before stepping up
+#define LATENCY_MAX_BACKOFF 8       // Largest dwell factor
+#define LATENCY_BACKOFF_RESET 10    // Dwell times at one level that reset the dwell factor
+#define LATENCY_CAP_STEPS 3
+
+static const unsigned capSteps[LATENCY_CAP_STEPS] = { 0, 512, 128 };
+
+static unsigned levels = LATENCY_CAP_STEPS;
+static unsigned level = 0;
+static unsigned previous = 0;       // Level before the last change
+static int failed[MODEL_MAX_VARIANTS];   // Variants that did not load
+static int active = 0;
+static unsigned settle = 0;         // Frames to skip after a change
+static unsigned frames = 0;         // Frames in the window
+static double sum = 0;
+static double sumPreprocess = 0;
+static double sumInference = 0;
+static double sumDecode = 0;
+static double sumModel = 0;
+static double average = 0;          // ms, last window
+static double belowSince = 0;       // ms, start of the windows under LATENCY_RECOVER
+static double lastChange = 0;       // ms
+static int lastUp = 0;              // The last change was a step up
+static unsigned backoff = 1;
+static unsigned switches = 0;
+static char reason[128] = "start";
+
+static double now_ms(void) {
+    return g_get_monotonic_time() / 1000.0;
+}
+
+static unsigned level_variant(unsigned l) {
+    return l / LATENCY_CAP_STEPS;
+}
+
+// Next level in direction dir whose variant loads; l itself if there is none
+static unsigned step(unsigned l, int dir) {
+    for (int next = (int)l + dir; next >= 0 && next < (int)levels; next += dir)
+        if (!failed[level_variant(next)])
+            return (unsigned)next;
+    return l;
+}
+
+static void publish(void) {
+    const char* variant = Model_Variant_Name(level_variant(level));
+    unsigned cap = capSteps[level % LATENCY_CAP_STEPS];
+    ACAP_STATUS_SetString("latency", "variant", variant);
+    ACAP_STATUS_SetNumber("latency", "cap", cap);
+    ACAP_STATUS_SetNumber("latency", "level", level);
+    ACAP_STATUS_SetString("latency", "reason", reason);
+    ACAP_STATUS_SetNumber("latency", "switches", switches);
+
+    cJSON* payload = cJSON_CreateObject();
+    cJSON_AddStringToObject(payload, "variant", variant);
+    cJSON_AddNumberToObject(payload, "cap", cap);
+    cJSON_AddNumberToObject(payload, "level", level);
+    cJSON_AddNumberToObject(payload, "latency", (int)average);
+    cJSON_AddNumberToObject(payload, "budget", Settings_Get()->latency.budget);
+    cJSON_AddStringToObject(payload, "reason", reason);
+    char topic[96];
+    snprintf(topic, sizeof(topic), "latency/%s", ACAP_DEVICE_Prop("serial"));
+    MQTT_Publish_JSON(topic, payload, 0, 1);
+    cJSON_Delete(payload);
+}
+
+static void reset_window(void) {
+    frames = 0;
+    sum = sumPreprocess = sumInference = sumDecode = sumModel = 0;
+}
+
+static void change(unsigned target, int up) {
+    double now = now_ms();
+    if (!up && lastUp && now - lastChange < Settings_Get()->latency.dwell * 1000.0 && backoff < LATENCY_MAX_BACKOFF)
+        backoff *= 2;
+    lastUp = up;
+    lastChange = now;
+    belowSince = 0;
+    settle = LATENCY_WINDOW;
+    reset_window();
+
+    previous = level;
+    level = target;
+    Model_Set_Candidate_Cap(capSteps[level % LATENCY_CAP_STEPS]);
+    // A variant that cannot be loaded is found on the next frame
+    if (level_variant(level) != Model_Variant())
+        Model_Switch_Variant(level_variant(level));
+    switches++;
+    LOG("Latency: level %u (%s, cap %u): %s\n", level, Model_Variant_Name(level_variant(level)),
+        capSteps[level % LATENCY_CAP_STEPS], reason);
+    publish();
+}
+
+// The stage that took most of the window
+static const char* slowest_stage(double* ms) {
+    double other = (sum - sumModel) / frames;
+    const char* name = "output";
+    *ms = other;
+    if (sumPreprocess / frames > *ms) { name = "preprocess"; *ms = sumPreprocess / frames; }
+    if (sumInference / frames > *ms) { name = "inference"; *ms = sumInference / frames; }
+    if (sumDecode / frames > *ms) { name = "decode"; *ms = sumDecode / frames; }
+    return name;
+}
+
+void Latency_Init(void) {
+    levels = Model_Variants() * LATENCY_CAP_STEPS;
+    level = 0;
+    active = Settings_Get()->latency.active;
+    ACAP_STATUS_SetBool("latency", "active", active);
+    ACAP_STATUS_SetNumber("latency", "budget", Settings_Get()->latency.budget);
+    ACAP_STATUS_SetNumber("latency", "latency", 0);
+    ACAP_STATUS_SetString("latency", "variant", Model_Variant_Name(0));
+    ACAP_STATUS_SetNumber("latency", "cap", 0);
+    ACAP_STATUS_SetNumber("latency", "level", 0);
+    ACAP_STATUS_SetString("latency", "reason", reason);
+    ACAP_STATUS_SetNumber("latency", "switches", 0);
+}
+
+void Latency_Frame(double latency) {
+    const LatencySettings* config = &Settings_Get()->latency;
+    if (Model_Loading())
+        return;
+
+    // The variant of the level did not load and the model went back
+    if (Model_Variant() != level_variant(level)) {
+        failed[level_variant(level)] = 1;
+        snprintf(reason, sizeof(reason), "variant %s failed to load", Model_Variant_Name(level_variant(level)));
+        level = level_variant(previous) == Model_Variant() ? previous : Model_Variant() * LATENCY_CAP_STEPS;
+        Model_Set_Candidate_Cap(capSteps[level % LATENCY_CAP_STEPS]);
+        LOG("Latency: %s\n", reason);
+        publish();
+    }
+
+    if (config->active != active) {
+        active = config->active;
+        belowSince = 0;
+        reset_window();
+        ACAP_STATUS_SetBool("latency", "active", active);
+        ACAP_STATUS_SetNumber("latency", "budget", config->budget);
+    }
+    if (!active) {
+        unsigned first = failed[0] ? step(0, 1) : 0;
+        if (level != first) {
+            snprintf(reason, sizeof(reason), "controller off");
+            change(first, 1);
+        }
+        return;
+    }
+
+    if (settle) {
+        settle--;
+        return;
+    }
+    const ModelTiming* timing = Model_Last_Timing();
+    sum += latency;
+    sumPreprocess += timing->preprocess;
+    sumInference += timing->inference;
+    sumDecode += timing->decode;
+    sumModel += timing->latency;
+    if (++frames < LATENCY_WINDOW)
+        return;
+
+    average = sum / frames;
+    ACAP_STATUS_SetNumber("latency", "latency", (int)average);
+    ACAP_STATUS_SetNumber("latency", "budget", config->budget);
+    double now = now_ms();
+    if (backoff > 1 && now - lastChange > LATENCY_BACKOFF_RESET * config->dwell * 1000.0)
+        backoff = 1;
+
+    if (average > config->budget) {
+        belowSince = 0;
+        unsigned target = step(level, 1);
+        if (target != level) {
+            double ms = 0;
+            const char* stage = slowest_stage(&ms);
+            snprintf(reason, sizeof(reason), "%d ms over the %d ms budget, %s %d ms",
+                     (int)average, config->budget, stage, (int)ms);
+            change(target, 0);
+            return;
+        }
+    } else if (average < config->budget * LATENCY_RECOVER) {
+        if (belowSince == 0)
+            belowSince = now;
+        unsigned target = step(level, -1);
+        if (target != level && now - belowSince >= config->dwell * 1000.0 * backoff) {
+            snprintf(reason, sizeof(reason), "%d ms under %d%% of the %d ms budget for %d s",
+                     (int)average, (int)(LATENCY_RECOVER * 100), config->budget, (int)((now - belowSince) / 1000));
+            change(target, 1);
+            return;
+        }
+    } else {
+        belowSince = 0;
+    }
+    reset_window();
+}
+
+void Latency_MQTT_Connected(void) {
+    publish();
+}
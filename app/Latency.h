@@ -0,0 +1,57 @@
+/**
+ * @file latency.h
+ * @brief Latency budget controller for the model variant and the candidate cap.
+ *
+ * Averages the capture to output latency of the frames over a window and
+ * compares it with "latency.budget" (ms). Over the budget it steps down one
+ * level, well under it (70%) for "latency.dwell" seconds it steps back up.
+ * The levels are every model variant (Model_Variants(), most accurate first)
+ * with the candidate cap at full, 512 and 128:
+ *
+ *   level 0: variant 0, full cap   (no load)
+ *   level 1: variant 0, cap 512
+ *   level 2: variant 0, cap 128
+ *   level 3: variant 1, full cap
+ *   ...
+ *
+ * A cap change applies on the next frame; a variant change reloads the model
+ * in the background (seconds without inference). A step up that has to be
+ * taken back within the dwell time doubles the dwell before the next one
+ * (up to 8x), so a level that only just misses the budget is not retried
+ * every few seconds. A variant that fails to load is skipped from then on.
+ * Without "latency.active" the controller goes back to level 0.
+ *
+ * Status group "latency": active, budget, latency (window average, ms),
+ * variant, cap (0 for the full buffer), level, reason (of the last change),
+ * switches. Each change is also published retained on latency/<serial>.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Set the status for the variants read by Model_Setup().
+ */
+void Latency_Init(void);
+
+/**
+ * @brief Report the latency of a frame that reached the output. Main loop only.
+ *
+ * @param latency ms from the capture of the frame to the end of its output.
+ */
+void Latency_Frame(double latency);
+
+/**
+ * @brief Publish the active level again, for the retained topic after a connect.
+ */
+void Latency_MQTT_Connected(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LATENCY_H
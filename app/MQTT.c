@@ -70,6 +70,17 @@ static char LastWillTopic[64];
 static char LastWillMessage[512];
 static pthread_mutex_t config_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Derived from MQTTSettings by MQTT_Cache_Settings() whenever the settings change.
+// Written by the settings endpoint and read by the publishers (main loop, Paho and
+// HTTP threads), always under cache_mutex. Not config_mutex: it is held across the
+// client setup and while the connection callback runs, which may publish.
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char cachedPrefix[128] = "";     // "preTopic/" or empty
+static char cachedName[128] = "";
+static char cachedLocation[128] = "";
+static char cachedSerial[32] = "";
+static unsigned cachedGeneration = 1;   // Bumped when cachedPrefix changes
+
 // Private function prototypes
 static int MQTT_SetupClient();
 static void connectionLost(void* context, char* cause);
@@ -82,6 +93,8 @@ static void onReconnect(void* context, char* cause);
 //static gboolean reconnect_task(gpointer user_data);
 
 static int  MQTT_Load_Settings(void);
+static void MQTT_Cache_Settings(void);
+static int  MQTT_Full_Topic(char* fullTopic, size_t size, const char* topic);
 static int  MQTT_Load_Library(void);
 static int  MQTT_Connect(void);
 static int  MQTT_SetupClient(void);
@@ -330,19 +343,10 @@ MQTT_Publish(const char *topic, const char *payload, int qos, int retained) {
         return 0;
     }
 
-    char *preTopic = cJSON_GetObjectItem(MQTTSettings, "preTopic") ? 
-                     cJSON_GetObjectItem(MQTTSettings, "preTopic")->valuestring : NULL;
     char fullTopic[256];
-    
-    if (preTopic && strlen(preTopic) > 0) {
-        int result = snprintf(fullTopic, sizeof(fullTopic), "%s/%s", preTopic, topic);
-        if (result >= sizeof(fullTopic)) {
-            LOG_WARN("%s: Topic too long (truncated)\n", __func__);
-            // Continue anyway - topic will be truncated but still valid
-        }
-    } else {
-        strncpy(fullTopic, topic, sizeof(fullTopic) - 1);
-        fullTopic[sizeof(fullTopic) - 1] = '\0';
+    if (!MQTT_Full_Topic(fullTopic, sizeof(fullTopic), topic)) {
+        LOG_WARN("%s: Topic too long (truncated)\n", __func__);
+        // Continue anyway - topic will be truncated but still valid
     }
 
 //    LOG_TRACE("%s: %s %s\n",__func__,fullTopic,payload);
@@ -375,43 +379,100 @@ MQTT_Publish_JSON(const char *topic, cJSON *payload, int qos, int retained) {
         return 0;
     }
 
-    cJSON* publish = cJSON_Duplicate(payload, 1);
-    if (!publish) {
-        LOG_WARN("%s: Failed to duplicate JSON\n", __func__);
+    int length = 0;
+    char* json = MQTT_Serialize(payload, &length);
+    if (!json) {
+        LOG_WARN("%s: Failed to serialize JSON\n", __func__);
         return 0;
     }
-    
-    cJSON* additional = cJSON_GetObjectItem(MQTTSettings, "payload");
-    if(additional) {
-        // Fixed: Proper NULL checking
-        cJSON* name_item = cJSON_GetObjectItem(additional, "name");
-        cJSON* location_item = cJSON_GetObjectItem(additional, "location");
-        
-        if(name_item && name_item->valuestring && strlen(name_item->valuestring)) {
-            cJSON_AddStringToObject(publish, "name", name_item->valuestring);
-        }
-        if(location_item && location_item->valuestring && strlen(name_item->valuestring)) {
-            cJSON_AddStringToObject(publish, "location", location_item->valuestring);
+    int result = MQTT_Publish(topic, json, qos, retained);
+    cJSON_free(json);
+    return result;
+}
+
+char*
+MQTT_Serialize(cJSON *payload, int *length) {
+    if (length) *length = 0;
+    if (!payload)
+        return NULL;
+
+    // The static fields are attached as references for the duration of the
+    // print instead of deep-copying the payload. They are copied first, so the
+    // settings endpoint can rewrite the cache meanwhile.
+    const char* names[3] = { "name", "location", "serial" };
+    char values[3][sizeof(cachedName)];
+    pthread_mutex_lock(&cache_mutex);
+    snprintf(values[0], sizeof(values[0]), "%s", cachedName);
+    snprintf(values[1], sizeof(values[1]), "%s", cachedLocation);
+    snprintf(values[2], sizeof(values[2]), "%s", cachedSerial);
+    pthread_mutex_unlock(&cache_mutex);
+    int added[3] = { 0, 0, 0 };
+    if (cJSON_IsObject(payload)) {
+        for (int i = 0; i < 3; i++) {
+            if (values[i][0] && !cJSON_GetObjectItem(payload, names[i])) {
+                cJSON_AddItemToObject(payload, names[i], cJSON_CreateStringReference(values[i]));
+                added[i] = 1;
+            }
         }
     }
-    
-    const char* serial = ACAP_DEVICE_Prop("serial");
-    if (serial) {
-        cJSON_AddStringToObject(publish, "serial", serial);
+
+    char* json = cJSON_PrintUnformatted(payload);
+
+    for (int i = 0; i < 3; i++)
+        if (added[i])
+            cJSON_DeleteItemFromObject(payload, names[i]);
+
+    if (json && length)
+        *length = strlen(json);
+    return json;
+}
+
+void
+MQTT_Topic_Set(MQTT_Topic *topic, const char *name) {
+    if (!topic)
+        return;
+    snprintf(topic->topic, sizeof(topic->topic), "%s", name ? name : "");
+    topic->full[0] = 0;
+    topic->generation = 0;
+}
+
+int
+MQTT_Publish_Serialized(MQTT_Topic *topic, const char *payload, int length, int qos, int retained) {
+    if (!mqtt_client || !mqtt.isConnected(mqtt_client)) {
+        return 0;
     }
-    
-    char* json = cJSON_PrintUnformatted(publish);
-    int result = 0;
-    
-    if (json) {
-        result = MQTT_Publish(topic, json, qos, retained);
-        free(json);
-    } else {
-        LOG_WARN("%s: Failed to serialize JSON\n", __func__);
+
+    if (!topic || !topic->topic[0] || !payload || length <= 0) {
+        LOG_WARN("%s: Invalid parameters\n", __func__);
+        return 0;
     }
-    
-    cJSON_Delete(publish);
-    return result;
+
+    pthread_mutex_lock(&cache_mutex);
+    int truncated = 0;
+    if (topic->generation != cachedGeneration) {
+        truncated = snprintf(topic->full, sizeof(topic->full), "%s%s", cachedPrefix, topic->topic) >= (int)sizeof(topic->full);
+        topic->generation = cachedGeneration;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    if (truncated) {
+        LOG_WARN("%s: Topic too long (truncated)\n", __func__);
+    }
+
+    // Paho copies the payload into its own send queue before returning
+    MQTTAsync_message pubmsg = MQTTAsync_message_initializer;
+    pubmsg.payload = (void*)payload;
+    pubmsg.payloadlen = length;
+    pubmsg.qos = qos;
+    pubmsg.retained = retained;
+
+    MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
+    opts.context = mqtt_client;
+
+    int rc = mqtt.sendMessage(mqtt_client, topic->full, &pubmsg, &opts);
+    if( rc != MQTTASYNC_SUCCESS )
+        LOG_TRACE("%s: Published failed\n",__func__);
+
+    return (rc == MQTTASYNC_SUCCESS);
 }
 
 int
@@ -426,22 +487,12 @@ MQTT_Publish_Binary(const char *topic, int payloadlen, void *payload, int qos, i
         return 0;
     }
 
-    char *preTopic = cJSON_GetObjectItem(MQTTSettings, "preTopic") ? cJSON_GetObjectItem(MQTTSettings, "preTopic")->valuestring : NULL;
-    char *fullTopic = NULL;
-    
-    if (preTopic && strlen(preTopic) > 0) {
-        fullTopic = malloc(strlen(preTopic) + strlen(topic) + 2); // +2 for '/' and null terminator
-        if (!fullTopic) {
-            LOG_WARN("%s: Failed to allocate memory for full topic\n", __func__);
-            return 0;
-        }
-        sprintf(fullTopic, "%s/%s", preTopic, topic);
-    } else {
-        fullTopic = (char *)topic;
+    char fullTopic[256];
+    if (!MQTT_Full_Topic(fullTopic, sizeof(fullTopic), topic)) {
+        LOG_WARN("%s: Topic too long (truncated)\n", __func__);
     }
 
 
-
     MQTTAsync_message pubmsg = MQTTAsync_message_initializer;
     pubmsg.payload = (void*)payload;
     pubmsg.payloadlen = payloadlen;
@@ -710,9 +761,41 @@ MQTT_Load_Settings() {
         }
         cJSON_Delete(saved);
     }
+    MQTT_Cache_Settings();
     return 1;
 }
 
+static void
+MQTT_Cache_Settings(void) {
+    cJSON* preTopic = cJSON_GetObjectItem(MQTTSettings, "preTopic");
+    char prefix[sizeof(cachedPrefix)] = "";
+    if (preTopic && preTopic->valuestring && strlen(preTopic->valuestring))
+        snprintf(prefix, sizeof(prefix), "%s/", preTopic->valuestring);
+    pthread_mutex_lock(&cache_mutex);
+    if (strcmp(prefix, cachedPrefix) != 0) {
+        strcpy(cachedPrefix, prefix);
+        cachedGeneration++;
+    }
+
+    cJSON* additional = cJSON_GetObjectItem(MQTTSettings, "payload");
+    cJSON* name_item = additional ? cJSON_GetObjectItem(additional, "name") : NULL;
+    cJSON* location_item = additional ? cJSON_GetObjectItem(additional, "location") : NULL;
+    snprintf(cachedName, sizeof(cachedName), "%s", name_item && name_item->valuestring ? name_item->valuestring : "");
+    snprintf(cachedLocation, sizeof(cachedLocation), "%s", location_item && location_item->valuestring ? location_item->valuestring : "");
+    const char* serial = ACAP_DEVICE_Prop("serial");
+    snprintf(cachedSerial, sizeof(cachedSerial), "%s", serial ? serial : "");
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+// Prefix and topic into fullTopic; returns 0 if it was truncated
+static int
+MQTT_Full_Topic(char* fullTopic, size_t size, const char* topic) {
+    pthread_mutex_lock(&cache_mutex);
+    int length = snprintf(fullTopic, size, "%s%s", cachedPrefix, topic);
+    pthread_mutex_unlock(&cache_mutex);
+    return length < (int)size;
+}
+
 static void
 MQTT_HTTP_callback(const ACAP_HTTP_Response response, const ACAP_HTTP_Request request)
 {
@@ -772,6 +855,7 @@ MQTT_HTTP_callback(const ACAP_HTTP_Response response, const ACAP_HTTP_Request re
         }
         
         ACAP_FILE_Write("localdata/mqtt.json", MQTTSettings);
+        MQTT_Cache_Settings();
         ACAP_HTTP_Respond_Text(response, "Payload updated");
         cJSON_Delete(new_settings);
         pthread_mutex_unlock(&config_mutex);
@@ -793,6 +877,7 @@ MQTT_HTTP_callback(const ACAP_HTTP_Response response, const ACAP_HTTP_Request re
         }
         item = item->next;
     }
+    MQTT_Cache_Settings();
 
     if (!ACAP_FILE_Write("localdata/mqtt.json", MQTTSettings)) {
         ACAP_HTTP_Respond_Error(response, 500, "Failed to save settings");
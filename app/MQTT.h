@@ -31,6 +31,23 @@ cJSON* MQTT_Settings();
 int    MQTT_Publish( const char *topic, const char *payload, int qos, int retained );
 int    MQTT_Publish_JSON( const char *topic, cJSON *payload, int qos, int retained );
 int    MQTT_Publish_Binary( const char *topic, int payloadlen, void *payload, int qos, int retained );
+
+/*
+ * Serialized publish path for payloads sent every frame.
+ * MQTT_Serialize prints the payload once including name, location and serial
+ * (cJSON_free() the result; it may be in the frame arena, Arena.h). The same buffer can then be published on a cached
+ * topic and reused by other outputs. MQTT_Topic keeps the preTopic-prefixed
+ * topic and rebuilds it only when the MQTT settings change.
+ */
+typedef struct {
+    char topic[128];        // Topic without preTopic
+    char full[256];         // Cached "preTopic/topic"
+    unsigned generation;
+} MQTT_Topic;
+
+char*  MQTT_Serialize( cJSON *payload, int *length );
+void   MQTT_Topic_Set( MQTT_Topic *topic, const char *name );
+int    MQTT_Publish_Serialized( MQTT_Topic *topic, const char *payload, int length, int qos, int retained );
 int    MQTT_Subscribe( const char *topic );
 int    MQTT_Unsubscribe( const char *topic );
 
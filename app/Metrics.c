@@ -0,0 +1,122 @@
+/**
+ * @file metrics.c
+ * @brief Implementation of the stage histograms and the metrics node.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ACAP.h"
+#include "Metrics.h"
+
+#define METRICS_BUCKETS 96          // 4 per octave up to 2^24 us
+
+typedef struct {
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t sum;                   // us
+} MetricsHistogram;
+
+static const char* stageNames[METRICS_STAGES] = {
+    "capture", "copy", "pp", "presence", "infer", "decode", "nms", "filter",
+    "track", "events", "jpeg", "jpeg_crop", "mqtt", "http", "sd", "output", "frame",
+    "capture_to_inference", "capture_to_event"
+};
+
+static const char* counterNames[METRICS_COUNTERS] = {
+    "frames", "dropped_frames", "skipped_frames", "candidates", "survivors", "detections",
+    "jpeg_misses"
+};
+
+static MetricsHistogram stages[METRICS_STAGES];
+static uint64_t counters[METRICS_COUNTERS];
+
+static unsigned bucket_index(uint64_t us) {
+    if (us < 4)
+        return (unsigned)us;
+    unsigned octave = 63 - __builtin_clzll(us);
+    unsigned index = (octave - 1) * 4 + ((us >> (octave - 2)) & 3);
+    return index < METRICS_BUCKETS ? index : METRICS_BUCKETS - 1;
+}
+
+// Exclusive upper bound of a bucket in us
+static uint64_t bucket_upper(unsigned index) {
+    if (index < 4)
+        return index + 1;
+    unsigned octave = index / 4 + 1;
+    return (uint64_t)(5 + index % 4) << (octave - 2);
+}
+
+static void record(MetricsStage stage, uint64_t us) {
+    if ((unsigned)stage >= METRICS_STAGES)
+        return;
+    MetricsHistogram* h = &stages[stage];
+    __atomic_fetch_add(&h->buckets[bucket_index(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, us, __ATOMIC_RELAXED);
+}
+
+void Metrics_Stage(MetricsStage stage, uint64_t start) {
+    uint64_t now = Metrics_Now();
+    record(stage, now > start ? (now - start) / 1000 : 0);
+}
+
+void Metrics_Stage_Ms(MetricsStage stage, double ms) {
+    record(stage, ms > 0 ? (uint64_t)(ms * 1000.0) : 0);
+}
+
+void Metrics_Count(MetricsCounter counter, unsigned value) {
+    if ((unsigned)counter < METRICS_COUNTERS)
+        __atomic_fetch_add(&counters[counter], value, __ATOMIC_RELAXED);
+}
+
+// Quantile in seconds from a copy of the buckets
+static double quantile(const uint64_t* buckets, uint64_t total, double q) {
+    uint64_t rank = (uint64_t)(q * total + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < METRICS_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return bucket_upper(i) / 1000000.0;
+    }
+    return bucket_upper(METRICS_BUCKETS - 1) / 1000000.0;
+}
+
+static void metrics_http_callback(const ACAP_HTTP_Response response, const ACAP_HTTP_Request request) {
+    static const double quantiles[] = { 0.5, 0.95, 0.99 };
+
+    // Written line by line to the response; requests may run on several workers
+    ACAP_HTTP_Header_TEXT(response);
+    ACAP_HTTP_Respond_String(response,
+                             "# HELP detectx_stage_seconds Time per pipeline stage\n"
+                             "# TYPE detectx_stage_seconds summary\n");
+    for (unsigned s = 0; s < METRICS_STAGES; s++) {
+        uint64_t buckets[METRICS_BUCKETS];
+        uint64_t count = 0;
+        for (unsigned i = 0; i < METRICS_BUCKETS; i++) {
+            buckets[i] = __atomic_load_n(&stages[s].buckets[i], __ATOMIC_RELAXED);
+            count += buckets[i];
+        }
+        uint64_t sum = __atomic_load_n(&stages[s].sum, __ATOMIC_RELAXED);
+        for (unsigned q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]) && count; q++)
+            ACAP_HTTP_Respond_String(response, "detectx_stage_seconds{stage=\"%s\",quantile=\"%g\"} %g\n",
+                                     stageNames[s], quantiles[q], quantile(buckets, count, quantiles[q]));
+        ACAP_HTTP_Respond_String(response,
+                                 "detectx_stage_seconds_sum{stage=\"%s\"} %g\n"
+                                 "detectx_stage_seconds_count{stage=\"%s\"} %llu\n",
+                                 stageNames[s], sum / 1000000.0, stageNames[s], (unsigned long long)count);
+    }
+    for (unsigned c = 0; c < METRICS_COUNTERS; c++)
+        ACAP_HTTP_Respond_String(response, "# TYPE detectx_%s_total counter\ndetectx_%s_total %llu\n",
+                                 counterNames[c], counterNames[c],
+                                 (unsigned long long)__atomic_load_n(&counters[c], __ATOMIC_RELAXED));
+
+    const char* reset = ACAP_HTTP_Request_Param(request, "reset");
+    if (reset && strcmp(reset, "1") == 0) {
+        // A sample recorded during the reset may be kept in part; not worth a lock
+        memset(stages, 0, sizeof(stages));
+        memset(counters, 0, sizeof(counters));
+    }
+}
+
+void Metrics_Init(void) {
+    ACAP_HTTP_Node("metrics", metrics_http_callback);
+}
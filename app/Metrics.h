@@ -0,0 +1,95 @@
+/**
+ * @file metrics.h
+ * @brief Per-stage latency histograms and counters, served on the "metrics" node.
+ *
+ * Stages are timed with the monotonic clock and recorded into log-scale
+ * histograms (4 buckets per octave, 1 us to ~16 s). Recording is a few
+ * relaxed atomic adds, so any thread can record (main loop, larod callbacks,
+ * HTTP dispatcher). The HTTP node reads the same atomics and never takes the
+ * status mutex.
+ *
+ * HTTP API (node "metrics", Prometheus text format):
+ *   - metrics           p50/p95/p99, sum and count per stage, and counters,
+ *                       since start or the last reset
+ *   - metrics?reset=1   Same, then clear all histograms and counters
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    METRICS_CAPTURE = 0,    ///< Waiting for a frame from VDO
+    METRICS_COPY,           ///< Copying a frame that is not imported into the pp input
+    METRICS_PP,             ///< Preprocessing job
+    METRICS_PRESENCE,       ///< Presence model (pp + inference)
+    METRICS_INFER,          ///< Main model inference job
+    METRICS_DECODE,         ///< Output tensor decode
+    METRICS_NMS,
+    METRICS_FILTER,         ///< AOI, size, confidence and label filters
+    METRICS_TRACK,          ///< Tracker update
+    METRICS_EVENTS,         ///< Event gating
+    METRICS_JPEG,           ///< Crop encode
+    METRICS_JPEG_CROP,      ///< Lossless crop of the camera JPEG ("cropping.source": "jpeg")
+    METRICS_MQTT,           ///< MQTT publish call
+    METRICS_HTTP,           ///< HTTP POST (dispatcher thread)
+    METRICS_SD,             ///< SD card write
+    METRICS_OUTPUT,         ///< All of Output()
+    METRICS_FRAME,          ///< All of one ImageProcess call
+    METRICS_CAPTURE_INFER,  ///< Frame age when inference starts (VDO delivery to submit)
+    METRICS_CAPTURE_EVENT,  ///< Frame age when Output() has handled its detections
+    METRICS_STAGES
+} MetricsStage;
+
+typedef enum {
+    METRICS_FRAMES = 0,     ///< Frames inferred
+    METRICS_DROPPED,        ///< Frames lost to capture or inference errors
+    METRICS_SKIPPED,        ///< Frames superseded by a newer one before they were fetched
+    METRICS_CANDIDATES,     ///< Boxes passing the decoder thresholds
+    METRICS_SURVIVORS,      ///< Boxes left after NMS
+    METRICS_DETECTIONS,     ///< Detections left after filtering
+    METRICS_JPEG_MISSES,    ///< "jpeg" source crops encoded from the frame; no camera JPEG matched
+    METRICS_COUNTERS
+} MetricsCounter;
+
+/**
+ * @brief Monotonic time in ns, the start value for Metrics_Stage().
+ */
+static inline uint64_t Metrics_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Record the time from start (Metrics_Now()) until now in a stage.
+ */
+void Metrics_Stage(MetricsStage stage, uint64_t start);
+
+/**
+ * @brief Record a duration measured elsewhere, in ms.
+ */
+void Metrics_Stage_Ms(MetricsStage stage, double ms);
+
+/**
+ * @brief Add to a counter.
+ */
+void Metrics_Count(MetricsCounter counter, unsigned value);
+
+/**
+ * @brief Register the "metrics" HTTP node.
+ */
+void Metrics_Init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
@@ -8,24 +8,34 @@
 #include <sys/mman.h>
 #include <sys/time.h>
 #include <errno.h>
-#include <jpeglib.h>
+#include <time.h>
+#include <pthread.h>
+#include <glib.h>
 
 #include "larod.h"
 #include "ACAP.h"
 #include "Model.h"
-#include "imgutils.h"
+#include "Model_decode.h"
+#include "Model_nms.h"
+#include "Model_jpeg.h"
+#include "Model_presence.h"
+#include "Model_dump.h"
+#include "Metrics.h"
+#include "Settings.h"
+#include "Video.h"
+#include "Arena.h"
 
 #define LOG(fmt, args...)    { syslog(LOG_INFO, fmt, ## args); printf(fmt, ## args);}
 #define LOG_WARN(fmt, args...)    { syslog(LOG_WARNING, fmt, ## args); printf(fmt, ## args);}
 //#define LOG_TRACE(fmt, args...)   { syslog(LOG_INFO, fmt, ## args); printf(fmt, ## args); }
 #define LOG_TRACE(fmt, args...)   {}
 #define MODEL_MAX_CACHED_CROPS 5
+#define MODEL_MAX_CANDIDATES 1024
 
 static bool createAndMapTmpFile(char* fileName, size_t fileSize, void** mappedAddr, int* convFd);
-float iou(float x1, float y1, float w1, float h1, float x2, float y2, float w2, float h2);
 void Model_Cleanup();
-cJSON* non_maximum_suppression(cJSON* list);
 static void clear_crop_cache(void);
+static int model_configure(unsigned index);
 
 // Model and video dimensions
 static unsigned int modelWidth = 640;
@@ -43,50 +53,135 @@ static float quant = 1.0;
 static float quant_zero = 0;
 static float objectnessThreshold = 0.25;
 static float confidenceThreshold = 0.30;
-static float nms = 0.05;
+static NmsConfig nmsConfig = { 0.05, 0, MODEL_NMS_DEFAULT_MAX };
 static int larodModelFd = -1;
 static larodConnection* conn = NULL;
+
+// Model load thread (Model_Setup)
+static pthread_t loadThread;
+static int loadRunning = 0;             // Started and not yet joined
+static int loadResult = 0;
+static uint64_t loadStart = 0;
+static Model_Ready_Callback readyCallback = NULL;
 static larodModel* InfModel = NULL;
 static larodModel* ppModel = NULL;
-static larodJobRequest* ppReq = NULL;
 static larodMap* ppMap;
-static larodJobRequest* infReq;
-static void* ppInputAddr = MAP_FAILED;
-static void* larodInputAddr = MAP_FAILED;
-static void* larodOutput1Addr = MAP_FAILED;
-static int ppInputFd = -1;
-static int larodInputFd = -1;
-static int larodOutput1Fd = -1;
-static larodTensor** inputTensors = NULL;
-static larodTensor** outputTensors = NULL;
-static larodTensor** ppInputTensors = NULL;
-static larodTensor** ppOutputTensors = 0;
 static size_t yuyvBufferSize = 0;
 //For cropping
-static unsigned char* original_rgb_buffer = NULL;
-larodMap* ppMapHD               = NULL;
-larodModel* ppModelHD           = NULL;
-larodTensor** ppInputTensorsHD  = NULL;
-size_t ppNumInputsHD            = 1;
-larodTensor** ppOutputTensorsHD = NULL;
-size_t ppNumOutputsHD           = 1;
-larodJobRequest* ppReqHD        = NULL;
-void* ppInputAddrHD             = MAP_FAILED;
-void* ppOutputAddrHD            = MAP_FAILED;
-int ppInputFdHD                 = -1;
-int ppOutputFdHD                = -1;
+static VdoBuffer* cropFrame = NULL;                 // Frame of the current detections (NV12)
+static int jpegStreamFailed = 0;                    // "cropping.source": "jpeg" stream could not start
+static uint64_t frameCaptureTime = 0;               // Capture time of the current detections
+static unsigned frameView = 0;                      // View of the current detections
 
 static cJSON* modelConfig = 0;
+static cJSON* variantConfig = 0;                    // modelConfig with the keys of the loaded variant
+static unsigned variant = 0;
+static unsigned variantCount = 1;
+static int variantFallback = -1;                    // Variant to load again if the one loading fails
+static unsigned candidateCap = MODEL_MAX_CANDIDATES;
+static ModelTiming lastTiming;
+static DecoderConfig decoder;
+static DecodeCandidate candidates[MODEL_MAX_CANDIDATES];
+static float candidateScores[MODEL_MAX_CANDIDATES];   // Scratch for model_decode_select()
+static DetectionList modelDetections;
 
 static char PP_SD_INPUT_FILE_PATTERN[] = "/tmp/larod.pp.test-XXXXXX";
 static char OBJECT_DETECTOR_INPUT_FILE_PATTERN[] = "/tmp/larod.in.test-XXXXXX";
 static char OBJECT_DETECTOR_OUT1_FILE_PATTERN[]  = "/tmp/larod.out1.test-XXXXXX";
-char PP_HD_INPUT_FILE_PATTERN[]  = "/tmp/larod.pp.hd.test-XXXXXX";
-char PP_HD_OUTPUT_FILE_PATTERN[] = "/tmp/larod.pp.hd.out.test-XXXXXX";
 
 int inferenceErrors = 5;
 static int currentRefId = 1;
 
+#define MODEL_PIPELINE_SLOTS 2
+
+// Region of the frame that preprocessing scales to the model input (pixels, even aligned)
+typedef struct {
+    int x, y, w, h;
+} ModelRegion;
+
+typedef enum {
+    SLOT_IDLE = 0,
+    SLOT_BUSY,      // Preprocessing or inference in flight
+    SLOT_DONE,      // Output tensor ready to decode
+    SLOT_FAILED,
+    SLOT_SKIPPED    // Presence stage found nothing; no main model run
+} ModelSlotState;
+
+// Tensors, buffers and job requests for one frame in flight.
+// The serial mode uses slots[0] only.
+typedef struct {
+    larodTensor** ppInputTensors;
+    larodTensor** ppOutputTensors;
+    larodTensor** inputTensors;
+    larodTensor** outputTensors;
+    larodJobRequest* ppReq;
+    larodJobRequest* infReq;
+    larodTensor** ppBound;      // Inputs currently set on ppReq
+    void* ppInputAddr;
+    void* larodInputAddr;
+    void* larodOutput1Addr;
+    int ppInputFd;
+    int larodInputFd;
+    int larodOutput1Fd;
+    VdoBuffer* frame;
+    ModelRegion region;         // Region of 'frame' the detections are relative to
+    ModelRegion ppRegion;       // Crop currently set on ppReq
+    ModelSlotState state;
+    double timestamp;       // Epoch ms when the frame was submitted
+    double submitTime;      // Monotonic ms
+    double infStart;
+    double ppTime;
+    double infTime;
+    double presenceTime;    // Presence stage pp + inference
+    uint64_t captureTime;   // Monotonic ns when VDO delivered the frame
+    unsigned view;          // View (YUV stream) of the frame
+    int escalated;          // Main model ran for this frame
+} ModelSlot;
+
+#define MODEL_SLOT_INIT { .ppInputAddr = MAP_FAILED, .larodInputAddr = MAP_FAILED, .larodOutput1Addr = MAP_FAILED, \
+                          .ppInputFd = -1, .larodInputFd = -1, .larodOutput1Fd = -1 }
+
+static ModelSlot slots[MODEL_PIPELINE_SLOTS] = { MODEL_SLOT_INIT, MODEL_SLOT_INIT };
+static unsigned pipelineSlots = 1;
+static unsigned pipelineNext = 0;
+static VdoBuffer* heldFrame = NULL;     // Frame of the detections returned by Model_Pipeline
+static pthread_mutex_t pipelineMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pipelineCond = PTHREAD_COND_INITIALIZER;
+
+typedef struct {
+    VdoBuffer* buffer;
+    larodTensor** tensors;
+} ImportedBuffer;
+
+static ImportedBuffer importedBuffers[VIDEO_MAX_VIEWS * NUM_VDO_BUFFERS];
+static unsigned numImported = 0;
+
+static larodMap* cropMap = NULL;
+static int cropUnsupported = 0;
+
+static struct {
+    unsigned frames;
+    double start;
+    double pp;
+    double inference;
+    double decode;
+    double latency;
+    double presence;
+    unsigned escalated;
+} modelStats;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static double epoch_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000;
+}
+
 typedef struct {
     int refId;
     int crop_x;
@@ -95,31 +190,255 @@ typedef struct {
     int crop_h;
 	int img_w;
 	int img_h;	
-    unsigned char* jpeg_buf;
+    unsigned char* jpeg_buf;    // Kept across frames, grown by model_jpeg_encode_nv12
+    unsigned long jpeg_capacity;
     unsigned jpeg_size;
 } CropCacheEntry;
 
 static CropCacheEntry cropCache[MODEL_MAX_CACHED_CROPS];
 static int numCropCache = 0;
 
+// Entries are invalidated per frame; their JPEG buffers are reused
 static void clear_crop_cache(void) {
-    for (int i = 0; i < numCropCache; i++) {
-        if (cropCache[i].jpeg_buf) {
-            free(cropCache[i].jpeg_buf);
-            cropCache[i].jpeg_buf = NULL;
-        }
-    }
     numCropCache = 0;
 }
 
+static unsigned char* copyJpeg = NULL;             // Output of Model_Encode_Crop()
+static unsigned long copyJpegCapacity = 0;
 
-cJSON*
-Model_Inference(VdoBuffer* image) {
+static void free_crop_cache(void) {
+    for (int i = 0; i < MODEL_MAX_CACHED_CROPS; i++)
+        model_jpeg_free(&cropCache[i].jpeg_buf, &cropCache[i].jpeg_capacity);
+    numCropCache = 0;
+    model_jpeg_free(&copyJpeg, &copyJpegCapacity);
+}
+
+
+// ---------- Zero-copy input ----------
+// Each VDO buffer gets its own pp input tensor bound to the buffer's dmabuf
+// fd. A frame from an imported buffer is preprocessed in place; otherwise the
+// frame is copied into the slot's temp-file tensor.
+
+static larodTensor**
+imported_tensors(VdoBuffer* image) {
+    for (unsigned i = 0; i < numImported; i++)
+        if (importedBuffers[i].buffer == image)
+            return importedBuffers[i].tensors;
+    return NULL;
+}
+
+static void
+cleanup_imported(void) {
     larodError* error = NULL;
-    if (!image) {
-        LOG_TRACE("%s: No image\n", __func__);
+    for (unsigned i = 0; i < numImported; i++)
+        larodDestroyTensors(conn, &importedBuffers[i].tensors, ppInputs, &error);
+    larodClearError(&error);
+    numImported = 0;
+}
+
+static bool
+import_buffer(VdoBuffer* buffer, larodTensor*** tensors) {
+    larodError* error = NULL;
+    int fd = vdo_buffer_get_fd(buffer);
+    gint64 offset = vdo_buffer_get_offset(buffer);
+    gsize capacity = vdo_buffer_get_capacity(buffer);
+    if (fd < 0 || offset < 0 || capacity < offset + yuyvBufferSize) {
+        LOG_WARN("%s: VDO buffer can not be imported (fd %d, offset %lld, capacity %zu)\n",
+                 __func__, fd, (long long)offset, (size_t)capacity);
+        return false;
+    }
+
+    larodTensor** t = larodCreateModelInputs(ppModel, &ppInputs, &error);
+    if (!t) {
+        LOG_WARN("%s: Failed creating input tensor: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+    if (!larodSetTensorFd(t[0], fd, &error) ||
+        !larodSetTensorFdOffset(t[0], offset, &error) ||
+        !larodSetTensorFdSize(t[0], capacity, &error) ||
+        !larodSetTensorFdProps(t[0], LAROD_FD_PROP_DMABUF | LAROD_FD_PROP_MAP, &error) ||
+        !larodTrackTensor(conn, t[0], &error)) {
+        LOG_WARN("%s: Failed binding VDO buffer to tensor: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        larodDestroyTensors(conn, &t, ppInputs, &error);
+        larodClearError(&error);
+        return false;
+    }
+    *tensors = t;
+    return true;
+}
+
+unsigned
+Model_Import_Buffers(VdoBuffer** buffers, unsigned count) {
+    if (!conn || !ppModel || !buffers)
         return 0;
+    cleanup_imported();
+    for (unsigned i = 0; i < count && numImported < VIDEO_MAX_VIEWS * NUM_VDO_BUFFERS; i++) {
+        if (!buffers[i])
+            continue;
+        if (!import_buffer(buffers[i], &importedBuffers[numImported].tensors)) {
+            // A partial table is fine; the remaining buffers use the copy path
+            continue;
+        }
+        importedBuffers[numImported].buffer = buffers[i];
+        numImported++;
+    }
+    LOG("%s: %u of %u VDO buffers imported for zero-copy preprocessing\n", __func__, numImported, count);
+    ACAP_STATUS_SetNumber("model", "importedBuffers", numImported);
+    return numImported;
+}
+
+// Point a pp job at the frame: its imported tensor, or the copy of the frame in 'fallback'.
+static bool
+bind_pp_input(larodJobRequest* req, VdoBuffer* image, larodTensor** fallback, void* fallbackAddr, larodTensor*** bound) {
+    larodError* error = NULL;
+    larodTensor** tensors = imported_tensors(image);
+    if (!tensors) {
+        uint64_t copyStart = Metrics_Now();
+        memcpy(fallbackAddr, vdo_buffer_get_data(image), yuyvBufferSize);
+        Metrics_Stage(METRICS_COPY, copyStart);
+        tensors = fallback;
+    }
+    if (*bound == tensors)
+        return true;
+    if (!larodSetJobRequestInputs(req, tensors, ppInputs, &error)) {
+        LOG_WARN("%s: Unable to set preprocessing input: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+    *bound = tensors;
+    return true;
+}
+
+// A rectangle (0..1000) expanded to the frame aspect, so objects are scaled
+// the same way as in the full-frame mode, only with more model pixels each.
+static ModelRegion
+aspect_region(double x1, double y1, double x2, double y2) {
+    ModelRegion full = { 0, 0, (int)videoWidth, (int)videoHeight };
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 > 1000) x2 = 1000;
+    if (y2 > 1000) y2 = 1000;
+    if (x2 <= x1 || y2 <= y1)
+        return full;
+    // In 0..1000 units both axes have the frame aspect, so equal sides keep it
+    double side = x2 - x1 > y2 - y1 ? x2 - x1 : y2 - y1;
+    double cx = (x1 + x2) / 2, cy = (y1 + y2) / 2;
+    x1 = cx - side / 2;
+    y1 = cy - side / 2;
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x1 + side > 1000) x1 = 1000 - side;
+    if (y1 + side > 1000) y1 = 1000 - side;
+
+    ModelRegion region;
+    region.x = (int)(x1 * videoWidth / 1000) & ~1;
+    region.y = (int)(y1 * videoHeight / 1000) & ~1;
+    region.w = (int)(side * videoWidth / 1000 + 1) & ~1;
+    region.h = (int)(side * videoHeight / 1000 + 1) & ~1;
+    if (region.x + region.w > (int)videoWidth) region.w = ((int)videoWidth - region.x) & ~1;
+    if (region.y + region.h > (int)videoHeight) region.h = ((int)videoHeight - region.y) & ~1;
+    if (region.w < 16 || region.h < 16)
+        return full;
+    return region;
+}
+
+// The view's AOI when "aoiInference" is set, else the full frame
+static ModelRegion
+inference_region(unsigned view) {
+    const Settings* settings = Settings_Get();
+    if (!settings->aoiInference || cropUnsupported)
+        return (ModelRegion){ 0, 0, (int)videoWidth, (int)videoHeight };
+    const ViewSettings* v = Settings_View(settings, view);
+    return aspect_region(v->aoiX1, v->aoiY1, v->aoiX2, v->aoiY2);
+}
+
+// The presence box, clipped to the view's AOI when "aoiInference" is set. A box
+// outside the AOI keeps the view's region, as detections there are filtered anyway.
+static ModelRegion
+presence_region(unsigned view, const PresenceResult* result) {
+    double x1 = result->x1 * 1000, y1 = result->y1 * 1000;
+    double x2 = result->x2 * 1000, y2 = result->y2 * 1000;
+    const Settings* settings = Settings_Get();
+    if (settings->aoiInference) {
+        const ViewSettings* v = Settings_View(settings, view);
+        if (x1 < v->aoiX1) x1 = v->aoiX1;
+        if (y1 < v->aoiY1) y1 = v->aoiY1;
+        if (x2 > v->aoiX2) x2 = v->aoiX2;
+        if (y2 > v->aoiY2) y2 = v->aoiY2;
+        if (x2 <= x1 || y2 <= y1)
+            return inference_region(view);
+    }
+    return aspect_region(x1, y1, x2, y2);
+}
+
+// Set the crop on the pp job of a slot. On failure the slot keeps its current crop.
+static void
+bind_pp_region(ModelSlot* slot, ModelRegion region) {
+    larodError* error = NULL;
+    if (cropUnsupported || memcmp(&slot->ppRegion, &region, sizeof(region)) == 0)
+        return;
+    if (!cropMap)
+        cropMap = larodCreateMap(&error);
+    if (!cropMap ||
+        !larodMapSetIntArr4(cropMap, "image.input.crop", region.x, region.y, region.w, region.h, &error) ||
+        !larodSetJobRequestParams(slot->ppReq, cropMap, &error)) {
+        LOG_WARN("%s: AOI inference crop not supported: %s\n", __func__, error ? error->msg : "no map");
+        larodClearError(&error);
+        cropUnsupported = 1;
+        return;
+    }
+    slot->ppRegion = region;
+    LOG_TRACE("%s: Inference region %d,%d %dx%d\n", __func__, region.x, region.y, region.w, region.h);
+}
+
+// Detections are relative to the region; map them back to the full frame (0..1)
+static void
+remap_region(DetectionList* list, const ModelRegion* region) {
+    if (region->x == 0 && region->y == 0 && region->w == (int)videoWidth && region->h == (int)videoHeight)
+        return;
+    float sx = (float)region->w / videoWidth;
+    float sy = (float)region->h / videoHeight;
+    float ox = (float)region->x / videoWidth;
+    float oy = (float)region->y / videoHeight;
+    for (unsigned i = 0; i < list->count; i++) {
+        list->x[i] = ox + list->x[i] * sx;
+        list->y[i] = oy + list->y[i] * sy;
+        list->w[i] *= sx;
+        list->h[i] *= sy;
     }
+}
+
+// Run the presence stage on the frame bound to the slot and set the region for
+// the main model. Returns 0 if the main model does not need to run.
+static int
+presence_gate(ModelSlot* slot) {
+    ModelRegion region = inference_region(slot->view);
+    slot->presenceTime = 0;
+    slot->escalated = 1;
+    if (model_presence_active()) {
+        PresenceResult result;
+        // If the presence stage fails, the main model takes the frame
+        if (model_presence_run(slot->ppBound, ppInputs, &result)) {
+            slot->presenceTime = result.ppTime + result.infTime;
+            if (!result.found) {
+                slot->escalated = 0;
+                slot->ppTime = slot->infTime = 0;
+                return 0;
+            }
+            if (model_presence_roi() && !cropUnsupported)
+                region = presence_region(slot->view, &result);
+        }
+    }
+    bind_pp_region(slot, region);
+    slot->region = slot->ppRegion;
+    return 1;
+}
+
+// Check that the model can take a frame. Returns 0 if it cannot.
+static int
+model_ready(void) {
     if (ACAP_STATUS_Bool("model", "state") == 0) {
         LOG_TRACE("%s: Model not running\n", __func__);
         return 0;
@@ -129,139 +448,439 @@ Model_Inference(VdoBuffer* image) {
         Model_Cleanup();
         return 0;
     }
+    return 1;
+}
 
-    // Get the captured NV12 frame
-    uint8_t* nv12Data = (uint8_t*)vdo_buffer_get_data(image);
-    
-    // Copy NV12 data to BOTH preprocessing input buffers
-    memcpy(ppInputAddr, nv12Data, yuyvBufferSize);      // For model inference (Aspect 1:1)
+// Crops of the next detections are made from this frame. With "cropping.source":
+// "jpeg" the camera JPEG stream of the first view runs next to it, and its new
+// frames are taken so the one of the same capture is at hand.
+static void
+set_crop_frame(VdoBuffer* frame) {
+    cropFrame = frame;
+    const Settings* settings = Settings_Get();
+    if (!settings->cropping.active || !settings->cropping.jpegSource) {
+        jpegStreamFailed = 0;
+        if (Video_Running_JPEG())
+            Video_Stop_JPEG();
+        return;
+    }
+    if (!Video_Running_JPEG() && !jpegStreamFailed) {
+        jpegStreamFailed = !Video_Start_JPEG(videoWidth, videoHeight, Settings_View(settings, 0)->channel);
+        if (jpegStreamFailed)
+            LOG_WARN("%s: Camera JPEG stream unavailable, crops are encoded from the frame\n", __func__);
+    }
+    Video_Poll_JPEG();
+}
 
+// Decode the output tensor of a slot into modelDetections
+static const DetectionList*
+decode_slot(ModelSlot* slot, double timestamp) {
+    uint8_t* output_tensor = (uint8_t*)slot->larodOutput1Addr;
+    model_dump_frame(output_tensor, timestamp);
+
+    uint64_t start = Metrics_Now();
+    unsigned count = model_decode(&decoder, output_tensor, candidates, MODEL_MAX_CANDIDATES);
+    if (count >= MODEL_MAX_CANDIDATES)
+        LOG_TRACE("%s: Candidate buffer full\n", __func__);
+    // Over the cap only the strongest candidates go on to NMS, wherever they are in the tensor
+    if (count > candidateCap)
+        count = model_decode_select(candidates, count, candidateCap, candidateScores);
+
+    Detections_Clear(&modelDetections);
+    for (unsigned i = 0; i < count; i++) {
+        const DecodeCandidate* candidate = &candidates[i];
+        Detections_Add(&modelDetections,
+                       candidate->x, candidate->y, candidate->w, candidate->h,
+                       candidate->confidence, candidate->classId,
+                       currentRefId++, timestamp);
+    }
+
+    Metrics_Stage(METRICS_DECODE, start);
+    Metrics_Count(METRICS_CANDIDATES, count);
+
+    start = Metrics_Now();
+    model_nms(&nmsConfig, &modelDetections);
+    Metrics_Stage(METRICS_NMS, start);
+    Metrics_Count(METRICS_SURVIVORS, modelDetections.count);
+    remap_region(&modelDetections, &slot->region);
+    return &modelDetections;
+}
 
-    // Cropping output config
-    cJSON* settings = ACAP_Get_Config("settings");
-    if (!settings) {
-		LOG_TRACE("ERROR %s>\n",__func__);
-		return 0;
-	}
-    cJSON* cropping = cJSON_GetObjectItem(settings, "cropping");
-    int cropping_active = cropping && cJSON_IsTrue(cJSON_GetObjectItem(cropping, "active"));
-	if( cropping_active ) {
-		memcpy(ppInputAddrHD, nv12Data, yuyvBufferSize);    // For HD preprocessing (original res)
-
-		// Run HD preprocessing job
-		if (!larodRunJob(conn, ppReqHD, &error)) {
-			LOG_WARN("%s: Unable to run HD pre-processing job: %s (%d)\n", __func__, error->msg, error->code);
-			larodClearError(&error);
-			inferenceErrors--;
-			return 0;
-		}
-		original_rgb_buffer = (unsigned char*)ppOutputAddrHD;
-	} else {
-		original_rgb_buffer = 0;
-	}
+// Stage timings for the status group "model", averaged over 10 frames
+static void
+update_stats(const ModelSlot* slot, double decodeTime) {
+    double now = now_ms();
+    modelStats.frames++;
+    modelStats.pp += slot->ppTime;
+    modelStats.inference += slot->infTime;
+    modelStats.decode += decodeTime;
+    modelStats.latency += now - slot->submitTime;
+    modelStats.presence += slot->presenceTime;
+    modelStats.escalated += slot->escalated;
+    lastTiming.preprocess = slot->ppTime;
+    lastTiming.inference = slot->infTime;
+    lastTiming.decode = decodeTime;
+    lastTiming.latency = now - slot->submitTime;
+    frameCaptureTime = slot->captureTime;
+    frameView = slot->view;
+    Metrics_Count(METRICS_FRAMES, 1);
+    if (slot->presenceTime > 0)
+        Metrics_Stage_Ms(METRICS_PRESENCE, slot->presenceTime);
+    if (slot->escalated) {
+        Metrics_Stage_Ms(METRICS_PP, slot->ppTime);
+        Metrics_Stage_Ms(METRICS_INFER, slot->infTime);
+    }
+    if (modelStats.start == 0)
+        modelStats.start = now;
+    if (modelStats.frames < 10)
+        return;
+    double elapsed = now - modelStats.start;
+    unsigned frames = modelStats.frames;
+    ACAP_STATUS_SetNumber("model", "fps", elapsed > 0 ? (int)(frames * 10000.0 / elapsed + 0.5) / 10.0 : 0);
+    ACAP_STATUS_SetNumber("model", "preprocessTime", (int)(modelStats.pp / frames));
+    ACAP_STATUS_SetNumber("model", "inferenceTime", (int)(modelStats.inference / frames));
+    ACAP_STATUS_SetNumber("model", "decodeTime", (int)(modelStats.decode / frames));
+    ACAP_STATUS_SetNumber("model", "latency", (int)(modelStats.latency / frames));
+    if (model_presence_active()) {
+        ACAP_STATUS_SetNumber("model", "presenceTime", (int)(modelStats.presence / frames));
+        ACAP_STATUS_SetNumber("model", "escalation", (int)(modelStats.escalated * 100.0 / frames + 0.5));
+    }
+    memset(&modelStats, 0, sizeof(modelStats));
+    modelStats.start = now;
+}
+
+const DetectionList*
+Model_Inference(VdoBuffer* image) {
+    larodError* error = NULL;
+    ModelSlot* slot = &slots[0];
+    if (!image) {
+        LOG_TRACE("%s: No image\n", __func__);
+        return 0;
+    }
+    if (!model_ready())
+        return 0;
+    slot->submitTime = now_ms();
+    slot->captureTime = Video_Capture_Time_YUV(image);
+    if (slot->captureTime)
+        Metrics_Stage(METRICS_CAPTURE_INFER, slot->captureTime);
+    slot->view = Video_View_YUV(image) > 0 ? (unsigned)Video_View_YUV(image) : 0;
+
+    // NV12 frame as preprocessing input (Aspect 1:1)
+    if (!bind_pp_input(slot->ppReq, image, slot->ppInputTensors, slot->ppInputAddr, &slot->ppBound)) {
+        inferenceErrors--;
+        Metrics_Count(METRICS_DROPPED, 1);
+        return 0;
+    }
+
+    // Crops are converted on demand from this frame
+    set_crop_frame(image);
+
+    if (!presence_gate(slot)) {
+        Detections_Clear(&modelDetections);
+        update_stats(slot, 0);
+        return &modelDetections;
+    }
 
     // Run standard preprocessing for model inference
-    if (!larodRunJob(conn, ppReq, &error)) {
+    if (!larodRunJob(conn, slot->ppReq, &error)) {
         LOG_WARN("%s: Unable to run job to preprocess model: %s (%d)\n", __func__, error->msg, error->code);
         larodClearError(&error);
         inferenceErrors--;
+        Metrics_Count(METRICS_DROPPED, 1);
         return 0;
     }
     
-    if (lseek(larodOutput1Fd, 0, SEEK_SET) == -1) {
+    slot->infStart = now_ms();
+    slot->ppTime = slot->infStart - slot->submitTime;
+
+    if (lseek(slot->larodOutput1Fd, 0, SEEK_SET) == -1) {
         LOG_WARN("%s: Unable to rewind output file position: %s\n", __func__, strerror(errno));
         inferenceErrors--;
+        Metrics_Count(METRICS_DROPPED, 1);
         return 0;
     }
     
     // Run inference
-    if (!larodRunJob(conn, infReq, &error)) {
+    if (!larodRunJob(conn, slot->infReq, &error)) {
         LOG_WARN("%s: Unable to run inference on model: %s (%d)\n", __func__, error->msg, error->code);
         larodClearError(&error);
         inferenceErrors--;
+        Metrics_Count(METRICS_DROPPED, 1);
         return 0;
     }
 
-    // Process inference results (unchanged)
-    uint8_t* output_tensor = (uint8_t*)larodOutput1Addr;
-    cJSON* list = cJSON_CreateArray();
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    long long timestamp = tv.tv_sec * 1000LL + tv.tv_usec / 1000;
-
-    for (int i = 0; i < boxes; i++) {
-        int box = i * (5 + classes);
-        float objectness = (float)(output_tensor[box + 4] - quant_zero) * quant;
-        if (objectness >= objectnessThreshold) {
-
-            float x = (output_tensor[box + 0] - quant_zero) * quant;
-            float y = (output_tensor[box + 1] - quant_zero) * quant;
-            float w = (output_tensor[box + 2] - quant_zero) * quant;
-            float h = (output_tensor[box + 3] - quant_zero) * quant;
-            int classId = -1;
-            float maxConfidence = 0;
-            for (int c = 0; c < classes; c++) {
-                float confidence = (float)(output_tensor[box + 5 + c] - quant_zero) * quant * objectness;
-                if (confidence > maxConfidence) {
-                    classId = c;
-                    maxConfidence = confidence;
-                }
-            }
-            if (maxConfidence > confidenceThreshold) {
-                cJSON* detection = cJSON_CreateObject();
-                const char* label = "Undefined";
-                cJSON* labels = cJSON_GetObjectItem(modelConfig, "labels");
-                if (labels && classId >= 0 && cJSON_GetArrayItem(labels, classId))
-                    label = cJSON_GetArrayItem(labels, classId)->valuestring;
-                cJSON_AddStringToObject(detection, "label", label);
-                cJSON_AddNumberToObject(detection, "c", maxConfidence);
-
-                double x_norm = x - (w / 2);
-                double y_norm = y - (h / 2);
-
-                cJSON_AddNumberToObject(detection, "x", x_norm);
-                cJSON_AddNumberToObject(detection, "y", y_norm);
-                cJSON_AddNumberToObject(detection, "w", w);
-                cJSON_AddNumberToObject(detection, "h", h);
-
-                cJSON_AddNumberToObject(detection, "timestamp", timestamp);
-                cJSON_AddNumberToObject(detection, "refId", currentRefId++);
-                cJSON_AddItemToArray(list, detection);
-            }
-        }
+    slot->infTime = now_ms() - slot->infStart;
+
+    // Decode inference results in the quantized domain
+    double decodeStart = now_ms();
+    const DetectionList* detections = decode_slot(slot, epoch_ms());
+    update_stats(slot, now_ms() - decodeStart);
+    return detections;
+}
+
+// ---------- Pipelined mode ----------
+// Frame N+1 is preprocessed while frame N is in inference; frame N-1 is
+// decoded and handed to Output on the main thread in the meantime.
+// The larod callbacks only touch the slot they were started for.
+
+static void
+slot_finished(ModelSlot* slot, ModelSlotState state) {
+    pthread_mutex_lock(&pipelineMutex);
+    slot->state = state;
+    pthread_cond_broadcast(&pipelineCond);
+    pthread_mutex_unlock(&pipelineMutex);
+}
+
+static void
+inference_done(void* userData, larodError* error) {
+    ModelSlot* slot = (ModelSlot*)userData;
+    slot->infTime = now_ms() - slot->infStart;
+    if (error) {
+        LOG_WARN("%s: Inference failed: %s (%d)\n", __func__, error->msg, error->code);
+        slot_finished(slot, SLOT_FAILED);
+        return;
+    }
+    slot_finished(slot, SLOT_DONE);
+}
+
+static void
+preprocessing_done(void* userData, larodError* error) {
+    ModelSlot* slot = (ModelSlot*)userData;
+    larodError* runError = NULL;
+    slot->infStart = now_ms();
+    slot->ppTime = slot->infStart - slot->submitTime;
+    if (error) {
+        LOG_WARN("%s: Preprocessing failed: %s (%d)\n", __func__, error->msg, error->code);
+        slot_finished(slot, SLOT_FAILED);
+        return;
+    }
+    if (!larodRunJobAsync(conn, slot->infReq, inference_done, slot, &runError)) {
+        LOG_WARN("%s: Unable to start inference: %s (%d)\n", __func__, runError->msg, runError->code);
+        larodClearError(&runError);
+        slot_finished(slot, SLOT_FAILED);
+    }
+}
+
+// Start preprocessing and inference for a frame. The slot owns the frame from here.
+static void
+pipeline_submit(ModelSlot* slot, VdoBuffer* image) {
+    larodError* error = NULL;
+    slot->frame = image;
+    slot->timestamp = epoch_ms();
+    slot->submitTime = now_ms();
+    slot->ppTime = 0;
+    slot->infTime = 0;
+    slot->captureTime = Video_Capture_Time_YUV(image);
+    if (slot->captureTime)
+        Metrics_Stage(METRICS_CAPTURE_INFER, slot->captureTime);
+    slot->view = Video_View_YUV(image) > 0 ? (unsigned)Video_View_YUV(image) : 0;
+
+    if (!bind_pp_input(slot->ppReq, image, slot->ppInputTensors, slot->ppInputAddr, &slot->ppBound)) {
+        slot->state = SLOT_FAILED;
+        return;
+    }
+    if (!presence_gate(slot)) {
+        slot->state = SLOT_SKIPPED;
+        return;
+    }
+    if (lseek(slot->larodOutput1Fd, 0, SEEK_SET) == -1) {
+        LOG_WARN("%s: Unable to rewind output file position: %s\n", __func__, strerror(errno));
+        slot->state = SLOT_FAILED;
+        return;
+    }
+
+    slot->state = SLOT_BUSY;
+    if (!larodRunJobAsync(conn, slot->ppReq, preprocessing_done, slot, &error)) {
+        LOG_WARN("%s: Unable to start preprocessing: %s (%d)\n", __func__, error->msg, error->code);
+        larodClearError(&error);
+        slot->state = SLOT_FAILED;
+    }
+}
+
+// Block until a slot has no jobs in flight
+static void
+pipeline_wait(ModelSlot* slot) {
+    pthread_mutex_lock(&pipelineMutex);
+    while (slot->state == SLOT_BUSY)
+        pthread_cond_wait(&pipelineCond, &pipelineMutex);
+    pthread_mutex_unlock(&pipelineMutex);
+}
+
+int
+Model_Pipelined(void) {
+    return pipelineSlots > 1;
+}
+
+const DetectionList*
+Model_Pipeline(VdoBuffer* image) {
+    if (!image) {
+        LOG_TRACE("%s: No image\n", __func__);
+        return 0;
+    }
+    if (!Model_Pipelined() || !model_ready()) {
+        Video_Release_YUV(image);
+        return 0;
+    }
+
+    ModelSlot* slot = &slots[pipelineNext];
+    ModelSlot* previous = &slots[pipelineNext ^ 1];
+    pipelineNext ^= 1;
+
+    // Start frame N+1 before finishing frame N
+    pipeline_submit(slot, image);
+
+    if (!previous->frame)
+        return 0;  // Pipeline is filling up
+    pipeline_wait(previous);
+
+    // The frame stays held until Model_Reset() so crops can be made from it
+    if (heldFrame)
+        Video_Release_YUV(heldFrame);
+    heldFrame = previous->frame;
+    previous->frame = NULL;
+    ModelSlotState state = previous->state;
+    previous->state = SLOT_IDLE;
+
+    if (state == SLOT_SKIPPED) {
+        set_crop_frame(heldFrame);
+        Detections_Clear(&modelDetections);
+        update_stats(previous, 0);
+        return &modelDetections;
     }
+    if (state != SLOT_DONE) {
+        inferenceErrors--;
+        Metrics_Count(METRICS_DROPPED, 1);
+        return 0;
+    }
+
+    set_crop_frame(heldFrame);
+
+    double decodeStart = now_ms();
+    const DetectionList* detections = decode_slot(previous, previous->timestamp);
+    update_stats(previous, now_ms() - decodeStart);
+    return detections;
+}
+
+void
+Model_Pipeline_Flush(void) {
+    // The result of a frame in flight would be returned after the pause as if it were current
+    for (unsigned i = 0; i < MODEL_PIPELINE_SLOTS; i++) {
+        ModelSlot* slot = &slots[i];
+        if (!slot->frame)
+            continue;
+        pipeline_wait(slot);
+        Video_Release_YUV(slot->frame);
+        slot->frame = NULL;
+        slot->state = SLOT_IDLE;
+    }
+}
+
+uint64_t
+Model_Capture_Time(void) {
+    return frameCaptureTime;
+}
+
+const ModelTiming*
+Model_Last_Timing(void) {
+    return &lastTiming;
+}
 
-    return non_maximum_suppression(list);
+void
+Model_Set_Candidate_Cap(unsigned cap) {
+    candidateCap = cap > 0 && cap < MODEL_MAX_CANDIDATES ? cap : MODEL_MAX_CANDIDATES;
+}
+
+unsigned
+Model_Candidate_Cap(void) {
+    return candidateCap;
+}
+
+unsigned
+Model_View(void) {
+    return frameView;
+}
+
+typedef struct {
+    int crop_x, crop_y, crop_w, crop_h;     // Crop in the frame, pixels
+    int det_x, det_y, det_w, det_h;         // Detection in the crop, pixels
+} CropGeometry;
+
+// Crop of a detection (0..1000) with the border settings, clipped to the frame
+static void
+crop_geometry(const DetectionList* list, unsigned index, const CroppingSettings* cropping, CropGeometry* g) {
+	int det_pixel_x = (int)round(list->x[index] * (double)videoWidth / 1000.0);
+	int det_pixel_y = (int)round(list->y[index] * (double)videoHeight / 1000.0);
+	int det_pixel_w = (int)round(list->w[index] * (double)videoWidth / 1000.0);
+	int det_pixel_h = (int)round(list->h[index] * (double)videoHeight / 1000.0);
+
+    // 4:2:0 chroma covers 2x2 pixels, so the crop starts on an even pixel
+    g->crop_x = (det_pixel_x - cropping->leftborder) & ~1;
+    g->crop_y = (det_pixel_y - cropping->topborder) & ~1;
+    g->crop_w = det_pixel_x + det_pixel_w + cropping->rightborder - g->crop_x;
+    g->crop_h = det_pixel_y + det_pixel_h + cropping->bottomborder - g->crop_y;
+
+    if (g->crop_x < 0) { g->crop_w += g->crop_x; g->crop_x = 0; }
+    if (g->crop_y < 0) { g->crop_h += g->crop_y; g->crop_y = 0; }
+    if (g->crop_x >= (int)videoWidth) g->crop_x = (videoWidth - 2) & ~1;
+    if (g->crop_y >= (int)videoHeight) g->crop_y = (videoHeight - 2) & ~1;
+    if (g->crop_x + g->crop_w > (int)videoWidth) g->crop_w = videoWidth - g->crop_x;
+    if (g->crop_y + g->crop_h > (int)videoHeight) g->crop_h = videoHeight - g->crop_y;
+    if (g->crop_w < 1) g->crop_w = 1;
+    if (g->crop_h < 1) g->crop_h = 1;
+
+    g->det_x = det_pixel_x - g->crop_x;
+    g->det_y = det_pixel_y - g->crop_y;
+    g->det_w = det_pixel_w;
+    g->det_h = det_pixel_h;
+    if (g->det_x < 0) { g->det_w += g->det_x; g->det_x = 0; }
+    if (g->det_y < 0) { g->det_h += g->det_y; g->det_y = 0; }
+    if (g->det_x + g->det_w > g->crop_w) g->det_w = g->crop_w - g->det_x;
+    if (g->det_y + g->det_h > g->crop_h) g->det_h = g->crop_h - g->det_y;
+    if (g->det_w < 1) g->det_w = 1;
+    if (g->det_h < 1) g->det_h = 1;
+}
+
+// Lossless crop of the camera JPEG of cropFrame ("cropping.source": "jpeg").
+// The crop in g is widened to the JPEG's MCU grid. 0 if the source is "yuv" or
+// no JPEG of the same capture is kept; the caller then encodes the frame.
+static int
+crop_camera_jpeg(CropGeometry* g, unsigned char** buffer, unsigned long* capacity, unsigned long* size) {
+    *size = 0;
+    if (!Video_Running_JPEG() || !Settings_Get()->cropping.jpegSource)
+        return 0;
+    size_t jpegSize = 0;
+    const uint8_t* jpeg = Video_View_YUV(cropFrame) == 0 ? Video_Match_JPEG(cropFrame, &jpegSize) : NULL;
+    int x = g->crop_x, y = g->crop_y, w = g->crop_w, h = g->crop_h;
+    uint64_t cropStart = Metrics_Now();
+    if (!jpeg || !model_jpeg_crop(jpeg, jpegSize, videoWidth, videoHeight, &x, &y, &w, &h, buffer, capacity, size)) {
+        Metrics_Count(METRICS_JPEG_MISSES, 1);
+        return 0;
+    }
+    Metrics_Stage(METRICS_JPEG_CROP, cropStart);
+    g->det_x += g->crop_x - x;
+    g->det_y += g->crop_y - y;
+    g->crop_x = x;
+    g->crop_y = y;
+    g->crop_w = w;
+    g->crop_h = h;
+    return 1;
 }
 
 //The detection coordinates has been transformed to [0...1000][0...1000]
 const unsigned char*
-Model_GetImageData(const cJSON* detection, unsigned* jpeg_size, int* out_x, int* out_y, int* out_w, int* out_h, int* img_w, int* img_h ) {
+Model_GetImageData(const DetectionList* list, unsigned index, unsigned* jpeg_size, int* out_x, int* out_y, int* out_w, int* out_h, int* img_w, int* img_h ) {
     if (jpeg_size) *jpeg_size = 0;
-    if (!detection) {
-        LOG_WARN("%s: detection is NULL\n", __func__);
+    if (!list || index >= list->count) {
+        LOG_WARN("%s: Invalid detection\n", __func__);
         return NULL;
     }
     LOG_TRACE("<%s\n", __func__);
 
-    char* json = cJSON_PrintUnformatted(detection);
-    if (json) {
-        LOG_TRACE("%s", json);
-        free(json);
-    }
-
-    cJSON* settings = ACAP_Get_Config("settings");
-    cJSON* cropping = settings ? cJSON_GetObjectItem(settings, "cropping") : NULL;
-    int cropping_active = cropping && cJSON_IsTrue(cJSON_GetObjectItem(cropping, "active"));
-    if (!cropping_active)
+    const CroppingSettings* cropping = &Settings_Get()->cropping;
+    if (!cropping->active)
         return NULL;
 
-    cJSON* refIdObj = cJSON_GetObjectItem(detection, "refId");
-    if (!refIdObj || !cJSON_IsNumber(refIdObj)) {
-        LOG_WARN("%s: detection missing valid 'refId'\n", __func__);
-        return NULL;
-    }
-    int refId = refIdObj->valueint;
+    int refId = list->refId[index];
 
     for (int i = 0; i < numCropCache; ++i) {
         if (cropCache[i].refId == refId) {
@@ -276,177 +895,165 @@ Model_GetImageData(const cJSON* detection, unsigned* jpeg_size, int* out_x, int*
         }
     }
 
-    int leftborder_px = cropping && cJSON_GetObjectItem(cropping, "leftborder") ? cJSON_GetObjectItem(cropping, "leftborder")->valueint : 0;
-    int rightborder_px = cropping && cJSON_GetObjectItem(cropping, "rightborder") ? cJSON_GetObjectItem(cropping, "rightborder")->valueint : 0;
-    int topborder_px = cropping && cJSON_GetObjectItem(cropping, "topborder") ? cJSON_GetObjectItem(cropping, "topborder")->valueint : 0;
-    int bottomborder_px = cropping && cJSON_GetObjectItem(cropping, "bottomborder") ? cJSON_GetObjectItem(cropping, "bottomborder")->valueint : 0;
-
-    cJSON* xObj = cJSON_GetObjectItem(detection, "x");
-    cJSON* yObj = cJSON_GetObjectItem(detection, "y");
-    cJSON* wObj = cJSON_GetObjectItem(detection, "w");
-    cJSON* hObj = cJSON_GetObjectItem(detection, "h");
-    if (!xObj || !cJSON_IsNumber(xObj) ||
-        !yObj || !cJSON_IsNumber(yObj) ||
-        !wObj || !cJSON_IsNumber(wObj) ||
-        !hObj || !cJSON_IsNumber(hObj)) {
-        LOG_WARN("%s: detection missing geometry\n", __func__);
-        return NULL;
-    }
+    CropGeometry g;
+    crop_geometry(list, index, cropping, &g);
 
-	int det_pixel_x = (int)round(xObj->valuedouble * (double)videoWidth / 1000.0);
-	int det_pixel_y = (int)round(yObj->valuedouble * (double)videoHeight / 1000.0);
-	int det_pixel_w = (int)round(wObj->valuedouble * (double)videoWidth / 1000.0);
-	int det_pixel_h = (int)round(hObj->valuedouble * (double)videoHeight / 1000.0);
-
-    int crop_x = det_pixel_x - leftborder_px;
-    int crop_y = det_pixel_y - topborder_px;
-    int crop_w = det_pixel_w + leftborder_px + rightborder_px;
-    int crop_h = det_pixel_h + topborder_px + bottomborder_px;
-
-    if (crop_x < 0) { crop_w += crop_x; crop_x = 0; }
-    if (crop_y < 0) { crop_h += crop_y; crop_y = 0; }
-    if (crop_x + crop_w > (int)videoWidth) crop_w = videoWidth - crop_x;
-    if (crop_y + crop_h > (int)videoHeight) crop_h = videoHeight - crop_y;
-    if (crop_w < 1) crop_w = 1;
-    if (crop_h < 1) crop_h = 1;
-
-    int det_x = det_pixel_x - crop_x;
-    int det_y = det_pixel_y - crop_y;
-    int det_w = det_pixel_w;
-    int det_h = det_pixel_h;
-    if (det_x < 0) { det_w += det_x; det_x = 0; }
-    if (det_y < 0) { det_h += det_y; det_y = 0; }
-    if (det_x + det_w > crop_w) det_w = crop_w - det_x;
-    if (det_y + det_h > crop_h) det_h = crop_h - det_y;
-    if (det_w < 1) det_w = 1;
-    if (det_h < 1) det_h = 1;
-
-    if (!original_rgb_buffer) {
-        LOG_WARN("%s: Original RGB image buffer is NULL\n", __func__);
+    const uint8_t* nv12 = cropFrame ? (const uint8_t*)vdo_buffer_get_data(cropFrame) : NULL;
+    if (!nv12) {
+        LOG_WARN("%s: No frame retained for cropping\n", __func__);
         return NULL;
     }
 
+    int quality = cropping->quality;
 
-    unsigned char* crop_buf = crop_interleaved(original_rgb_buffer, videoWidth, videoHeight, 3, crop_x, crop_y, crop_w, crop_h);
-    if (!crop_buf) {
-        LOG_WARN("%s: failed to crop interleaved RGB buffer\n", __func__);
-        return NULL;
-    }
-
-    unsigned char* jpeg_buf = NULL;
+    // When the cache is full the last entry is overwritten
+    int entry = numCropCache < MODEL_MAX_CACHED_CROPS ? numCropCache : MODEL_MAX_CACHED_CROPS - 1;
+    CropCacheEntry* cache = &cropCache[entry];
     unsigned long jpeglen = 0;
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
-    cinfo.image_width = crop_w;
-    cinfo.image_height = crop_h;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, 90, TRUE);
-
-    buffer_to_jpeg(crop_buf, &cinfo, &jpeglen, &jpeg_buf);
-
-    jpeg_destroy_compress(&cinfo);
-    free(crop_buf);
-
-    if (!jpeg_buf || jpeglen == 0) {
-        LOG_WARN("%s: JPEG encoding failed\n", __func__);
-        return NULL;
+    if (!crop_camera_jpeg(&g, &cache->jpeg_buf, &cache->jpeg_capacity, &jpeglen)) {
+        uint64_t encodeStart = Metrics_Now();
+        int encoded = model_jpeg_encode_nv12(nv12, videoWidth, videoHeight, videoWidth,
+                                             g.crop_x, g.crop_y, g.crop_w, g.crop_h, quality,
+                                             &cache->jpeg_buf, &cache->jpeg_capacity, &jpeglen);
+        Metrics_Stage(METRICS_JPEG, encodeStart);
+        if (!encoded || jpeglen == 0) {
+            LOG_WARN("%s: JPEG encoding failed\n", __func__);
+            if (entry < numCropCache)
+                numCropCache--;
+            return NULL;
+        }
     }
-
-
-    if (numCropCache < MODEL_MAX_CACHED_CROPS) {
-        cropCache[numCropCache].refId = refId;
-        cropCache[numCropCache].crop_x = det_x;
-        cropCache[numCropCache].crop_y = det_y;
-        cropCache[numCropCache].crop_w = det_w;
-        cropCache[numCropCache].crop_h = det_h;
-        cropCache[numCropCache].img_w = crop_w;
-        cropCache[numCropCache].img_h = crop_h;
-        cropCache[numCropCache].jpeg_buf = jpeg_buf;
-        cropCache[numCropCache].jpeg_size = jpeglen;
+    int crop_w = g.crop_w, crop_h = g.crop_h;
+    int det_x = g.det_x, det_y = g.det_y, det_w = g.det_w, det_h = g.det_h;
+
+    cache->refId = refId;
+    cache->crop_x = det_x;
+    cache->crop_y = det_y;
+    cache->crop_w = det_w;
+    cache->crop_h = det_h;
+    cache->img_w = crop_w;
+    cache->img_h = crop_h;
+    cache->jpeg_size = jpeglen;
+    if (entry == numCropCache)
         numCropCache++;
-    }
 
     if (jpeg_size) *jpeg_size = (unsigned)jpeglen;
     if (out_x) *out_x = det_x;
     if (out_y) *out_y = det_y;
     if (out_w) *out_w = det_w;
     if (out_h) *out_h = det_h;
-	*img_w = crop_w;
-	*img_h = crop_h;
+	if (img_w) *img_w = crop_w;
+	if (img_h) *img_h = crop_h;
 
     LOG_TRACE("%s>\n", __func__);
-    return jpeg_buf;
+    return cache->jpeg_buf;
 }
 
-void Model_Reset(void) {
-    clear_crop_cache();
-}
+int
+Model_Copy_Crop(const DetectionList* list, unsigned index, ModelCrop* crop) {
+    if (!list || index >= list->count || !crop)
+        return 0;
+    const uint8_t* nv12 = cropFrame ? (const uint8_t*)vdo_buffer_get_data(cropFrame) : NULL;
+    if (!nv12)
+        return 0;
 
-float iou(float x1, float y1, float w1, float h1, float x2, float y2, float w2, float h2) {
-    float xx1 = fmax(x1 - (w1 / 2), x2 - (w2 / 2));
-    float yy1 = fmax(y1 - (h1 / 2), y2 - (h2 / 2));
-    float xx2 = fmin(x1 + (w1 / 2), x2 + (w2 / 2));
-    float yy2 = fmin(y1 + (h1 / 2), y2 + (h2 / 2));
-
-    float inter  = fmax(0, xx2 - xx1) * fmax(0, yy2 - yy1);
-    float union_ = w1 * h1 + w2 * h2 - inter;
-
-    return inter / union_;
-}
-
-cJSON* non_maximum_suppression(cJSON* list) {
-    if(!list) {
-        LOG_WARN("%s: Invalid list\n",__func__);
-        return 0;
-    }
-    int items = cJSON_GetArraySize(list);
-    if (items < 2) {
-        return list;
-    }
-    int keep[items];
-    memset(keep, 1, items * sizeof(int));
-    for (int i = 0; i < items; i++) {
-        if (keep[i]) {
-            cJSON* detection = cJSON_GetArrayItem(list, i);
-            float x1 = cJSON_GetObjectItem(detection, "x")->valuedouble;
-            float y1 = cJSON_GetObjectItem(detection, "y")->valuedouble;
-            float w1 = cJSON_GetObjectItem(detection, "w")->valuedouble;
-            float h1 = cJSON_GetObjectItem(detection, "h")->valuedouble;
-            float c1 = cJSON_GetObjectItem(detection, "c")->valuedouble;
-            for (int j = i + 1; j < items; j++) {
-                if (keep[j]) {
-                    cJSON* alternative = cJSON_GetArrayItem(list, j);
-                    float x2 = cJSON_GetObjectItem(alternative, "x")->valuedouble;
-                    float y2 = cJSON_GetObjectItem(alternative, "y")->valuedouble;
-                    float w2 = cJSON_GetObjectItem(alternative, "w")->valuedouble;
-                    float h2 = cJSON_GetObjectItem(alternative, "h")->valuedouble;
-                    float c2 = cJSON_GetObjectItem(alternative, "c")->valuedouble;
-                    float iou_value = iou(x1, y1, w1, h1, x2, y2, w2, h2);
-                    if (iou_value > nms) {
-                        if (c1 > c2) {
-                            keep[j] = 0;
-                        } else {
-                            keep[i] = 0;
-                            break;
-                        }
-                    }
-                }
-            }
+    CropGeometry g;
+    crop_geometry(list, index, &Settings_Get()->cropping, &g);
+
+    // A camera JPEG crop is kept as it is and needs no encode later
+    if (crop_camera_jpeg(&g, &crop->jpeg, &crop->jpegCapacity, &crop->jpegSize)) {
+        crop->width = g.crop_w;
+        crop->height = g.crop_h;
+        crop->det_x = g.det_x;
+        crop->det_y = g.det_y;
+        crop->det_w = g.det_w;
+        crop->det_h = g.det_h;
+        return 1;
+    }
+
+    // Even stride and plane height so the copy is a valid NV12 image
+    int stride = (g.crop_w + 1) & ~1;
+    int rows = (g.crop_h + 1) & ~1;
+    size_t needed = (size_t)stride * rows * 3 / 2;
+    if (needed > crop->capacity) {
+        unsigned char* buffer = realloc(crop->nv12, needed);
+        if (!buffer) {
+            LOG_WARN("%s: Out of memory\n", __func__);
+            return 0;
         }
+        crop->nv12 = buffer;
+        crop->capacity = needed;
+    }
+
+    uint64_t copyStart = Metrics_Now();
+    int copyW = g.crop_x + stride <= (int)videoWidth ? stride : g.crop_w;
+    for (int row = 0; row < rows; row++) {
+        int src = g.crop_y + (row < g.crop_h ? row : g.crop_h - 1);
+        memcpy(crop->nv12 + (size_t)row * stride, nv12 + (size_t)src * videoWidth + g.crop_x, copyW);
+    }
+    const uint8_t* uv = nv12 + (size_t)videoWidth * videoHeight;
+    unsigned char* dst = crop->nv12 + (size_t)stride * rows;
+    int chromaRows = rows / 2;
+    int lastChroma = (int)videoHeight / 2 - 1;
+    for (int row = 0; row < chromaRows; row++) {
+        int src = g.crop_y / 2 + row;
+        if (src > lastChroma) src = lastChroma;
+        memcpy(dst + (size_t)row * stride, uv + (size_t)src * videoWidth + g.crop_x, copyW);
+    }
+    Metrics_Stage(METRICS_COPY, copyStart);
+
+    crop->stride = stride;
+    crop->rows = rows;
+    crop->width = g.crop_w;
+    crop->height = g.crop_h;
+    crop->det_x = g.det_x;
+    crop->det_y = g.det_y;
+    crop->det_w = g.det_w;
+    crop->det_h = g.det_h;
+    return 1;
+}
+
+const unsigned char*
+Model_Encode_Crop(const ModelCrop* crop, unsigned* jpeg_size) {
+    if (jpeg_size) *jpeg_size = 0;
+    if (crop && crop->jpegSize) {
+        if (jpeg_size) *jpeg_size = (unsigned)crop->jpegSize;
+        return crop->jpeg;
     }
-    cJSON* result = cJSON_CreateArray();
-    for (int i = 0; i < items; i++) {
-        if (keep[i]) {
-            cJSON* detection = cJSON_GetArrayItem(list, i);
-            cJSON_AddItemToArray(result, cJSON_Duplicate(detection, 1));
-        }
+    if (!crop || !crop->nv12 || crop->width < 1 || crop->height < 1)
+        return NULL;
+    unsigned long jpeglen = 0;
+    uint64_t encodeStart = Metrics_Now();
+    int encoded = model_jpeg_encode_nv12(crop->nv12, crop->stride, crop->rows, crop->stride,
+                                         0, 0, crop->width, crop->height, Settings_Get()->cropping.quality,
+                                         &copyJpeg, &copyJpegCapacity, &jpeglen);
+    Metrics_Stage(METRICS_JPEG, encodeStart);
+    if (!encoded || jpeglen == 0) {
+        LOG_WARN("%s: JPEG encoding failed\n", __func__);
+        return NULL;
+    }
+    if (jpeg_size) *jpeg_size = (unsigned)jpeglen;
+    return copyJpeg;
+}
+
+void
+Model_Free_Crop(ModelCrop* crop) {
+    if (!crop)
+        return;
+    free(crop->nv12);
+    model_jpeg_free(&crop->jpeg, &crop->jpegCapacity);
+    memset(crop, 0, sizeof(*crop));
+}
+
+void Model_Reset(void) {
+    clear_crop_cache();
+    // The frame's output payloads are released in one step
+    Arena_Reset();
+    cropFrame = NULL;
+    if (heldFrame) {
+        Video_Release_YUV(heldFrame);
+        heldFrame = NULL;
     }
-    cJSON_Delete(list);
-    return result;
 }
 
 static bool 
@@ -483,149 +1090,270 @@ createAndMapTmpFile(char* fileName, size_t fileSize, void** mappedAddr, int* con
 }
 
 
+// Create tensors, buffers and job requests for one pipeline slot
+static bool
+setup_slot(ModelSlot* slot) {
+    larodError* error = NULL;
+    char ppInputPattern[sizeof(PP_SD_INPUT_FILE_PATTERN)];
+    char inputPattern[sizeof(OBJECT_DETECTOR_INPUT_FILE_PATTERN)];
+    char outputPattern[sizeof(OBJECT_DETECTOR_OUT1_FILE_PATTERN)];
+    memcpy(ppInputPattern, PP_SD_INPUT_FILE_PATTERN, sizeof(ppInputPattern));
+    memcpy(inputPattern, OBJECT_DETECTOR_INPUT_FILE_PATTERN, sizeof(inputPattern));
+    memcpy(outputPattern, OBJECT_DETECTOR_OUT1_FILE_PATTERN, sizeof(outputPattern));
+
+    slot->ppInputTensors = larodCreateModelInputs(ppModel, &ppInputs, &error);
+    if (!slot->ppInputTensors) {
+        LOG_WARN("%s: Failed retrieving input tensors: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+    slot->ppOutputTensors = larodCreateModelOutputs(ppModel, &ppOutputs, &error);
+    if (!slot->ppOutputTensors) {
+        LOG_WARN("%s: Failed retrieving output tensors: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+    slot->inputTensors = larodCreateModelInputs(InfModel, &inputs, &error);
+    if (!slot->inputTensors) {
+        LOG_WARN("%s: Failed retrieving input tensors: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+    slot->outputTensors = larodCreateModelOutputs(InfModel, &outputs, &error);
+    if (!slot->outputTensors) {
+        LOG_WARN("%s: Failed retrieving output tensors: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+
+    // Determine tensor buffer sizes
+    const larodTensorPitches* ppInputPitches = larodGetTensorPitches(slot->ppInputTensors[0], &error);
+    if (!ppInputPitches) {
+        LOG_WARN("%s: Could not get pitches of tensor: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+
+    yuyvBufferSize = ppInputPitches->pitches[0];
+    LOG_TRACE("Buffer size: %zu\n", yuyvBufferSize);
+
+    const larodTensorPitches* ppOutputPitches = larodGetTensorPitches(slot->ppOutputTensors[0], &error);
+    if (!ppOutputPitches) {
+        LOG_WARN("%s: Could not get pitches of tensor: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+
+    size_t rgbBufferSize = ppOutputPitches->pitches[0];
+    size_t expectedSize = modelWidth * modelHeight * channels;
+    if (expectedSize != rgbBufferSize) {
+        LOG_WARN("%s: Expected video output size %zu, actual %zu\n", __func__, expectedSize, rgbBufferSize);
+        return false;
+    }
+
+    const larodTensorPitches* outputPitches = larodGetTensorPitches(slot->outputTensors[0], &error);
+    if (!outputPitches) {
+        LOG_WARN("%s: Could not get pitches of tensor: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+
+    // Allocate space for input tensors
+    if (!createAndMapTmpFile(ppInputPattern, yuyvBufferSize, &slot->ppInputAddr, &slot->ppInputFd)) {
+        LOG_WARN("%s: Could not allocate pre-processor tensor\n", __func__);
+        return false;
+    }
+    if (!createAndMapTmpFile(inputPattern, modelWidth * modelHeight * channels, &slot->larodInputAddr, &slot->larodInputFd)) {
+        LOG_WARN("%s: Could not allocate input tensor\n", __func__);
+        return false;
+    }
+    if (!createAndMapTmpFile(outputPattern, decoder.tensorSize, &slot->larodOutput1Addr, &slot->larodOutput1Fd)) {
+        LOG_WARN("%s: Could not allocate output tensor\n", __func__);
+        return false;
+    }
+
+    // Connect tensors to file descriptors. The pp output is the inference input.
+    if (!larodSetTensorFd(slot->ppInputTensors[0], slot->ppInputFd, &error)) {
+        LOG_WARN("%s: Failed setting input tensor fd: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+    if (!larodSetTensorFd(slot->ppOutputTensors[0], slot->larodInputFd, &error)) {
+        LOG_WARN("%s: Failed setting output tensor fd: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+    if (!larodSetTensorFd(slot->inputTensors[0], slot->larodInputFd, &error)) {
+        LOG_WARN("%s: Failed setting input tensor fd: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+    if (!larodSetTensorFd(slot->outputTensors[0], slot->larodOutput1Fd, &error)) {
+        LOG_WARN("%s: Failed setting output tensor fd: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+
+    // Create job requests
+    slot->ppReq = larodCreateJobRequest(ppModel,
+                                        slot->ppInputTensors,
+                                        ppInputs,
+                                        slot->ppOutputTensors,
+                                        ppOutputs,
+                                        NULL,
+                                        &error);
+    if (!slot->ppReq) {
+        LOG_WARN("%s: Failed creating preprocessing job request: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+    slot->ppBound = slot->ppInputTensors;
+    slot->ppRegion = (ModelRegion){ 0, 0, (int)videoWidth, (int)videoHeight };
+    slot->region = slot->ppRegion;
+    slot->infReq = larodCreateJobRequest(InfModel,
+                                         slot->inputTensors,
+                                         inputs,
+                                         slot->outputTensors,
+                                         outputs,
+                                         NULL,
+                                         &error);
+    if (!slot->infReq) {
+        LOG_WARN("%s: Failed creating inference request: %s\n", __func__, error->msg);
+        larodClearError(&error);
+        return false;
+    }
+    return true;
+}
+
+static void
+cleanup_slot(ModelSlot* slot) {
+    larodError* error = NULL;
+    larodDestroyJobRequest(&slot->ppReq);
+    larodDestroyJobRequest(&slot->infReq);
+    slot->ppBound = NULL;
+    if (slot->ppInputTensors) larodDestroyTensors(conn, &slot->ppInputTensors, ppInputs, &error);
+    if (slot->ppOutputTensors) larodDestroyTensors(conn, &slot->ppOutputTensors, ppOutputs, &error);
+    if (slot->inputTensors) larodDestroyTensors(conn, &slot->inputTensors, inputs, &error);
+    if (slot->outputTensors) larodDestroyTensors(conn, &slot->outputTensors, outputs, &error);
+    larodClearError(&error);
+    if (slot->ppInputAddr != MAP_FAILED) munmap(slot->ppInputAddr, yuyvBufferSize);
+    if (slot->ppInputFd >= 0) close(slot->ppInputFd);
+    if (slot->larodInputAddr != MAP_FAILED) munmap(slot->larodInputAddr, modelWidth * modelHeight * channels);
+    if (slot->larodInputFd >= 0) close(slot->larodInputFd);
+    if (slot->larodOutput1Addr != MAP_FAILED) munmap(slot->larodOutput1Addr, decoder.tensorSize);
+    if (slot->larodOutput1Fd >= 0) close(slot->larodOutput1Fd);
+    slot->ppInputAddr = slot->larodInputAddr = slot->larodOutput1Addr = MAP_FAILED;
+    slot->ppInputFd = slot->larodInputFd = slot->larodOutput1Fd = -1;
+    if (slot->frame) {
+        Video_Release_YUV(slot->frame);
+        slot->frame = NULL;
+    }
+    slot->state = SLOT_IDLE;
+}
+
 void
 Model_Cleanup() {
     // Only the model handle is released here. We count on larod service to
     // release the privately loaded model when the session is disconnected in
     // larodDisconnect().
-    larodError* error = NULL;
-	
-	clear_crop_cache();
-	
+	// A load in progress cannot be aborted; wait for larod to finish it
+	if (loadRunning) {
+		pthread_join(loadThread, NULL);
+		loadRunning = 0;
+	}
+	free_crop_cache();
+	cropFrame = NULL;
+	Video_Stop_JPEG();
+	jpegStreamFailed = 0;
+	model_jpeg_cleanup();
+
+	// Jobs in flight must complete before their tensors and the connection go away
+	for (unsigned i = 0; i < MODEL_PIPELINE_SLOTS; i++) {
+		pipeline_wait(&slots[i]);
+		cleanup_slot(&slots[i]);
+	}
+	if (heldFrame) {
+		Video_Release_YUV(heldFrame);
+		heldFrame = NULL;
+	}
+	pipelineNext = 0;
+	cleanup_imported();
+	model_presence_cleanup();
+	model_dump_cleanup();
+	model_decode_cleanup();
+
 	if( ppMap ) larodDestroyMap(&ppMap);
+	if( cropMap ) larodDestroyMap(&cropMap);
     if( ppModel ) larodDestroyModel(&ppModel);
     larodDestroyModel(&InfModel);
     if (conn) larodDisconnect(&conn, NULL);
     if (larodModelFd >= 0) close(larodModelFd);
-    if (larodInputAddr != MAP_FAILED) munmap(larodInputAddr, modelWidth * modelHeight * channels);
-    if (larodInputFd >= 0) close(larodInputFd);
-    if (ppInputAddr != MAP_FAILED) munmap(ppInputAddr, modelWidth * modelHeight * channels);
-    if (ppInputFd >= 0) close(ppInputFd);
-    if (larodOutput1Addr != MAP_FAILED) munmap(larodOutput1Addr, boxes * (classes + 5));
-    larodDestroyJobRequest(&ppReq);
-    larodDestroyJobRequest(&infReq);
-    larodDestroyTensors(conn, &inputTensors, inputs, &error);
-    larodDestroyTensors(conn, &outputTensors, outputs, &error);
-    larodClearError(&error);
+    larodModelFd = -1;
 	ACAP_STATUS_SetString("model","status","Model stopped");
 	ACAP_STATUS_SetBool("model","state", 0);	
 }
 
 
 
-cJSON* Model_Setup(void) {
+// larod connection, models, tensors and presence model from variantConfig.
+// Runs on loadThread; on failure model_loaded() cleans up on the main loop.
+static int
+model_load(void) {
     larodError* error = NULL;
-    ACAP_STATUS_SetString("model", "status", "Model initialization failed. Check log file");
-    ACAP_STATUS_SetBool("model", "state", 0);
-
-    modelConfig = ACAP_FILE_Read("model/model.json");
-    if (!modelConfig) {
-        LOG_WARN("%s: Unable to read model.json\n", __func__);
-        return 0;
-    }
-    modelWidth = cJSON_GetObjectItem(modelConfig, "modelWidth")->valueint;
-    modelHeight = cJSON_GetObjectItem(modelConfig, "modelHeight")->valueint;
-    videoWidth = cJSON_GetObjectItem(modelConfig, "videoWidth")->valueint;
-    videoHeight = cJSON_GetObjectItem(modelConfig, "videoHeight")->valueint;
-    boxes = cJSON_GetObjectItem(modelConfig, "boxes")->valueint;
-    classes = cJSON_GetObjectItem(modelConfig, "classes")->valueint;
-    quant = cJSON_GetObjectItem(modelConfig, "quant")->valuedouble;
-    quant_zero = cJSON_GetObjectItem(modelConfig, "zeroPoint")->valuedouble;
-    objectnessThreshold = cJSON_GetObjectItem(modelConfig, "objectness")->valuedouble;
-    nms = cJSON_GetObjectItem(modelConfig, "nms")->valuedouble;
-
-    LOG_TRACE("Boxes: %d Classes: %d Objectness: %f nms:%f", boxes, classes, objectnessThreshold, nms);
 
     // Preprocessing (inference, 1:1 model)
     ppMap = larodCreateMap(&error);
     if (!ppMap) {
         LOG_WARN("%s: Could not create preprocessing larodMap %s\n", __func__, error->msg);
-        Model_Cleanup();
         return 0;
     }
 	
     if (!larodMapSetStr(ppMap, "image.input.format", "nv12", &error)) {
         LOG_WARN("%s: Failed setting preprocessing parameters: %s\n", __func__, error->msg);
-        Model_Cleanup();
         return 0;
     }
     if (!larodMapSetIntArr2(ppMap, "image.input.size", videoWidth, videoHeight, &error)) {
         LOG_WARN("%s: Failed setting preprocessing parameters: %s\n", __func__, error->msg);
-        Model_Cleanup();
         return 0;
     }
     if (!larodMapSetStr(ppMap, "image.output.format", "rgb-interleaved", &error)) {
         LOG_WARN("%s: Failed setting preprocessing parameters: %s\n", __func__, error->msg);
-        Model_Cleanup();
         return 0;
     }
     if (!larodMapSetIntArr2(ppMap, "image.output.size", modelWidth, modelHeight, &error)) {
         LOG_WARN("%s: Failed setting preprocessing parameters: %s\n", __func__, error->msg);
-        Model_Cleanup();
-        return 0;
-    }
-    // --- HD Pre-processing for cropping from original resolution ----
-    ppMapHD = larodCreateMap(&error);
-    if (!ppMapHD) {
-        LOG_WARN("%s: Could not create preprocessing (HD) larodMap %s\n", __func__, error->msg);
-        Model_Cleanup();
-        return 0;
-    }
-    if (!larodMapSetStr(ppMapHD, "image.input.format", "nv12", &error)) {
-        LOG_WARN("%s: Failed setting HD preprocessing parameters: %s\n", __func__, error->msg);
-        Model_Cleanup();
-        return 0;
-    }
-    if (!larodMapSetIntArr2(ppMapHD, "image.input.size", videoWidth, videoHeight, &error)) {
-        LOG_WARN("%s: Failed setting HD preprocessing parameters: %s\n", __func__, error->msg);
-        Model_Cleanup();
-        return 0;
-    }
-    if (!larodMapSetStr(ppMapHD, "image.output.format", "rgb-interleaved", &error)) {
-        LOG_WARN("%s: Failed setting HD preprocessing parameters: %s\n", __func__, error->msg);
-        Model_Cleanup();
-        return 0;
-    }
-    if (!larodMapSetIntArr2(ppMapHD, "image.output.size", videoWidth, videoHeight, &error)) {
-        LOG_WARN("%s: Failed setting HD preprocessing parameters: %s\n", __func__, error->msg);
-        Model_Cleanup();
         return 0;
     }
 
     // Model (inference)
-    const char* modelPath = cJSON_GetObjectItem(modelConfig, "path") ? cJSON_GetObjectItem(modelConfig, "path")->valuestring : 0;
+    const char* modelPath = cJSON_GetObjectItem(variantConfig, "path") ? cJSON_GetObjectItem(variantConfig, "path")->valuestring : 0;
     if (!modelPath) {
         LOG_WARN("%s: Model path not found\n", __func__);
-        Model_Cleanup();
         return 0;
     }
     larodModelFd = open(modelPath, O_RDONLY);
     if (larodModelFd < 0) {
         LOG_WARN("%s: Could not open model %s\n", __func__, modelPath);
-        Model_Cleanup();
         return 0;
     }
     if (!larodConnect(&conn, &error)) {
         LOG_WARN("%s: Could not connect to larod: %s\n", __func__, error->msg);
-        Model_Cleanup();
         return 0;
     }
     const char* chipString = "cpu-tflite";
-    cJSON* chip = cJSON_GetObjectItem(modelConfig, "chip");
+    cJSON* chip = cJSON_GetObjectItem(variantConfig, "chip");
     if (chip && chip->type == cJSON_String)
         chipString = chip->valuestring;
     const larodDevice* device = larodGetDevice(conn, chipString, 0, &error);
     if (!device) {
         LOG_WARN("%s: Could not get device %s: %s\n", __func__, chipString, error->msg);
         larodClearError(&error);
-        Model_Cleanup();
         return 0;
     }
     InfModel = larodLoadModel(conn, larodModelFd, device, LAROD_ACCESS_PRIVATE, "object_detection", NULL, &error);
     if (!InfModel) {
         LOG_WARN("%s: Unable to load model: %s\n", __func__, error->msg);
         larodClearError(&error);
-        Model_Cleanup();
         return 0;
     }
 
@@ -635,228 +1363,232 @@ cJSON* Model_Setup(void) {
     if (!device_prePros) {
         LOG_WARN("%s: Could not get device %s: %s\n", __func__, larodLibyuvPP, error->msg);
         larodClearError(&error);
-        Model_Cleanup();
         return 0;
     }
     ppModel = larodLoadModel(conn, -1, device_prePros, LAROD_ACCESS_PRIVATE, "", ppMap, &error);
     if (!ppModel) {
         LOG_WARN("%s: Unable to load preprocessing model with chip %s: %s", __func__, larodLibyuvPP, error->msg);
         larodClearError(&error);
-        Model_Cleanup();
         return 0;
     }
 
-    // HD preprocessing model
-    ppModelHD = larodLoadModel(conn, -1, device_prePros, LAROD_ACCESS_PRIVATE, "", ppMapHD, &error);
-    if (!ppModelHD) {
-        LOG_WARN("%s: Unable to load HD preprocessing model: %s", __func__, error ? error->msg : "");
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
-    // Create input/output tensors
-    ppInputTensors = larodCreateModelInputs(ppModel, &ppInputs, &error);
-    if (!ppInputTensors) {
-        LOG_WARN("%s: Failed retrieving input tensors: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
-    ppOutputTensors = larodCreateModelOutputs(ppModel, &ppOutputs, &error);
-    if (!ppOutputTensors) {
-        LOG_WARN("%s: Failed retrieving output tensors: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
-    // HD preprocessing tensors
-    ppInputTensorsHD = larodCreateModelInputs(ppModelHD, &inputs, &error);
-    if (!ppInputTensorsHD) {
-        LOG_WARN("%s: Failed retrieving HD input tensors: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
+    // Tensors, buffers and job requests per frame in flight
+    for (unsigned i = 0; i < pipelineSlots; i++) {
+        if (!setup_slot(&slots[i])) {
+            LOG_WARN("%s: Could not set up inference buffers\n", __func__);
+            return 0;
+        }
     }
 
-    ppOutputTensorsHD = larodCreateModelOutputs(ppModelHD, &outputs, &error);
-    if (!ppOutputTensorsHD) {
-        LOG_WARN("%s: Failed retrieving HD output tensors: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
-    inputTensors = larodCreateModelInputs(InfModel, &inputs, &error);
-    if (!inputTensors) {
-        LOG_WARN("%s: Failed retrieving input tensors: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
-    outputTensors = larodCreateModelOutputs(InfModel, &outputs, &error);
-    if (!outputTensors) {
-        LOG_WARN("%s: Failed retrieving output tensors: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
+    // Optional presence model, gating the main model. It reads the same NV12 input.
+    if (!model_presence_setup(conn, device, cJSON_GetObjectItem(variantConfig, "presence"),
+                              videoWidth, videoHeight, slots[0].ppInputFd))
+        LOG_WARN("%s: Presence model not loaded; the main model runs on every frame\n", __func__);
+    return 1;
+}
 
-    // Determine tensor buffer sizes
-    const larodTensorPitches* ppInputPitches = larodGetTensorPitches(ppInputTensors[0], &error);
-    if (!ppInputPitches) {
-        LOG_WARN("%s: Could not get pitches of tensor: %s\n", __func__, error->msg);
-        larodClearError(&error);
+static gboolean
+model_loaded(gpointer data) {
+    pthread_join(loadThread, NULL);
+    loadRunning = 0;
+    ACAP_STATUS_SetNumber("model", "loadTime", (int)((Metrics_Now() - loadStart) / 1000000));
+    if (loadResult) {
+        variantFallback = -1;
+        clear_crop_cache();
+        ACAP_STATUS_SetString("model", "status", "Model OK.");
+        ACAP_STATUS_SetBool("model", "state", 1);
+    } else {
+        int fallback = variantFallback;
+        variantFallback = -1;
         Model_Cleanup();
-        return 0;
+        if (fallback >= 0) {
+            LOG_WARN("%s: Variant %s failed to load, loading %s\n", __func__,
+                     Model_Variant_Name(variant), Model_Variant_Name(fallback));
+            if (model_configure(fallback))
+                return G_SOURCE_REMOVE;
+        }
     }
+    if (readyCallback)
+        readyCallback(loadResult);
+    return G_SOURCE_REMOVE;
+}
 
-    yuyvBufferSize = ppInputPitches->pitches[0];
-    LOG_TRACE("Buffer size: %zu\n", yuyvBufferSize);
-    
-    const larodTensorPitches* ppOutputPitches = larodGetTensorPitches(ppOutputTensors[0], &error);
-    if (!ppOutputPitches) {
-        LOG_WARN("%s: Could not get pitches of tensor: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
+static void*
+load_thread(void* arg) {
+    loadResult = model_load();
+    g_idle_add(model_loaded, NULL);
+    return NULL;
+}
 
-    size_t rgbBufferSize = ppOutputPitches->pitches[0];
-    size_t expectedSize = modelWidth * modelHeight * channels;
-    if (expectedSize != rgbBufferSize) {
-        LOG_WARN("%s: Expected video output size %zu, actual %zu\n", __func__, expectedSize, rgbBufferSize);
-        Model_Cleanup();
+// modelConfig with the keys of variants[index - 1] on top; variant 0 is modelConfig
+static cJSON*
+variant_config(unsigned index) {
+    if (index == 0)
+        return modelConfig;
+    cJSON* config = cJSON_Duplicate(modelConfig, 1);
+    if (!config)
         return 0;
-    }
-    
-    const larodTensorPitches* outputPitches = larodGetTensorPitches(outputTensors[0], &error);
-    if (!outputPitches) {
-        LOG_WARN("%s: Could not get pitches of tensor: %s\n", __func__, error->msg);
-        Model_Cleanup();
-        return 0;
-    }
+    cJSON_DeleteItemFromObject(config, "variants");
+    cJSON* key;
+    cJSON_ArrayForEach(key, cJSON_GetArrayItem(cJSON_GetObjectItem(modelConfig, "variants"), index - 1)) {
+        cJSON* copy = cJSON_Duplicate(key, 1);
+        if (cJSON_GetObjectItem(config, key->string))
+            cJSON_ReplaceItemInObject(config, key->string, copy);
+        else
+            cJSON_AddItemToObject(config, key->string, copy);
+    }
+    return config;
+}
 
-    // Allocate space for input tensors
-    if (!createAndMapTmpFile(PP_SD_INPUT_FILE_PATTERN, yuyvBufferSize, &ppInputAddr, &ppInputFd)) {
-        LOG_WARN("%s: Could not allocate pre-processor tensor\n", __func__);
-        Model_Cleanup();
-        return 0;
-    }
+static void
+free_config(void) {
+    if (variantConfig && variantConfig != modelConfig)
+        cJSON_Delete(variantConfig);
+    variantConfig = 0;
+    // The label table points into modelConfig
+    Detections_Set_Labels(NULL);
+    cJSON_Delete(modelConfig);
+    modelConfig = 0;
+}
 
-    if (!createAndMapTmpFile(OBJECT_DETECTOR_INPUT_FILE_PATTERN, modelWidth * modelHeight * channels, &larodInputAddr, &larodInputFd)) {
-        LOG_WARN("%s: Could not allocate input tensor\n", __func__);
-        Model_Cleanup();
+// Read the parameters of a variant, set up its decoder and start its load
+static int
+model_configure(unsigned index) {
+    cJSON* config = variant_config(index);
+    if (!config) {
+        LOG_WARN("%s: Unable to read variant %u\n", __func__, index);
         return 0;
     }
-    if (!createAndMapTmpFile(OBJECT_DETECTOR_OUT1_FILE_PATTERN, boxes * (classes + 5), &larodOutput1Addr, &larodOutput1Fd)) {
-        LOG_WARN("%s: Could not allocate output tensor\n", __func__);
-        Model_Cleanup();
-        return 0;
-    }
-
-    // Allocate space for HD preprocessing input/output
-    size_t nv12BufferSizeHD = videoWidth * videoHeight * 3 / 2;
-    size_t rgbBufferSizeHD = videoWidth * videoHeight * 3;
-    if (!createAndMapTmpFile(PP_HD_INPUT_FILE_PATTERN,
-                             nv12BufferSizeHD,
-							 &ppInputAddrHD,
-							 &ppInputFdHD)) {
-        LOG_WARN("%s: Could not allocate HD preproc input tensor\n", __func__);
-        Model_Cleanup();
+    if (variantConfig && variantConfig != modelConfig)
+        cJSON_Delete(variantConfig);
+    variantConfig = config;
+    variant = index;
+
+    modelWidth = cJSON_GetObjectItem(variantConfig, "modelWidth")->valueint;
+    modelHeight = cJSON_GetObjectItem(variantConfig, "modelHeight")->valueint;
+    boxes = cJSON_GetObjectItem(variantConfig, "boxes")->valueint;
+    classes = cJSON_GetObjectItem(variantConfig, "classes")->valueint;
+    quant = cJSON_GetObjectItem(variantConfig, "quant")->valuedouble;
+    quant_zero = cJSON_GetObjectItem(variantConfig, "zeroPoint")->valuedouble;
+    objectnessThreshold = cJSON_GetObjectItem(variantConfig, "objectness")->valuedouble;
+    nmsConfig.iouThreshold = cJSON_GetObjectItem(variantConfig, "nms")->valuedouble;
+    cJSON* nmsMode = cJSON_GetObjectItem(variantConfig, "nmsMode");
+    nmsConfig.perClass = nmsMode && cJSON_IsString(nmsMode) && strcmp(nmsMode->valuestring, "class") == 0;
+    cJSON* maxDetections = cJSON_GetObjectItem(variantConfig, "maxDetections");
+    nmsConfig.maxDetections = maxDetections && maxDetections->valueint > 0 ? maxDetections->valueint : MODEL_NMS_DEFAULT_MAX;
+
+    LOG_TRACE("Variant: %s Boxes: %d Classes: %d Objectness: %f nms:%f mode:%s max:%u", Model_Variant_Name(variant),
+              boxes, classes, objectnessThreshold, nmsConfig.iouThreshold, nmsConfig.perClass ? "class" : "agnostic",
+              nmsConfig.maxDetections);
+    pipelineSlots = cJSON_IsTrue(cJSON_GetObjectItem(variantConfig, "pipeline")) ? MODEL_PIPELINE_SLOTS : 1;
+
+    // The output layout selects the decoder, and the thresholds are
+    // converted to the quantized tensor domain once here
+    DecoderFormat format;
+    if (!model_decode_format(variantConfig, &format)) {
+        LOG_WARN("%s: Unsupported model output format\n", __func__);
         return 0;
     }
-    if (!createAndMapTmpFile(PP_HD_OUTPUT_FILE_PATTERN,
-	                         rgbBufferSizeHD,
-							 &ppOutputAddrHD,
-							 &ppOutputFdHD)) {
-        LOG_WARN("%s: Could not allocate HD preproc output tensor\n", __func__);
-        Model_Cleanup();
+    if (!model_decode_setup(&decoder, &format, boxes, classes, quant, quant_zero, objectnessThreshold, confidenceThreshold)) {
+        LOG_WARN("%s: Invalid model output quantization\n", __func__);
         return 0;
     }
+    model_dump_init(variantConfig, &decoder);
 
-    // Connect tensors to file descriptors
-    if (!larodSetTensorFd(ppInputTensors[0], ppInputFd, &error)) {
-        LOG_WARN("%s: Failed setting input tensor fd: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
-    if (!larodSetTensorFd(ppOutputTensors[0], larodInputFd, &error)) {
-        LOG_WARN("%s: Failed setting output tensor fd: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
-    // HD preprocessing tensor connections
-    if (!larodSetTensorFd(ppInputTensorsHD[0], ppInputFdHD, &error)) {
-        LOG_WARN("%s: Failed setting HD input tensor fd: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
-    if (!larodSetTensorFd(ppOutputTensorsHD[0], ppOutputFdHD, &error)) {
-        LOG_WARN("%s: Failed setting HD output tensor fd: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
-        return 0;
-    }
+    // Decode workers, "decodeThreads" in settings.json; applies on restart
+    unsigned threads = model_decode_threads(Settings_Get()->decodeThreads);
+    ACAP_STATUS_SetNumber("model", "decodeThreads", threads);
+    ACAP_STATUS_SetString("model", "variant", Model_Variant_Name(variant));
 
-    if (!larodSetTensorFd(inputTensors[0], larodInputFd, &error)) {
-        LOG_WARN("%s: Failed setting input tensor fd: %s\n", __func__, error->msg);
-        larodClearError(&error);
-        Model_Cleanup();
+    // The larod part is slow (seconds for a large DLPU model), so
+    // it runs on its own thread while the caller starts video, MQTT and HTTP
+    loadStart = Metrics_Now();
+    ACAP_STATUS_SetString("model", "status", "Loading model");
+    if (pthread_create(&loadThread, NULL, load_thread, NULL) != 0) {
+        LOG_WARN("%s: Unable to start the model load thread\n", __func__);
         return 0;
     }
+    loadRunning = 1;
+    return 1;
+}
 
-    if (!larodSetTensorFd(outputTensors[0], larodOutput1Fd, &error)) {
-        LOG_WARN("%s: Failed setting output tensor fd: %s\n", __func__, error->msg);
-        Model_Cleanup();
-        return 0;
-    }
+cJSON* Model_Setup(Model_Ready_Callback ready) {
+    ACAP_STATUS_SetString("model", "status", "Model initialization failed. Check log file");
+    ACAP_STATUS_SetBool("model", "state", 0);
 
-    // Create job requests
-    ppReq = larodCreateJobRequest(ppModel,
-                                  ppInputTensors,
-                                  ppInputs,
-                                  ppOutputTensors,
-                                  ppOutputs,
-                                  NULL,
-                                  &error);
-    if (!ppReq) {
-        LOG_WARN("%s: Failed creating preprocessing job request: %s\n", __func__, error->msg);
-        Model_Cleanup();
+    modelConfig = ACAP_FILE_Read("model/model.json");
+    if (!modelConfig) {
+        LOG_WARN("%s: Unable to read model.json\n", __func__);
         return 0;
     }
-    // HD preprocessing job request
-    ppReqHD = larodCreateJobRequest(ppModelHD,
-                                    ppInputTensorsHD,
-                                    ppNumInputsHD,
-                                    ppOutputTensorsHD,
-                                    ppNumOutputsHD,
-                                    NULL,
-                                    &error);
-    if (!ppReqHD) {
-        LOG_WARN("%s: Failed creating HD preproc job request: %s\n", __func__, error ? error->msg : "");
-        Model_Cleanup();
-        return 0;
+    // Video size and labels are shared by all variants
+    videoWidth = cJSON_GetObjectItem(modelConfig, "videoWidth")->valueint;
+    videoHeight = cJSON_GetObjectItem(modelConfig, "videoHeight")->valueint;
+    Detections_Set_Labels(cJSON_GetObjectItem(modelConfig, "labels"));
+
+    unsigned declared = (unsigned)cJSON_GetArraySize(cJSON_GetObjectItem(modelConfig, "variants"));
+    variantCount = 1 + declared;
+    if (variantCount > MODEL_MAX_VARIANTS) {
+        LOG_WARN("%s: Only the first %d model variants are used\n", __func__, MODEL_MAX_VARIANTS - 1);
+        variantCount = MODEL_MAX_VARIANTS;
     }
+    ACAP_STATUS_SetNumber("model", "variants", variantCount);
 
-    infReq = larodCreateJobRequest(InfModel,
-                                   inputTensors,
-                                   inputs,
-                                   outputTensors,
-                                   outputs,
-                                   NULL,
-                                   &error);
-    if (!infReq) {
-        LOG_WARN("%s: Failed creating inference request: %s\n", __func__, error->msg);
+    readyCallback = ready;
+    if (!model_configure(0)) {
         Model_Cleanup();
+        free_config();
         return 0;
     }
+    return modelConfig;
+}
 
-    clear_crop_cache();
+unsigned
+Model_Variants(void) {
+    return variantCount;
+}
 
-    ACAP_STATUS_SetString("model", "status", "Model OK.");
-    ACAP_STATUS_SetBool("model", "state", 1);
+unsigned
+Model_Variant(void) {
+    return variant;
+}
 
-    return modelConfig;
+const char*
+Model_Variant_Name(unsigned index) {
+    static char names[MODEL_MAX_VARIANTS][32];
+    if (!modelConfig || index >= variantCount)
+        return "";
+    cJSON* entry = index ? cJSON_GetArrayItem(cJSON_GetObjectItem(modelConfig, "variants"), index - 1) : modelConfig;
+    cJSON* name = cJSON_GetObjectItem(entry, "name");
+    if (name && cJSON_IsString(name))
+        return name->valuestring;
+    cJSON* width = cJSON_GetObjectItem(entry, "modelWidth");
+    cJSON* height = cJSON_GetObjectItem(entry, "modelHeight");
+    if (!width) width = cJSON_GetObjectItem(modelConfig, "modelWidth");
+    if (!height) height = cJSON_GetObjectItem(modelConfig, "modelHeight");
+    snprintf(names[index], sizeof(names[index]), "%dx%d", width ? width->valueint : 0, height ? height->valueint : 0);
+    return names[index];
+}
+
+int
+Model_Loading(void) {
+    return loadRunning;
+}
+
+int
+Model_Switch_Variant(unsigned index) {
+    if (!modelConfig || index >= variantCount || loadRunning)
+        return 0;
+    if (index == variant)
+        return 1;
+    unsigned previous = variant;
+    Model_Cleanup();
+    variantFallback = (int)previous;
+    if (model_configure(index))
+        return 1;
+    // An invalid variant never reaches larod; the previous one is loaded again
+    variantFallback = -1;
+    if (!model_configure(previous))
+        LOG_WARN("%s: Unable to reload variant %s\n", __func__, Model_Variant_Name(previous));
+    return 0;
 }
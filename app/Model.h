@@ -6,39 +6,186 @@
 #include "vdo-frame.h"
 #include "vdo-types.h"
 #include "cJSON.h"
+#include "Detections.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Called on the main loop when the model load started by Model_Setup() ends.
+ *
+ * @param ok 1 if the model is loaded and inference can start, 0 on failure
+ *           (the model is cleaned up and its status says why).
+ */
+typedef void (*Model_Ready_Callback)(int ok);
+
 /**
  * @brief Initializes and configures the detection model for inference.
  *
- * This function sets up the neural network, allocates all required buffers, 
- * and reads model parameters and configuration. 
- * It must be called before any inference or image processing.
+ * This function reads model parameters and configuration (labels, sizes,
+ * decoder) and returns. The larod connection, the models and all buffers are
+ * then loaded on a separate thread, so video, MQTT and HTTP can start in
+ * the meantime. No inference or image processing before ready(1).
+ * The load time is reported in the status as "model.loadTime" (ms).
  *
+ * @param ready Called on the main loop when the load is done.
  * @return Pointer to a cJSON object containing model and video configuration data,
- *         or NULL on failure. This object can be used for downstream configuration needs.
+ *         or NULL on failure (ready is then not called). This object can be used for
+ *         downstream configuration needs.
  *         Do not free this object; management is handled internally.
  */
-cJSON* Model_Setup(void);
+cJSON* Model_Setup(Model_Ready_Callback ready);
 
 /**
  * @brief Perform inference on a captured video frame and return detected objects.
  *
- * This function runs the preprocessing and inference pipeline. It returns a cJSON array
- * of detection objects. Each detection object will include fields such as:
- *   - "label": Detected object class as a string
- *   - "c": Confidence value, 0–1 (or 0–100 as an integer)
- *   - "x", "y", "w", "h": Detection region (relative to input image, float 0–1)
- *   - "timestamp": Epoch milliseconds of detection
- *   - "refId": A unique integer reference for this detection (valid until next inference/reset)
+ * This function runs the preprocessing and inference pipeline and fills an internal
+ * detection list (see Detections.h) after non-maximum suppression:
+ *   - label: class index into the model labels
+ *   - c: Confidence value, 0–1
+ *   - x, y, w, h: Detection region (relative to input image, float 0–1)
+ *   - timestamp: Epoch milliseconds of detection
+ *   - refId: A unique integer reference for this detection (valid until next inference/reset)
+ *
+ * With a presence model in model.json (Model_presence.h), the main model only
+ * runs when the presence model finds something; otherwise the list is empty.
  *
  * @param image  The input image buffer (YUV or RGB). Ownership is not transferred.
- * @return A cJSON array of detection objects. The caller is responsible for freeing this array (cJSON_Delete).
+ * @return Pointer to the internal detection list, valid until the next call, or NULL on error.
+ *         Do not free.
+ */
+const DetectionList* Model_Inference(VdoBuffer* image);
+
+/**
+ * @brief Bind the preprocessing input directly to the VDO buffers (zero-copy).
+ *
+ * Creates one larod tensor per VDO buffer on the buffer's dmabuf fd. Frames
+ * from imported buffers are preprocessed in place instead of being copied into
+ * the temp-file tensors, which remain as fallback for buffers that could not
+ * be imported. Call after Model_Setup() and Video_Start_YUV().
+ *
+ * @param buffers All buffers the YUV image provider can return.
+ * @param count   Number of buffers.
+ * @return Number of imported buffers (0 means the copy path is used).
+ */
+unsigned Model_Import_Buffers(VdoBuffer** buffers, unsigned count);
+
+/**
+ * @brief Returns 1 if model.json enables the pipelined mode ("pipeline": true).
+ *
+ * In pipelined mode use Video_Hold_YUV() and Model_Pipeline() instead of
+ * Video_Capture_YUV() and Model_Inference().
+ */
+int Model_Pipelined(void);
+
+/**
+ * @brief Submit a frame and return the detections of the previous frame.
+ *
+ * Preprocessing and inference run as asynchronous larod jobs on double-buffered
+ * tensors. Frame N+1 is preprocessed while frame N is in inference, and frame N
+ * is decoded while frame N+1 is processed. Detections are therefore one frame behind.
+ * Per-stage timings, end-to-end latency and fps are reported in the status group "model".
+ *
+ * @param image  Frame from Video_Hold_YUV(). Ownership is transferred; the model
+ *               releases it with Video_Release_YUV().
+ * @return Detections of the previous frame (same format as Model_Inference), or NULL
+ *         while the pipeline fills up or on error. The frame of the returned detections
+ *         is kept until Model_Reset().
+ */
+const DetectionList* Model_Pipeline(VdoBuffer* image);
+
+/**
+ * @brief Drop the frames in flight in the pipeline and release them.
+ *
+ * Waits for a job that is still running. Call it when frames stop being submitted
+ * (a static scene), so the next Model_Pipeline() does not return detections
+ * from before the pause.
+ */
+void Model_Pipeline_Flush(void);
+
+/**
+ * @brief Capture time of the frame behind the last returned detections.
+ *
+ * @return Monotonic ns (as Metrics_Now()) when VDO delivered the frame, 0 if unknown.
+ */
+uint64_t Model_Capture_Time(void);
+
+/**
+ * @brief View (YUV stream index) of the frame behind the last returned detections.
+ *
+ * All views share the model, the larod connection and the preprocessing
+ * model; each view's VDO buffers are imported as their own preprocessing
+ * input tensors.
+ */
+unsigned Model_View(void);
+
+/** Most model variants read from model.json, including the top level model. */
+#define MODEL_MAX_VARIANTS 4
+
+/**
+ * @brief Stage timings of the last frame that returned detections, ms.
+ */
+typedef struct {
+    double preprocess;
+    double inference;
+    double decode;
+    double latency;             ///< Submit to decoded detections
+} ModelTiming;
+
+const ModelTiming* Model_Last_Timing(void);
+
+/**
+ * @brief Number of model variants, 1 without "variants" in model.json.
+ *
+ * Variant 0 is the top level model. The entries of the "variants" list are
+ * variants 1.., ordered from the most accurate to the fastest, and give the
+ * keys that differ from the top level, e.g.
+ *   "variants": [ { "name": "960", "path": "model/model960.tflite",
+ *                   "modelWidth": 960, "modelHeight": 960, "boxes": 56700,
+ *                   "quant": 0.0039, "zeroPoint": 0 } ]
+ * The video size and the labels are shared by all variants. The status
+ * reports "model.variants" and the loaded "model.variant".
+ */
+unsigned Model_Variants(void);
+
+/** @brief Variant that is loaded or loading. */
+unsigned Model_Variant(void);
+
+/**
+ * @brief Name of a variant: its "name", else the model input size ("960x960").
  */
-cJSON* Model_Inference(VdoBuffer* image);
+const char* Model_Variant_Name(unsigned index);
+
+/**
+ * @brief Replace the loaded model with another variant.
+ *
+ * The model is cleaned up and the variant is loaded in the background like
+ * in Model_Setup(); the ready callback is called again when it is done. No
+ * inference until then. If the variant fails to load, the previous one is
+ * loaded again and Model_Variant() returns to it. Main loop only.
+ *
+ * @return 1 if the load started (or index is already loaded), 0 if index is
+ *         out of range, a load is running or the variant is invalid.
+ */
+int Model_Switch_Variant(unsigned index);
+
+/** @brief 1 while a model load started by Model_Setup() or Model_Switch_Variant() runs. */
+int Model_Loading(void);
+
+/**
+ * @brief Limit the candidates taken from the output tensor before NMS.
+ *
+ * Bounds the NMS cost of a frame that floods the decoder. Over the cap the
+ * cap highest-confidence candidates are kept (model_decode_select()), so no
+ * output head or part of the frame is dropped first. Main loop only.
+ *
+ * @param cap Candidates per frame, 0 for the full buffer.
+ */
+void Model_Set_Candidate_Cap(unsigned cap);
+
+/** @brief Candidate cap in use. */
+unsigned Model_Candidate_Cap(void);
 
 /**
  * @brief Clean up and free all model resources and buffers.
@@ -56,7 +203,17 @@ void Model_Cleanup(void);
  *
  * All pixel coordinates are **relative to the original source image size**.
  *
- * @param detection  A pointer to a single cJSON detection object (from Model_Inference), MUST contain "refId".
+ * The crop is JPEG encoded directly from the NV12 frame of the detections (no RGB
+ * conversion). The crop origin is aligned to even pixels for 4:2:0 chroma.
+ * JPEG quality is read from settings "cropping.quality" (1..100, default 90).
+ *
+ * With "cropping.source": "jpeg" the crop is cut losslessly out of the camera's
+ * own JPEG of the same capture (first view only), with no encode on the CPU.
+ * Its origin then moves to the 8 or 16 pixel MCU grid and the quality is that
+ * of the camera stream. Without a matching JPEG frame the crop is encoded.
+ *
+ * @param list       Filtered detection list (coordinates 0..1000) derived from Model_Inference.
+ * @param index      Index of the detection in list. Its refId selects the cached crop.
  * @param jpeg_size  Output: Set to the JPEG buffer's length in bytes on success, or 0 on failure.
  * @param out_x      Output: Left pixel coordinate of the actual detected object in the cropped image.
  * @param out_y      Output: Top pixel coordinate of the actual detected object in the cropped image.
@@ -68,15 +225,16 @@ void Model_Cleanup(void);
  *         Buffer is valid until Model_Reset() is called or until the next Model_Inference().
  *
  * Typical usage in output loop:
- *   int x,y,w,h;
+ *   int x,y,w,h,img_w,img_h;
  *   unsigned size;
- *   const unsigned char* jpeg = Model_GetImageData(detection, &size, &x, &y, &w, &h);
+ *   const unsigned char* jpeg = Model_GetImageData(list, i, &size, &x, &y, &w, &h, &img_w, &img_h);
  *   if (jpeg && size) {
  *       // save or send jpeg; save label, (x, y, w, h) for annotation or re-training
  *   }
  */
 const unsigned char* Model_GetImageData(
-    const cJSON* detection,
+    const DetectionList* list,
+    unsigned index,
     unsigned* jpeg_size,
     int* out_x,
     int* out_y,
@@ -86,11 +244,55 @@ const unsigned char* Model_GetImageData(
     int* img_h
 );
 
+/**
+ * @brief A detection crop copied out of the frame, to be encoded later.
+ *
+ * Zero-initialize before the first Model_Copy_Crop(). The buffer is grown
+ * when needed and kept; release it with Model_Free_Crop().
+ */
+typedef struct {
+    unsigned char* nv12;    ///< Y rows, then interleaved UV rows, both with 'stride'
+    size_t capacity;
+    unsigned char* jpeg;    ///< Camera JPEG crop ("cropping.source": "jpeg"), used instead of nv12
+    unsigned long jpegSize; ///< 0 when the crop is in nv12
+    unsigned long jpegCapacity;
+    int stride;             ///< Even
+    int rows;               ///< Y plane rows (even)
+    int width, height;      ///< Crop size in pixels, relative to the source image
+    int det_x, det_y;       ///< Detection in the crop, pixels
+    int det_w, det_h;
+} ModelCrop;
+
+/**
+ * @brief Copy the crop of a detection (same region and borders as
+ * Model_GetImageData()) out of the current frame, without encoding it.
+ *
+ * A memcpy of the region, so candidates can be kept past Model_Reset() and
+ * only the one that is exported is encoded. With "cropping.source": "jpeg"
+ * the camera JPEG crop is kept instead and nothing is encoded later.
+ *
+ * @return 1 on success, 0 if there is no frame or no memory.
+ */
+int Model_Copy_Crop(const DetectionList* list, unsigned index, ModelCrop* crop);
+
+/**
+ * @brief JPEG encode a copied crop with "cropping.quality".
+ *
+ * @return Internally managed buffer valid until the next call (do NOT free), or NULL.
+ */
+const unsigned char* Model_Encode_Crop(const ModelCrop* crop, unsigned* jpeg_size);
+
+/**
+ * @brief Free the buffer of a copied crop.
+ */
+void Model_Free_Crop(ModelCrop* crop);
+
 /**
  * @brief Reset/cleanup per-inference buffers used for image crops and JPEG encoding.
  *
  * This MUST be called (typically after Output has finished handling all detections)
  * to guarantee that memory is released and JPEG/crop state is not leaked.
+ * In pipelined mode it also releases the frame of the last returned detections.
  */
 void Model_Reset(void);
 
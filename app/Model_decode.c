@@ -0,0 +1,539 @@
+/**
+ * @file model_decode.c
+ * @brief Implementation of the quantized-domain YOLO output decoder.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <pthread.h>
+#include "Model_decode.h"
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MODEL_DECODE_NEON 1
+#endif
+
+/**
+ * Boxes per pass of the "channels" scan. Each class row of a chunk is one
+ * contiguous read, and the running maximum stays in L1.
+ */
+#define MODEL_DECODE_CHUNK 1024
+
+/**
+ * Range boundaries of the worker pool are a multiple of this many boxes:
+ * a multiple of the 16-box vector block, and of the 64-byte cache line for
+ * both layouts, so no two threads write or read the same line.
+ */
+#define MODEL_DECODE_ALIGN 64
+
+/**
+ * Candidates kept per worker; the first range writes to the caller's buffer.
+ * The merge matches a serial scan for capacities up to this size.
+ */
+#define MODEL_DECODE_WORKER_CANDIDATES 1024
+
+static inline float dequant(const DecoderConfig* config, uint8_t value) {
+    return ((float)value - config->zeroPoint) * config->quant;
+}
+
+// Fill in *out from the raw box values (unsigned domain) of a survivor
+static inline void emit(const DecoderConfig* config, uint8_t cx, uint8_t cy, uint8_t rw, uint8_t rh,
+                        float confidence, unsigned classId, DecodeCandidate* out) {
+    float w = dequant(config, rw);
+    float h = dequant(config, rh);
+    out->x = dequant(config, cx) - (w / 2);
+    out->y = dequant(config, cy) - (h / 2);
+    out->w = w;
+    out->h = h;
+    out->confidence = confidence;
+    out->classId = (int)classId;
+}
+
+// Float check of a survivor with the same expressions as before the integer
+// gates. Returns the confidence, or 0 if it fails.
+static inline float confirm(const DecoderConfig* config, uint8_t best, uint8_t rawObjectness, const int objectness) {
+    float objectnessValue = 1;
+    if (objectness) {
+        objectnessValue = dequant(config, rawObjectness);
+        if (objectnessValue < config->objectnessThreshold)
+            return 0;
+    }
+    float confidence = dequant(config, best) * objectnessValue;
+    return confidence > config->confidenceThreshold ? confidence : 0;
+}
+
+// ---- [boxes][channels] ----
+
+// Returns 1 and fills in *out if the box passes both thresholds.
+static inline int decode_box(const DecoderConfig* config, const uint8_t* box, DecodeCandidate* out,
+                             const uint8_t flip, const int objectness) {
+    uint8_t rawObjectness = 0;
+    if (objectness) {
+        rawObjectness = box[4] ^ flip;
+        if (rawObjectness < config->objectnessQ)
+            return 0;
+    }
+
+    const uint8_t* scores = box + (objectness ? 5 : 4);
+    unsigned classId = 0;
+    uint8_t best = scores[0] ^ flip;
+    for (unsigned c = 1; c < config->classes; c++) {
+        uint8_t score = scores[c] ^ flip;
+        if (score > best) {
+            best = score;
+            classId = c;
+        }
+    }
+    if (best < config->classQ)
+        return 0;
+
+    float confidence = confirm(config, best, rawObjectness, objectness);
+    if (!(confidence > 0))
+        return 0;
+    emit(config, box[0] ^ flip, box[1] ^ flip, box[2] ^ flip, box[3] ^ flip, confidence, classId, out);
+    return 1;
+}
+
+static inline unsigned scan_boxes(const DecoderConfig* config, const uint8_t* tensor,
+                                  unsigned first, unsigned end,
+                                  DecodeCandidate* out, unsigned capacity,
+                                  const uint8_t flip, const int objectness) {
+    const unsigned stride = config->stride;
+    unsigned count = 0;
+
+#ifdef MODEL_DECODE_NEON
+    if (config->gateStride == stride) {
+        // Reject 16 boxes at a time: mask out everything but the gated values
+        // (objectness, or all class scores without it) and compare the block
+        // maximum against the quantized threshold.
+        const uint8x16_t flipv = vdupq_n_u8(flip);
+        const uint8_t gate = objectness ? config->objectnessQ : config->classQ;
+        const unsigned blocks = (end - first) / 16;
+        const size_t blockBytes = 16 * (size_t)stride;
+        const uint8_t* start = tensor + (size_t)first * stride;
+        for (unsigned b = 0; b < blocks; b++) {
+            const uint8_t* block = start + b * blockBytes;
+            __builtin_prefetch(block + 2 * blockBytes);
+            uint8x16_t acc = vdupq_n_u8(0);
+            for (unsigned k = 0; k < stride; k++)
+                acc = vmaxq_u8(acc, vandq_u8(veorq_u8(vld1q_u8(block + 16 * k), flipv),
+                                             vld1q_u8(config->gateMask[k])));
+            if (vmaxvq_u8(acc) < gate)
+                continue;
+            for (unsigned i = 0; i < 16; i++) {
+                if (decode_box(config, block + i * stride, &out[count], flip, objectness)) {
+                    if (++count >= capacity)
+                        return count;
+                }
+            }
+        }
+        first += blocks * 16;
+    }
+#endif
+
+    // Scalar scan (non-NEON builds and the tail of the vector scan)
+    for (unsigned i = first; i < end; i++) {
+        if (decode_box(config, tensor + (size_t)i * stride, &out[count], flip, objectness)) {
+            if (++count >= capacity)
+                break;
+        }
+    }
+    return count;
+}
+
+// ---- [channels][boxes] ----
+
+// Running maximum of 'n' values of a row into best[]
+static inline void max_row(uint8_t* best, const uint8_t* row, unsigned n, const uint8_t flip) {
+    unsigned i = 0;
+#ifdef MODEL_DECODE_NEON
+    const uint8x16_t flipv = vdupq_n_u8(flip);
+    for (; i + 16 <= n; i += 16)
+        vst1q_u8(best + i, vmaxq_u8(vld1q_u8(best + i), veorq_u8(vld1q_u8(row + i), flipv)));
+#endif
+    for (; i < n; i++) {
+        uint8_t v = row[i] ^ flip;
+        if (v > best[i])
+            best[i] = v;
+    }
+}
+
+// Box 'i' of a channel-major tensor; its values are 'boxes' bytes apart.
+static inline int decode_column(const DecoderConfig* config, const uint8_t* tensor, unsigned i,
+                                DecodeCandidate* out, const uint8_t flip, const int objectness) {
+    const size_t boxes = config->boxes;
+    uint8_t rawObjectness = objectness ? tensor[4 * boxes + i] ^ flip : 0;
+
+    const uint8_t* scores = tensor + (objectness ? 5 : 4) * boxes + i;
+    unsigned classId = 0;
+    uint8_t best = scores[0] ^ flip;
+    for (unsigned c = 1; c < config->classes; c++) {
+        uint8_t score = scores[c * boxes] ^ flip;
+        if (score > best) {
+            best = score;
+            classId = c;
+        }
+    }
+    if (best < config->classQ)
+        return 0;
+
+    float confidence = confirm(config, best, rawObjectness, objectness);
+    if (!(confidence > 0))
+        return 0;
+    emit(config, tensor[i] ^ flip, tensor[boxes + i] ^ flip, tensor[2 * boxes + i] ^ flip,
+         tensor[3 * boxes + i] ^ flip, confidence, classId, out);
+    return 1;
+}
+
+static inline unsigned scan_channels(const DecoderConfig* config, const uint8_t* tensor,
+                                     unsigned begin, unsigned end,
+                                     DecodeCandidate* out, unsigned capacity,
+                                     const uint8_t flip, const int objectness) {
+    const size_t boxes = config->boxes;
+    uint8_t best[MODEL_DECODE_CHUNK];
+    unsigned count = 0;
+
+    for (unsigned first = begin; first < end; first += MODEL_DECODE_CHUNK) {
+        unsigned n = end - first < MODEL_DECODE_CHUNK ? end - first : MODEL_DECODE_CHUNK;
+        uint8_t gate;
+        // Per box maximum of the gated rows: objectness, or all class rows
+        memset(best, 0, n);
+        if (objectness) {
+            max_row(best, tensor + 4 * boxes + first, n, flip);
+            gate = config->objectnessQ;
+        } else {
+            const uint8_t* scores = tensor + 4 * boxes + first;
+            for (unsigned c = 0; c < config->classes; c++)
+                max_row(best, scores + c * boxes, n, flip);
+            gate = config->classQ;
+        }
+        for (unsigned i = 0; i < n; i++) {
+            if (best[i] < gate)
+                continue;
+            if (decode_column(config, tensor, first + i, &out[count], flip, objectness)) {
+                if (++count >= capacity)
+                    return count;
+            }
+        }
+    }
+    return count;
+}
+
+// One scan per format; the format arguments are constants in each
+#define MODEL_DECODE_SCAN(name, scan, flip, objectness) \
+    static unsigned name(const DecoderConfig* config, const uint8_t* tensor, \
+                         unsigned first, unsigned end, \
+                         DecodeCandidate* out, unsigned capacity) { \
+        return scan(config, tensor, first, end, out, capacity, flip, objectness); \
+    }
+
+MODEL_DECODE_SCAN(scan_boxes_u8_objectness,    scan_boxes,    0x00, 1)
+MODEL_DECODE_SCAN(scan_boxes_s8_objectness,    scan_boxes,    0x80, 1)
+MODEL_DECODE_SCAN(scan_boxes_u8,               scan_boxes,    0x00, 0)
+MODEL_DECODE_SCAN(scan_boxes_s8,               scan_boxes,    0x80, 0)
+MODEL_DECODE_SCAN(scan_channels_u8_objectness, scan_channels, 0x00, 1)
+MODEL_DECODE_SCAN(scan_channels_s8_objectness, scan_channels, 0x80, 1)
+MODEL_DECODE_SCAN(scan_channels_u8,            scan_channels, 0x00, 0)
+MODEL_DECODE_SCAN(scan_channels_s8,            scan_channels, 0x80, 0)
+
+// [layout][isSigned][objectness]
+static const DecoderScan scans[2][2][2] = {
+    { { scan_boxes_u8,    scan_boxes_u8_objectness },    { scan_boxes_s8,    scan_boxes_s8_objectness } },
+    { { scan_channels_u8, scan_channels_u8_objectness }, { scan_channels_s8, scan_channels_s8_objectness } }
+};
+
+int model_decode_format(const cJSON* model, DecoderFormat* format) {
+    if (!format)
+        return 0;
+    format->layout = MODEL_LAYOUT_BOXES;
+    format->isSigned = 0;
+    format->objectness = 1;
+    if (!model)
+        return 1;
+
+    const cJSON* layout = cJSON_GetObjectItem(model, "outputLayout");
+    if (cJSON_IsString(layout)) {
+        if (strcmp(layout->valuestring, "channels") == 0) {
+            format->layout = MODEL_LAYOUT_CHANNELS;
+            format->objectness = 0;
+        } else if (strcmp(layout->valuestring, "boxes") != 0) {
+            syslog(LOG_WARNING, "model_decode_format: Unknown outputLayout %s", layout->valuestring);
+            return 0;
+        }
+    }
+    const cJSON* type = cJSON_GetObjectItem(model, "outputType");
+    if (cJSON_IsString(type)) {
+        if (strcmp(type->valuestring, "int8") == 0) {
+            format->isSigned = 1;
+        } else if (strcmp(type->valuestring, "uint8") != 0) {
+            syslog(LOG_WARNING, "model_decode_format: Unknown outputType %s", type->valuestring);
+            return 0;
+        }
+    }
+    const cJSON* objectness = cJSON_GetObjectItem(model, "outputObjectness");
+    if (cJSON_IsBool(objectness))
+        format->objectness = cJSON_IsTrue(objectness);
+    return 1;
+}
+
+int model_decode_setup(DecoderConfig* config,
+                       const DecoderFormat* format,
+                       unsigned boxes,
+                       unsigned classes,
+                       float quant,
+                       float zeroPoint,
+                       float objectnessThreshold,
+                       float confidenceThreshold)
+{
+    if (!config || boxes == 0 || classes == 0 || quant <= 0) {
+        syslog(LOG_WARNING, "model_decode_setup: Invalid model parameters (boxes %u, classes %u, quant %f)",
+               boxes, classes, quant);
+        return 0;
+    }
+
+    memset(config, 0, sizeof(*config));
+    if (format)
+        config->format = *format;
+    else
+        model_decode_format(NULL, &config->format);
+    const int objectness = config->format.objectness ? 1 : 0;
+    config->boxes = boxes;
+    config->classes = classes;
+    config->channels = 4 + objectness + classes;
+    config->stride = config->channels;
+    config->tensorSize = (size_t)boxes * config->channels;
+    config->quant = quant;
+    config->flip = config->format.isSigned ? 0x80 : 0;
+    config->zeroPoint = config->format.isSigned ? zeroPoint + 128 : zeroPoint;
+    config->objectnessThreshold = objectnessThreshold;
+    config->confidenceThreshold = confidenceThreshold;
+    config->scan = scans[config->format.layout == MODEL_LAYOUT_CHANNELS][config->format.isSigned ? 1 : 0][objectness];
+
+    // The integer thresholds only have to be conservative; every survivor
+    // is checked again in float with the same expressions as before.
+    config->objectnessQ = 255;
+    for (int q = 0; q <= 255; q++) {
+        if (dequant(config, (uint8_t)q) >= objectnessThreshold) {
+            config->objectnessQ = (uint8_t)q;
+            break;
+        }
+    }
+
+    // No box can have a higher objectness than the largest raw value.
+    float maxObjectness = objectness ? dequant(config, 255) : 1;
+    config->classQ = 255;
+    for (int q = 0; q <= 255; q++) {
+        if (dequant(config, (uint8_t)q) * maxObjectness > confidenceThreshold) {
+            config->classQ = (uint8_t)q;
+            break;
+        }
+    }
+
+    // Gate of the "boxes" vector scan: objectness, or every class score
+    if (config->format.layout == MODEL_LAYOUT_BOXES && config->stride <= MODEL_DECODE_MAX_STRIDE) {
+        for (unsigned i = 0; i < 16 * config->stride; i++) {
+            unsigned channel = i % config->stride;
+            int gated = objectness ? channel == 4 : channel >= 4;
+            config->gateMask[i / 16][i % 16] = gated ? 0xFF : 0;
+        }
+        config->gateStride = config->stride;
+    }
+    return 1;
+}
+
+typedef struct {
+    pthread_t thread;
+    unsigned generation;        ///< Last run picked up
+    unsigned first, end;        ///< Box range of the current run
+    unsigned count;
+} DecodeWorker;
+
+static DecodeWorker workers[MODEL_DECODE_MAX_THREADS - 1];
+static DecodeCandidate workerCandidates[MODEL_DECODE_MAX_THREADS - 1][MODEL_DECODE_WORKER_CANDIDATES];
+static unsigned workerCount = 0;
+
+// Current run, written under poolMutex before the workers are woken
+static const DecoderConfig* runConfig = NULL;
+static const uint8_t* runTensor = NULL;
+static unsigned runCapacity = 0;
+static unsigned runGeneration = 0;
+static unsigned runPending = 0;
+static int poolStopping = 0;
+
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolStart = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t poolDone = PTHREAD_COND_INITIALIZER;
+// One parallel run at a time, and no resize during a run
+static pthread_mutex_t runMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void* worker_thread(void* arg) {
+    DecodeWorker* worker = arg;
+    DecodeCandidate* out = workerCandidates[worker - workers];
+
+    pthread_mutex_lock(&poolMutex);
+    for (;;) {
+        while (!poolStopping && worker->generation == runGeneration)
+            pthread_cond_wait(&poolStart, &poolMutex);
+        if (poolStopping)
+            break;
+        worker->generation = runGeneration;
+        pthread_mutex_unlock(&poolMutex);
+
+        worker->count = worker->first < worker->end
+            ? runConfig->scan(runConfig, runTensor, worker->first, worker->end, out, runCapacity)
+            : 0;
+
+        pthread_mutex_lock(&poolMutex);
+        if (--runPending == 0)
+            pthread_cond_signal(&poolDone);
+    }
+    pthread_mutex_unlock(&poolMutex);
+    return NULL;
+}
+
+static void stop_workers(void) {
+    pthread_mutex_lock(&poolMutex);
+    poolStopping = 1;
+    pthread_cond_broadcast(&poolStart);
+    pthread_mutex_unlock(&poolMutex);
+    for (unsigned i = 0; i < workerCount; i++)
+        pthread_join(workers[i].thread, NULL);
+    poolStopping = 0;
+    workerCount = 0;
+}
+
+unsigned model_decode_threads(unsigned threads) {
+    if (threads < 1)
+        threads = 1;
+    if (threads > MODEL_DECODE_MAX_THREADS)
+        threads = MODEL_DECODE_MAX_THREADS;
+
+    pthread_mutex_lock(&runMutex);
+    if (threads != workerCount + 1) {
+        stop_workers();
+        while (workerCount + 1 < threads) {
+            DecodeWorker* worker = &workers[workerCount];
+            worker->generation = runGeneration;
+            if (pthread_create(&worker->thread, NULL, worker_thread, worker) != 0) {
+                syslog(LOG_WARNING, "model_decode_threads: Unable to start decode worker %u", workerCount + 1);
+                break;
+            }
+            workerCount++;
+        }
+    }
+    threads = workerCount + 1;
+    pthread_mutex_unlock(&runMutex);
+    return threads;
+}
+
+void model_decode_cleanup(void) {
+    model_decode_threads(1);
+}
+
+unsigned model_decode(const DecoderConfig* config,
+                      const uint8_t* tensor,
+                      DecodeCandidate* out,
+                      unsigned capacity)
+{
+    if (!config || !config->scan || !tensor || !out || capacity == 0)
+        return 0;
+
+    // Serial when there is no pool, the tensor is small or another thread
+    // is already using the pool
+    const unsigned boxes = config->boxes;
+    if (workerCount == 0 || boxes < 2 * MODEL_DECODE_MIN_RANGE || pthread_mutex_trylock(&runMutex) != 0)
+        return config->scan(config, tensor, 0, boxes, out, capacity);
+
+    unsigned threads = workerCount + 1;
+    if (threads > boxes / MODEL_DECODE_MIN_RANGE)
+        threads = boxes / MODEL_DECODE_MIN_RANGE;
+    unsigned range = (boxes + threads - 1) / threads;
+    range = (range + MODEL_DECODE_ALIGN - 1) / MODEL_DECODE_ALIGN * MODEL_DECODE_ALIGN;
+
+    pthread_mutex_lock(&poolMutex);
+    runConfig = config;
+    runTensor = tensor;
+    runCapacity = capacity < MODEL_DECODE_WORKER_CANDIDATES ? capacity : MODEL_DECODE_WORKER_CANDIDATES;
+    for (unsigned i = 0; i < workerCount; i++) {
+        unsigned first = (i + 1) * range;
+        workers[i].first = first < boxes ? first : boxes;
+        workers[i].end = first + range < boxes ? first + range : boxes;
+    }
+    runPending = workerCount;
+    runGeneration++;
+    pthread_cond_broadcast(&poolStart);
+    pthread_mutex_unlock(&poolMutex);
+
+    unsigned count = config->scan(config, tensor, 0, range < boxes ? range : boxes, out, capacity);
+
+    pthread_mutex_lock(&poolMutex);
+    while (runPending > 0)
+        pthread_cond_wait(&poolDone, &poolMutex);
+    pthread_mutex_unlock(&poolMutex);
+
+    // Merge in box order, so the result is the same as a serial scan
+    for (unsigned i = 0; i < workerCount && count < capacity; i++) {
+        unsigned n = workers[i].count;
+        if (n > capacity - count)
+            n = capacity - count;
+        memcpy(out + count, workerCandidates[i], n * sizeof(DecodeCandidate));
+        count += n;
+    }
+    pthread_mutex_unlock(&runMutex);
+    return count;
+}
+
+// Value that would be at index k if values were sorted from high to low
+static float select_descending(float* values, unsigned count, unsigned k) {
+    unsigned left = 0, right = count - 1;
+    while (left < right) {
+        float pivot = values[left + (right - left) / 2];
+        unsigned i = left, j = right;
+        while (i <= j) {
+            while (values[i] > pivot) i++;
+            while (values[j] < pivot) j--;
+            if (i <= j) {
+                float swap = values[i];
+                values[i] = values[j];
+                values[j] = swap;
+                i++;
+                if (j == 0)
+                    break;
+                j--;
+            }
+        }
+        if (k <= j)
+            right = j;
+        else if (k >= i)
+            left = i;
+        else
+            break;
+    }
+    return values[k];
+}
+
+unsigned model_decode_select(DecodeCandidate* candidates, unsigned count, unsigned keep, float* scratch) {
+    if (count <= keep)
+        return count;
+    if (keep == 0)
+        return 0;
+    for (unsigned i = 0; i < count; i++)
+        scratch[i] = candidates[i].confidence;
+    float threshold = select_descending(scratch, count, keep - 1);
+
+    unsigned above = 0;
+    for (unsigned i = 0; i < count; i++)
+        above += candidates[i].confidence > threshold;
+    unsigned ties = keep - above;
+    unsigned kept = 0;
+    for (unsigned i = 0; i < count; i++) {
+        float c = candidates[i].confidence;
+        if (c > threshold || (c == threshold && ties > 0)) {
+            if (c == threshold)
+                ties--;
+            candidates[kept++] = candidates[i];
+        }
+    }
+    return kept;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file model_decode.h
+ * @brief Quantized-domain decoder for the YOLO output tensor.
+ *
+ * The objectness and confidence thresholds are converted to the model's
+ * quantized domain once (model_decode_setup). The per-frame scan then rejects
+ * boxes with integer compares (NEON on aarch64, scalar elsewhere) and finds
+ * the class argmax without dequantizing. Only surviving boxes are converted
+ * to float.
+ *
+ * Supported output tensors (model.json):
+ *   - "outputLayout": "boxes"       [boxes][channels], YOLOv5 style (default)
+ *   - "outputLayout": "channels"    [channels][boxes], YOLOv8/11 anchor-free
+ *   - "outputType": "uint8" | "int8"
+ *   - "outputObjectness": true | false
+ *                                   Channel 4 is objectness. Default true for
+ *                                   "boxes" and false for "channels".
+ * The channels are cx, cy, w, h (normalized 0..1), then objectness if
+ * present, then the class scores. "quant" and "zeroPoint" apply to all
+ * values. Setup picks one scan function for the layout, type and objectness,
+ * so the per-box code has no format branches.
+ *
+ * Large tensors can be split over a pool of worker threads
+ * (model_decode_threads()). Each thread scans one aligned box range into its
+ * own buffer, and the buffers are merged in box order, so the candidates are
+ * the same as with one thread.
+ */
+
+#ifndef MODEL_DECODE_H
+#define MODEL_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Largest box stride (channels) handled by the vector scan of the "boxes"
+ * layout. Models with more classes use the scalar scan.
+ */
+#define MODEL_DECODE_MAX_STRIDE 133
+
+/** Most threads, including the caller, that share one model_decode() call. */
+#define MODEL_DECODE_MAX_THREADS 4
+
+/** Fewest boxes per thread. Smaller tensors are scanned on the calling thread. */
+#define MODEL_DECODE_MIN_RANGE 8192
+
+/**
+ * @brief A box that passed objectness and confidence thresholds.
+ *
+ * Coordinates are normalized 0..1, x/y is the top left corner.
+ */
+typedef struct {
+    float x, y, w, h;
+    float confidence;           ///< class score * objectness, 0..1
+    int classId;
+} DecodeCandidate;
+
+typedef enum {
+    MODEL_LAYOUT_BOXES = 0,     ///< [boxes][channels]
+    MODEL_LAYOUT_CHANNELS       ///< [channels][boxes]
+} DecoderLayout;
+
+/**
+ * @brief Output tensor format, from model.json (model_decode_format()).
+ */
+typedef struct {
+    DecoderLayout layout;
+    int isSigned;               ///< int8 values instead of uint8
+    int objectness;             ///< Channel 4 is objectness
+} DecoderFormat;
+
+typedef struct DecoderConfig DecoderConfig;
+
+/** Scan boxes [first, end) of a tensor. */
+typedef unsigned (*DecoderScan)(const DecoderConfig* config, const uint8_t* tensor,
+                                unsigned first, unsigned end,
+                                DecodeCandidate* out, unsigned capacity);
+
+/**
+ * @brief Decoder configuration, computed once from model.json.
+ *
+ * Raw values are compared in the unsigned domain; int8 values are flipped
+ * (xor 0x80) and the zero point moved by 128, so the thresholds and the
+ * argmax are the same for both types.
+ */
+struct DecoderConfig {
+    DecoderFormat format;
+    unsigned boxes;
+    unsigned classes;
+    unsigned channels;          ///< 4 + objectness + classes
+    unsigned stride;            ///< Bytes per box ("boxes" layout), = channels
+    size_t tensorSize;          ///< boxes * channels bytes
+    float quant;
+    float zeroPoint;            ///< In the unsigned domain
+    uint8_t flip;               ///< 0x80 for int8, else 0
+    float objectnessThreshold;
+    float confidenceThreshold;
+    uint8_t objectnessQ;        ///< Smallest raw objectness that passes objectnessThreshold
+    uint8_t classQ;             ///< Smallest raw class score that can pass confidenceThreshold
+    DecoderScan scan;           ///< Scan for this format
+    unsigned gateStride;        ///< Stride of gateMask, 0 if the vector scan is not used
+    uint8_t gateMask[MODEL_DECODE_MAX_STRIDE][16];  ///< 0xFF at the gated value of each box in a 16-box block
+};
+
+/**
+ * @brief Read the output tensor format of a model.
+ *
+ * @param model  model.json, or the "presence" object in it.
+ * @param format Format to fill in; the default is YOLOv5 ("boxes", uint8, objectness).
+ * @return 1 on success, 0 on an unknown layout or type.
+ */
+int model_decode_format(const cJSON* model, DecoderFormat* format);
+
+/**
+ * @brief Compute the quantized thresholds and pick the scan for a model.
+ *
+ * @param config              Decoder configuration to fill in.
+ * @param format              Output tensor format, NULL for YOLOv5 uint8.
+ * @param boxes               Number of boxes in the output tensor.
+ * @param classes             Number of classes per box.
+ * @param quant               Output tensor scale (must be > 0).
+ * @param zeroPoint           Output tensor zero point.
+ * @param objectnessThreshold Minimum objectness, 0..1 (unused without objectness).
+ * @param confidenceThreshold Minimum class confidence (score * objectness), 0..1.
+ * @return 1 on success, 0 on invalid parameters.
+ */
+int model_decode_setup(DecoderConfig* config,
+                       const DecoderFormat* format,
+                       unsigned boxes,
+                       unsigned classes,
+                       float quant,
+                       float zeroPoint,
+                       float objectnessThreshold,
+                       float confidenceThreshold);
+
+/**
+ * @brief Start or resize the decode worker pool.
+ *
+ * The calling thread of model_decode() scans the first range itself, so
+ * 1 stops the pool. Waits for a decode in progress.
+ *
+ * @param threads Threads per decode, 1..MODEL_DECODE_MAX_THREADS.
+ * @return Threads in use; fewer if a worker could not be started.
+ */
+unsigned model_decode_threads(unsigned threads);
+
+/** @brief Stop the worker pool. */
+void model_decode_cleanup(void);
+
+/**
+ * @brief Scan the output tensor and collect candidates.
+ *
+ * Uses the worker pool for tensors of at least 2 * MODEL_DECODE_MIN_RANGE
+ * boxes. A call made while another thread is using the pool scans serially.
+ *
+ * @param config    Configuration from model_decode_setup().
+ * @param tensor    Output tensor, config->tensorSize bytes.
+ * @param out       Candidate buffer.
+ * @param capacity  Number of entries in out. Further candidates are dropped.
+ * @return Number of candidates written to out.
+ */
+unsigned model_decode(const DecoderConfig* config,
+                      const uint8_t* tensor,
+                      DecodeCandidate* out,
+                      unsigned capacity);
+
+/**
+ * @brief Keep the highest-confidence candidates.
+ *
+ * Finds the keep-th highest confidence with a partial select and then keeps
+ * the candidates above it, and as many equal to it as fit, in their original
+ * order, so NMS sees them as before.
+ *
+ * @param candidates Candidates from model_decode(), compacted in place.
+ * @param count      Number of candidates.
+ * @param keep       Candidates to keep.
+ * @param scratch    count floats of scratch space.
+ * @return Number of candidates kept, min(count, keep).
+ */
+unsigned model_decode_select(DecodeCandidate* candidates, unsigned count, unsigned keep, float* scratch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODEL_DECODE_H
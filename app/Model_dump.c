@@ -0,0 +1,147 @@
+/**
+ * @file model_dump.c
+ * @brief Implementation of the output tensor dump.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <errno.h>
+#include "ACAP.h"
+#include "Output_helpers.h"
+#include "Model_dump.h"
+
+#define DUMP_FOLDER "/var/spool/storage/SD_DISK/detectx"
+#define DUMP_DEFAULT_FRAMES 100
+#define DUMP_MAX_FRAMES 10000
+
+static cJSON* model = NULL;
+static ModelDumpHeader header;
+static size_t tensorSize = 0;
+static FILE* file = NULL;
+static char path[128] = "";
+static unsigned requested = 0;      // Set by the HTTP thread, taken by the main loop
+static unsigned remaining = 0;      // Main loop only
+static unsigned written = 0;
+static int registered = 0;
+
+static void close_dump(void) {
+    if (!file)
+        return;
+    if (fclose(file) != 0)
+        syslog(LOG_WARNING, "model_dump: Closing %s.bin failed: %s", path, strerror(errno));
+    else
+        syslog(LOG_INFO, "model_dump: %u frames written to %s.bin", written, path);
+    file = NULL;
+    remaining = 0;
+}
+
+static int write_sidecar(void) {
+    char name[sizeof(path) + 8];
+    snprintf(name, sizeof(name), "%s.json", path);
+    cJSON* sidecar = cJSON_CreateObject();
+    cJSON_AddItemReferenceToObject(sidecar, "model", model);
+    // A copy, since the settings endpoint may replace parts of the tree meanwhile
+    cJSON* settings = ACAP_Copy_Config("settings");
+    if (settings)
+        cJSON_AddItemToObject(sidecar, "settings", settings);
+    char* text = cJSON_Print(sidecar);
+    cJSON_Delete(sidecar);
+    if (!text)
+        return 0;
+    FILE* f = fopen(name, "w");
+    int ok = f && fputs(text, f) >= 0;
+    if (f && fclose(f) != 0)
+        ok = 0;
+    free(text);
+    if (!ok)
+        syslog(LOG_WARNING, "model_dump: Unable to write %s: %s", name, strerror(errno));
+    return ok;
+}
+
+static void open_dump(unsigned frames, double timestamp) {
+    if (!ensure_sd_directory())
+        return;
+    snprintf(path, sizeof(path), "%s/dump-%.0f", DUMP_FOLDER, timestamp);
+    if (!write_sidecar())
+        return;
+    char name[sizeof(path) + 8];
+    snprintf(name, sizeof(name), "%s.bin", path);
+    file = fopen(name, "wb");
+    if (!file || fwrite(&header, sizeof(header), 1, file) != 1) {
+        syslog(LOG_WARNING, "model_dump: Unable to write %s: %s", name, strerror(errno));
+        if (file) fclose(file);
+        file = NULL;
+        return;
+    }
+    remaining = frames;
+    written = 0;
+}
+
+void model_dump_frame(const uint8_t* tensor, double timestamp) {
+    unsigned frames = __atomic_exchange_n(&requested, 0, __ATOMIC_ACQUIRE);
+    if (frames) {
+        close_dump();
+        open_dump(frames, timestamp);
+    }
+    if (!file || !tensor)
+        return;
+
+    if (fwrite(&timestamp, sizeof(timestamp), 1, file) != 1 ||
+        fwrite(tensor, tensorSize, 1, file) != 1) {
+        syslog(LOG_WARNING, "model_dump: Write failed after %u frames: %s", written, strerror(errno));
+        close_dump();
+        return;
+    }
+    written++;
+    if (--remaining == 0)
+        close_dump();
+}
+
+static void dump_http_callback(const ACAP_HTTP_Response response, const ACAP_HTTP_Request request) {
+    const char* frames = ACAP_HTTP_Request_Param(request, "frames");
+    if (frames) {
+        int n = atoi(frames);
+        if (n <= 0)
+            n = DUMP_DEFAULT_FRAMES;
+        if (n > DUMP_MAX_FRAMES)
+            n = DUMP_MAX_FRAMES;
+        __atomic_store_n(&requested, (unsigned)n, __ATOMIC_RELEASE);
+        ACAP_HTTP_Header_JSON(response);
+        ACAP_HTTP_Respond_String(response, "{\"frames\":%d,\"folder\":\"%s\"}", n, DUMP_FOLDER);
+        return;
+    }
+    // Read without a lock; a value from a dump that is just switching is fine here
+    ACAP_HTTP_Header_JSON(response);
+    ACAP_HTTP_Respond_String(response, "{\"pending\":%u,\"file\":\"%s\",\"written\":%u}",
+                             __atomic_load_n(&requested, __ATOMIC_RELAXED), path, written);
+}
+
+void model_dump_init(cJSON* modelConfig, const DecoderConfig* decoder) {
+    model = modelConfig;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MODEL_DUMP_MAGIC, sizeof(header.magic));
+    header.version = MODEL_DUMP_VERSION;
+    header.boxes = decoder->boxes;
+    header.classes = decoder->classes;
+    header.quant = decoder->quant;
+    // The decoder keeps the zero point of int8 tensors in the unsigned domain
+    header.zeroPoint = decoder->format.isSigned ? decoder->zeroPoint - 128 : decoder->zeroPoint;
+    if (decoder->format.layout == MODEL_LAYOUT_CHANNELS)
+        header.format |= MODEL_DUMP_CHANNELS;
+    if (decoder->format.isSigned)
+        header.format |= MODEL_DUMP_SIGNED;
+    if (!decoder->format.objectness)
+        header.format |= MODEL_DUMP_NO_OBJECTNESS;
+    tensorSize = decoder->tensorSize;
+    if (!registered) {
+        ACAP_HTTP_Node("dump", dump_http_callback);
+        registered = 1;
+    }
+}
+
+void model_dump_cleanup(void) {
+    close_dump();
+    model = NULL;
+}
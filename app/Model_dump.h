@@ -0,0 +1,77 @@
+/**
+ * @file model_dump.h
+ * @brief Dump raw output tensors to the SD card as replay bench input.
+ *
+ * HTTP API (node "dump"):
+ *   - dump?frames=N   Write the next N output tensors (default 100, max 10000)
+ *   - dump            State of the current or last dump
+ *
+ * Files in /var/spool/storage/SD_DISK/detectx:
+ *   - dump-<epoch>.bin   ModelDumpHeader, then per frame a double timestamp
+ *                        (epoch ms) followed by the output tensor, boxes *
+ *                        channels bytes in the layout given by 'format'
+ *   - dump-<epoch>.json  {"model": model.json, "settings": settings}
+ *
+ * The tensors are written on the main loop from the decode step, so a dump
+ * costs one SD write per frame while it runs. Feed the pair to the host
+ * bench with "make replay REPLAY=dump-<epoch>".
+ */
+
+#ifndef MODEL_DUMP_H
+#define MODEL_DUMP_H
+
+#include <stdint.h>
+#include "cJSON.h"
+#include "Model_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MODEL_DUMP_MAGIC "DXTENSOR"
+#define MODEL_DUMP_VERSION 1
+
+// ModelDumpHeader.format; 0 is [boxes][5 + classes] uint8 (YOLOv5)
+#define MODEL_DUMP_CHANNELS       0x1   ///< [channels][boxes]
+#define MODEL_DUMP_SIGNED         0x2   ///< int8 values
+#define MODEL_DUMP_NO_OBJECTNESS  0x4   ///< No objectness channel
+
+/**
+ * @brief File header of a tensor dump (host byte order).
+ */
+typedef struct {
+    char magic[8];              ///< MODEL_DUMP_MAGIC, not terminated
+    uint32_t version;           ///< MODEL_DUMP_VERSION
+    uint32_t boxes;
+    uint32_t classes;
+    float quant;
+    float zeroPoint;
+    uint32_t format;            ///< MODEL_DUMP_* flags (reserved and 0 in older dumps)
+} ModelDumpHeader;
+
+/**
+ * @brief Register the "dump" node for the current model.
+ *
+ * @param modelConfig model.json, referenced (not copied) in the sidecar.
+ * @param decoder     Decoder of the model, for the tensor size and format.
+ */
+void model_dump_init(cJSON* modelConfig, const DecoderConfig* decoder);
+
+/**
+ * @brief Write the tensor if a dump is pending. Main loop only.
+ *
+ * @param tensor    Output tensor, decoder->tensorSize bytes.
+ * @param timestamp Frame time, epoch ms.
+ */
+void model_dump_frame(const uint8_t* tensor, double timestamp);
+
+/**
+ * @brief Close a dump in progress.
+ */
+void model_dump_cleanup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODEL_DUMP_H
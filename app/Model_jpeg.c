@@ -0,0 +1,188 @@
+/**
+ * @file model_jpeg.c
+ * @brief Implementation of the NV12 crop encoder.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <turbojpeg.h>
+#include "Model_jpeg.h"
+
+static tjhandle compressor = NULL;
+static tjhandle transformer = NULL;
+static unsigned char* chromaU = NULL;
+static unsigned char* chromaV = NULL;
+static size_t chromaCapacity = 0;
+
+int model_jpeg_init(void)
+{
+    if (compressor)
+        return 1;
+    compressor = tjInitCompress();
+    if (!compressor) {
+        syslog(LOG_WARNING, "model_jpeg_init: Unable to create JPEG compressor");
+        return 0;
+    }
+    return 1;
+}
+
+void model_jpeg_cleanup(void)
+{
+    if (compressor)
+        tjDestroy(compressor);
+    compressor = NULL;
+    if (transformer)
+        tjDestroy(transformer);
+    transformer = NULL;
+    free(chromaU);
+    free(chromaV);
+    chromaU = chromaV = NULL;
+    chromaCapacity = 0;
+}
+
+// Output buffer of at least 'needed' bytes, replaced only when it is too small
+static int reserve(unsigned long needed, unsigned char** buffer, unsigned long* capacity)
+{
+    if (needed <= *capacity)
+        return 1;
+    model_jpeg_free(buffer, capacity);
+    *buffer = tjAlloc((int)needed);
+    if (!*buffer) {
+        syslog(LOG_WARNING, "model_jpeg: Unable to allocate %lu bytes", needed);
+        return 0;
+    }
+    *capacity = needed;
+    return 1;
+}
+
+int model_jpeg_encode_nv12(const uint8_t* nv12,
+                           int width,
+                           int height,
+                           int stride,
+                           int x,
+                           int y,
+                           int w,
+                           int h,
+                           int quality,
+                           unsigned char** buffer,
+                           unsigned long* capacity,
+                           unsigned long* size)
+{
+    if (size)
+        *size = 0;
+    if (!nv12 || !buffer || !capacity || !size || !model_jpeg_init())
+        return 0;
+    if ((x & 1) || (y & 1) || x < 0 || y < 0 || w < 1 || h < 1 || x + w > width || y + h > height) {
+        syslog(LOG_WARNING, "model_jpeg_encode_nv12: Invalid region %d,%d %dx%d", x, y, w, h);
+        return 0;
+    }
+    if (quality < 1) quality = 1;
+    if (quality > 100) quality = 100;
+
+    // Split the interleaved UV of the region into planar U and V
+    int chromaW = (w + 1) / 2;
+    int chromaH = (h + 1) / 2;
+    size_t chromaSize = (size_t)chromaW * chromaH;
+    if (chromaSize > chromaCapacity) {
+        unsigned char* u = realloc(chromaU, chromaSize);
+        if (u) chromaU = u;
+        unsigned char* v = realloc(chromaV, chromaSize);
+        if (v) chromaV = v;
+        if (!u || !v) {
+            syslog(LOG_WARNING, "model_jpeg_encode_nv12: Out of memory");
+            return 0;
+        }
+        chromaCapacity = chromaSize;
+    }
+    const uint8_t* uv = nv12 + (size_t)stride * height + (size_t)(y / 2) * stride + x;
+    for (int row = 0; row < chromaH; row++) {
+        const uint8_t* src = uv + (size_t)row * stride;
+        unsigned char* u = chromaU + (size_t)row * chromaW;
+        unsigned char* v = chromaV + (size_t)row * chromaW;
+        for (int col = 0; col < chromaW; col++) {
+            u[col] = src[2 * col];
+            v[col] = src[2 * col + 1];
+        }
+    }
+
+    if (!reserve(tjBufSize(w, h, TJSAMP_420), buffer, capacity))
+        return 0;
+
+    const unsigned char* planes[3] = { nv12 + (size_t)y * stride + x, chromaU, chromaV };
+    int strides[3] = { stride, chromaW, chromaW };
+    unsigned long jpegSize = *capacity;
+    if (tjCompressFromYUVPlanes(compressor, planes, w, strides, h, TJSAMP_420,
+                                buffer, &jpegSize, quality, TJFLAG_NOREALLOC | TJFLAG_FASTDCT) != 0) {
+        syslog(LOG_WARNING, "model_jpeg_encode_nv12: %s", tjGetErrorStr2(compressor));
+        return 0;
+    }
+    *size = jpegSize;
+    return 1;
+}
+
+int model_jpeg_crop(const uint8_t* jpeg,
+                    unsigned long jpegSize,
+                    int width,
+                    int height,
+                    int* x,
+                    int* y,
+                    int* w,
+                    int* h,
+                    unsigned char** buffer,
+                    unsigned long* capacity,
+                    unsigned long* size)
+{
+    if (size)
+        *size = 0;
+    if (!jpeg || !jpegSize || !x || !y || !w || !h || !buffer || !capacity || !size)
+        return 0;
+    if (!transformer && !(transformer = tjInitTransform())) {
+        syslog(LOG_WARNING, "model_jpeg_crop: Unable to create JPEG transformer");
+        return 0;
+    }
+    int frameW = 0, frameH = 0, subsamp = -1, colorspace = 0;
+    if (tjDecompressHeader3(transformer, jpeg, jpegSize, &frameW, &frameH, &subsamp, &colorspace) != 0 ||
+        subsamp < 0 || subsamp >= TJ_NUMSAMP) {
+        syslog(LOG_WARNING, "model_jpeg_crop: %s", tjGetErrorStr2(transformer));
+        return 0;
+    }
+    if (frameW != width || frameH != height || *x < 0 || *y < 0 || *w < 1 || *h < 1 ||
+        *x + *w > width || *y + *h > height)
+        return 0;
+
+    int snapX = *x - *x % tjMCUWidth[subsamp];
+    int snapY = *y - *y % tjMCUHeight[subsamp];
+    tjtransform transform;
+    memset(&transform, 0, sizeof(transform));
+    transform.r.x = snapX;
+    transform.r.y = snapY;
+    transform.r.w = *x + *w - snapX;
+    transform.r.h = *y + *h - snapY;
+    transform.op = TJXOP_NONE;
+    transform.options = TJXOPT_CROP | TJXOPT_COPYNONE;
+
+    if (!reserve(tjBufSize(transform.r.w, transform.r.h, subsamp), buffer, capacity))
+        return 0;
+    unsigned long cropSize = *capacity;
+    if (tjTransform(transformer, jpeg, jpegSize, 1, buffer, &cropSize, &transform, TJFLAG_NOREALLOC) != 0) {
+        syslog(LOG_WARNING, "model_jpeg_crop: %s", tjGetErrorStr2(transformer));
+        return 0;
+    }
+    *x = snapX;
+    *y = snapY;
+    *w = transform.r.w;
+    *h = transform.r.h;
+    *size = cropSize;
+    return 1;
+}
+
+void model_jpeg_free(unsigned char** buffer, unsigned long* capacity)
+{
+    if (buffer && *buffer)
+        tjFree(*buffer);
+    if (buffer)
+        *buffer = NULL;
+    if (capacity)
+        *capacity = 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file model_jpeg.h
+ * @brief Crop encoder: JPEG directly from an NV12 frame with one persistent turbojpeg handle.
+ *
+ * The luma of the crop is read in place from the frame (row stride of the frame).
+ * turbojpeg only takes planar chroma, so the interleaved UV of the crop region is
+ * split into two small scratch planes (a quarter of the crop area each).
+ * No RGB conversion is done. Output buffers are owned by the caller and grown
+ * with tjBufSize() only when a larger crop is encoded, so they are reused
+ * across frames.
+ *
+ * model_jpeg_crop() cuts a region out of a camera encoded JPEG with a lossless
+ * tjTransform() instead: the DCT coefficients are copied, nothing is decoded
+ * or encoded. The region is widened to the JPEG's MCU grid.
+ */
+
+#ifndef MODEL_JPEG_H
+#define MODEL_JPEG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Create the turbojpeg compressor.
+ *
+ * Called by the first encode, so apps without crops never create it.
+ * @return 1 on success, 0 on failure.
+ */
+int model_jpeg_init(void);
+
+/**
+ * @brief Destroy the compressor and the chroma scratch planes.
+ */
+void model_jpeg_cleanup(void);
+
+/**
+ * @brief Encode a region of an NV12 frame as JPEG (4:2:0).
+ *
+ * @param nv12      Start of the frame (Y plane followed by interleaved UV plane).
+ * @param width     Frame width in pixels.
+ * @param height    Frame height in pixels.
+ * @param stride    Bytes per row in both planes.
+ * @param x,y       Top left corner of the region. Must be even.
+ * @param w,h       Region size in pixels; region must be inside the frame.
+ * @param quality   JPEG quality 1..100.
+ * @param buffer    In/out: output buffer from tjAlloc(), or NULL. Replaced if too small.
+ * @param capacity  In/out: allocated size of *buffer.
+ * @param size      Out: JPEG size in bytes.
+ * @return 1 on success, 0 on failure.
+ */
+int model_jpeg_encode_nv12(const uint8_t* nv12,
+                           int width,
+                           int height,
+                           int stride,
+                           int x,
+                           int y,
+                           int w,
+                           int h,
+                           int quality,
+                           unsigned char** buffer,
+                           unsigned long* capacity,
+                           unsigned long* size);
+
+/**
+ * @brief Crop a JPEG frame without re-encoding it (tjTransform, TJXOPT_CROP).
+ *
+ * The top left corner is moved up and left to the MCU grid (8 or 16 pixels);
+ * the bottom right corner is kept. Quality is that of the source JPEG.
+ *
+ * @param jpeg       JPEG frame.
+ * @param jpegSize   Size of jpeg in bytes.
+ * @param width      Expected frame width; other sizes fail.
+ * @param height     Expected frame height.
+ * @param x,y        In/out: top left corner of the region, snapped to the MCU grid.
+ * @param w,h        In/out: region size in pixels, widened by the snap.
+ * @param buffer     In/out: output buffer from tjAlloc(), or NULL. Replaced if too small.
+ * @param capacity   In/out: allocated size of *buffer.
+ * @param size       Out: JPEG size in bytes.
+ * @return 1 on success, 0 on failure.
+ */
+int model_jpeg_crop(const uint8_t* jpeg,
+                    unsigned long jpegSize,
+                    int width,
+                    int height,
+                    int* x,
+                    int* y,
+                    int* w,
+                    int* h,
+                    unsigned char** buffer,
+                    unsigned long* capacity,
+                    unsigned long* size);
+
+/**
+ * @brief Free a buffer returned by model_jpeg_encode_nv12() or model_jpeg_crop().
+ */
+void model_jpeg_free(unsigned char** buffer, unsigned long* capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODEL_JPEG_H
@@ -0,0 +1,95 @@
+/**
+ * @file model_nms.c
+ * @brief Implementation of the sort-based non-maximum suppression.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "Model_nms.h"
+
+typedef struct {
+    float c;
+    unsigned index;
+} NmsOrder;
+
+static NmsOrder order[DETECTIONS_MAX];
+static unsigned char keep[DETECTIONS_MAX];
+
+// Corners and area of the boxes kept so far
+static float keptX1[DETECTIONS_MAX];
+static float keptY1[DETECTIONS_MAX];
+static float keptX2[DETECTIONS_MAX];
+static float keptY2[DETECTIONS_MAX];
+static float keptArea[DETECTIONS_MAX];
+static int keptLabel[DETECTIONS_MAX];
+
+// Highest confidence first, ties in list order so the result is deterministic
+static int compare_order(const void* a, const void* b) {
+    const NmsOrder* oa = (const NmsOrder*)a;
+    const NmsOrder* ob = (const NmsOrder*)b;
+    if (oa->c > ob->c) return -1;
+    if (oa->c < ob->c) return 1;
+    return (oa->index > ob->index) - (oa->index < ob->index);
+}
+
+unsigned model_nms(const NmsConfig* config, DetectionList* list)
+{
+    if (!config || !list)
+        return 0;
+
+    unsigned items = list->count;
+    unsigned maxDetections = config->maxDetections;
+    if (maxDetections == 0 || maxDetections > DETECTIONS_MAX)
+        maxDetections = DETECTIONS_MAX;
+    if (items < 2)
+        return items;
+
+    for (unsigned i = 0; i < items; i++) {
+        order[i].c = list->c[i];
+        order[i].index = i;
+    }
+    qsort(order, items, sizeof(NmsOrder), compare_order);
+    memset(keep, 0, items);
+
+    unsigned kept = 0;
+    const float threshold = config->iouThreshold;
+    for (unsigned n = 0; n < items && kept < maxDetections; n++) {
+        unsigned i = order[n].index;
+        float x1 = list->x[i];
+        float y1 = list->y[i];
+        float x2 = x1 + list->w[i];
+        float y2 = y1 + list->h[i];
+        float area = list->w[i] * list->h[i];
+        int label = list->label[i];
+
+        int suppressed = 0;
+        for (unsigned k = 0; k < kept; k++) {
+            if (config->perClass && keptLabel[k] != label)
+                continue;
+            float iw = (x2 < keptX2[k] ? x2 : keptX2[k]) - (x1 > keptX1[k] ? x1 : keptX1[k]);
+            float ih = (y2 < keptY2[k] ? y2 : keptY2[k]) - (y1 > keptY1[k] ? y1 : keptY1[k]);
+            if (iw <= 0 || ih <= 0)
+                continue;
+            float inter = iw * ih;
+            // inter / union > threshold, without the division
+            if (inter > threshold * (area + keptArea[k] - inter)) {
+                suppressed = 1;
+                break;
+            }
+        }
+        if (suppressed)
+            continue;
+
+        keptX1[kept] = x1;
+        keptY1[kept] = y1;
+        keptX2[kept] = x2;
+        keptY2[kept] = y2;
+        keptArea[kept] = area;
+        keptLabel[kept] = label;
+        kept++;
+        keep[i] = 1;
+    }
+
+    Detections_Compact(list, keep);
+    return kept;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file model_nms.h
+ * @brief Sort-based non-maximum suppression on a DetectionList.
+ *
+ * Candidates are ordered by confidence once and then compared only against
+ * boxes that have already been kept, so the cost is O(n log n + n * kept)
+ * instead of comparing every pair. Suppression is either per class or across
+ * classes, and stops as soon as maxDetections boxes have been kept.
+ */
+
+#ifndef MODEL_NMS_H
+#define MODEL_NMS_H
+
+#include "Detections.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief NMS configuration, read from model.json.
+ *
+ *   - "nms":           IoU threshold (iouThreshold)
+ *   - "nmsMode":       "agnostic" (default) or "class"
+ *   - "maxDetections": cap on kept boxes (default MODEL_NMS_DEFAULT_MAX)
+ */
+typedef struct {
+    float iouThreshold;         ///< Boxes with IoU above this are suppressed
+    int perClass;               ///< 1: only suppress boxes with the same label
+    unsigned maxDetections;     ///< Stop after this many boxes are kept
+} NmsConfig;
+
+#define MODEL_NMS_DEFAULT_MAX 100
+
+/**
+ * @brief Suppress overlapping detections in place.
+ *
+ * Boxes use x/y as top left corner. Kept entries stay in their original order.
+ *
+ * @param config NMS configuration.
+ * @param list   Detection list to filter.
+ * @return Number of kept detections.
+ */
+unsigned model_nms(const NmsConfig* config, DetectionList* list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODEL_NMS_H
@@ -0,0 +1,271 @@
+/**
+ * @file model_presence.c
+ * @brief Implementation of the presence stage.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "Model_decode.h"
+#include "Model_presence.h"
+
+#define PRESENCE_MAX_CANDIDATES 64
+
+static larodConnection* conn = NULL;
+static larodMap* ppMap = NULL;
+static larodModel* ppModel = NULL;
+static larodModel* model = NULL;
+static int modelFd = -1;
+static larodTensor** ppInputTensors = NULL;
+static larodTensor** ppOutputTensors = NULL;
+static larodTensor** inputTensors = NULL;
+static larodTensor** outputTensors = NULL;
+static size_t ppInputs = 1, ppOutputs = 1, inputs = 1, outputs = 1;
+static larodJobRequest* ppReq = NULL;
+static larodJobRequest* infReq = NULL;
+static larodTensor** ppBound = NULL;
+static void* inputAddr = MAP_FAILED;
+static void* outputAddr = MAP_FAILED;
+static int inputFd = -1;
+static int outputFd = -1;
+static size_t inputSize = 0;
+static size_t outputSize = 0;
+static DecoderConfig decoder;
+static DecodeCandidate candidates[PRESENCE_MAX_CANDIDATES];
+static int active = 0;
+static int roi = 0;
+static float margin = 0.25f;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int get_int(cJSON* config, const char* name) {
+    cJSON* item = cJSON_GetObjectItem(config, name);
+    return item && cJSON_IsNumber(item) ? item->valueint : 0;
+}
+
+static double get_double(cJSON* config, const char* name, double fallback) {
+    cJSON* item = cJSON_GetObjectItem(config, name);
+    return item && cJSON_IsNumber(item) ? item->valuedouble : fallback;
+}
+
+static int map_tmp_file(const char* pattern, size_t size, void** addr, int* fd) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s", pattern);
+    *fd = mkstemp(name);
+    if (*fd < 0) {
+        syslog(LOG_WARNING, "model_presence: Unable to open temp file %s: %s", name, strerror(errno));
+        return 0;
+    }
+    unlink(name);
+    if (ftruncate(*fd, (off_t)size) < 0) {
+        syslog(LOG_WARNING, "model_presence: Unable to truncate temp file: %s", strerror(errno));
+        return 0;
+    }
+    *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+    if (*addr == MAP_FAILED) {
+        syslog(LOG_WARNING, "model_presence: Unable to mmap temp file: %s", strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+static int fail(const char* what, larodError** error) {
+    syslog(LOG_WARNING, "model_presence_setup: %s: %s", what, error && *error ? (*error)->msg : "");
+    larodClearError(error);
+    model_presence_cleanup();
+    return 0;
+}
+
+int model_presence_setup(larodConnection* connection,
+                         const larodDevice* device,
+                         cJSON* config,
+                         unsigned videoWidth,
+                         unsigned videoHeight,
+                         int initialInputFd)
+{
+    larodError* error = NULL;
+    if (!config)
+        return 1;
+
+    const char* path = cJSON_GetObjectItem(config, "path") ? cJSON_GetObjectItem(config, "path")->valuestring : NULL;
+    unsigned width = get_int(config, "modelWidth");
+    unsigned height = get_int(config, "modelHeight");
+    unsigned boxes = get_int(config, "boxes");
+    unsigned classes = get_int(config, "classes");
+    if (!path || !width || !height || !boxes || !classes) {
+        syslog(LOG_WARNING, "model_presence_setup: presence needs path, modelWidth, modelHeight, boxes and classes");
+        return 0;
+    }
+    DecoderFormat format;
+    if (!model_decode_format(config, &format)) {
+        syslog(LOG_WARNING, "model_presence_setup: Unsupported output format");
+        return 0;
+    }
+    if (!model_decode_setup(&decoder, &format, boxes, classes,
+                            get_double(config, "quant", 1), get_double(config, "zeroPoint", 0),
+                            get_double(config, "objectness", 0.25), get_double(config, "confidence", 0.3))) {
+        syslog(LOG_WARNING, "model_presence_setup: Invalid output quantization");
+        return 0;
+    }
+    roi = cJSON_IsTrue(cJSON_GetObjectItem(config, "roi"));
+    margin = get_double(config, "margin", 0.25);
+    conn = connection;
+
+    ppMap = larodCreateMap(&error);
+    if (!ppMap ||
+        !larodMapSetStr(ppMap, "image.input.format", "nv12", &error) ||
+        !larodMapSetIntArr2(ppMap, "image.input.size", videoWidth, videoHeight, &error) ||
+        !larodMapSetStr(ppMap, "image.output.format", "rgb-interleaved", &error) ||
+        !larodMapSetIntArr2(ppMap, "image.output.size", width, height, &error))
+        return fail("Failed setting preprocessing parameters", &error);
+
+    const larodDevice* ppDevice = larodGetDevice(conn, "cpu-proc", 0, &error);
+    if (!ppDevice)
+        return fail("Could not get device cpu-proc", &error);
+    ppModel = larodLoadModel(conn, -1, ppDevice, LAROD_ACCESS_PRIVATE, "", ppMap, &error);
+    if (!ppModel)
+        return fail("Unable to load preprocessing model", &error);
+
+    modelFd = open(path, O_RDONLY);
+    if (modelFd < 0) {
+        syslog(LOG_WARNING, "model_presence_setup: Could not open model %s", path);
+        return fail("Model file", NULL);
+    }
+    model = larodLoadModel(conn, modelFd, device, LAROD_ACCESS_PRIVATE, "presence", NULL, &error);
+    if (!model)
+        return fail("Unable to load model", &error);
+
+    ppInputTensors = larodCreateModelInputs(ppModel, &ppInputs, &error);
+    if (!ppInputTensors)
+        return fail("Failed retrieving preprocessing inputs", &error);
+    ppOutputTensors = larodCreateModelOutputs(ppModel, &ppOutputs, &error);
+    if (!ppOutputTensors)
+        return fail("Failed retrieving preprocessing outputs", &error);
+    inputTensors = larodCreateModelInputs(model, &inputs, &error);
+    if (!inputTensors)
+        return fail("Failed retrieving model inputs", &error);
+    outputTensors = larodCreateModelOutputs(model, &outputs, &error);
+    if (!outputTensors)
+        return fail("Failed retrieving model outputs", &error);
+
+    inputSize = (size_t)width * height * 3;
+    outputSize = decoder.tensorSize;
+    if (!map_tmp_file("/tmp/larod.presence.in-XXXXXX", inputSize, &inputAddr, &inputFd) ||
+        !map_tmp_file("/tmp/larod.presence.out-XXXXXX", outputSize, &outputAddr, &outputFd))
+        return fail("Could not allocate tensors", NULL);
+
+    // The pp output is the model input; the pp input is rebound per frame
+    if (!larodSetTensorFd(ppInputTensors[0], initialInputFd, &error) ||
+        !larodSetTensorFd(ppOutputTensors[0], inputFd, &error) ||
+        !larodSetTensorFd(inputTensors[0], inputFd, &error) ||
+        !larodSetTensorFd(outputTensors[0], outputFd, &error))
+        return fail("Failed setting tensor fd", &error);
+
+    ppReq = larodCreateJobRequest(ppModel, ppInputTensors, ppInputs, ppOutputTensors, ppOutputs, NULL, &error);
+    if (!ppReq)
+        return fail("Failed creating preprocessing job request", &error);
+    ppBound = ppInputTensors;
+    infReq = larodCreateJobRequest(model, inputTensors, inputs, outputTensors, outputs, NULL, &error);
+    if (!infReq)
+        return fail("Failed creating inference request", &error);
+
+    active = 1;
+    syslog(LOG_INFO, "model_presence_setup: Presence model %s %ux%u loaded%s", path, width, height,
+           roi ? " (ROI)" : "");
+    return 1;
+}
+
+int model_presence_active(void) {
+    return active;
+}
+
+int model_presence_roi(void) {
+    return active && roi;
+}
+
+int model_presence_run(larodTensor** frameInputs, size_t count, PresenceResult* result) {
+    larodError* error = NULL;
+    memset(result, 0, sizeof(*result));
+    if (!active)
+        return 0;
+
+    double start = now_ms();
+    if (ppBound != frameInputs) {
+        if (!larodSetJobRequestInputs(ppReq, frameInputs, count, &error)) {
+            syslog(LOG_WARNING, "model_presence_run: Unable to set preprocessing input: %s", error->msg);
+            larodClearError(&error);
+            return 0;
+        }
+        ppBound = frameInputs;
+    }
+    if (!larodRunJob(conn, ppReq, &error)) {
+        syslog(LOG_WARNING, "model_presence_run: Preprocessing failed: %s", error->msg);
+        larodClearError(&error);
+        return 0;
+    }
+    double infStart = now_ms();
+    if (lseek(outputFd, 0, SEEK_SET) == -1 || !larodRunJob(conn, infReq, &error)) {
+        syslog(LOG_WARNING, "model_presence_run: Inference failed: %s", error ? error->msg : strerror(errno));
+        larodClearError(&error);
+        return 0;
+    }
+    double end = now_ms();
+    result->ppTime = infStart - start;
+    result->infTime = end - infStart;
+
+    unsigned n = model_decode(&decoder, (const uint8_t*)outputAddr, candidates, PRESENCE_MAX_CANDIDATES);
+    if (n == 0)
+        return 1;
+
+    float x1 = 1, y1 = 1, x2 = 0, y2 = 0;
+    for (unsigned i = 0; i < n; i++) {
+        const DecodeCandidate* c = &candidates[i];
+        if (c->x < x1) x1 = c->x;
+        if (c->y < y1) y1 = c->y;
+        if (c->x + c->w > x2) x2 = c->x + c->w;
+        if (c->y + c->h > y2) y2 = c->y + c->h;
+    }
+    float mx = (x2 - x1) * margin, my = (y2 - y1) * margin;
+    result->found = 1;
+    result->x1 = x1 - mx < 0 ? 0 : x1 - mx;
+    result->y1 = y1 - my < 0 ? 0 : y1 - my;
+    result->x2 = x2 + mx > 1 ? 1 : x2 + mx;
+    result->y2 = y2 + my > 1 ? 1 : y2 + my;
+    return 1;
+}
+
+void model_presence_cleanup(void) {
+    larodError* error = NULL;
+    active = 0;
+    larodDestroyJobRequest(&ppReq);
+    larodDestroyJobRequest(&infReq);
+    ppBound = NULL;
+    if (conn) {
+        if (ppInputTensors) larodDestroyTensors(conn, &ppInputTensors, ppInputs, &error);
+        if (ppOutputTensors) larodDestroyTensors(conn, &ppOutputTensors, ppOutputs, &error);
+        if (inputTensors) larodDestroyTensors(conn, &inputTensors, inputs, &error);
+        if (outputTensors) larodDestroyTensors(conn, &outputTensors, outputs, &error);
+        larodClearError(&error);
+    }
+    if (model) larodDestroyModel(&model);
+    if (ppModel) larodDestroyModel(&ppModel);
+    if (ppMap) larodDestroyMap(&ppMap);
+    if (inputAddr != MAP_FAILED) munmap(inputAddr, inputSize);
+    if (outputAddr != MAP_FAILED) munmap(outputAddr, outputSize);
+    inputAddr = outputAddr = MAP_FAILED;
+    if (inputFd >= 0) close(inputFd);
+    if (outputFd >= 0) close(outputFd);
+    if (modelFd >= 0) close(modelFd);
+    inputFd = outputFd = modelFd = -1;
+    conn = NULL;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file model_presence.h
+ * @brief Optional presence stage that gates the main model.
+ *
+ * A small detection model declared as "presence" in model.json runs on every
+ * frame, on the same larod connection and NV12 input tensors as the main
+ * model. The main model only runs when the presence model finds an object;
+ * with "roi" set, only on the area around what was found.
+ *
+ * model.json:
+ *   "presence": {
+ *     "path": "model/presence.tflite",
+ *     "modelWidth": 320, "modelHeight": 320,
+ *     "boxes": 6300, "classes": 1,
+ *     "quant": 0.0039, "zeroPoint": 0,
+ *     "objectness": 0.25, "confidence": 0.3,
+ *     "roi": true, "margin": 0.25
+ *   }
+ * The output tensor layout is the same as the main model ([boxes][5 + classes]).
+ */
+
+#ifndef MODEL_PRESENCE_H
+#define MODEL_PRESENCE_H
+
+#include "larod.h"
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Result of one presence run.
+ */
+typedef struct {
+    int found;                  ///< 1 if any box passed the thresholds
+    float x1, y1, x2, y2;       ///< Union of the boxes found, 0..1, grown by margin
+    double ppTime;              ///< ms
+    double infTime;             ///< ms
+} PresenceResult;
+
+/**
+ * @brief Load the presence model if model.json declares one.
+ *
+ * @param conn        Connection of the main model.
+ * @param device      Inference device of the main model.
+ * @param config      model.json "presence" object, or NULL.
+ * @param videoWidth  Width of the NV12 frames.
+ * @param videoHeight Height of the NV12 frames.
+ * @param inputFd     Fd for the initial preprocessing input (the main copy buffer).
+ * @return 1 if there is no presence stage or it was loaded, 0 on failure.
+ */
+int model_presence_setup(larodConnection* conn,
+                         const larodDevice* device,
+                         cJSON* config,
+                         unsigned videoWidth,
+                         unsigned videoHeight,
+                         int inputFd);
+
+/**
+ * @brief 1 if the presence stage is loaded.
+ */
+int model_presence_active(void);
+
+/**
+ * @brief 1 if the main model should run on the presence ROI only.
+ */
+int model_presence_roi(void);
+
+/**
+ * @brief Run the presence model on a frame.
+ *
+ * @param inputs NV12 input tensors bound for the frame (imported or copy).
+ * @param count  Number of input tensors.
+ * @param result Outcome and stage timings.
+ * @return 1 on success, 0 if a job failed.
+ */
+int model_presence_run(larodTensor** inputs, size_t count, PresenceResult* result);
+
+/**
+ * @brief Release the presence model. The connection stays open.
+ */
+void model_presence_cleanup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODEL_PRESENCE_H
@@ -0,0 +1,155 @@
+/**
+ * @file motion.c
+ * @brief Implementation of the luma motion gate.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include "ACAP.h"
+#include "Settings.h"
+#include "Motion.h"
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MOTION_NEON 1
+#endif
+
+#define MOTION_POINTS (MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT)
+#define MOTION_STATUS_INTERVAL 1000    // ms
+
+typedef struct {
+    uint32_t offsets[MOTION_POINTS];        // Y plane offset of each grid point
+    int gridAoi[4];
+    uint8_t samples[2][MOTION_POINTS];
+    int current;
+    int havePrevious;
+    double lastActivity;                    // ms, last change or detection
+} MotionView;
+
+static unsigned frameWidth = 0;
+static unsigned frameHeight = 0;
+static MotionView views[SETTINGS_MAX_VIEWS];
+static unsigned inferred = 0;
+static unsigned skipped = 0;
+static double level = 0;
+
+static double now_ms(void) {
+    return g_get_monotonic_time() / 1000.0;
+}
+
+// Grid points spread evenly over the view's AOI (0..1000)
+static void build_grid(MotionView* v, const ViewSettings* aoi) {
+    int x1 = aoi->aoiX1, y1 = aoi->aoiY1, x2 = aoi->aoiX2, y2 = aoi->aoiY2;
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 > 1000) x2 = 1000;
+    if (y2 > 1000) y2 = 1000;
+    if (x2 <= x1) { x1 = 0; x2 = 1000; }
+    if (y2 <= y1) { y1 = 0; y2 = 1000; }
+
+    unsigned i = 0;
+    for (int gy = 0; gy < MOTION_GRID_HEIGHT; gy++) {
+        unsigned y = (unsigned)((y1 + (y2 - y1) * (gy + 0.5) / MOTION_GRID_HEIGHT) * frameHeight / 1000);
+        if (y >= frameHeight) y = frameHeight - 1;
+        for (int gx = 0; gx < MOTION_GRID_WIDTH; gx++) {
+            unsigned x = (unsigned)((x1 + (x2 - x1) * (gx + 0.5) / MOTION_GRID_WIDTH) * frameWidth / 1000);
+            if (x >= frameWidth) x = frameWidth - 1;
+            v->offsets[i++] = y * frameWidth + x;
+        }
+    }
+    v->gridAoi[0] = aoi->aoiX1;
+    v->gridAoi[1] = aoi->aoiY1;
+    v->gridAoi[2] = aoi->aoiX2;
+    v->gridAoi[3] = aoi->aoiY2;
+    v->havePrevious = 0;
+}
+
+// Number of points that differ by more than MOTION_NOISE
+static unsigned changed_points(const uint8_t* a, const uint8_t* b) {
+    unsigned count = 0;
+    unsigned i = 0;
+#ifdef MOTION_NEON
+    const uint8x16_t noise = vdupq_n_u8(MOTION_NOISE);
+    while (i + 16 <= MOTION_POINTS) {
+        // Per-lane counters are u8; flush before they can wrap
+        uint8x16_t acc = vdupq_n_u8(0);
+        unsigned end = i + 16 * 255;
+        if (end > MOTION_POINTS) end = MOTION_POINTS;
+        for (; i + 16 <= end; i += 16) {
+            uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+            acc = vaddq_u8(acc, vshrq_n_u8(vcgtq_u8(diff, noise), 7));
+        }
+        count += vaddlvq_u8(acc);
+    }
+#endif
+    for (; i < MOTION_POINTS; i++) {
+        int diff = (int)a[i] - (int)b[i];
+        if (diff > MOTION_NOISE || diff < -MOTION_NOISE)
+            count++;
+    }
+    return count;
+}
+
+static gboolean status(gpointer data) {
+    ACAP_STATUS_SetNumber("motion", "inferred", inferred);
+    ACAP_STATUS_SetNumber("motion", "skipped", skipped);
+    ACAP_STATUS_SetNumber("motion", "level", level);
+    return G_SOURCE_CONTINUE;
+}
+
+void Motion_Init(unsigned width, unsigned height) {
+    frameWidth = width;
+    frameHeight = height;
+    double now = now_ms();
+    for (unsigned i = 0; i < SETTINGS_MAX_VIEWS; i++) {
+        views[i].gridAoi[0] = -1;
+        views[i].havePrevious = 0;
+        views[i].lastActivity = now;
+    }
+    g_timeout_add(MOTION_STATUS_INTERVAL, status, NULL);
+}
+
+int Motion_Check(unsigned view, VdoBuffer* buffer) {
+    const Settings* settings = Settings_Get();
+    const MotionSettings* config = &settings->motion;
+    const uint8_t* luma = buffer ? (const uint8_t*)vdo_buffer_get_data(buffer) : NULL;
+    MotionView* v = &views[view < SETTINGS_MAX_VIEWS ? view : 0];
+    if (!config->active || !luma || !frameWidth || !frameHeight) {
+        v->havePrevious = 0;
+        inferred++;
+        return 1;
+    }
+
+    const ViewSettings* aoi = Settings_View(settings, view);
+    if (v->gridAoi[0] != aoi->aoiX1 || v->gridAoi[1] != aoi->aoiY1 ||
+        v->gridAoi[2] != aoi->aoiX2 || v->gridAoi[3] != aoi->aoiY2)
+        build_grid(v, aoi);
+
+    uint8_t* sample = v->samples[v->current];
+    for (unsigned i = 0; i < MOTION_POINTS; i++)
+        sample[i] = luma[v->offsets[i]];
+
+    double now = now_ms();
+    if (v->havePrevious) {
+        level = changed_points(sample, v->samples[v->current ^ 1]) * 100.0 / MOTION_POINTS;
+        if (level >= config->threshold)
+            v->lastActivity = now;
+    } else {
+        v->lastActivity = now;
+    }
+    v->havePrevious = 1;
+    v->current ^= 1;
+
+    if (now - v->lastActivity <= config->holdoff) {
+        inferred++;
+        return 1;
+    }
+    skipped++;
+    return 0;
+}
+
+void Motion_Activity(unsigned view, unsigned detections) {
+    if (detections && view < SETTINGS_MAX_VIEWS)
+        views[view].lastActivity = now_ms();
+}
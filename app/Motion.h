@@ -0,0 +1,53 @@
+/**
+ * @file motion.h
+ * @brief Luma motion gate that skips inference on static scenes.
+ *
+ * Samples the Y plane of the NV12 frame on a low-res grid inside the area of
+ * interest and compares it with the previous frame. Inference runs while the
+ * share of changed grid points is at or above the "motion" threshold, and for
+ * 'holdoff' ms after the last change or the last frame with detections, so
+ * gestures in progress and objects standing still are not cut off. Each view
+ * keeps its own grid, previous sample and holdoff.
+ *
+ * Status group "motion": inferred, skipped (frames since start), level
+ * (percent of the grid changed in the last frame).
+ */
+
+#ifndef MOTION_H
+#define MOTION_H
+
+#include "vdo-frame.h"
+#include "vdo-types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOTION_GRID_WIDTH  64
+#define MOTION_GRID_HEIGHT 48
+#define MOTION_NOISE       12      ///< Luma difference below this is sensor noise
+
+/**
+ * @brief Set the frame size of the YUV stream and start the status timer.
+ */
+void Motion_Init(unsigned width, unsigned height);
+
+/**
+ * @brief Decide whether to run inference on a frame.
+ *
+ * @param view   View the frame came from.
+ * @param buffer NV12 frame from Video_Capture_YUV()/Video_Hold_YUV().
+ * @return 1 to run inference, 0 to skip the frame. Always 1 when the gate is off.
+ */
+int Motion_Check(unsigned view, VdoBuffer* buffer);
+
+/**
+ * @brief Report the detections of an inferred frame; detections restart the view's holdoff.
+ */
+void Motion_Activity(unsigned view, unsigned detections);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_H
@@ -2,8 +2,8 @@
  * @file output.c
  * @brief Central orchestrator for detection output, event logic, API endpoints.
  *
- * Implements detection reporting, HTTP/MQTT/SD export, and per-label event gating
- * with rolling-window or immediate logic depending on "prioritize" setting.
+ * Implements detection reporting, HTTP/MQTT/SD export, and per-class event gating
+ * (Output_events) with rolling-window or immediate logic depending on "prioritize" setting.
  */
 
 #include <stdio.h>
@@ -18,11 +18,21 @@
 #include "MQTT.h"
 #include "Model.h"
 #include "cJSON.h"
+#include "Detections.h"
 
 #include "Output.h"
+#include "Output_binary.h"
+#include "Output_bestshot.h"
 #include "Output_crop_cache.h"
+#include "Output_events.h"
+#include "Output_sd.h"
 #include "Output_helpers.h"
 #include "Output_http.h"
+#include "Output_snapshot.h"
+#include "Metrics.h"
+#include "Settings.h"
+#include "Tracker.h"
+#include "Arena.h"
 
 
 #define LOG(fmt, args...)      { syslog(LOG_INFO, fmt, ## args); printf(fmt, ## args);}
@@ -30,346 +40,429 @@
 //#define LOG_TRACE(fmt, args...) { syslog(LOG_INFO, fmt, ## args); printf(fmt, ## args);}
 #define LOG_TRACE(fmt, args...) {}
 
-#define MAX_LABELS 32
-#define MAX_ROLLING 16
-
-#define SD_FOLDER "/var/spool/storage/SD_DISK/detectx"
-
+// Views, names and topics are read once in Output_init; a change applies on restart
 typedef struct {
-    char name[64];
-    int state; // 0=LOW, 1=HIGH
-    int rolling[MAX_ROLLING];   // For accuracy mode: 1=detected, 0=not in most recent frame, ringbuffer
-    int rolling_head;
-    int rolling_count;          // How much of rolling[] is in use ( <= window_size)
-    double last_detect_time;    // ms
-} LabelEventState;
-
-static LabelEventState eventsCache[MAX_LABELS];
-static int eventsCache_len = 0;
-static int lastDetectionsWereEmpty = 0;
-static double last_output_time_ms = 0;
-
-// --------- Helper: manage per-label state ---------
-static LabelEventState* find_or_create_label_state(const char* label) {
-    for (int i = 0; i < eventsCache_len; ++i)
-        if (strcmp(eventsCache[i].name, label) == 0)
-            return &eventsCache[i];
-    if (eventsCache_len < MAX_LABELS) {
-        strncpy(eventsCache[eventsCache_len].name, label, 63);
-        eventsCache[eventsCache_len].name[63] = 0;
-        eventsCache[eventsCache_len].state = 0;
-        eventsCache[eventsCache_len].rolling_head = 0;
-        eventsCache[eventsCache_len].rolling_count = 0;
-        memset(eventsCache[eventsCache_len].rolling, 0, sizeof(eventsCache[eventsCache_len].rolling));
-        eventsCache[eventsCache_len].last_detect_time = 0;
-        return &eventsCache[eventsCache_len++];
-    }
-    return NULL;
+    char name[32];                  // "" for the single unnamed view
+    MQTT_Topic detectionTopic;
+    MQTT_Topic cropTopic;
+    MQTT_Topic binaryTopic;
+    int lastDetectionsWereEmpty;
+} OutputView;
+
+static OutputView views[SETTINGS_MAX_VIEWS];
+static unsigned viewCount = 1;
+static uint8_t binary[OUTPUT_BINARY_MAX];
+
+// ACAP event id of a label in a view: "<label>" or "<label>_<view name>"
+static const char* event_id(const OutputView* view, const char* label, char* id, size_t size) {
+    if (!view->name[0])
+        return label;
+    snprintf(id, size, "%s_%s", label, view->name);
+    replace_spaces(id);
+    return id;
+}
+
+// MQTT event topic: "event/<serial>[/<view name>]/<label>/<state>"
+static void event_topic(const OutputView* view, const char* label, const char* state, char* topic, size_t size) {
+    if (view->name[0])
+        snprintf(topic, size, "event/%s/%s/%s/%s", ACAP_DEVICE_Prop("serial"), view->name, label, state);
+    else
+        snprintf(topic, size, "event/%s/%s/%s", ACAP_DEVICE_Prop("serial"), label, state);
 }
 
 static gboolean Output_DeactivateExpired(gpointer user_data) {
     double now = ACAP_DEVICE_Timestamp();
-	cJSON* settings = ACAP_Get_Config("settings");
-	if(!settings)
-		return TRUE;
-    double minEventDuration = cJSON_GetObjectItem(settings,"minEventDuration")?cJSON_GetObjectItem(settings,"minEventDuration")->valuedouble:3000;
-	
+    double minEventDuration = Settings_Get()->minEventDuration;
+
     char topic[256];
-    for (int i = 0; i < eventsCache_len; ++i) {
-        if (eventsCache[i].state == 1) {
-            // Use the last_detect_time set by Output() on detection
-            if ((now - eventsCache[i].last_detect_time) > minEventDuration) {
-                eventsCache[i].state = 0;
-                ACAP_EVENTS_Fire_State(eventsCache[i].name, 0);
-                snprintf(topic, sizeof(topic), "event/%s/%s/false", ACAP_DEVICE_Prop("serial"), eventsCache[i].name);
-                cJSON* statePayload = cJSON_CreateObject();
-                cJSON_AddStringToObject(statePayload, "label", eventsCache[i].name);
-                cJSON_AddFalseToObject(statePayload, "state");
-                cJSON_AddNumberToObject(statePayload, "timestamp", ACAP_DEVICE_Timestamp());
-                MQTT_Publish_JSON(topic, statePayload, 0, 0);
-                cJSON_Delete(statePayload);
-                LOG_TRACE("%s: Label %s set to LOW\n", __func__, eventsCache[i].name);
-            }
+    char id[96];
+    for (unsigned v = 0; v < viewCount; v++) {
+        DetectionClasses falling = output_events_expire(v, now, minEventDuration);
+        for (int classId; (classId = Detections_Class_Pop(&falling)) >= 0;) {
+            const char* label = Detections_Label(classId);
+            ACAP_EVENTS_Fire_State(event_id(&views[v], label, id, sizeof(id)), 0);
+            event_topic(&views[v], label, "false", topic, sizeof(topic));
+            cJSON* statePayload = cJSON_CreateObject();
+            cJSON_AddStringToObject(statePayload, "label", label);
+            if (views[v].name[0])
+                cJSON_AddStringToObject(statePayload, "view", views[v].name);
+            cJSON_AddFalseToObject(statePayload, "state");
+            cJSON_AddNumberToObject(statePayload, "timestamp", now);
+            MQTT_Publish_JSON(topic, statePayload, 0, 0);
+            cJSON_Delete(statePayload);
+            LOG_TRACE("%s: Label %s set to LOW\n", __func__, label);
         }
     }
 	return TRUE;
 }
 
-int lastDetectionsWhereEmpty = 0;
-
-// --------- Main output function (with rolling logic) ---------
-void Output(cJSON* detections) {
-    if (!detections || cJSON_GetArraySize(detections) == 0) {
-		ACAP_STATUS_SetObject("labels", "detections", cJSON_CreateArray());
-        return;
-	}
-
-    LOG_TRACE("<%s %d\n", __func__, cJSON_GetArraySize(detections));
+// --------- Event gating: one pass over the frame, then per class in the gate ---------
+static void Output_Events(const DetectionList* detections, unsigned view, double now, const Settings* settings) {
+    OutputEventsConfig config = {
+        settings->prioritizeAccuracy,
+        settings->eventFrames,
+        settings->eventWindow
+    };
+
+    DetectionClasses present = {{0}};
+    unsigned first[DETECTIONS_MAX_CLASSES];   // First detection of each present class
+    memset(first, 0xff, sizeof(first));
+    unsigned count = detections ? detections->count : 0;
+    for (unsigned i = 0; i < count; i++) {
+        int classId = detections->label[i];
+        if (classId < 0 || classId >= DETECTIONS_MAX_CLASSES)
+            continue;
+        if (!Detections_Class_Test(&present, classId)) {
+            Detections_Class_Set(&present, classId);
+            first[classId] = i;
+        }
+    }
+    // Coasting tracks keep their class present through missed and skipped frames
+    if (settings->tracker.active)
+        Detections_Class_Merge(&present, &Tracker_Frame(view)->present);
 
-    // Export current detections to status
-    ACAP_STATUS_SetObject("labels", "detections", detections);
-    double now = ACAP_DEVICE_Timestamp();
+    DetectionClasses rising = output_events_update(view, &present, now, &config);
 
-    cJSON* settings = ACAP_Get_Config("settings");
-    if (!settings) {
-        LOG_TRACE("ERROR %s - no settings>\n", __func__);
-        return;
+    char topic[256];
+    char id[96];
+    for (int classId; (classId = Detections_Class_Pop(&rising)) >= 0;) {
+        const char* label = Detections_Label(classId);
+        ACAP_EVENTS_Fire_State(event_id(&views[view], label, id, sizeof(id)), 1);
+        event_topic(&views[view], label, "true", topic, sizeof(topic));
+        // Only the payload is in the arena; the event state above updates the status tree
+        Arena_Begin();
+        cJSON* eventPayload = Detections_Item_JSON(detections, first[classId]);
+        if (first[classId] >= count) {
+            cJSON_AddStringToObject(eventPayload, "label", label);
+            cJSON_AddNumberToObject(eventPayload, "timestamp", now);
+        }
+        if (views[view].name[0])
+            cJSON_AddStringToObject(eventPayload, "view", views[view].name);
+        cJSON_AddTrueToObject(eventPayload, "state");
+        MQTT_Publish_JSON(topic, eventPayload, 0, 0);
+        cJSON_Delete(eventPayload);
+        Arena_End();
     }
+}
 
-    // Cropping/crop export config
-    cJSON* cropping = cJSON_GetObjectItem(settings, "cropping");
-    int cropping_active = cropping && cJSON_IsTrue(cJSON_GetObjectItem(cropping, "active"));
-    int sdcard_enable   = cropping && cJSON_IsTrue(cJSON_GetObjectItem(cropping, "sdcard"));
-    int mqtt_export     = cropping && cJSON_IsTrue(cJSON_GetObjectItem(cropping, "mqtt"));
-    int http_export     = cropping && cJSON_IsTrue(cJSON_GetObjectItem(cropping, "http"));
-    int throttle        = cJSON_GetObjectItem(cropping, "throttle") ?
-                         cJSON_GetObjectItem(cropping, "throttle")->valueint : 500;
-
-    if (sdcard_enable && !ensure_sd_directory()) {
-        sdcard_enable = 0;
-    }
+// --------- Tracks: "track/<serial>[/<view name>]" when a track starts and ends ---------
+static void Output_Tracks(const DetectionList* detections, unsigned view, double now) {
+    const TrackerFrame* frame = Tracker_Frame(view);
+    if (!frame->started && !frame->ended)
+        return;
 
-    // --- Export all detections as MQTT (non-crop summary) ---
     char topic[256];
-    snprintf(topic, sizeof(topic), "detection/%s", ACAP_DEVICE_Prop("serial"));
-    cJSON* mqttPayload = cJSON_CreateObject();
-    cJSON_AddItemReferenceToObject(mqttPayload, "detections", detections);
-
-    if (cJSON_GetArraySize(detections)) {
-        MQTT_Publish_JSON(topic, mqttPayload, 0, 0);
-        lastDetectionsWereEmpty = 0;
-    } else {
-        if (!lastDetectionsWereEmpty)
-            MQTT_Publish_JSON(topic, mqttPayload, 0, 0);
-        lastDetectionsWereEmpty = 1;
+    if (views[view].name[0])
+        snprintf(topic, sizeof(topic), "track/%s/%s", ACAP_DEVICE_Prop("serial"), views[view].name);
+    else
+        snprintf(topic, sizeof(topic), "track/%s", ACAP_DEVICE_Prop("serial"));
+
+    Arena_Begin();
+    for (unsigned i = 0; i < frame->started; i++) {
+        cJSON* payload = Detections_Item_JSON(detections, frame->startedIndex[i]);
+        if (views[view].name[0])
+            cJSON_AddStringToObject(payload, "view", views[view].name);
+        cJSON_AddTrueToObject(payload, "state");
+        MQTT_Publish_JSON(topic, payload, 0, 0);
+        cJSON_Delete(payload);
     }
-    cJSON_Delete(mqttPayload);
-
-    // --- Adaptive event gating
-    const char *prioritize = cJSON_GetObjectItem(settings, "prioritize")?cJSON_GetObjectItem(settings, "prioritize")->valuestring:"accuracy";
-
-    double averageInferenceTime = ACAP_STATUS_Double("mode", "averageTime"); // ms
-    int   desired_window_ms = 1000;              // 1 second rolling window for accuracy mode
-    int   min_frames_in_window = 3;              // Default: 3 detections needed
-    int   window_size = (int)((desired_window_ms + averageInferenceTime - 1) / averageInferenceTime);
-    if (window_size < 2) window_size = 2;
-    if (window_size > MAX_ROLLING) window_size = MAX_ROLLING;
-
-    // allow overrides (future: from JSON)
-    cJSON* logic = cJSON_GetObjectItem(settings, "eventLogic");
-    if (logic) {
-        if (cJSON_GetObjectItem(logic, "frames")) min_frames_in_window = cJSON_GetObjectItem(logic, "frames")->valueint;
-        if (cJSON_GetObjectItem(logic, "window")) desired_window_ms = cJSON_GetObjectItem(logic, "window")->valueint;
+    for (unsigned i = 0; i < frame->ended; i++) {
+        const TrackerEnded* ended = &frame->endedTracks[i];
+        output_bestshot_end(view, ended->id);
+        cJSON* payload = cJSON_CreateObject();
+        cJSON_AddStringToObject(payload, "label", Detections_Label(ended->label));
+        cJSON_AddNumberToObject(payload, "track", ended->id);
+        if (views[view].name[0])
+            cJSON_AddStringToObject(payload, "view", views[view].name);
+        cJSON_AddFalseToObject(payload, "state");
+        cJSON_AddNumberToObject(payload, "x", ended->x);
+        cJSON_AddNumberToObject(payload, "y", ended->y);
+        cJSON_AddNumberToObject(payload, "w", ended->w);
+        cJSON_AddNumberToObject(payload, "h", ended->h);
+        cJSON_AddNumberToObject(payload, "duration", ended->duration);
+        cJSON_AddNumberToObject(payload, "timestamp", now);
+        MQTT_Publish_JSON(topic, payload, 0, 0);
+        cJSON_Delete(payload);
     }
+    Arena_End();
+}
 
-    // --- Cropping settings ---
-    int leftborder_offset   = cropping && cJSON_GetObjectItem(cropping, "leftborder") ?
-                                cJSON_GetObjectItem(cropping, "leftborder")->valueint : 0;
-    int rightborder_offset  = cropping && cJSON_GetObjectItem(cropping, "rightborder") ?
-                                cJSON_GetObjectItem(cropping, "rightborder")->valueint : 0;
-    int topborder_offset    = cropping && cJSON_GetObjectItem(cropping, "topborder") ?
-                                cJSON_GetObjectItem(cropping, "topborder")->valueint : 0;
-    int bottomborder_offset = cropping && cJSON_GetObjectItem(cropping, "bottomborder") ?
-                                cJSON_GetObjectItem(cropping, "bottomborder")->valueint : 0;
-
-    // --- Per-detection logic ---
-    int idx = 0;
-    cJSON* detection = detections->child;
-
-    // -- Track which labels were present in this frame
-    char frame_labels[MAX_LABELS][64];
-    int n_frame_labels = 0;
-
-    while (detection) {
-        const char* label = "Undefined";
-        int conf = 0;
-        double timestamp = now;
-		cJSON* labelObj;
-        if ((labelObj = cJSON_GetObjectItem(detection, "label")))
-            if (cJSON_IsString(labelObj)) label = labelObj->valuestring;
-		cJSON* confObj;
-        if ((confObj = cJSON_GetObjectItem(detection, "c")))
-            if (cJSON_IsNumber(confObj)) conf = confObj->valueint;
-		cJSON* timestampObj;
-        if ((timestampObj = cJSON_GetObjectItem(detection, "timestamp")))
-            if (cJSON_IsNumber(timestampObj)) timestamp = timestampObj->valuedouble;
-
-        // Store this label for present frame (for non-detected tracking)
-        if (n_frame_labels < MAX_LABELS) {
-            strncpy(frame_labels[n_frame_labels++], label, 63);
-            frame_labels[n_frame_labels - 1][63] = 0;
-        }
+// --------- Crop export of a best-shot winner: one JPEG encode for all outputs ---------
+static void Output_Crop(const OutputBestShot* shot, int idx, const CroppingSettings* cropping) {
+    OutputView* view = &views[shot->view < viewCount ? shot->view : 0];
+    const char* label = Detections_Label(shot->label);
+    int conf = (int)shot->confidence;
+    double timestamp = shot->timestamp;
+    int sdcard_enable = cropping->sdcard;
+    int mqtt_export   = cropping->mqtt;
+    int http_export   = cropping->http;
+
+    unsigned jpeg_size = 0;
+    const unsigned char* jpeg_data = Model_Encode_Crop(&shot->crop, &jpeg_size);
+    if (!jpeg_data || jpeg_size == 0)
+        return;
 
-        // --------- Event Gating: Speed/Accuracy mode ----------
-        LabelEventState* evt = find_or_create_label_state(label);
-        if (!evt) { idx++; detection = detection->next; continue; }
-        if (strcmp(prioritize, "speed") == 0) {
-            // Immediate HIGH on any detection, LOW handled below (minEventDuration)
-            if (evt->state == 0) {
-                evt->state = 1;
-                evt->last_detect_time = now;
-                ACAP_EVENTS_Fire_State(label, 1);
-                snprintf(topic, sizeof(topic), "event/%s/%s/true", ACAP_DEVICE_Prop("serial"), label);
-                cJSON_AddTrueToObject(detection, "state");
-                MQTT_Publish_JSON(topic, detection, 0, 0);
+    // Detection box in the crop, as placed after MCU snapping and clipping at the frame edge
+    int crop_x = shot->crop.det_x;
+    int crop_y = shot->crop.det_y;
+    int crop_w = shot->crop.det_w;
+    int crop_h = shot->crop.det_h;
+
+    // Cache for HTTP crop API (raw JPEG)
+    output_crop_cache_add(jpeg_data, jpeg_size, label, conf, crop_x, crop_y, crop_w, crop_h);
+
+    // --- SD Card Export (written by the Output_sd thread) ----
+    if (sdcard_enable) {
+        if (!output_sd_enqueue(label, timestamp, idx, jpeg_data, jpeg_size,
+                               crop_x, crop_y, crop_w, crop_h,
+                               cropping->sdHourly, cropping->sdQuota))
+            LOG_WARN("%s: Failed to queue crop for SD\n", __func__);
+    }
+
+    // --- MQTT and HTTP Export ----
+    if (mqtt_export || http_export) {
+        // Only the JSON exports need base64; the buffer is freed before the next frame
+        char* imageDataBase64 = Arena_Alloc(4 * ((jpeg_size + 2) / 3) + 1);
+        if (imageDataBase64)
+            imageDataBase64[base64_encode_to(jpeg_data, jpeg_size, imageDataBase64)] = '\0';
+        cJSON* payload = cJSON_CreateObject();
+        cJSON_AddStringToObject(payload, "label", label);
+        if (view->name[0])
+            cJSON_AddStringToObject(payload, "view", view->name);
+        cJSON_AddNumberToObject(payload, "timestamp", timestamp);
+        cJSON_AddNumberToObject(payload, "confidence", conf);
+        if (shot->track)
+            cJSON_AddNumberToObject(payload, "track", shot->track);
+        cJSON_AddNumberToObject(payload, "x", crop_x);
+        cJSON_AddNumberToObject(payload, "y", crop_y);
+        cJSON_AddNumberToObject(payload, "w", crop_w);
+        cJSON_AddNumberToObject(payload, "h", crop_h);
+        // The base64 image is referenced, not copied, and the payload is
+        // printed once for both MQTT and HTTP
+        cJSON_AddItemToObject(payload, "image", cJSON_CreateStringReference(imageDataBase64));
+        int length = 0;
+        char* serialized = imageDataBase64 ? MQTT_Serialize(payload, &length) : NULL;
+        cJSON_Delete(payload);
+        Arena_Free(imageDataBase64);
+        if (mqtt_export && serialized) {
+            uint64_t publishStart = Metrics_Now();
+            MQTT_Publish_Serialized(&view->cropTopic, serialized, length, 0, 0);
+            Metrics_Stage(METRICS_MQTT, publishStart);
+            LOG_TRACE("Crop published on MQTT\n");
+        }
+        if (http_export && serialized) {
+            const char* url = cropping->http_url;
+
+            if (url && url[0] != 0) {
+                // Posted by the dispatcher thread, which takes ownership of the buffer
+                if (!output_http_enqueue(url, serialized, cropping->http_auth, cropping->http_username,
+                                         cropping->http_password, cropping->http_token, cropping->http_batch)) {
+                    LOG_WARN("HTTP export not queued: %s\n", url);
+                }
+                serialized = NULL;
             } else {
-                evt->last_detect_time = now;
+                LOG_WARN("HTTP export enabled, but %s.\n", cropping->httpError ? cropping->httpError : "URL is not set");
             }
-        } else {
-            // Accuracy mode: Rolling window
-            evt->rolling_head = (evt->rolling_head + 1) % window_size;
-            evt->rolling[evt->rolling_head] = 1;
-            if (evt->rolling_count < window_size) evt->rolling_count++;
-            evt->last_detect_time = now;
-
-            // Will mark 0 for non-detected labels below
-            int sum = 0;
-            for (int i = 0; i < evt->rolling_count; ++i)
-                sum += evt->rolling[i];
-            if ((evt->state == 0) && (sum >= min_frames_in_window)) {
-                evt->state = 1;
-                evt->last_detect_time = now;
-                ACAP_EVENTS_Fire_State(label, 1);
-                snprintf(topic, sizeof(topic), "event/%s/%s/true", ACAP_DEVICE_Prop("serial"), label);
-                cJSON_AddTrueToObject(detection, "state");
-                MQTT_Publish_JSON(topic, detection, 0, 0);
-            }
-            if (evt->state == 1) evt->last_detect_time = now;
         }
+        free(serialized);
+    }
+}
+
+// Close due windows; also runs from a timer so windows close without frames
+static void Output_Crops(double now, const Settings* settings) {
+    const OutputBestShot* shot;
+    int idx = 0;
+    while ((shot = output_bestshot_next(now, settings->cropping.throttle)) != NULL)
+        if (settings->cropping.active)
+            Output_Crop(shot, idx++, &settings->cropping);
+}
 
+static gboolean Output_Crops_Due(gpointer user_data) {
+    Output_Crops(ACAP_DEVICE_Timestamp(), Settings_Get());
+    return TRUE;
+}
 
-        // --- Cropping output path ---
-        if (cropping_active) {
-            int crop_x = 0, crop_y = 0, crop_w = 0, crop_h = 0, img_w = 0, img_h = 0;
-            unsigned jpeg_size = 0;
-            const unsigned char* jpeg_data =
-                Model_GetImageData(detection, &jpeg_size,
-                                   &crop_x, &crop_y, &crop_w, &crop_h,
-                                   &img_w, &img_h);
-
-            // Apply border offsets if available
-            crop_x = leftborder_offset;
-            crop_y = topborder_offset;
-            crop_w = img_w - leftborder_offset - rightborder_offset;
-            crop_h = img_h - topborder_offset - bottomborder_offset;
-
-            // Cache for HTTP crop API
-            const char* imageDataBase64 = NULL;
-            if (jpeg_data && jpeg_size > 0) {
-                imageDataBase64 = output_crop_cache_add(
-                    jpeg_data, jpeg_size, label, conf, crop_x, crop_y, crop_w, crop_h);
-            }
+static gboolean Output_HTTP_Status(gpointer user_data) {
+    OutputHttpStats stats;
+    output_http_stats(&stats);
+    ACAP_STATUS_SetNumber("http", "queue", stats.queued);
+    ACAP_STATUS_SetNumber("http", "dropped", stats.dropped);
+    ACAP_STATUS_SetNumber("http", "posted", stats.posted);
+    ACAP_STATUS_SetNumber("http", "failed", stats.failed);
+    ACAP_STATUS_SetNumber("http", "latency", stats.latency);
+    const char* error = Settings_Get()->cropping.httpError;
+    ACAP_STATUS_SetString("http", "error", error ? error : "");
+    return TRUE;
+}
 
-            double now_ts = ACAP_DEVICE_Timestamp();
-            if (imageDataBase64 && now_ts - last_output_time_ms > throttle) {
-                last_output_time_ms = now_ts;
-
-                // --- SD Card Export ----
-                if (sdcard_enable) {
-                    char safe_label[64];
-                    strncpy(safe_label, label, sizeof(safe_label) - 1);
-                    safe_label[sizeof(safe_label) - 1] = 0;
-                    replace_spaces(safe_label);
-
-                    char fname_img[256], fname_label[256];
-                    snprintf(fname_img, sizeof(fname_img), "%s/crop_%s_%.0f_%d.jpg",
-                             SD_FOLDER, safe_label, timestamp, idx);
-                    snprintf(fname_label, sizeof(fname_label), "%s/crop_%s_%.0f_%d.txt",
-                             SD_FOLDER, safe_label, timestamp, idx);
-
-                    if (save_jpeg_to_file(fname_img, jpeg_data, jpeg_size)) {
-                        if (save_label_to_file(fname_label, label, crop_x, crop_y, crop_w, crop_h)) {
-                            LOG_TRACE("Saved crop to SD: %s, %s\n", fname_img, fname_label);
-                        } else {
-                            LOG_WARN("%s: Failed to save crop label to SD: %s\n", __func__, fname_label);
-                        }
-                    } else {
-                        LOG_WARN("%s: Failed to save crop to SD: %s\n", __func__, fname_img);
-                    }
-                }
+static gboolean Output_SD_Status(gpointer user_data) {
+    OutputSdStats stats;
+    output_sd_stats(&stats);
+    ACAP_STATUS_SetNumber("SDCARD", "queue", stats.queued);
+    ACAP_STATUS_SetNumber("SDCARD", "dropped", stats.dropped);
+    ACAP_STATUS_SetNumber("SDCARD", "written", stats.written);
+    ACAP_STATUS_SetNumber("SDCARD", "failed", stats.failed);
+    ACAP_STATUS_SetNumber("SDCARD", "evicted", stats.evicted);
+    ACAP_STATUS_SetNumber("SDCARD", "latency", stats.latency);
+    ACAP_STATUS_SetNumber("SDCARD", "usage", (int)(stats.usage * 10 + 0.5) / 10.0);
+    return TRUE;
+}
 
-                // --- MQTT and HTTP Export ----
-                if (mqtt_export || http_export) {
-                    cJSON* payload = cJSON_CreateObject();
-                    cJSON_AddStringToObject(payload, "label", label);
-                    cJSON_AddNumberToObject(payload, "timestamp", timestamp);
-                    cJSON_AddNumberToObject(payload, "confidence", conf);
-                    cJSON_AddNumberToObject(payload, "x", crop_x);
-                    cJSON_AddNumberToObject(payload, "y", crop_y);
-                    cJSON_AddNumberToObject(payload, "w", crop_w);
-                    cJSON_AddNumberToObject(payload, "h", crop_h);
-                    cJSON_AddStringToObject(payload, "image", imageDataBase64);
-                    if (mqtt_export) {
-                        char crop_topic[64];
-                        snprintf(crop_topic, sizeof(crop_topic), "crop/%s", ACAP_DEVICE_Prop("serial"));
-                        MQTT_Publish_JSON(crop_topic, payload, 0, 0);
-                        LOG_TRACE("Crop published on MQTT\n");
-                    }
-                    if (http_export) {
-                        cJSON_AddStringToObject(payload, "serial", ACAP_DEVICE_Prop("serial"));
-                        const char* url = cJSON_GetObjectItem(cropping, "http_url") ?
-                                          cJSON_GetObjectItem(cropping, "http_url")->valuestring : NULL;
-                        const char* authentication = cJSON_GetObjectItem(cropping, "http_auth") ?
-                                                     cJSON_GetObjectItem(cropping, "http_auth")->valuestring : "none";
-                        const char* username = cJSON_GetObjectItem(cropping, "http_username") ?
-                                               cJSON_GetObjectItem(cropping, "http_username")->valuestring : NULL;
-                        const char* password = cJSON_GetObjectItem(cropping, "http_password") ?
-                                               cJSON_GetObjectItem(cropping, "http_password")->valuestring : NULL;
-                        const char* token = cJSON_GetObjectItem(cropping, "http_token") ?
-                                            cJSON_GetObjectItem(cropping, "http_token")->valuestring : NULL;
-
-                        if (url && url[0] != 0) {
-                            int http_ok = output_http_post_json(url, payload,
-                                authentication, username, password, token);
-                            if (!http_ok) {
-                                LOG_WARN("HTTP POST failed: %s\n", url);
-                            }
-                        } else {
-                            LOG_WARN("HTTP export enabled, but URL is not set.\n");
-                        }
-                    }
-                    cJSON_Delete(payload);
-                }
-            }
-        } // end cropping_active
-
-        idx++;
-        detection = detection->next;
-    } // end detection loop
-
-    // -- For all labels that did NOT occur this frame, roll in 0 (for accuracy, not speed)
-    if (strcmp(prioritize, "accuracy") == 0) {
-        for (int i = 0; i < eventsCache_len; ++i) {
-            int seen = 0;
-            for (int j = 0; j < n_frame_labels; ++j)
-                if (strcmp(eventsCache[i].name, frame_labels[j]) == 0) seen = 1;
-            if (!seen) {
-                eventsCache[i].rolling_head = (eventsCache[i].rolling_head + 1) % window_size;
-                eventsCache[i].rolling[eventsCache[i].rolling_head] = 0;
-                if (eventsCache[i].rolling_count < window_size) eventsCache[i].rolling_count++;
-                // do NOT update last_detect_time here, only on real detection
+int lastDetectionsWhereEmpty = 0;
+
+// --------- Main output function (with rolling logic) ---------
+void Output(const DetectionList* detections, unsigned viewIndex) {
+    double now = ACAP_DEVICE_Timestamp();
+    const Settings* settings = Settings_Get();
+    if (viewIndex >= viewCount)
+        viewIndex = 0;
+    OutputView* view = &views[viewIndex];
+
+    // Empty frames also advance the event windows
+    uint64_t start = Metrics_Now();
+    Output_Events(detections, viewIndex, now, settings);
+    if (settings->tracker.active)
+        Output_Tracks(detections, viewIndex, now);
+    Metrics_Stage(METRICS_EVENTS, start);
+
+    if (!detections || detections->count == 0) {
+        output_snapshot_publish(viewIndex, NULL, now);
+        return;
+	}
+
+    LOG_TRACE("<%s %u\n", __func__, detections->count);
+
+    // The frame's payloads live in the arena until Model_Reset()
+    Arena_Begin();
+
+    // Publish current detections to the snapshot API
+    cJSON* json = Detections_JSON(detections);
+    output_snapshot_publish(viewIndex, json, now);
+
+    // --- Export all detections as MQTT (non-crop summary) ---
+    if (settings->detectionBinary && (detections->count || !view->lastDetectionsWereEmpty)) {
+        size_t length = output_binary_encode(detections, viewIndex, now, binary, sizeof(binary));
+        if (length) {
+            uint64_t publishStart = Metrics_Now();
+            MQTT_Publish_Serialized(&view->binaryTopic, (const char*)binary, (int)length, 0, 0);
+            Metrics_Stage(METRICS_MQTT, publishStart);
+        }
+    }
+    if (settings->detectionJson && (detections->count || !view->lastDetectionsWereEmpty)) {
+        cJSON* mqttPayload = cJSON_CreateObject();
+        if (view->name[0])
+            cJSON_AddStringToObject(mqttPayload, "view", view->name);
+        cJSON_AddItemReferenceToObject(mqttPayload, "detections", json);
+        int length = 0;
+        char* serialized = MQTT_Serialize(mqttPayload, &length);
+        if (serialized) {
+            uint64_t publishStart = Metrics_Now();
+            MQTT_Publish_Serialized(&view->detectionTopic, serialized, length, 0, 0);
+            Metrics_Stage(METRICS_MQTT, publishStart);
+        }
+        cJSON_free(serialized);
+        cJSON_Delete(mqttPayload);
+    }
+    view->lastDetectionsWereEmpty = detections->count == 0;
+    cJSON_Delete(json);
+    Arena_End();
+
+    // --- Crop candidates; each window's best one is encoded when the window closes ---
+    if (settings->cropping.active) {
+        int tracking = settings->tracker.active;
+        for (unsigned i = 0; i < detections->count; i++) {
+            unsigned track = detections->track[i];
+            float speed = 0;
+            if (tracking) {
+                // Tentative tracks have no id; a track opens one window
+                if (!track)
+                    continue;
+                if (!output_bestshot_is_open(viewIndex, track, detections->label[i]) &&
+                    !Tracker_Crop(viewIndex, track))
+                    continue;
+                speed = Tracker_Speed(viewIndex, track);
             }
+            output_bestshot_offer(viewIndex, detections, i, speed, now);
         }
     }
+    Output_Crops(now, settings);
 
     LOG_TRACE("%s>\n", __func__);
 }
 
-// --- Reset: Clear all timers/state/crop API/eventsCache ---
+// --- Reset: Clear all timers/state/crop API/event gate ---
 void Output_reset(void) {
     LOG_TRACE("<%s\n", __func__);
-    eventsCache_len = 0;
-    lastDetectionsWereEmpty = 0;
-    last_output_time_ms = 0;
+    output_events_reset();
+    output_bestshot_reset();
+    Tracker_Reset();
+    for (unsigned v = 0; v < viewCount; v++) {
+        views[v].lastDetectionsWereEmpty = 0;
+    }
     output_crop_cache_reset();
     LOG_TRACE("%s>\n", __func__);
 }
 
+// --- Label table for the binary detections, retained on "labels/<serial>" ---
+void Output_MQTT_Connected(void) {
+    cJSON* table = cJSON_CreateObject();
+    cJSON_AddNumberToObject(table, "schema", OUTPUT_BINARY_VERSION);
+    cJSON* labels = cJSON_AddArrayToObject(table, "labels");
+    for (int i = 0; i < Detections_Label_Count(); i++)
+        cJSON_AddItemToArray(labels, cJSON_CreateString(Detections_Label(i)));
+    cJSON* names = cJSON_AddArrayToObject(table, "views");
+    for (unsigned v = 0; v < viewCount; v++)
+        cJSON_AddItemToArray(names, cJSON_CreateString(views[v].name));
+    char topic[96];
+    snprintf(topic, sizeof(topic), "labels/%s", ACAP_DEVICE_Prop("serial"));
+    MQTT_Publish_JSON(topic, table, 0, 1);
+    cJSON_Delete(table);
+}
+
+// --- Cleanup: Stop the HTTP dispatcher and SD writer, dropping exports not yet done, free crop history ---
+void Output_cleanup(void) {
+    output_http_stop();
+    output_sd_stop();
+    output_bestshot_cleanup();
+    output_crop_cache_cleanup();
+}
+
 // --- Initialization: Register HTTP endpoint for crop API, register events in ACAP ---
 void Output_init(void) {
     LOG_TRACE("<%s\n", __func__);
     ACAP_HTTP_Node("crops", output_crop_cache_http_callback);
 
+    // Named views publish on "detection/<serial>/<view name>" and "crop/<serial>/<view name>"
+    const Settings* settings = Settings_Get();
+    viewCount = settings->viewCount;
+    char topic[96];
+    for (unsigned v = 0; v < viewCount; v++) {
+        OutputView* view = &views[v];
+        snprintf(view->name, sizeof(view->name), "%s", settings->views[v].name);
+        const char* separator = view->name[0] ? "/" : "";
+        snprintf(topic, sizeof(topic), "detection/%s%s%s", ACAP_DEVICE_Prop("serial"), separator, view->name);
+        MQTT_Topic_Set(&view->detectionTopic, topic);
+        snprintf(topic, sizeof(topic), "crop/%s%s%s", ACAP_DEVICE_Prop("serial"), separator, view->name);
+        MQTT_Topic_Set(&view->cropTopic, topic);
+        snprintf(topic, sizeof(topic), "detectionbin/%s%s%s", ACAP_DEVICE_Prop("serial"), separator, view->name);
+        MQTT_Topic_Set(&view->binaryTopic, topic);
+    }
+
+    // One snapshot per view, served as "snapshot?view=<name>"
+    const char* names[SETTINGS_MAX_VIEWS];
+    for (unsigned v = 0; v < viewCount; v++)
+        names[v] = views[v].name;
+    if (output_snapshot_init(names, viewCount))
+        ACAP_HTTP_Node("snapshot", output_snapshot_http_callback);
+
+    // Crop history size is read once; a change applies on restart
+    output_crop_cache_init(settings->cropping.history);
+    if (output_http_start())
+        g_timeout_add(1000, Output_HTTP_Status, NULL);
+    if (output_sd_start())
+        g_timeout_add(1000, Output_SD_Status, NULL);
+    g_timeout_add(100, Output_Crops_Due, NULL);
+
     cJSON* model = ACAP_Get_Config("model");
     if (!model) {
         LOG_WARN("%s: No Model Config found\n", __func__);
@@ -383,18 +476,26 @@ void Output_init(void) {
     cJSON* label = labels->child;
     while (label) {
         if (cJSON_IsString(label)) {
-            char niceName[32];
-            snprintf(niceName, sizeof(niceName), "DetectX: %s", label->valuestring);
-            char* labelCopy = strdup(label->valuestring);
-            if (labelCopy) {
-                replace_spaces(labelCopy);
-                ACAP_EVENTS_Add_Event(labelCopy, niceName, 1);
-                free(labelCopy);
+            for (unsigned v = 0; v < viewCount; v++) {
+                char niceName[64];
+                char id[96];
+                if (views[v].name[0]) {
+                    snprintf(niceName, sizeof(niceName), "DetectX: %s (%s)", label->valuestring, views[v].name);
+                    event_id(&views[v], label->valuestring, id, sizeof(id));
+                    ACAP_EVENTS_Add_Event(id, niceName, 1);
+                    continue;
+                }
+                snprintf(niceName, sizeof(niceName), "DetectX: %s", label->valuestring);
+                char* labelCopy = strdup(label->valuestring);
+                if (labelCopy) {
+                    replace_spaces(labelCopy);
+                    ACAP_EVENTS_Add_Event(labelCopy, niceName, 1);
+                    free(labelCopy);
+                }
             }
         }
         label = label->next;
     }
-    output_crop_cache_reset();
 	g_timeout_add(200, Output_DeactivateExpired, NULL);	
     LOG_TRACE("%s>\n", __func__);
 }
@@ -5,19 +5,27 @@
  * Provides Output(), Output_init(), and Output_reset() entry points for the
  * core application. Handles exporting output to MQTT, SD card, HTTP API,
  * and maintains transient state for event activation/deactivation.
+ *
+ * Each view has its own event gate. A named view publishes on
+ * detection/<serial>/<name>, crop/<serial>/<name> and
+ * event/<serial>/<name>/<label>/<state>, and declares the ACAP events
+ * "<label>_<name>". The single unnamed view keeps the plain topics and
+ * label events. Views are read in Output_init; a change applies on restart.
  */
 
 #ifndef OUTPUT_H
 #define OUTPUT_H
 
 #include "cJSON.h"
+#include "Detections.h"
 
 /**
  * @brief Processes detections and exports as configured (MQTT, SD, HTTP, crop cache).
  *
- * @param detectionList cJSON array of detected objects (from model).
+ * @param detections Filtered detections (coordinates 0..1000, confidence 0..100).
+ * @param view       View the frame came from (Model_View()).
  */
-void Output(cJSON* detectionList);
+void Output(const DetectionList* detections, unsigned view);
 
 /**
  * @brief Resets all output and event/transient state (crop cache, timers).
@@ -31,4 +39,18 @@ void Output_reset(void);
  */
 void Output_init(void);
 
+/**
+ * @brief Publish the label table of the binary detection stream (retained).
+ *
+ * Call when MQTT connects. Detections on detectionbin/<serial>[/<view name>]
+ * ("detectionFormat": "binary" or "both") carry class ids into this table;
+ * see output_binary.h for the layout.
+ */
+void Output_MQTT_Connected(void);
+
+/**
+ * @brief Stops the background HTTP export dispatcher. Call once on shutdown.
+ */
+void Output_cleanup(void);
+
 #endif // OUTPUT_H
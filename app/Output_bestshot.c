@@ -0,0 +1,114 @@
+/**
+ * @file output_bestshot.c
+ * @brief Implementation of the best-shot crop selection.
+ */
+
+#include <string.h>
+#include <math.h>
+#include "Output_bestshot.h"
+
+#define BESTSHOT_FULL_SIZE 250.0f   // Box side (0..1000) that gets the full size score
+#define BESTSHOT_EDGE      2.0f     // Boxes this close to the frame edge are cut off
+#define BESTSHOT_BLUR      2.0f     // Score factor 1 / (1 + speed * BESTSHOT_BLUR)
+
+typedef struct {
+    int open;
+    int due;                // Track ended; close on the next call
+    int hasCrop;
+    double opened;          // ms
+    OutputBestShot shot;
+} Candidate;
+
+static Candidate candidates[OUTPUT_BESTSHOT_MAX];
+
+static float score(const DetectionList* d, unsigned i, float speed) {
+    float size = sqrtf(d->w[i] * d->h[i]) / BESTSHOT_FULL_SIZE;
+    if (size > 1) size = 1;
+    float s = d->c[i] / 100.0f * size;
+    if (d->x[i] <= BESTSHOT_EDGE || d->y[i] <= BESTSHOT_EDGE ||
+        d->x[i] + d->w[i] >= 1000 - BESTSHOT_EDGE || d->y[i] + d->h[i] >= 1000 - BESTSHOT_EDGE)
+        s *= 0.5f;
+    return s / (1 + speed * BESTSHOT_BLUR);
+}
+
+static Candidate* find(unsigned view, unsigned track, int label) {
+    for (unsigned i = 0; i < OUTPUT_BESTSHOT_MAX; i++) {
+        Candidate* c = &candidates[i];
+        if (!c->open || c->shot.view != view || c->shot.track != track)
+            continue;
+        if (track || c->shot.label == label)
+            return c;
+    }
+    return NULL;
+}
+
+int output_bestshot_offer(unsigned view, const DetectionList* detections, unsigned index,
+                          float speed, double now) {
+    if (!detections || index >= detections->count)
+        return 0;
+    unsigned track = detections->track[index];
+    int label = detections->label[index];
+    int opened = 0;
+
+    Candidate* c = find(view, track, label);
+    if (!c) {
+        for (unsigned i = 0; i < OUTPUT_BESTSHOT_MAX && !c; i++)
+            if (!candidates[i].open)
+                c = &candidates[i];
+        if (!c)
+            return 0;
+        c->open = 1;
+        c->due = 0;
+        c->hasCrop = 0;
+        c->opened = now;
+        c->shot.view = view;
+        c->shot.track = track;
+        c->shot.label = label;
+        opened = 1;
+    }
+
+    float s = score(detections, index, speed);
+    if (c->hasCrop && s <= c->shot.score)
+        return opened;
+    if (!Model_Copy_Crop(detections, index, &c->shot.crop))
+        return opened;
+    c->hasCrop = 1;
+    c->shot.score = s;
+    c->shot.confidence = detections->c[index];
+    c->shot.timestamp = detections->timestamp[index];
+    return opened;
+}
+
+int output_bestshot_is_open(unsigned view, unsigned track, int label) {
+    return find(view, track, label) != NULL;
+}
+
+void output_bestshot_end(unsigned view, unsigned track) {
+    Candidate* c = track ? find(view, track, 0) : NULL;
+    if (c)
+        c->due = 1;
+}
+
+const OutputBestShot* output_bestshot_next(double now, double window) {
+    for (unsigned i = 0; i < OUTPUT_BESTSHOT_MAX; i++) {
+        Candidate* c = &candidates[i];
+        if (!c->open || (!c->due && now - c->opened < window))
+            continue;
+        c->open = 0;
+        if (c->hasCrop)
+            return &c->shot;
+    }
+    return NULL;
+}
+
+void output_bestshot_reset(void) {
+    for (unsigned i = 0; i < OUTPUT_BESTSHOT_MAX; i++)
+        candidates[i].open = 0;
+}
+
+void output_bestshot_cleanup(void) {
+    for (unsigned i = 0; i < OUTPUT_BESTSHOT_MAX; i++) {
+        candidates[i].open = 0;
+        Model_Free_Crop(&candidates[i].shot.crop);
+    }
+}
@@ -0,0 +1,91 @@
+/**
+ * @file output_bestshot.h
+ * @brief Best-shot crop selection: one crop per track or label and window.
+ *
+ * Instead of encoding every detection and throttling the exports, each
+ * detection is offered as a candidate. The candidates are keyed by view and
+ * track id (tracker on) or label (tracker off). A candidate is scored from
+ * metadata only: confidence, box size, a penalty for boxes cut by the frame
+ * edge, and, for tracks, a motion blur penalty from the track speed. Only a
+ * better candidate copies its crop region out of the frame
+ * (Model_Copy_Crop()). When the window closes, the winner is handed back for
+ * its single JPEG encode and export.
+ *
+ * A window opens with the first candidate of a key and closes 'window' ms
+ * later ("cropping.throttle"), or when its track ends. With the tracker on,
+ * a track gets one window, so it exports one crop.
+ */
+
+#ifndef OUTPUT_BESTSHOT_H
+#define OUTPUT_BESTSHOT_H
+
+#include "Detections.h"
+#include "Model.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Windows open at the same time; candidates of further keys are dropped. */
+#define OUTPUT_BESTSHOT_MAX 8
+
+/**
+ * @brief A closed window and its winning crop.
+ */
+typedef struct {
+    unsigned view;
+    unsigned track;         ///< 0 when keyed by label
+    int label;
+    float confidence;       ///< 0..100
+    float score;
+    double timestamp;       ///< Epoch ms of the winning frame
+    ModelCrop crop;
+} OutputBestShot;
+
+/**
+ * @brief Offer detection 'index' of the current frame as a candidate.
+ *
+ * Call before Model_Reset(); the crop is copied only if it is the best
+ * candidate of its window so far.
+ *
+ * @param speed  Track speed (Tracker_Speed()), 0 if unknown.
+ * @param now    ms, same clock as output_bestshot_next().
+ * @return 1 if it opened a new window.
+ */
+int output_bestshot_offer(unsigned view, const DetectionList* detections, unsigned index,
+                          float speed, double now);
+
+/**
+ * @brief True if a window is open for the key of a detection.
+ */
+int output_bestshot_is_open(unsigned view, unsigned track, int label);
+
+/**
+ * @brief Close the window of a track that ended.
+ */
+void output_bestshot_end(unsigned view, unsigned track);
+
+/**
+ * @brief Take the next window that is due.
+ *
+ * @param now    ms.
+ * @param window Window length in ms.
+ * @return A winner valid until the next call or offer, or NULL when none is due.
+ */
+const OutputBestShot* output_bestshot_next(double now, double window);
+
+/**
+ * @brief Drop all open windows.
+ */
+void output_bestshot_reset(void);
+
+/**
+ * @brief Drop all windows and free the crop buffers.
+ */
+void output_bestshot_cleanup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUTPUT_BESTSHOT_H
@@ -0,0 +1,66 @@
+/**
+ * @file output_binary.c
+ * @brief Implementation of the binary detection encoding.
+ */
+
+#include "Output_binary.h"
+
+static uint8_t* put16(uint8_t* p, unsigned v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t* put32(uint8_t* p, uint32_t v) {
+    p = put16(p, v & 0xffff);
+    return put16(p, v >> 16);
+}
+
+static uint8_t* put64(uint8_t* p, uint64_t v) {
+    p = put32(p, (uint32_t)v);
+    return put32(p, (uint32_t)(v >> 32));
+}
+
+// 0..1000 to 0..65535, clamped
+static unsigned unit16(float v) {
+    if (v <= 0)
+        return 0;
+    if (v >= 1000)
+        return 65535;
+    return (unsigned)(v * 65.535f + 0.5f);
+}
+
+size_t output_binary_encode(const DetectionList* detections, unsigned view, double timestamp,
+                            uint8_t* out, size_t size) {
+    unsigned count = detections ? detections->count : 0;
+    unsigned flags = 0;
+    for (unsigned i = 0; i < count; i++)
+        if (detections->track[i])
+            flags |= OUTPUT_BINARY_FLAG_TRACK;
+    size_t record = OUTPUT_BINARY_RECORD + (flags & OUTPUT_BINARY_FLAG_TRACK ? OUTPUT_BINARY_TRACK : 0);
+    size_t length = OUTPUT_BINARY_HEADER + count * record;
+    if (!out || length > size || count > 0xffff)
+        return 0;
+
+    uint8_t* p = out;
+    *p++ = 'D';
+    *p++ = 'X';
+    *p++ = OUTPUT_BINARY_VERSION;
+    *p++ = (uint8_t)view;
+    p = put16(p, count);
+    p = put16(p, flags);
+    p = put64(p, timestamp > 0 ? (uint64_t)timestamp : 0);
+
+    for (unsigned i = 0; i < count; i++) {
+        int c = (int)(detections->c[i] + 0.5f);
+        *p++ = (uint8_t)detections->label[i];
+        *p++ = (uint8_t)(c < 0 ? 0 : c > 100 ? 100 : c);
+        p = put16(p, unit16(detections->x[i]));
+        p = put16(p, unit16(detections->y[i]));
+        p = put16(p, unit16(detections->w[i]));
+        p = put16(p, unit16(detections->h[i]));
+        if (flags & OUTPUT_BINARY_FLAG_TRACK)
+            p = put32(p, detections->track[i]);
+    }
+    return length;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file output_binary.h
+ * @brief Compact binary encoding of the per-frame detections for MQTT.
+ *
+ * Schema version 1, all fields little-endian, no padding.
+ *
+ * Header, 16 bytes:
+ *   0  u8[2]  magic "DX"
+ *   2  u8     version (1)
+ *   3  u8     view index
+ *   4  u16    record count
+ *   6  u16    flags; bit 0: records carry a track id
+ *   8  u64    frame time, epoch ms
+ *
+ * Record, 10 bytes (14 with track ids):
+ *   0  u8     class id, index into the retained label table
+ *   1  u8     confidence 0..100
+ *   2  u16    x, top left, 0..65535 of the frame width
+ *   4  u16    y, 0..65535 of the frame height
+ *   6  u16    w
+ *   8  u16    h
+ *  10  u32    track id (flag bit 0 only)
+ *
+ * The label table is JSON, published retained on labels/<serial> on every
+ * connect: { "schema": 1, "labels": [...], "views": [...] }.
+ */
+
+#ifndef OUTPUT_BINARY_H
+#define OUTPUT_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Detections.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OUTPUT_BINARY_VERSION     1
+#define OUTPUT_BINARY_HEADER      16
+#define OUTPUT_BINARY_RECORD      10
+#define OUTPUT_BINARY_TRACK       4
+#define OUTPUT_BINARY_FLAG_TRACK  0x0001
+
+/** Largest encoded frame. */
+#define OUTPUT_BINARY_MAX (OUTPUT_BINARY_HEADER + DETECTIONS_MAX * (OUTPUT_BINARY_RECORD + OUTPUT_BINARY_TRACK))
+
+/**
+ * @brief Encode filtered detections (0..1000, confidence 0..100).
+ *
+ * @param detections Detections of one frame (may be NULL for an empty frame).
+ * @param view       View index.
+ * @param timestamp  Frame time, epoch ms.
+ * @param out        Output buffer.
+ * @param size       Size of out; OUTPUT_BINARY_MAX always fits.
+ * @return Encoded length, or 0 if out is too small.
+ */
+size_t output_binary_encode(const DetectionList* detections, unsigned view, double timestamp,
+                            uint8_t* out, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUTPUT_BINARY_H
@@ -3,8 +3,10 @@
  * @brief Implementation of detection crop ring buffer and HTTP callback API.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <syslog.h>
 #include <pthread.h>
 #include "Output_crop_cache.h"
 #include "Output_helpers.h"
@@ -13,19 +15,56 @@
  * @brief An entry in the FIFO crop cache.
  */
 typedef struct {
-    char *base64_image;        ///< malloc'ed, may be NULL if uninitialized.
+    unsigned id;               ///< 0 if unused
+    unsigned size;             ///< JPEG bytes in the entry's slab slot
     char label[64];            ///< Category name
     int confidence;            ///< Confidence 0..100
     int x, y, w, h;            ///< Crop rectangle
 } CropEntry;
 
 // Crop cache ring buffer and synchronization
-static CropEntry crop_history[CROP_HISTORY_SIZE];
+static CropEntry crop_history[CROP_HISTORY_MAX];
+static unsigned char *crop_slab = NULL;       // crop_history_size slots of CROP_SLOT_SIZE
+static int crop_history_size = 0;
 static int crop_history_head = 0;        // index to write next
-static int crop_history_count = 0;       // number of valid entries (<= CROP_HISTORY_SIZE)
+static int crop_history_count = 0;       // number of valid entries (<= crop_history_size)
+static unsigned crop_next_id = 1;
 static pthread_mutex_t crop_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-const char*
+#define CROP_BASE64_CHUNK 3072       // Input bytes per base64 write, a multiple of 3
+
+static void clear_history(void)
+{
+    memset(crop_history, 0, sizeof(crop_history));
+    crop_history_head = 0;
+    crop_history_count = 0;
+}
+
+int output_crop_cache_init(unsigned history_size)
+{
+    if (history_size < 1) history_size = 1;
+    if (history_size > CROP_HISTORY_MAX) history_size = CROP_HISTORY_MAX;
+
+    pthread_mutex_lock(&crop_cache_mutex);
+    if (crop_slab && crop_history_size == (int)history_size) {
+        clear_history();
+        pthread_mutex_unlock(&crop_cache_mutex);
+        return 1;
+    }
+    free(crop_slab);
+    crop_slab = malloc((size_t)history_size * CROP_SLOT_SIZE);
+    crop_history_size = crop_slab ? (int)history_size : 0;
+    clear_history();
+    pthread_mutex_unlock(&crop_cache_mutex);
+
+    if (!crop_slab) {
+        syslog(LOG_WARNING, "output_crop_cache_init: Unable to allocate %u crops", history_size);
+        return 0;
+    }
+    return 1;
+}
+
+unsigned
 output_crop_cache_add(
     const unsigned char *jpeg_data,
     unsigned jpeg_size,
@@ -34,19 +73,20 @@ output_crop_cache_add(
     int x, int y, int w, int h)
 {
     // Defensive: null input
-    if (!jpeg_data || jpeg_size == 0 || !label) return NULL;
-    char *b64img = base64_encode(jpeg_data, jpeg_size);
-    if (!b64img) return NULL;
+    if (!jpeg_data || jpeg_size == 0 || !label) return 0;
+    if (jpeg_size > CROP_SLOT_SIZE) return 0;
 
     pthread_mutex_lock(&crop_cache_mutex);
+    if (!crop_slab) {
+        pthread_mutex_unlock(&crop_cache_mutex);
+        return 0;
+    }
 
     CropEntry *entry = &crop_history[crop_history_head];
-
-    if (entry->base64_image) {
-        free(entry->base64_image);
-        entry->base64_image = NULL;
-    }
-    entry->base64_image = b64img;
+    memcpy(crop_slab + (size_t)crop_history_head * CROP_SLOT_SIZE, jpeg_data, jpeg_size);
+    entry->id = crop_next_id++;
+    if (crop_next_id == 0) crop_next_id = 1;
+    entry->size = jpeg_size;
     strncpy(entry->label, label, sizeof(entry->label) - 1);
     entry->label[sizeof(entry->label) - 1] = 0;
     entry->confidence = confidence;
@@ -54,32 +94,95 @@ output_crop_cache_add(
     entry->y = y;
     entry->w = w;
     entry->h = h;
+    unsigned id = entry->id;
 
-    crop_history_head = (crop_history_head + 1) % CROP_HISTORY_SIZE;
-    if (crop_history_count < CROP_HISTORY_SIZE) crop_history_count++;
+    crop_history_head = (crop_history_head + 1) % crop_history_size;
+    if (crop_history_count < crop_history_size) crop_history_count++;
 
     pthread_mutex_unlock(&crop_cache_mutex);
 
-    return b64img;
+    return id;
 }
 
 void output_crop_cache_reset(void)
 {
     pthread_mutex_lock(&crop_cache_mutex);
+    clear_history();
+    pthread_mutex_unlock(&crop_cache_mutex);
+}
+
+void output_crop_cache_cleanup(void)
+{
+    pthread_mutex_lock(&crop_cache_mutex);
+    free(crop_slab);
+    crop_slab = NULL;
+    crop_history_size = 0;
+    clear_history();
+    pthread_mutex_unlock(&crop_cache_mutex);
+}
 
-    for (int i = 0; i < CROP_HISTORY_SIZE; ++i) {
-        if (crop_history[i].base64_image) {
-            free(crop_history[i].base64_image);
-            crop_history[i].base64_image = NULL;
+// Write one entry as a JSON object, with the JPEG base64 encoded in chunks if given
+static void write_entry(ACAP_HTTP_Response response, const CropEntry *entry, const unsigned char *jpeg)
+{
+    ACAP_HTTP_Respond_String(response, "{\"id\":%u,\"label\":", entry->id);
+    ACAP_HTTP_Write_JSON_String(response, entry->label);
+    ACAP_HTTP_Respond_String(response,
+        ",\"confidence\":%d,\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,\"size\":%u",
+        entry->confidence, entry->x, entry->y, entry->w, entry->h, entry->size);
+    if (jpeg) {
+        char b64[4 * CROP_BASE64_CHUNK / 3];
+        ACAP_HTTP_Respond_Data(response, 10, ",\"image\":\"");
+        for (unsigned offset = 0; offset < entry->size; offset += CROP_BASE64_CHUNK) {
+            unsigned len = entry->size - offset < CROP_BASE64_CHUNK ? entry->size - offset : CROP_BASE64_CHUNK;
+            ACAP_HTTP_Respond_Data(response, base64_encode_to(jpeg + offset, len, b64), b64);
         }
-        crop_history[i].label[0] = '\0';
-        crop_history[i].confidence = 0;
-        crop_history[i].x = crop_history[i].y = crop_history[i].w = crop_history[i].h = 0;
+        ACAP_HTTP_Respond_Data(response, 1, "\"");
     }
-    crop_history_head = 0;
-    crop_history_count = 0;
+    ACAP_HTTP_Respond_Data(response, 1, "}");
+}
 
+// Copy entry n (0 is newest) and its JPEG out of the ring. Returns 0 past the end.
+static int copy_entry(int n, CropEntry *entry, unsigned char *jpeg)
+{
+    int found = 0;
+    pthread_mutex_lock(&crop_cache_mutex);
+    if (n < crop_history_count) {
+        int idx = (crop_history_head - 1 - n + 2 * crop_history_size) % crop_history_size;
+        *entry = crop_history[idx];
+        if (jpeg)
+            memcpy(jpeg, crop_slab + (size_t)idx * CROP_SLOT_SIZE, entry->size);
+        found = 1;
+    }
     pthread_mutex_unlock(&crop_cache_mutex);
+    return found;
+}
+
+static void respond_image(ACAP_HTTP_Response response, unsigned id, unsigned char *jpeg)
+{
+    CropEntry entry;
+    int found = 0;
+    pthread_mutex_lock(&crop_cache_mutex);
+    for (int n = 0; n < crop_history_count; ++n) {
+        int idx = (crop_history_head - 1 - n + 2 * crop_history_size) % crop_history_size;
+        if (crop_history[idx].id == id) {
+            entry = crop_history[idx];
+            memcpy(jpeg, crop_slab + (size_t)idx * CROP_SLOT_SIZE, entry.size);
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&crop_cache_mutex);
+
+    if (!found) {
+        ACAP_HTTP_Respond_Error(response, 404, "Crop not found");
+        return;
+    }
+    ACAP_HTTP_Respond_String(response,
+        "Content-Type: image/jpeg\r\n"
+        "Content-Length: %u\r\n"
+        "Cache-Control: max-age=3600\r\n"
+        "\r\n", entry.size);
+    ACAP_HTTP_Respond_Data(response, entry.size, jpeg);
 }
 
 void output_crop_cache_http_callback(
@@ -91,30 +194,36 @@ void output_crop_cache_http_callback(
         return;
     }
 
-    cJSON *arr = cJSON_CreateArray();
-
-    pthread_mutex_lock(&crop_cache_mutex);
-
-    // Show most recent to least recent
-    int idx = (crop_history_head - 1 + CROP_HISTORY_SIZE) % CROP_HISTORY_SIZE;
-    for (int i = 0; i < crop_history_count; ++i) {
-        CropEntry *entry = &crop_history[idx];
-
-        cJSON *item = cJSON_CreateObject();
-        cJSON_AddStringToObject(item, "image", entry->base64_image ? entry->base64_image : "");
-        cJSON_AddStringToObject(item, "label", entry->label);
-        cJSON_AddNumberToObject(item, "confidence", entry->confidence);
-        cJSON_AddNumberToObject(item, "x", entry->x);
-        cJSON_AddNumberToObject(item, "y", entry->y);
-        cJSON_AddNumberToObject(item, "w", entry->w);
-        cJSON_AddNumberToObject(item, "h", entry->h);
-        cJSON_AddItemToArray(arr, item);
-
-        idx = (idx - 1 + CROP_HISTORY_SIZE) % CROP_HISTORY_SIZE;
+    const char *id = ACAP_HTTP_Request_Param(request, "id");
+    const char *list = ACAP_HTTP_Request_Param(request, "list");
+    int metadata_only = !id && list && strcmp(list, "0") != 0;
+
+    // Several requests may run at once, so each has its own copy of a crop
+    unsigned char *jpeg = NULL;
+    if (!metadata_only) {
+        jpeg = malloc(CROP_SLOT_SIZE);
+        if (!jpeg) {
+            ACAP_HTTP_Respond_Error(response, 500, "Out of memory");
+            return;
+        }
     }
 
-    pthread_mutex_unlock(&crop_cache_mutex);
+    if (id) {
+        respond_image(response, (unsigned)strtoul(id, NULL, 10), jpeg);
+        free(jpeg);
+        return;
+    }
 
-    ACAP_HTTP_Respond_JSON(response, arr);
-    cJSON_Delete(arr);
+    // Entries are copied out one at a time so the mutex is never held while
+    // writing, and each is streamed so the response is never built in memory
+    CropEntry entry;
+    ACAP_HTTP_Header_JSON(response);
+    ACAP_HTTP_Respond_Data(response, 1, "[");
+    for (int n = 0; copy_entry(n, &entry, jpeg); ++n) {
+        if (n)
+            ACAP_HTTP_Respond_Data(response, 1, ",");
+        write_entry(response, &entry, jpeg);
+    }
+    ACAP_HTTP_Respond_Data(response, 1, "]");
+    free(jpeg);
 }
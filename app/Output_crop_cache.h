@@ -3,8 +3,17 @@
  * @brief Ring buffer image crop cache and HTTP API for recent detections.
  *
  * Provides a thread-safe, fixed-size ring buffer to store a history of
- * cropped detection images with metadata, and the HTTP callback to dump this
- * history as a JSON array.
+ * cropped detection images with metadata, and the HTTP callback to serve
+ * this history.
+ *
+ * Crops are stored as raw JPEG in one slab allocated at init, one fixed-size
+ * slot per history entry. Base64 is only produced for the JSON listing that
+ * embeds the images.
+ *
+ * HTTP API (node "crops"):
+ *   - crops          JSON array, newest first, with base64 "image" (legacy)
+ *   - crops?list=1   JSON array, newest first, metadata only (id, size, ...)
+ *   - crops?id=N     The JPEG of crop N as image/jpeg
  */
 
 #ifndef OUTPUT_CROP_CACHE_H
@@ -14,18 +23,36 @@
 #include "ACAP.h"
 
 /**
- * Number of recent crops to keep in history.
+ * Default number of recent crops to keep in history (settings "cropping.history").
  */
 #define CROP_HISTORY_SIZE 10
+#define CROP_HISTORY_MAX  50
+
+/**
+ * Bytes reserved per crop in the slab. Larger crops are not kept in history.
+ */
+#ifndef CROP_SLOT_SIZE
+#define CROP_SLOT_SIZE (256 * 1024)
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Allocate the slab for a history of the given size.
+ *
+ * Clears the history. Can be called again to change the size.
+ *
+ * @param history_size Number of crops to keep (1..CROP_HISTORY_MAX).
+ * @return 1 on success, 0 if the slab could not be allocated.
+ */
+int output_crop_cache_init(unsigned history_size);
+
 /**
  * @brief Add a crop JPEG and its metadata to the history buffer.
  *
- * The JPEG is base64-encoded for storage.
+ * The JPEG bytes are copied into the slab as is.
  * The buffer runs in FIFO, overwriting oldest entries.
  *
  * @param jpeg_data   Pointer to JPEG bytes.
@@ -36,9 +63,9 @@ extern "C" {
  * @param y           Top left Y coordinate of crop.
  * @param w           Width of crop.
  * @param h           Height of crop.
- * @return Pointer to the (owned) base64 encoded string (may be freed), or NULL on error.
+ * @return Id of the stored crop (used with crops?id=N), or 0 if not stored.
  */
-const char* output_crop_cache_add(
+unsigned output_crop_cache_add(
     const unsigned char *jpeg_data,
     unsigned jpeg_size,
     const char *label,
@@ -46,13 +73,17 @@ const char* output_crop_cache_add(
     int x, int y, int w, int h);
 
 /**
- * @brief Reset (clear) the crop cache and free any memory.
+ * @brief Reset (clear) the crop cache. The slab is kept.
  */
 void output_crop_cache_reset(void);
 
 /**
- * @brief HTTP GET callback which responds with the latest crop history.
- *        Array is sorted newest-first.
+ * @brief Free the slab.
+ */
+void output_crop_cache_cleanup(void);
+
+/**
+ * @brief HTTP GET callback which responds with the crop history or one crop image.
  *
  * @param response   ACAP HTTP response handle.
  * @param request    ACAP HTTP request handle.
@@ -0,0 +1,109 @@
+/**
+ * @file output_events.c
+ * @brief Implementation of the per-class event gate.
+ */
+
+#include <string.h>
+#include "Output_events.h"
+
+typedef struct {
+    uint64_t history[DETECTIONS_MAX_CLASSES];   // Bit 0 is the most recent frame
+    double lastDetect[DETECTIONS_MAX_CLASSES];  // ms
+    DetectionClasses tracked;                   // Classes with a hit in the window
+    DetectionClasses high;                      // Classes with state HIGH
+    double lastFrame;
+    double frameInterval;
+} EventGate;
+
+static EventGate gates[OUTPUT_EVENTS_MAX_VIEWS];
+
+static EventGate* gate(unsigned view) {
+    return &gates[view < OUTPUT_EVENTS_MAX_VIEWS ? view : 0];
+}
+
+// Frames covering the window, and never fewer than the hits it must hold
+static int window_frames(const EventGate* g, const OutputEventsConfig* config) {
+    int frames = config->frames;  // Not measured yet; only the first frames of a run
+    if (g->frameInterval > 0) {
+        int covering = (int)((config->window + g->frameInterval - 1) / g->frameInterval);
+        if (covering > frames)
+            frames = covering;
+    }
+    if (frames < 2) frames = 2;
+    if (frames > OUTPUT_EVENTS_MAX_WINDOW) frames = OUTPUT_EVENTS_MAX_WINDOW;
+    return frames;
+}
+
+DetectionClasses output_events_update(unsigned view, const DetectionClasses* present, double now, const OutputEventsConfig* config) {
+    EventGate* g = gate(view);
+    uint64_t* history = g->history;
+    if (g->lastFrame > 0) {
+        double elapsed = now - g->lastFrame;
+        // A gap ages the history by the frames it would have held, so hits
+        // before a pause count no more than they would at the usual rate.
+        // The gap is then the interval until the next frames measure it again.
+        if (g->frameInterval > 0 && elapsed > 2 * g->frameInterval) {
+            double missed = elapsed / g->frameInterval - 1;
+            int shift = missed >= OUTPUT_EVENTS_MAX_WINDOW ? OUTPUT_EVENTS_MAX_WINDOW : (int)missed;
+            DetectionClasses classes = g->tracked;
+            memset(&g->tracked, 0, sizeof(g->tracked));
+            for (int c; (c = Detections_Class_Pop(&classes)) >= 0;) {
+                history[c] = shift >= 64 ? 0 : history[c] << shift;
+                if (history[c])
+                    Detections_Class_Set(&g->tracked, c);
+            }
+            g->frameInterval = elapsed;
+        } else if (elapsed > 0) {
+            g->frameInterval = g->frameInterval > 0 ? g->frameInterval * 0.9 + elapsed * 0.1 : elapsed;
+        }
+    }
+    g->lastFrame = now;
+
+    int size = window_frames(g, config);
+    uint64_t mask = size >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << size) - 1;
+    int required = config->accuracy ? config->frames : 1;
+    if (required < 1) required = 1;
+    if (required > size) required = size;
+
+    DetectionClasses rising = {{0}};
+    DetectionClasses classes = g->tracked;
+    Detections_Class_Merge(&classes, present);
+    memset(&g->tracked, 0, sizeof(g->tracked));
+    for (int c; (c = Detections_Class_Pop(&classes)) >= 0;) {
+        int hit = Detections_Class_Test(present, c);
+        history[c] = ((history[c] << 1) | (uint64_t)hit) & mask;
+        if (history[c])
+            Detections_Class_Set(&g->tracked, c);
+        if (hit)
+            g->lastDetect[c] = now;
+        if (Detections_Class_Test(&g->high, c))
+            continue;
+        int hits = config->accuracy ? __builtin_popcountll(history[c]) : hit;
+        if (hits >= required) {
+            Detections_Class_Set(&g->high, c);
+            Detections_Class_Set(&rising, c);
+        }
+    }
+    return rising;
+}
+
+DetectionClasses output_events_expire(unsigned view, double now, double minEventDuration) {
+    EventGate* g = gate(view);
+    DetectionClasses falling = {{0}};
+    DetectionClasses classes = g->high;
+    for (int c; (c = Detections_Class_Pop(&classes)) >= 0;) {
+        if (now - g->lastDetect[c] > minEventDuration) {
+            Detections_Class_Set(&falling, c);
+            Detections_Class_Clear(&g->high, c);
+        }
+    }
+    return falling;
+}
+
+double output_events_frame_interval(unsigned view) {
+    return gate(view)->frameInterval;
+}
+
+void output_events_reset(void) {
+    memset(gates, 0, sizeof(gates));
+}
@@ -0,0 +1,83 @@
+/**
+ * @file output_events.h
+ * @brief Per-class event gating for detection events.
+ *
+ * State is indexed by model class id. Each frame, Output() passes the set of
+ * classes present in the frame as a bitset; the gate keeps one bit per frame
+ * per class in a sliding window, so counting hits is a mask and popcount
+ * instead of a rescan, and no label strings are touched.
+ *
+ * The window is time based: its length in frames is derived from the
+ * measured interval between frames, so it keeps covering the configured
+ * duration when the frame rate changes. It is never shorter than
+ * eventLogic.frames, so at low rates it spans that many frames instead.
+ * A gap between frames ages the history by the frames it would have held.
+ *
+ * Each view has its own gate, so the same class can be HIGH in one view
+ * and LOW in another, and the window follows each view's own frame rate.
+ *
+ * The gate only tracks state. The caller fires the ACAP/MQTT events for the
+ * classes returned as rising (from output_events_update) or falling (from
+ * output_events_expire).
+ */
+
+#ifndef OUTPUT_EVENTS_H
+#define OUTPUT_EVENTS_H
+
+#include <stdint.h>
+#include "Detections.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of independent gates, one per view. */
+#define OUTPUT_EVENTS_MAX_VIEWS 4
+
+/** Longest window in frames (one bit per frame). */
+#define OUTPUT_EVENTS_MAX_WINDOW 64
+
+/**
+ * @brief Gate settings, taken from the settings snapshot.
+ */
+typedef struct {
+    int accuracy;       ///< 1: require 'frames' hits within 'window' ms; 0: go HIGH on first hit
+    int frames;         ///< eventLogic.frames
+    int window;         ///< eventLogic.window in ms
+} OutputEventsConfig;
+
+/**
+ * @brief Advance the gate by one frame.
+ *
+ * Call once per processed frame, also for frames without detections.
+ *
+ * @param view    View the frame came from.
+ * @param present Class ids detected in this frame.
+ * @param now     Frame time in ms.
+ * @param config  Gate settings.
+ * @return Classes that went HIGH on this frame.
+ */
+DetectionClasses output_events_update(unsigned view, const DetectionClasses* present, double now, const OutputEventsConfig* config);
+
+/**
+ * @brief Set classes LOW in a view that have not been detected for minEventDuration ms.
+ *
+ * @return Classes that went LOW.
+ */
+DetectionClasses output_events_expire(unsigned view, double now, double minEventDuration);
+
+/**
+ * @brief Frame interval in ms of a view used for its window (0 until measured).
+ */
+double output_events_frame_interval(unsigned view);
+
+/**
+ * @brief Clear the state of all views. Classes that were HIGH are dropped without a falling edge.
+ */
+void output_events_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUTPUT_EVENTS_H
@@ -27,6 +27,15 @@ char* base64_encode(const unsigned char *src, size_t len)
     size_t olen = 4 * ((len + 2) / 3);     // Output is always a multiple of 4
     char *out = (char*)malloc(olen + 1);
     if (!out) return NULL;
+    out[base64_encode_to(src, len, out)] = '\0';
+    return out;
+}
+
+/**
+ * @brief Encode a memory buffer to base64 into the caller's buffer.
+ */
+size_t base64_encode_to(const unsigned char *src, size_t len, char *out)
+{
     char *pos = out;
 
     int val = 0, valb = -6;
@@ -40,9 +49,8 @@ char* base64_encode(const unsigned char *src, size_t len)
     }
     if (valb > -6) *pos++ = base64_table[((val << 8) >> (valb + 8)) & 0x3F];
     while ((pos - out) % 4) *pos++ = '=';
-    *pos = '\0';
 
-    return out;
+    return (size_t)(pos - out);
 }
 
 /**
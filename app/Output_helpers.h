@@ -60,6 +60,18 @@ int save_label_to_file(const char* path, const char* label, int x, int y, int w,
  */
 char* base64_encode(const unsigned char *src, size_t len);
 
+/**
+ * @brief Encode a binary buffer in base64 into a caller buffer.
+ *
+ * Chunks of a multiple of 3 bytes can be encoded one after the other.
+ *
+ * @param src Pointer to input buffer.
+ * @param len Input length in bytes.
+ * @param out Room for 4 * ((len + 2) / 3) characters; no NUL is written.
+ * @return Characters written.
+ */
+size_t base64_encode_to(const unsigned char *src, size_t len, char *out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,83 +9,293 @@
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <pthread.h>
+#include <time.h>
 #include "Output_http.h"
+#include "Metrics.h"
 
-int output_http_post_json(
-    const char* url,
-    cJSON* payload,
-    const char* authentication,
-    const char* username,
-    const char* password,
-    const char* token
-)
-{
-    if (!url || !payload)
-        return 0;
+#define OUTPUT_HTTP_TIMEOUT 10L          // Seconds per POST, also bounds output_http_stop()
+#define OUTPUT_HTTP_CONNECT_TIMEOUT 5L
 
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        syslog(LOG_WARNING, "output_http_post_json: CURL initialization failed");
-        return 0;
-    }
+typedef struct {
+    char* url;
+    char authentication[16];
+    char username[64];
+    char password[64];
+    char* token;
+    unsigned batch;
+    char* payload;
+} OutputHttpJob;
+
+static OutputHttpJob* queue[OUTPUT_HTTP_QUEUE_SIZE];
+static unsigned queueHead = 0;
+static unsigned queueCount = 0;
+static OutputHttpStats stats;
+static int running = 0;
+static int stopping = 0;
+static pthread_t dispatcherThread;
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void copy_string(char* dst, size_t size, const char* src) {
+    snprintf(dst, size, "%s", src ? src : "");
+}
+
+static char* dup_string(const char* src) {
+    return strdup(src ? src : "");
+}
+
+static void free_job(OutputHttpJob* job) {
+    if (!job)
+        return;
+    free(job->url);
+    free(job->token);
+    free(job->payload);
+    free(job);
+}
+
+static int same_target(const OutputHttpJob* a, const OutputHttpJob* b) {
+    return strcmp(a->url, b->url) == 0 &&
+           strcmp(a->authentication, b->authentication) == 0 &&
+           strcmp(a->username, b->username) == 0 &&
+           strcmp(a->password, b->password) == 0 &&
+           strcmp(a->token, b->token) == 0;
+}
+
+// POST one body on the persistent handle. curl_easy_reset keeps the
+// connection cache, so consecutive posts to the same host reuse the connection.
+static int post(CURL* curl, const OutputHttpJob* target, const char* body)
+{
     int ok = 0;
     struct curl_slist *headers = NULL;
-    char *payload_str = NULL;
+
+    curl_easy_reset(curl);
 
     // Set content-type
     headers = curl_slist_append(headers, "Content-Type: application/json");
 
     // Handle authentication
-    if (authentication) {
-        if (strcmp(authentication, "basic") == 0 && username && password) {
-            curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_BASIC);
-            char userpwd[256];
-            snprintf(userpwd, sizeof(userpwd), "%s:%s", username, password);
-            curl_easy_setopt(curl, CURLOPT_USERPWD, userpwd);
-        } else if (strcmp(authentication, "digest") == 0 && username && password) {
-            curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_DIGEST);
-            char userpwd[256];
-            snprintf(userpwd, sizeof(userpwd), "%s:%s", username, password);
-            curl_easy_setopt(curl, CURLOPT_USERPWD, userpwd);
-        } else if (strcmp(authentication, "bearer") == 0 && token) {
-            char bearer_header[384];
-            snprintf(bearer_header, sizeof(bearer_header), "Authorization: Bearer %s", token);
+    char userpwd[256];
+    snprintf(userpwd, sizeof(userpwd), "%s:%s", target->username, target->password);
+    if (strcmp(target->authentication, "basic") == 0 && target->username[0]) {
+        curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_BASIC);
+        curl_easy_setopt(curl, CURLOPT_USERPWD, userpwd);
+    } else if (strcmp(target->authentication, "digest") == 0 && target->username[0]) {
+        curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_DIGEST);
+        curl_easy_setopt(curl, CURLOPT_USERPWD, userpwd);
+    } else if (strcmp(target->authentication, "bearer") == 0 && target->token[0]) {
+        size_t size = strlen(target->token) + sizeof("Authorization: Bearer ");
+        char* bearer_header = malloc(size);
+        if (bearer_header) {
+            snprintf(bearer_header, size, "Authorization: Bearer %s", target->token);
             headers = curl_slist_append(headers, bearer_header);
+            free(bearer_header);
         }
-        // else ("none" or missing) => do nothing extra
-    }
-
-    // Prepare JSON
-    payload_str = cJSON_PrintUnformatted(payload);
-    if (!payload_str) {
-        syslog(LOG_WARNING, "output_http_post_json: Unable to encode JSON payload");
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-        return 0;
     }
+    // else ("none" or missing) => do nothing extra
 
     // Set CURL options
-    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_URL, target->url);
     curl_easy_setopt(curl, CURLOPT_POST, 1L);
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload_str);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, OUTPUT_HTTP_TIMEOUT);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, OUTPUT_HTTP_CONNECT_TIMEOUT);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
 
+    uint64_t start = Metrics_Now();
     CURLcode res = curl_easy_perform(curl);
+    Metrics_Stage(METRICS_HTTP, start);
 
     if (res != CURLE_OK) {
-        syslog(LOG_WARNING, "output_http_post_json: HTTP POST failed: %s", curl_easy_strerror(res));
+        syslog(LOG_WARNING, "output_http: HTTP POST to %s failed: %s", target->url, curl_easy_strerror(res));
     } else {
         long http_code = 0;
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
         if (http_code >= 200 && http_code < 300) {
             ok = 1;
         } else {
-            syslog(LOG_WARNING, "output_http_post_json: HTTP POST returned status %ld", http_code);
+            syslog(LOG_WARNING, "output_http: HTTP POST to %s returned status %ld", target->url, http_code);
         }
     }
 
-    if (payload_str) free(payload_str);
     curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
     return ok;
 }
+
+static void* dispatcher(void* arg) {
+    (void)arg;
+    CURL* curl = curl_easy_init();
+    if (!curl)
+        syslog(LOG_WARNING, "output_http: CURL initialization failed");
+
+    OutputHttpJob* jobs[OUTPUT_HTTP_MAX_BATCH];
+    pthread_mutex_lock(&queueMutex);
+    while (1) {
+        while (!stopping && queueCount == 0)
+            pthread_cond_wait(&queueCond, &queueMutex);
+        if (stopping)
+            break;
+
+        // Take the oldest payload and the following ones with the same target
+        unsigned count = 0;
+        jobs[count++] = queue[queueHead];
+        queueHead = (queueHead + 1) % OUTPUT_HTTP_QUEUE_SIZE;
+        queueCount--;
+        unsigned batch = jobs[0]->batch;
+        if (batch > OUTPUT_HTTP_MAX_BATCH)
+            batch = OUTPUT_HTTP_MAX_BATCH;
+        while (count < batch && queueCount > 0 && same_target(jobs[0], queue[queueHead])) {
+            jobs[count++] = queue[queueHead];
+            queueHead = (queueHead + 1) % OUTPUT_HTTP_QUEUE_SIZE;
+            queueCount--;
+        }
+        stats.queued = queueCount;
+        pthread_mutex_unlock(&queueMutex);
+
+        // A batch is posted as a JSON array of the queued payloads
+        char* body = NULL;
+        if (jobs[0]->batch > 1) {
+            size_t size = 3;
+            for (unsigned i = 0; i < count; i++)
+                size += strlen(jobs[i]->payload) + 1;
+            body = malloc(size);
+            if (body) {
+                char* p = body;
+                *p++ = '[';
+                for (unsigned i = 0; i < count; i++) {
+                    if (i) *p++ = ',';
+                    size_t len = strlen(jobs[i]->payload);
+                    memcpy(p, jobs[i]->payload, len);
+                    p += len;
+                }
+                *p++ = ']';
+                *p = 0;
+            }
+        } else {
+            body = jobs[0]->payload;
+            jobs[0]->payload = NULL;
+        }
+
+        double start = now_ms();
+        int ok = 0;
+        if (!body)
+            syslog(LOG_WARNING, "output_http: Unable to allocate POST body");
+        else if (curl)
+            ok = post(curl, jobs[0], body);
+        double elapsed = now_ms() - start;
+        free(body);
+        for (unsigned i = 0; i < count; i++)
+            free_job(jobs[i]);
+
+        pthread_mutex_lock(&queueMutex);
+        if (ok) {
+            stats.posted++;
+            stats.latency = stats.posted == 1 ? elapsed : stats.latency * 0.9 + elapsed * 0.1;
+        } else {
+            stats.failed++;
+        }
+    }
+    pthread_mutex_unlock(&queueMutex);
+
+    if (curl)
+        curl_easy_cleanup(curl);
+    return NULL;
+}
+
+int output_http_start(void) {
+    if (running)
+        return 1;
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    stopping = 0;
+    if (pthread_create(&dispatcherThread, NULL, dispatcher, NULL) != 0) {
+        syslog(LOG_WARNING, "output_http_start: Unable to create dispatcher thread");
+        return 0;
+    }
+    running = 1;
+    return 1;
+}
+
+void output_http_stop(void) {
+    if (!running)
+        return;
+    pthread_mutex_lock(&queueMutex);
+    stopping = 1;
+    pthread_cond_signal(&queueCond);
+    pthread_mutex_unlock(&queueMutex);
+    pthread_join(dispatcherThread, NULL);
+    running = 0;
+
+    while (queueCount > 0) {
+        free_job(queue[queueHead]);
+        queueHead = (queueHead + 1) % OUTPUT_HTTP_QUEUE_SIZE;
+        queueCount--;
+    }
+    stats.queued = 0;
+}
+
+int output_http_enqueue(
+    const char* url,
+    char* payload,
+    const char* authentication,
+    const char* username,
+    const char* password,
+    const char* token,
+    unsigned batch
+)
+{
+    if (!running || !url || !url[0] || !payload) {
+        free(payload);
+        return 0;
+    }
+    OutputHttpJob* job = calloc(1, sizeof(OutputHttpJob));
+    if (!job) {
+        free(payload);
+        return 0;
+    }
+    job->payload = payload;
+    // The URL and the token are copied whole; curl gets exactly what was configured
+    job->url = dup_string(url);
+    job->token = dup_string(token);
+    if (!job->url || !job->token) {
+        free_job(job);
+        return 0;
+    }
+    copy_string(job->authentication, sizeof(job->authentication), authentication ? authentication : "none");
+    copy_string(job->username, sizeof(job->username), username);
+    copy_string(job->password, sizeof(job->password), password);
+    job->batch = batch ? batch : 1;
+
+    OutputHttpJob* dropped = NULL;
+    pthread_mutex_lock(&queueMutex);
+    if (queueCount == OUTPUT_HTTP_QUEUE_SIZE) {
+        // Drop the oldest; the newest crop is the most relevant one
+        dropped = queue[queueHead];
+        queueHead = (queueHead + 1) % OUTPUT_HTTP_QUEUE_SIZE;
+        queueCount--;
+        stats.dropped++;
+    }
+    queue[(queueHead + queueCount) % OUTPUT_HTTP_QUEUE_SIZE] = job;
+    queueCount++;
+    stats.queued = queueCount;
+    pthread_cond_signal(&queueCond);
+    pthread_mutex_unlock(&queueMutex);
+
+    free_job(dropped);
+    return 1;
+}
+
+void output_http_stats(OutputHttpStats* out) {
+    if (!out)
+        return;
+    pthread_mutex_lock(&queueMutex);
+    *out = stats;
+    pthread_mutex_unlock(&queueMutex);
+}
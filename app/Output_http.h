@@ -4,32 +4,81 @@
  *
  * Provides an interface for exporting detections (crops) via HTTP POST,
  * supporting basic, digest, and bearer authentication.
+ *
+ * Posts are made by a background dispatcher thread so a slow receiver never
+ * blocks the main loop. Payloads are queued in a bounded queue; when it is full
+ * the oldest payload is dropped. The dispatcher keeps one curl handle so the
+ * connection (and TLS session) to the receiver is reused between posts.
  */
 
 #ifndef OUTPUT_HTTP_H
 #define OUTPUT_HTTP_H
 
-#include "cJSON.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OUTPUT_HTTP_QUEUE_SIZE 16
+#define OUTPUT_HTTP_MAX_BATCH  8
+
+/**
+ * @brief Dispatcher counters.
+ */
+typedef struct {
+    unsigned queued;        ///< Payloads waiting to be posted
+    unsigned dropped;       ///< Payloads dropped because the queue was full
+    unsigned posted;        ///< Successful POST requests
+    unsigned failed;        ///< Failed POST requests (network, curl, or HTTP error)
+    double latency;         ///< Average POST time in ms over recent requests
+} OutputHttpStats;
 
 /**
- * @brief Export a detection crop as a HTTP POST request with authentication.
+ * @brief Start the dispatcher thread.
+ * @return 1 on success, 0 on failure.
+ */
+int output_http_start(void);
+
+/**
+ * @brief Stop the dispatcher thread and drop queued payloads.
+ *
+ * Waits for a POST in progress to complete (bounded by the request timeout).
+ */
+void output_http_stop(void);
+
+/**
+ * @brief Queue a serialized JSON payload for HTTP POST with authentication.
+ *
+ * The payload is posted as is, so a buffer already printed for another output
+ * (e.g. MQTT_Serialize) is not serialized again.
  *
  * @param url            Target endpoint.
- * @param payload        JSON payload object (ownership retained by caller).
+ * @param payload        JSON text from malloc(). Ownership is transferred, also on failure.
  * @param authentication Authentication mode ("none", "basic", "digest", "bearer").
  * @param username       Username for basic/digest auth (may be NULL).
  * @param password       Password for basic/digest auth (may be NULL).
  * @param token          Bearer token (may be NULL).
+ * @param batch          Max payloads per POST. With batch > 1, queued payloads for
+ *                       the same target are posted together as a JSON array.
  *
- * @return 1 on success (HTTP 2xx), 0 on failure (network, curl, or HTTP error).
+ * @return 1 if queued, 0 if the dispatcher is not running or the payload is invalid.
  */
-int output_http_post_json(
+int output_http_enqueue(
     const char* url,
-    cJSON* payload,
+    char* payload,
     const char* authentication,
     const char* username,
     const char* password,
-    const char* token
+    const char* token,
+    unsigned batch
 );
 
+/**
+ * @brief Read the dispatcher counters.
+ */
+void output_http_stats(OutputHttpStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // OUTPUT_HTTP_H
@@ -0,0 +1,406 @@
+/**
+ * @file output_sd.c
+ * @brief Implementation of the background SD card crop writer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "Output_sd.h"
+#include "Output_helpers.h"
+#include "Metrics.h"
+
+#define SD_FOLDER "/var/spool/storage/SD_DISK/detectx"
+#define OUTPUT_SD_QUOTA_TARGET 0.9          // Evict down to this share of the quota
+#define OUTPUT_SD_MB (1024.0 * 1024.0)
+
+typedef struct {
+    char label[64];
+    double timestamp;
+    int index;
+    int x, y, w, h;
+    int hourly;
+    unsigned quota;
+    unsigned size;
+    unsigned char jpeg[];
+} OutputSdJob;
+
+typedef struct {
+    char name[128];
+    time_t mtime;
+    off_t size;
+} OutputSdFile;
+
+static OutputSdJob* queue[OUTPUT_SD_QUEUE_SIZE];
+static unsigned queueHead = 0;
+static unsigned queueCount = 0;
+static OutputSdStats stats;
+static int running = 0;
+static int stopping = 0;
+static pthread_t writerThread;
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;
+
+// Writer thread only
+static char folder[16] = "";                // Crop folder currently open
+static int folderFd = -1;
+static uint64_t usage = 0;                  // Bytes in the crop folders
+static int usageKnown = 0;
+
+// YYYYMMDD or YYYYMMDD_HH
+static int is_crop_folder(const char* name) {
+    size_t len = strlen(name);
+    if (len != 8 && len != 11)
+        return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (i == 8 ? name[i] != '_' : (name[i] < '0' || name[i] > '9'))
+            return 0;
+    }
+    return 1;
+}
+
+static uint64_t folder_size(const char* name) {
+    char path[192];
+    snprintf(path, sizeof(path), "%s/%s", SD_FOLDER, name);
+    DIR* dir = opendir(path);
+    if (!dir)
+        return 0;
+    uint64_t size = 0;
+    struct dirent* entry;
+    struct stat st;
+    while ((entry = readdir(dir))) {
+        if (fstatat(dirfd(dir), entry->d_name, &st, 0) == 0 && S_ISREG(st.st_mode))
+            size += st.st_size;
+    }
+    closedir(dir);
+    return size;
+}
+
+static void scan_usage(void) {
+    usage = 0;
+    DIR* dir = opendir(SD_FOLDER);
+    if (!dir)
+        return;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (is_crop_folder(entry->d_name))
+            usage += folder_size(entry->d_name);
+    }
+    closedir(dir);
+    usageKnown = 1;
+}
+
+static void close_folder(void) {
+    if (folderFd >= 0)
+        close(folderFd);
+    folderFd = -1;
+    folder[0] = 0;
+}
+
+static int open_folder(const OutputSdJob* job) {
+    char name[sizeof(folder)];
+    struct tm tm;
+    time_t seconds = (time_t)(job->timestamp / 1000);
+    localtime_r(&seconds, &tm);
+    strftime(name, sizeof(name), job->hourly ? "%Y%m%d_%H" : "%Y%m%d", &tm);
+    if (folderFd >= 0 && strcmp(name, folder) == 0)
+        return 1;
+
+    close_folder();
+    if (!ensure_sd_directory())
+        return 0;
+    char path[192];
+    snprintf(path, sizeof(path), "%s/%s", SD_FOLDER, name);
+    if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        syslog(LOG_WARNING, "output_sd: Unable to create %s: %s", path, strerror(errno));
+        return 0;
+    }
+    folderFd = open(path, O_RDONLY | O_DIRECTORY);
+    if (folderFd < 0) {
+        syslog(LOG_WARNING, "output_sd: Unable to open %s: %s", path, strerror(errno));
+        return 0;
+    }
+    snprintf(folder, sizeof(folder), "%s", name);
+    if (!usageKnown)
+        scan_usage();
+    return 1;
+}
+
+static int write_file(const char* name, const void* data, size_t size) {
+    int fd = openat(folderFd, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        syslog(LOG_WARNING, "output_sd: Unable to open %s/%s: %s", folder, name, strerror(errno));
+        return 0;
+    }
+    const unsigned char* p = data;
+    size_t left = size;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            syslog(LOG_WARNING, "output_sd: Write to %s/%s failed: %s", folder, name, strerror(errno));
+            close(fd);
+            return 0;
+        }
+        p += n;
+        left -= n;
+    }
+    if (close(fd) != 0) {
+        syslog(LOG_WARNING, "output_sd: Closing %s/%s failed: %s", folder, name, strerror(errno));
+        return 0;
+    }
+    usage += size;
+    return 1;
+}
+
+static int write_crop(const OutputSdJob* job) {
+    char name[128], text[96];
+    snprintf(name, sizeof(name), "crop_%s_%.0f_%d.jpg", job->label, job->timestamp, job->index);
+    if (!write_file(name, job->jpeg, job->size))
+        return 0;
+    snprintf(name, sizeof(name), "crop_%s_%.0f_%d.txt", job->label, job->timestamp, job->index);
+    int len = snprintf(text, sizeof(text), "%s %d %d %d %d\n", job->label, job->x, job->y, job->w, job->h);
+    return write_file(name, text, len < (int)sizeof(text) ? (size_t)len : sizeof(text) - 1);
+}
+
+static int oldest_folder(char* out, size_t size) {
+    DIR* dir = opendir(SD_FOLDER);
+    if (!dir)
+        return 0;
+    int found = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (is_crop_folder(entry->d_name) && (!found || strcmp(entry->d_name, out) < 0)) {
+            snprintf(out, size, "%s", entry->d_name);
+            found = 1;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+static int compare_files(const void* a, const void* b) {
+    const OutputSdFile* fa = a;
+    const OutputSdFile* fb = b;
+    if (fa->mtime != fb->mtime)
+        return fa->mtime < fb->mtime ? -1 : 1;
+    return strcmp(fa->name, fb->name);
+}
+
+// Delete the oldest files of one folder until usage is at target. An emptied
+// folder is removed unless it is the one being written. Returns files removed.
+static unsigned evict_folder(const char* name, uint64_t target) {
+    char path[192];
+    snprintf(path, sizeof(path), "%s/%s", SD_FOLDER, name);
+    DIR* dir = opendir(path);
+    if (!dir)
+        return 0;
+
+    OutputSdFile* files = NULL;
+    size_t count = 0, capacity = 0;
+    struct dirent* entry;
+    struct stat st;
+    while ((entry = readdir(dir))) {
+        if (fstatat(dirfd(dir), entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        if (count == capacity) {
+            size_t grow = capacity ? capacity * 2 : 256;
+            OutputSdFile* bigger = realloc(files, grow * sizeof(OutputSdFile));
+            if (!bigger)
+                break;
+            files = bigger;
+            capacity = grow;
+        }
+        snprintf(files[count].name, sizeof(files[count].name), "%s", entry->d_name);
+        files[count].mtime = st.st_mtime;
+        files[count].size = st.st_size;
+        count++;
+    }
+    if (count)
+        qsort(files, count, sizeof(OutputSdFile), compare_files);
+
+    unsigned removed = 0;
+    size_t i = 0;
+    for (; i < count && usage > target; i++) {
+        if (unlinkat(dirfd(dir), files[i].name, 0) != 0)
+            continue;
+        usage = usage > (uint64_t)files[i].size ? usage - files[i].size : 0;
+        removed++;
+    }
+    closedir(dir);
+    free(files);
+
+    if (i == count && strcmp(name, folder) != 0 && rmdir(path) == 0)
+        removed++;
+    return removed;
+}
+
+static unsigned evict(unsigned quota) {
+    if (usage <= (uint64_t)quota * OUTPUT_SD_MB)
+        return 0;
+    uint64_t target = (uint64_t)(quota * OUTPUT_SD_MB * OUTPUT_SD_QUOTA_TARGET);
+    unsigned removed = 0;
+    char name[sizeof(folder)];
+    while (usage > target) {
+        if (!oldest_folder(name, sizeof(name))) {
+            usage = 0;
+            break;
+        }
+        unsigned n = evict_folder(name, target);
+        if (n == 0) {
+            // Files may have been removed behind our back; count again
+            scan_usage();
+            if (usage > target)
+                syslog(LOG_WARNING, "output_sd: Unable to free space in %s/%s for the quota", SD_FOLDER, name);
+            break;
+        }
+        removed += n;
+    }
+    return removed;
+}
+
+static void* writer(void* arg) {
+    (void)arg;
+    OutputSdJob* jobs[OUTPUT_SD_QUEUE_SIZE];
+    pthread_mutex_lock(&queueMutex);
+    while (1) {
+        while (!stopping && queueCount == 0)
+            pthread_cond_wait(&queueCond, &queueMutex);
+        if (stopping)
+            break;
+
+        // Take everything queued; crops of one batch share the open folder
+        unsigned count = 0;
+        while (queueCount > 0) {
+            jobs[count++] = queue[queueHead];
+            queueHead = (queueHead + 1) % OUTPUT_SD_QUEUE_SIZE;
+            queueCount--;
+        }
+        stats.queued = 0;
+        pthread_mutex_unlock(&queueMutex);
+
+        unsigned written = 0, failed = 0;
+        double elapsed = 0;
+        for (unsigned i = 0; i < count; i++) {
+            uint64_t start = Metrics_Now();
+            if (open_folder(jobs[i]) && write_crop(jobs[i])) {
+                written++;
+            } else {
+                // The card may be gone; look up the folder and the usage again
+                failed++;
+                close_folder();
+                usageKnown = 0;
+            }
+            Metrics_Stage(METRICS_SD, start);
+            elapsed += (Metrics_Now() - start) / 1000000.0;
+        }
+        unsigned quota = jobs[count - 1]->quota;
+        unsigned evicted = quota && usageKnown ? evict(quota) : 0;
+        for (unsigned i = 0; i < count; i++)
+            free(jobs[i]);
+
+        pthread_mutex_lock(&queueMutex);
+        if (written) {
+            double latency = elapsed / count;
+            stats.latency = stats.written == 0 ? latency : stats.latency * 0.9 + latency * 0.1;
+        }
+        stats.written += written;
+        stats.failed += failed;
+        stats.evicted += evicted;
+        stats.usage = usage / OUTPUT_SD_MB;
+    }
+    pthread_mutex_unlock(&queueMutex);
+
+    close_folder();
+    return NULL;
+}
+
+int output_sd_start(void) {
+    if (running)
+        return 1;
+    stopping = 0;
+    usageKnown = 0;
+    if (pthread_create(&writerThread, NULL, writer, NULL) != 0) {
+        syslog(LOG_WARNING, "output_sd_start: Unable to create writer thread");
+        return 0;
+    }
+    running = 1;
+    return 1;
+}
+
+void output_sd_stop(void) {
+    if (!running)
+        return;
+    pthread_mutex_lock(&queueMutex);
+    stopping = 1;
+    pthread_cond_signal(&queueCond);
+    pthread_mutex_unlock(&queueMutex);
+    pthread_join(writerThread, NULL);
+    running = 0;
+
+    while (queueCount > 0) {
+        free(queue[queueHead]);
+        queueHead = (queueHead + 1) % OUTPUT_SD_QUEUE_SIZE;
+        queueCount--;
+    }
+    stats.queued = 0;
+}
+
+int output_sd_enqueue(const char* label, double timestamp, int index,
+                      const unsigned char* jpeg, unsigned size,
+                      int x, int y, int w, int h,
+                      int hourly, unsigned quota)
+{
+    if (!running || !jpeg || size == 0)
+        return 0;
+    OutputSdJob* job = malloc(sizeof(OutputSdJob) + size);
+    if (!job)
+        return 0;
+    snprintf(job->label, sizeof(job->label), "%s", label ? label : "");
+    replace_spaces(job->label);
+    job->timestamp = timestamp;
+    job->index = index;
+    job->x = x;
+    job->y = y;
+    job->w = w;
+    job->h = h;
+    job->hourly = hourly;
+    job->quota = quota;
+    job->size = size;
+    memcpy(job->jpeg, jpeg, size);
+
+    OutputSdJob* dropped = NULL;
+    pthread_mutex_lock(&queueMutex);
+    if (queueCount == OUTPUT_SD_QUEUE_SIZE) {
+        // Drop the oldest, like the HTTP dispatcher
+        dropped = queue[queueHead];
+        queueHead = (queueHead + 1) % OUTPUT_SD_QUEUE_SIZE;
+        queueCount--;
+        stats.dropped++;
+    }
+    queue[(queueHead + queueCount) % OUTPUT_SD_QUEUE_SIZE] = job;
+    queueCount++;
+    stats.queued = queueCount;
+    pthread_cond_signal(&queueCond);
+    pthread_mutex_unlock(&queueMutex);
+
+    free(dropped);
+    return 1;
+}
+
+void output_sd_stats(OutputSdStats* out) {
+    if (!out)
+        return;
+    pthread_mutex_lock(&queueMutex);
+    *out = stats;
+    pthread_mutex_unlock(&queueMutex);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file output_sd.h
+ * @brief Background SD card writer for crop images and labels.
+ *
+ * Output() queues a copy of each crop; a writer thread drains the queue in
+ * batches, so slow SD media never stalls the main loop. Crops are written to
+ * one folder per day (YYYYMMDD) or per hour (YYYYMMDD_HH) under SD_FOLDER,
+ * created once when the first crop for it is written.
+ *
+ * With a quota, the writer keeps the total size of these folders below it by
+ * deleting the oldest crops first (oldest folder, then oldest files within
+ * it). Other files in SD_FOLDER, such as tensor dumps, are not counted.
+ *
+ * When the queue is full the oldest crop is dropped.
+ */
+
+#ifndef OUTPUT_SD_H
+#define OUTPUT_SD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OUTPUT_SD_QUEUE_SIZE 32
+
+/**
+ * @brief Writer counters.
+ */
+typedef struct {
+    unsigned queued;        ///< Crops waiting to be written
+    unsigned dropped;       ///< Crops dropped because the queue was full
+    unsigned written;       ///< Crops written (image and label)
+    unsigned failed;        ///< Crops that could not be written
+    unsigned evicted;       ///< Files deleted to stay within the quota
+    double latency;         ///< Average write time per crop in ms
+    double usage;           ///< MB used by the crop folders
+} OutputSdStats;
+
+/**
+ * @brief Start the writer thread.
+ * @return 1 on success, 0 on failure.
+ */
+int output_sd_start(void);
+
+/**
+ * @brief Stop the writer thread. Crops not yet written are dropped.
+ */
+void output_sd_stop(void);
+
+/**
+ * @brief Queue a crop for writing.
+ *
+ * The image is copied; the caller keeps ownership of jpeg.
+ *
+ * @param label     Class label, spaces are replaced in the file name.
+ * @param timestamp Detection time, epoch ms.
+ * @param index     Detection index in the frame, keeps file names unique.
+ * @param jpeg      JPEG data.
+ * @param size      JPEG size in bytes.
+ * @param x,y,w,h   Crop rectangle written to the label file.
+ * @param hourly    1: one folder per hour, 0: per day.
+ * @param quota     Limit for the crop folders in MB, 0 for none.
+ * @return 1 if queued, 0 if the writer is not running or out of memory.
+ */
+int output_sd_enqueue(const char* label, double timestamp, int index,
+                      const unsigned char* jpeg, unsigned size,
+                      int x, int y, int w, int h,
+                      int hourly, unsigned quota);
+
+/**
+ * @brief Read the writer counters.
+ */
+void output_sd_stats(OutputSdStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUTPUT_SD_H
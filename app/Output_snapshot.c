@@ -0,0 +1,222 @@
+/**
+ * @file output_snapshot.c
+ * @brief Implementation of the double-buffered detection snapshot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "Output_snapshot.h"
+
+typedef struct {
+    unsigned seq;              ///< Odd while the buffer is being written
+    unsigned version;
+    unsigned length;
+    char text[OUTPUT_SNAPSHOT_SIZE];
+} Snapshot;
+
+typedef struct {
+    char name[32];
+    Snapshot snapshots[2];
+    Snapshot* current;
+    unsigned version;          ///< Only written by the publisher
+    int lastWasEmpty;
+} SnapshotView;
+
+// Allocated once by output_snapshot_init(); names do not change after that
+static SnapshotView* views = NULL;
+static unsigned viewCount = 0;
+
+// Long-poll requests sleep on waitCond until a publish; each holds a FastCGI worker
+static pthread_mutex_t waitMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t waitCond;
+static unsigned waiters = 0;
+
+// Snapshot JSON of a view: version, view name if it has one, timestamp, detections
+static cJSON* snapshot_json(const SnapshotView* view, unsigned number, double timestamp) {
+    cJSON* wrapper = cJSON_CreateObject();
+    cJSON_AddNumberToObject(wrapper, "version", number);
+    if (view->name[0])
+        cJSON_AddStringToObject(wrapper, "view", view->name);
+    cJSON_AddNumberToObject(wrapper, "timestamp", timestamp);
+    return wrapper;
+}
+
+int output_snapshot_init(const char* const* names, unsigned count)
+{
+    if (count < 1) count = 1;
+    if (count > OUTPUT_SNAPSHOT_MAX_VIEWS) count = OUTPUT_SNAPSHOT_MAX_VIEWS;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&waitCond, &attr);
+    pthread_condattr_destroy(&attr);
+    views = calloc(count, sizeof(SnapshotView));
+    if (!views) {
+        syslog(LOG_WARNING, "output_snapshot: Out of memory");
+        return 0;
+    }
+    viewCount = count;
+    for (unsigned v = 0; v < count; v++) {
+        SnapshotView* view = &views[v];
+        snprintf(view->name, sizeof(view->name), "%s", names && names[v] ? names[v] : "");
+        view->lastWasEmpty = 1;
+        cJSON* empty = snapshot_json(view, 0, 0);
+        cJSON_AddItemToObject(empty, "detections", cJSON_CreateArray());
+        cJSON_PrintPreallocated(empty, view->snapshots[0].text, OUTPUT_SNAPSHOT_SIZE, 0);
+        cJSON_Delete(empty);
+        view->snapshots[0].length = strlen(view->snapshots[0].text);
+        view->current = &view->snapshots[0];
+    }
+    return 1;
+}
+
+void output_snapshot_publish(unsigned index, cJSON* detections, double timestamp)
+{
+    if (!views || index >= viewCount)
+        return;
+    SnapshotView* view = &views[index];
+    int empty = !detections || cJSON_GetArraySize(detections) == 0;
+    if (empty && view->lastWasEmpty)
+        return;
+    view->lastWasEmpty = empty;
+
+    Snapshot* next = __atomic_load_n(&view->current, __ATOMIC_RELAXED) == &view->snapshots[0] ?
+                     &view->snapshots[1] : &view->snapshots[0];
+    unsigned version = view->version + 1;
+
+    cJSON* wrapper = snapshot_json(view, version, timestamp);
+    if (detections)
+        cJSON_AddItemReferenceToObject(wrapper, "detections", detections);
+    else
+        cJSON_AddItemToObject(wrapper, "detections", cJSON_CreateArray());
+
+    __atomic_add_fetch(&next->seq, 1, __ATOMIC_ACQ_REL);
+    if (!cJSON_PrintPreallocated(wrapper, next->text, OUTPUT_SNAPSHOT_SIZE, 0)) {
+        // Too many detections for the buffer; publish the version without them
+        cJSON_DeleteItemFromObject(wrapper, "detections");
+        cJSON_AddItemToObject(wrapper, "detections", cJSON_CreateArray());
+        cJSON_AddTrueToObject(wrapper, "truncated");
+        cJSON_PrintPreallocated(wrapper, next->text, OUTPUT_SNAPSHOT_SIZE, 0);
+    }
+    next->length = strlen(next->text);
+    next->version = version;
+    __atomic_add_fetch(&next->seq, 1, __ATOMIC_RELEASE);
+    cJSON_Delete(wrapper);
+
+    view->version = version;
+    __atomic_store_n(&view->current, next, __ATOMIC_RELEASE);
+
+    // Waiters check the version of their own view again
+    pthread_mutex_lock(&waitMutex);
+    if (waiters)
+        pthread_cond_broadcast(&waitCond);
+    pthread_mutex_unlock(&waitMutex);
+}
+
+unsigned output_snapshot_version(unsigned index)
+{
+    if (!views || index >= viewCount)
+        return 0;
+    Snapshot* snapshot = __atomic_load_n(&views[index].current, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&snapshot->version, __ATOMIC_ACQUIRE);
+}
+
+// Wait up to wait_ms for a version of the view other than known. With
+// OUTPUT_SNAPSHOT_MAX_WAITERS requests already waiting it returns at once,
+// so long-polls cannot take all the FastCGI workers.
+static void wait_version(unsigned index, unsigned known, int wait_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += wait_ms / 1000;
+    deadline.tv_nsec += (wait_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&waitMutex);
+    if (waiters < OUTPUT_SNAPSHOT_MAX_WAITERS) {
+        waiters++;
+        while (output_snapshot_version(index) == known)
+            if (pthread_cond_timedwait(&waitCond, &waitMutex, &deadline) == ETIMEDOUT)
+                break;
+        waiters--;
+    }
+    pthread_mutex_unlock(&waitMutex);
+}
+
+// Copy the current snapshot of a view into readBuffer (OUTPUT_SNAPSHOT_SIZE). Returns the length.
+static unsigned read_snapshot(const SnapshotView* view, char* readBuffer)
+{
+    while (1) {
+        Snapshot* snapshot = __atomic_load_n(&view->current, __ATOMIC_ACQUIRE);
+        unsigned seq = __atomic_load_n(&snapshot->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        unsigned length = snapshot->length;
+        if (length >= OUTPUT_SNAPSHOT_SIZE)
+            continue;
+        memcpy(readBuffer, snapshot->text, length);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&snapshot->seq, __ATOMIC_RELAXED) == seq) {
+            readBuffer[length] = 0;
+            return length;
+        }
+    }
+}
+
+void output_snapshot_http_callback(
+    ACAP_HTTP_Response response,
+    const ACAP_HTTP_Request request)
+{
+    if (strcmp(ACAP_HTTP_Get_Method(request), "GET") != 0) {
+        ACAP_HTTP_Respond_Error(response, 405, "Method Not Allowed");
+        return;
+    }
+    if (!views) {
+        ACAP_HTTP_Respond_Error(response, 503, "Service Unavailable");
+        return;
+    }
+
+    // Without "view" the first view is served
+    unsigned index = 0;
+    const char* name = ACAP_HTTP_Request_Param(request, "view");
+    if (name) {
+        while (index < viewCount && strcmp(views[index].name, name) != 0)
+            index++;
+        if (index == viewCount) {
+            ACAP_HTTP_Respond_Error(response, 404, "Unknown view");
+            return;
+        }
+    }
+
+    // A waiting request holds one of the few FastCGI workers, so the wait is kept short
+    // and only a few requests wait at the same time
+    const char* since = ACAP_HTTP_Request_Param(request, "since");
+    const char* wait = ACAP_HTTP_Request_Param(request, "wait");
+    if (since) {
+        unsigned known = (unsigned)strtoul(since, NULL, 10);
+        int wait_ms = wait ? atoi(wait) : 1000;
+        if (wait_ms < 0) wait_ms = 0;
+        if (wait_ms > OUTPUT_SNAPSHOT_MAX_WAIT) wait_ms = OUTPUT_SNAPSHOT_MAX_WAIT;
+        if (wait_ms > 0)
+            wait_version(index, known, wait_ms);
+    }
+
+    // Requests may run on several workers, so each reads into its own buffer
+    char* readBuffer = malloc(OUTPUT_SNAPSHOT_SIZE);
+    if (!readBuffer) {
+        ACAP_HTTP_Respond_Error(response, 500, "Out of memory");
+        return;
+    }
+    unsigned length = read_snapshot(&views[index], readBuffer);
+    ACAP_HTTP_Header_JSON(response);
+    ACAP_HTTP_Respond_Data(response, length, readBuffer);
+    free(readBuffer);
+}
@@ -0,0 +1,78 @@
+/**
+ * @file output_snapshot.h
+ * @brief Versioned snapshot of the latest detections and HTTP long-poll API.
+ *
+ * Each view has its own snapshot and version. Output() publishes each new
+ * detection list of a view as serialized JSON into one of the view's two
+ * buffers and then swaps its current pointer, so publishing never takes
+ * a lock and readers never see a partially written snapshot. Each buffer has
+ * a sequence counter; a reader that raced with a rewrite of the same buffer
+ * simply copies it again.
+ *
+ * HTTP API (node "snapshot"):
+ *   - snapshot                     Latest snapshot of the first view
+ *   - snapshot?view=NAME           Latest snapshot of a named view
+ *   - snapshot?since=V&wait=MS     Wait up to MS (max OUTPUT_SNAPSHOT_MAX_WAIT)
+ *                                  for a snapshot newer than version V (also with view)
+ *
+ * A waiting request is woken by the publish of a new version. At most
+ * OUTPUT_SNAPSHOT_MAX_WAITERS requests wait at a time; further ones get the
+ * current snapshot at once, so the FastCGI workers stay available.
+ *
+ * Response: {"version":N,"view":"NAME","timestamp":T,"detections":[...]}
+ * ("view" only for named views).
+ */
+
+#ifndef OUTPUT_SNAPSHOT_H
+#define OUTPUT_SNAPSHOT_H
+
+#include "cJSON.h"
+#include "ACAP.h"
+
+#define OUTPUT_SNAPSHOT_SIZE     (64 * 1024)
+#define OUTPUT_SNAPSHOT_MAX_WAIT 2000
+#define OUTPUT_SNAPSHOT_MAX_WAITERS 2
+#define OUTPUT_SNAPSHOT_MAX_VIEWS 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Allocate the snapshots of the views. Call once, before the first request.
+ *
+ * @param names  View names ("" for the single unnamed view).
+ * @param count  Number of views, 1..OUTPUT_SNAPSHOT_MAX_VIEWS.
+ * @return 1 on success, 0 if out of memory.
+ */
+int output_snapshot_init(const char* const* names, unsigned count);
+
+/**
+ * @brief Publish a new detection snapshot of a view.
+ *
+ * An empty list following an empty list of the same view is not published
+ * again, so the version only changes when there is something new.
+ *
+ * @param view        View index.
+ * @param detections  JSON array from Detections_JSON(), or NULL for no detections.
+ * @param timestamp   Epoch ms of the frame.
+ */
+void output_snapshot_publish(unsigned view, cJSON* detections, double timestamp);
+
+/**
+ * @brief Version of the current snapshot of a view (0 before the first publish).
+ */
+unsigned output_snapshot_version(unsigned view);
+
+/**
+ * @brief HTTP GET callback serving the snapshot, optionally long-polling.
+ */
+void output_snapshot_http_callback(
+    ACAP_HTTP_Response response,
+    const ACAP_HTTP_Request request);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUTPUT_SNAPSHOT_H
@@ -0,0 +1,118 @@
+/**
+ * @file scheduler.c
+ * @brief Implementation of the frame-rate scheduler.
+ */
+
+#include <glib.h>
+#include "ACAP.h"
+#include "Settings.h"
+#include "Scheduler.h"
+
+#define SCHEDULER_STATUS_INTERVAL 1000    // ms
+#define SCHEDULER_VIEW_BOOST 4            // Weight factor of a view with recent detections
+#define SCHEDULER_VIEW_HOLD 5000          // ms a view counts as active after a detection
+
+static GSourceFunc frameCallback = NULL;
+static double lastActivity = 0;       // ms, last frame with detections
+static double viewActivity[SETTINGS_MAX_VIEWS];   // ms, last frame with detections per view
+static int viewCredit[SETTINGS_MAX_VIEWS];
+static unsigned frameCount = 0;       // Frames since the last status update
+static double statusStart = 0;
+static const char* appliedMode = "max";
+
+static double now_ms(void) {
+    return g_get_monotonic_time() / 1000.0;
+}
+
+static double rate_period(double fps) {
+    return fps > 0 ? 1000.0 / fps : 0;
+}
+
+// Time from the start of this frame to the start of the next one
+static double next_period(const SchedulerSettings* config, double busy, double end) {
+    switch (config->mode) {
+        case SCHEDULER_FPS:
+            appliedMode = "fps";
+            return rate_period(config->fps);
+        case SCHEDULER_DUTY:
+            appliedMode = "duty";
+            return busy * 100.0 / config->duty;
+        case SCHEDULER_ADAPTIVE:
+            if (end - lastActivity > config->idleTimeout * 1000.0) {
+                appliedMode = "idle";
+                return rate_period(config->idleFps);
+            }
+            appliedMode = "adaptive";
+            return rate_period(config->fps);
+        case SCHEDULER_MAX:
+        default:
+            appliedMode = "max";
+            return 0;
+    }
+}
+
+static gboolean tick(gpointer data) {
+    double start = now_ms();
+    if (!frameCallback || frameCallback(data) == G_SOURCE_REMOVE)
+        return G_SOURCE_REMOVE;
+    double end = now_ms();
+    frameCount++;
+
+    double delay = start + next_period(&Settings_Get()->scheduler, end - start, end) - end;
+    if (delay < 1)
+        g_idle_add(tick, data);
+    else
+        g_timeout_add((guint)delay, tick, data);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean status(gpointer data) {
+    double now = now_ms();
+    double elapsed = now - statusStart;
+    if (elapsed > 0)
+        ACAP_STATUS_SetNumber("scheduler", "fps", (int)(frameCount * 10000.0 / elapsed) / 10.0);
+    ACAP_STATUS_SetString("scheduler", "mode", appliedMode);
+    frameCount = 0;
+    statusStart = now;
+    return G_SOURCE_CONTINUE;
+}
+
+void Scheduler_Start(GSourceFunc frame) {
+    frameCallback = frame;
+    lastActivity = statusStart = now_ms();
+    g_idle_add(tick, NULL);
+    g_timeout_add(SCHEDULER_STATUS_INTERVAL, status, NULL);
+}
+
+unsigned Scheduler_Next_View(unsigned views) {
+    const Settings* settings = Settings_Get();
+    if (views > settings->viewCount)
+        views = settings->viewCount;
+    if (views <= 1)
+        return 0;
+
+    // Smooth weighted round robin: every view earns its weight, the richest
+    // one runs and pays the total, so views interleave instead of bursting
+    double now = now_ms();
+    unsigned best = 0;
+    int total = 0;
+    for (unsigned v = 0; v < views; v++) {
+        int weight = settings->views[v].weight;
+        if (settings->viewActivity && now - viewActivity[v] <= SCHEDULER_VIEW_HOLD)
+            weight *= SCHEDULER_VIEW_BOOST;
+        viewCredit[v] += weight;
+        total += weight;
+        if (viewCredit[v] > viewCredit[best])
+            best = v;
+    }
+    viewCredit[best] -= total;
+    return best;
+}
+
+void Scheduler_Activity(unsigned view, unsigned detections) {
+    if (!detections)
+        return;
+    lastActivity = now_ms();
+    if (view < SETTINGS_MAX_VIEWS)
+        viewActivity[view] = lastActivity;
+}
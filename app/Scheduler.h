@@ -0,0 +1,60 @@
+/**
+ * @file scheduler.h
+ * @brief Frame-rate scheduler for the image processing callback.
+ *
+ * Runs the frame callback on the main loop at the rate given by the
+ * "scheduler" settings instead of back to back from an idle source:
+ *   - max:      back to back (previous behaviour)
+ *   - fps:      fixed target rate
+ *   - duty:     wait so processing takes at most 'duty' percent of the time
+ *   - adaptive: target rate, dropping to 'idleFps' after 'idleTimeout'
+ *               seconds without detections; full rate again on the next detection
+ *
+ * With several views (VDO channels) every frame callback serves one view,
+ * picked by Scheduler_Next_View() in proportion to the view weights. In
+ * "viewMode": "activity" a view with detections in the last 5 s gets four
+ * times its weight, so the shared model follows the scene that is busy;
+ * "roundrobin" uses the weights only.
+ *
+ * Status group "scheduler": fps (measured), mode (mode currently applied,
+ * "idle" when adaptive has dropped to the idle rate).
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start calling frame on the main loop.
+ *
+ * @param frame Processes one frame. Returning G_SOURCE_REMOVE stops the scheduler.
+ */
+void Scheduler_Start(GSourceFunc frame);
+
+/**
+ * @brief Pick the view to capture for the next frame.
+ *
+ * @param views Number of views that are streaming (Video_Views_YUV()).
+ * @return View index, 0 with a single view.
+ */
+unsigned Scheduler_Next_View(unsigned views);
+
+/**
+ * @brief Report the outcome of a frame.
+ *
+ * @param view       View the detections came from.
+ * @param detections Number of detections after filtering. Any detection
+ *                   brings the adaptive mode back to full rate.
+ */
+void Scheduler_Activity(unsigned view, unsigned detections);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCHEDULER_H
@@ -0,0 +1,248 @@
+/**
+ * @file settings.c
+ * @brief Compiles settings.json into a Settings snapshot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <glib.h>
+#include "Settings.h"
+
+static Settings defaults = {
+    .confidence = 50,
+    .viewCount = 1,
+    .views = { { .channel = 1, .aoiX1 = 100, .aoiY1 = 100, .aoiX2 = 900, .aoiY2 = 900, .weight = 1 } },
+    .minWidth = 20, .minHeight = 20,
+    .minEventDuration = 3000,
+    .prioritizeAccuracy = 1,
+    .eventFrames = 3,
+    .eventWindow = 1000,
+    .detectionJson = 1,
+    .decodeThreads = 2,
+    .cropping = { .throttle = 500, .quality = 90, .history = 10, .http_batch = 1, .http_auth = "none",
+                  .sdQuota = 1024 },
+    .scheduler = { .mode = SCHEDULER_MAX, .fps = 10, .duty = 50, .idleFps = 1, .idleTimeout = 30 },
+    .motion = { .threshold = 1, .holdoff = 3000 },
+    .tracker = { .iou = 0.3, .coast = 5, .minHits = 2 },
+    .latency = { .budget = 500, .dwell = 30 }
+};
+
+static Settings* current = NULL;
+
+static int get_int(cJSON* object, const char* name, int fallback) {
+    cJSON* item = object ? cJSON_GetObjectItem(object, name) : NULL;
+    return item && cJSON_IsNumber(item) ? (int)item->valuedouble : fallback;
+}
+
+static double get_double(cJSON* object, const char* name, double fallback) {
+    cJSON* item = object ? cJSON_GetObjectItem(object, name) : NULL;
+    return item && cJSON_IsNumber(item) ? item->valuedouble : fallback;
+}
+
+static int get_bool(cJSON* object, const char* name) {
+    return object && cJSON_IsTrue(cJSON_GetObjectItem(object, name));
+}
+
+// Returns 0 if the value does not fit; out is then left empty
+static int get_string(cJSON* object, const char* name, char* out, size_t size) {
+    cJSON* item = object ? cJSON_GetObjectItem(object, name) : NULL;
+    if (!item || !cJSON_IsString(item) || !item->valuestring)
+        return 1;
+    if (strlen(item->valuestring) >= size) {
+        out[0] = 0;
+        return 0;
+    }
+    snprintf(out, size, "%s", item->valuestring);
+    return 1;
+}
+
+void Settings_Compile(cJSON* json, Settings* s) {
+    *s = defaults;
+
+    s->confidence = get_int(json, "confidence", s->confidence);
+
+    cJSON* aoi = cJSON_GetObjectItem(json, "aoi");
+    ViewSettings* first = &s->views[0];
+    first->aoiX1 = get_int(aoi, "x1", first->aoiX1);
+    first->aoiY1 = get_int(aoi, "y1", first->aoiY1);
+    first->aoiX2 = get_int(aoi, "x2", first->aoiX2);
+    first->aoiY2 = get_int(aoi, "y2", first->aoiY2);
+
+    // Every view starts from the single-view defaults and the top level AOI
+    cJSON* views = cJSON_GetObjectItem(json, "views");
+    cJSON* view = views && cJSON_IsArray(views) ? views->child : NULL;
+    ViewSettings base = *first;
+    s->viewCount = 0;
+    for (; view && s->viewCount < SETTINGS_MAX_VIEWS; view = view->next) {
+        if (!cJSON_IsObject(view))
+            continue;
+        ViewSettings* v = &s->views[s->viewCount];
+        *v = base;
+        get_string(view, "name", v->name, sizeof(v->name));
+        v->channel = get_int(view, "channel", v->channel);
+        if (v->channel < 1) v->channel = 1;
+        cJSON* viewAoi = cJSON_GetObjectItem(view, "aoi");
+        v->aoiX1 = get_int(viewAoi, "x1", v->aoiX1);
+        v->aoiY1 = get_int(viewAoi, "y1", v->aoiY1);
+        v->aoiX2 = get_int(viewAoi, "x2", v->aoiX2);
+        v->aoiY2 = get_int(viewAoi, "y2", v->aoiY2);
+        v->weight = get_int(view, "weight", v->weight);
+        if (v->weight < 1) v->weight = 1;
+        if (v->weight > 100) v->weight = 100;
+        // Names end up in topics and event names
+        for (char* p = v->name; *p; p++)
+            if (*p == ' ' || *p == '/' || *p == '#' || *p == '+') *p = '_';
+        if (!v->name[0])
+            snprintf(v->name, sizeof(v->name), "view%u", s->viewCount + 1);
+        s->viewCount++;
+    }
+    if (s->viewCount == 0) {
+        s->views[0] = base;
+        s->viewCount = 1;
+    }
+    cJSON* viewMode = cJSON_GetObjectItem(json, "viewMode");
+    s->viewActivity = !(viewMode && cJSON_IsString(viewMode) && strcmp(viewMode->valuestring, "roundrobin") == 0);
+
+    s->aoiInference = get_bool(json, "aoiInference");
+    s->decodeThreads = get_int(json, "decodeThreads", s->decodeThreads);
+    if (s->decodeThreads < 1) s->decodeThreads = 1;
+
+    cJSON* size = cJSON_GetObjectItem(json, "size");
+    if (size) {
+        s->minWidth = get_int(size, "x2", 0) - get_int(size, "x1", 0);
+        s->minHeight = get_int(size, "y2", 0) - get_int(size, "y1", 0);
+    }
+
+    cJSON* ignore = cJSON_GetObjectItem(json, "ignore");
+    cJSON* label = ignore && cJSON_IsArray(ignore) ? ignore->child : NULL;
+    for (; label; label = label->next) {
+        if (!cJSON_IsString(label))
+            continue;
+        Detections_Class_Set(&s->ignore, Detections_Label_Id(label->valuestring));
+    }
+
+    s->minEventDuration = get_double(json, "minEventDuration", s->minEventDuration);
+    cJSON* prioritize = cJSON_GetObjectItem(json, "prioritize");
+    if (prioritize && cJSON_IsString(prioritize))
+        s->prioritizeAccuracy = strcmp(prioritize->valuestring, "speed") != 0;
+    cJSON* logic = cJSON_GetObjectItem(json, "eventLogic");
+    s->eventFrames = get_int(logic, "frames", s->eventFrames);
+    s->eventWindow = get_int(logic, "window", s->eventWindow);
+
+    cJSON* format = cJSON_GetObjectItem(json, "detectionFormat");
+    if (format && cJSON_IsString(format)) {
+        s->detectionJson = strcmp(format->valuestring, "binary") != 0;
+        s->detectionBinary = strcmp(format->valuestring, "binary") == 0 || strcmp(format->valuestring, "both") == 0;
+    }
+
+    cJSON* cropping = cJSON_GetObjectItem(json, "cropping");
+    CroppingSettings* c = &s->cropping;
+    c->active = get_bool(cropping, "active");
+    c->throttle = get_int(cropping, "throttle", c->throttle);
+    c->quality = get_int(cropping, "quality", c->quality);
+    if (c->quality < 1) c->quality = 1;
+    if (c->quality > 100) c->quality = 100;
+    cJSON* source = cropping ? cJSON_GetObjectItem(cropping, "source") : NULL;
+    c->jpegSource = source && cJSON_IsString(source) && strcmp(source->valuestring, "jpeg") == 0;
+    c->history = get_int(cropping, "history", c->history);
+    c->sdcard = get_bool(cropping, "sdcard");
+    cJSON* folders = cropping ? cJSON_GetObjectItem(cropping, "sdFolders") : NULL;
+    if (folders && cJSON_IsString(folders))
+        c->sdHourly = strcmp(folders->valuestring, "hour") == 0;
+    c->sdQuota = get_int(cropping, "sdQuota", c->sdQuota);
+    if (c->sdQuota < 0) c->sdQuota = 0;
+    c->mqtt = get_bool(cropping, "mqtt");
+    c->http = get_bool(cropping, "http");
+    c->leftborder = get_int(cropping, "leftborder", 0);
+    c->rightborder = get_int(cropping, "rightborder", 0);
+    c->topborder = get_int(cropping, "topborder", 0);
+    c->bottomborder = get_int(cropping, "bottomborder", 0);
+    c->http_batch = get_int(cropping, "http_batch", c->http_batch);
+    if (c->http_batch < 1) c->http_batch = 1;
+    // A cut URL or credential would post to the wrong place, so a value
+    // that does not fit disables the HTTP target instead
+    if (!get_string(cropping, "http_url", c->http_url, sizeof(c->http_url)))
+        c->httpError = "http_url is too long";
+    get_string(cropping, "http_auth", c->http_auth, sizeof(c->http_auth));
+    if (!get_string(cropping, "http_username", c->http_username, sizeof(c->http_username)))
+        c->httpError = "http_username is too long";
+    if (!get_string(cropping, "http_password", c->http_password, sizeof(c->http_password)))
+        c->httpError = "http_password is too long";
+    if (!get_string(cropping, "http_token", c->http_token, sizeof(c->http_token)))
+        c->httpError = "http_token is too long";
+    if (c->httpError) {
+        c->http_url[0] = 0;
+        syslog(LOG_WARNING, "Settings: cropping.%s, HTTP export disabled", c->httpError);
+    }
+
+    cJSON* scheduler = cJSON_GetObjectItem(json, "scheduler");
+    SchedulerSettings* sc = &s->scheduler;
+    cJSON* mode = scheduler ? cJSON_GetObjectItem(scheduler, "mode") : NULL;
+    if (mode && cJSON_IsString(mode)) {
+        if (strcmp(mode->valuestring, "fps") == 0) sc->mode = SCHEDULER_FPS;
+        else if (strcmp(mode->valuestring, "duty") == 0) sc->mode = SCHEDULER_DUTY;
+        else if (strcmp(mode->valuestring, "adaptive") == 0) sc->mode = SCHEDULER_ADAPTIVE;
+        else sc->mode = SCHEDULER_MAX;
+    }
+    sc->fps = get_double(scheduler, "fps", sc->fps);
+    if (sc->fps < 0) sc->fps = 0;
+    sc->duty = get_int(scheduler, "duty", sc->duty);
+    if (sc->duty < 1) sc->duty = 1;
+    if (sc->duty > 100) sc->duty = 100;
+    sc->idleFps = get_double(scheduler, "idleFps", sc->idleFps);
+    if (sc->idleFps < 0.1) sc->idleFps = 0.1;
+    sc->idleTimeout = get_int(scheduler, "idleTimeout", sc->idleTimeout);
+    if (sc->idleTimeout < 1) sc->idleTimeout = 1;
+
+    cJSON* motion = cJSON_GetObjectItem(json, "motion");
+    MotionSettings* m = &s->motion;
+    m->active = get_bool(motion, "active");
+    m->threshold = get_double(motion, "threshold", m->threshold);
+    m->holdoff = get_int(motion, "holdoff", m->holdoff);
+    if (m->holdoff < 0) m->holdoff = 0;
+
+    cJSON* tracker = cJSON_GetObjectItem(json, "tracker");
+    TrackerSettings* t = &s->tracker;
+    t->active = get_bool(tracker, "active");
+    t->iou = get_double(tracker, "iou", t->iou);
+    if (t->iou < 0.05) t->iou = 0.05;
+    if (t->iou > 0.95) t->iou = 0.95;
+    t->coast = get_int(tracker, "coast", t->coast);
+    if (t->coast < 0) t->coast = 0;
+    t->minHits = get_int(tracker, "minHits", t->minHits);
+    if (t->minHits < 1) t->minHits = 1;
+
+    cJSON* latency = cJSON_GetObjectItem(json, "latency");
+    LatencySettings* l = &s->latency;
+    l->active = get_bool(latency, "active");
+    l->budget = get_int(latency, "budget", l->budget);
+    if (l->budget < 10) l->budget = 10;
+    l->dwell = get_int(latency, "dwell", l->dwell);
+    if (l->dwell < 1) l->dwell = 1;
+}
+
+// Runs on the main loop, between frames
+static gboolean swap(gpointer data) {
+    Settings* previous = current;
+    current = (Settings*)data;
+    free(previous);
+    return G_SOURCE_REMOVE;
+}
+
+const Settings* Settings_Get(void) {
+    return current ? current : &defaults;
+}
+
+void Settings_Update(cJSON* settings) {
+    if (!settings)
+        return;
+    Settings* next = malloc(sizeof(Settings));
+    if (!next) {
+        syslog(LOG_WARNING, "Settings_Update: Out of memory");
+        return;
+    }
+    Settings_Compile(settings, next);
+    g_main_context_invoke(NULL, swap, next);
+}
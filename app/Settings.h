@@ -0,0 +1,170 @@
+/**
+ * @file settings.h
+ * @brief Typed snapshot of settings.json used by the frame pipeline.
+ *
+ * The settings tree is compiled into a plain struct whenever it changes, so
+ * ImageProcess, Output and Model_GetImageData read fields instead of walking
+ * cJSON on every frame. A snapshot is never modified after it is built.
+ * Updates are compiled on the calling thread (the HTTP thread for the
+ * settings endpoint) and swapped in on the main loop between frames, where
+ * the previous snapshot is freed.
+ */
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+#include "cJSON.h"
+#include "Detections.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SETTINGS_HTTP_URL_MAX   2048
+#define SETTINGS_HTTP_TOKEN_MAX 4096
+
+typedef struct {
+    int active;
+    int throttle;           ///< ms between crop exports
+    int quality;            ///< JPEG quality 1..100
+    int jpegSource;         ///< "source": "jpeg" (1) crops the camera JPEG, "yuv" (0) encodes the frame
+    int history;            ///< Crops kept for the crops API
+    int sdcard;
+    int sdHourly;           ///< "sdFolders": "hour" (1) or "day" (0)
+    int sdQuota;            ///< MB kept in the crop folders, 0 for no limit
+    int mqtt;
+    int http;
+    int leftborder;         ///< Pixels added around the detection
+    int rightborder;
+    int topborder;
+    int bottomborder;
+    int http_batch;
+    char http_url[SETTINGS_HTTP_URL_MAX];  ///< Empty if any HTTP value was too long
+    char http_auth[16];
+    char http_username[64];
+    char http_password[64];
+    char http_token[SETTINGS_HTTP_TOKEN_MAX];
+    const char* httpError;  ///< Why the HTTP target is disabled, NULL if it is not
+} CroppingSettings;
+
+typedef enum {
+    SCHEDULER_MAX = 0,      ///< Back to back, as fast as the model runs
+    SCHEDULER_FPS,          ///< Fixed target rate
+    SCHEDULER_DUTY,         ///< Busy at most 'duty' percent of the time
+    SCHEDULER_ADAPTIVE      ///< Target rate, idle rate after idleTimeout without detections
+} SchedulerMode;
+
+typedef struct {
+    SchedulerMode mode;
+    double fps;             ///< Target rate for fps and adaptive; 0 is unlimited
+    int duty;               ///< Max busy percent 1..100
+    double idleFps;         ///< Adaptive idle rate
+    int idleTimeout;        ///< Adaptive: seconds without detections before idling
+} SchedulerSettings;
+
+typedef struct {
+    int active;
+    double threshold;       ///< Percent of the motion grid that must change
+    int holdoff;            ///< ms to keep inferring after the last change or detection
+} MotionSettings;
+
+typedef struct {
+    int active;
+    double iou;             ///< Minimum IoU with the predicted box to continue a track
+    int coast;              ///< Inferred frames a track survives without a match
+    int minHits;            ///< Matches before a track gets an id and is reported
+} TrackerSettings;
+
+typedef struct {
+    int active;
+    int budget;             ///< ms from capture to output the controller keeps the frames under
+    int dwell;              ///< s well under budget before stepping back up
+} LatencySettings;
+
+#define SETTINGS_MAX_VIEWS 4
+
+/**
+ * @brief One view area (VDO channel) watched by the shared model.
+ *
+ * Without a "views" list there is one unnamed view on channel 1 that uses
+ * the top level "aoi". Each entry may set its own "aoi"; it defaults to the
+ * top level one.
+ */
+typedef struct {
+    char name[32];          ///< Event and MQTT topic suffix; "" keeps the single-view names
+    unsigned channel;       ///< VDO channel, applies on restart
+    int aoiX1, aoiY1;       ///< Area of interest 0..1000; detection centers must be inside
+    int aoiX2, aoiY2;
+    int weight;             ///< Relative share of the model frames, 1..100
+} ViewSettings;
+
+typedef struct {
+    int confidence;         ///< Minimum confidence 0..100
+    unsigned viewCount;     ///< 1..SETTINGS_MAX_VIEWS
+    int viewActivity;       ///< "viewMode": "activity" (1) or "roundrobin" (0)
+    ViewSettings views[SETTINGS_MAX_VIEWS];
+    int minWidth;           ///< Minimum detection size 0..1000
+    int minHeight;
+    int aoiInference;       ///< Crop the model input to the AOI
+    int decodeThreads;      ///< Decode workers, 1 or more; read when the model is configured
+    DetectionClasses ignore; ///< Class ids in the "ignore" list
+    double minEventDuration;      ///< ms
+    int prioritizeAccuracy;       ///< "prioritize": "accuracy" (1) or "speed" (0)
+    int eventFrames;              ///< eventLogic.frames
+    int eventWindow;              ///< eventLogic.window in ms
+    int detectionJson;            ///< "detectionFormat": "json" or "both"
+    int detectionBinary;          ///< "detectionFormat": "binary" or "both"
+    CroppingSettings cropping;
+    SchedulerSettings scheduler;
+    MotionSettings motion;
+    TrackerSettings tracker;
+    LatencySettings latency;
+} Settings;
+
+/**
+ * @brief Current settings snapshot. Never NULL; defaults until the first update.
+ *
+ * Only call from the main loop. The pointer is valid until the main loop
+ * runs its next idle callback.
+ */
+const Settings* Settings_Get(void);
+
+/**
+ * @brief Compile the settings tree into a new snapshot.
+ *
+ * Labels in "ignore" are resolved against the model labels, so call again
+ * after Detections_Set_Labels(). Safe to call from any thread.
+ *
+ * @param settings The "settings" config object.
+ */
+void Settings_Update(cJSON* settings);
+
+/**
+ * @brief Compile a settings tree into a caller-owned snapshot (no swap).
+ *
+ * Used by Settings_Update() and by the host bench.
+ */
+void Settings_Compile(cJSON* settings, Settings* out);
+
+/**
+ * @brief Settings of a view; the first view for an index out of range.
+ */
+static inline const ViewSettings* Settings_View(const Settings* settings, unsigned view)
+{
+    return &settings->views[view < settings->viewCount ? view : 0];
+}
+
+/**
+ * @brief True if the class id is in the ignore list.
+ */
+static inline int Settings_Ignored(const Settings* settings, int label)
+{
+    return Detections_Class_Test(&settings->ignore, label);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SETTINGS_H
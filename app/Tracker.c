@@ -0,0 +1,266 @@
+/**
+ * @file tracker.c
+ * @brief Implementation of the multi-object tracker.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "ACAP.h"
+#include "Settings.h"
+#include "Tracker.h"
+
+#define TRACKER_STATUS_INTERVAL 1000    // ms
+
+typedef struct {
+    unsigned id;            // 0 while tentative
+    int label;
+    float x, y, w, h;       // Estimate at 'predicted'
+    float mx, my;           // Center of the last match
+    float vx, vy;           // Center velocity, units per ms
+    double first;           // ms of the first match
+    double updated;         // ms of the last match
+    double predicted;       // ms of the estimate
+    unsigned hits;
+    unsigned misses;        // Inferred frames since the last match
+    int cropped;
+} Track;
+
+typedef struct {
+    Track tracks[TRACKER_MAX_TRACKS];
+    unsigned count;
+    TrackerFrame frame;
+} TrackerView;
+
+typedef struct {
+    float score;
+    unsigned short track;
+    unsigned short detection;
+} TrackerPair;
+
+static TrackerView views[SETTINGS_MAX_VIEWS];
+static TrackerPair pairs[TRACKER_MAX_TRACKS * TRACKER_MAX_DETECTIONS];
+static unsigned nextId = 1;
+static unsigned total = 0;
+
+static TrackerView* get_view(unsigned view) {
+    return &views[view < SETTINGS_MAX_VIEWS ? view : 0];
+}
+
+static float box_iou(float ax, float ay, float aw, float ah, float bx, float by, float bw, float bh) {
+    float x1 = ax > bx ? ax : bx;
+    float y1 = ay > by ? ay : by;
+    float x2 = ax + aw < bx + bw ? ax + aw : bx + bw;
+    float y2 = ay + ah < by + bh ? ay + ah : by + bh;
+    if (x2 <= x1 || y2 <= y1)
+        return 0;
+    float inter = (x2 - x1) * (y2 - y1);
+    float uni = aw * ah + bw * bh - inter;
+    return uni > 0 ? inter / uni : 0;
+}
+
+// IoU matches score 1..2 and always win over center matches (0..1)
+static float match_score(const Track* t, const DetectionList* d, unsigned i, float minIou) {
+    float iou = box_iou(t->x, t->y, t->w, t->h, d->x[i], d->y[i], d->w[i], d->h[i]);
+    if (iou >= minIou)
+        return 1 + iou;
+    float dx = (t->x + t->w / 2) - (d->x[i] + d->w[i] / 2);
+    float dy = (t->y + t->h / 2) - (d->y[i] + d->h[i] / 2);
+    float gate = (t->w + t->h) / 4;     // Half the mean box side
+    float d2 = dx * dx + dy * dy;
+    float g2 = gate * gate;
+    return d2 < g2 ? 1 - d2 / g2 : 0;
+}
+
+static int by_score(const void* a, const void* b) {
+    float sa = ((const TrackerPair*)a)->score;
+    float sb = ((const TrackerPair*)b)->score;
+    return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
+
+static void correct(Track* t, const DetectionList* d, unsigned i, double timestamp) {
+    float cx = d->x[i] + d->w[i] / 2;
+    float cy = d->y[i] + d->h[i] / 2;
+    double dt = timestamp - t->updated;
+    if (t->hits && dt > 0) {
+        float vx = (float)((cx - t->mx) / dt);
+        float vy = (float)((cy - t->my) / dt);
+        // The first velocity is measured, later ones are smoothed
+        t->vx = t->hits > 1 ? 0.5f * t->vx + 0.5f * vx : vx;
+        t->vy = t->hits > 1 ? 0.5f * t->vy + 0.5f * vy : vy;
+    }
+    t->x = d->x[i];
+    t->y = d->y[i];
+    t->w = d->w[i];
+    t->h = d->h[i];
+    t->mx = cx;
+    t->my = cy;
+    t->updated = t->predicted = timestamp;
+    t->hits++;
+    t->misses = 0;
+}
+
+static unsigned new_id(void) {
+    unsigned id = nextId++;
+    if (nextId == 0)
+        nextId = 1;
+    total++;
+    return id;
+}
+
+void Tracker_Update(unsigned view, DetectionList* detections, double timestamp) {
+    const TrackerSettings* config = &Settings_Get()->tracker;
+    TrackerView* v = get_view(view);
+    TrackerFrame* frame = &v->frame;
+    memset(&frame->present, 0, sizeof(frame->present));
+    frame->started = 0;
+    frame->ended = 0;
+
+    unsigned count = detections ? detections->count : 0;
+    for (unsigned i = 0; i < count; i++)
+        detections->track[i] = 0;
+    if (!config->active) {
+        v->count = 0;
+        return;
+    }
+
+    // Move every track to the frame time
+    for (unsigned t = 0; t < v->count; t++) {
+        Track* track = &v->tracks[t];
+        double dt = timestamp - track->predicted;
+        if (dt > 0) {
+            track->x += (float)(track->vx * dt);
+            track->y += (float)(track->vy * dt);
+            track->predicted = timestamp;
+        }
+    }
+
+    // Greedy assignment, best score first
+    unsigned n = count < TRACKER_MAX_DETECTIONS ? count : TRACKER_MAX_DETECTIONS;
+    unsigned pairCount = 0;
+    for (unsigned t = 0; t < v->count; t++) {
+        for (unsigned i = 0; i < n; i++) {
+            if (detections->label[i] != v->tracks[t].label)
+                continue;
+            float score = match_score(&v->tracks[t], detections, i, (float)config->iou);
+            if (score > 0)
+                pairs[pairCount++] = (TrackerPair){ score, (unsigned short)t, (unsigned short)i };
+        }
+    }
+    qsort(pairs, pairCount, sizeof(TrackerPair), by_score);
+
+    int trackDetection[TRACKER_MAX_TRACKS];
+    unsigned char detectionUsed[TRACKER_MAX_DETECTIONS] = { 0 };
+    for (unsigned t = 0; t < v->count; t++)
+        trackDetection[t] = -1;
+    for (unsigned p = 0; p < pairCount; p++) {
+        if (trackDetection[pairs[p].track] >= 0 || detectionUsed[pairs[p].detection])
+            continue;
+        trackDetection[pairs[p].track] = pairs[p].detection;
+        detectionUsed[pairs[p].detection] = 1;
+    }
+
+    // Update matched tracks, coast the others, drop expired ones
+    unsigned kept = 0;
+    for (unsigned t = 0; t < v->count; t++) {
+        Track* track = &v->tracks[t];
+        int i = trackDetection[t];
+        if (i >= 0) {
+            correct(track, detections, (unsigned)i, timestamp);
+            if (!track->id && track->hits >= (unsigned)config->minHits) {
+                track->id = new_id();
+                frame->startedIndex[frame->started++] = (unsigned)i;
+            }
+            detections->track[i] = track->id;
+        } else if (!track->id || ++track->misses > (unsigned)config->coast) {
+            if (track->id) {
+                TrackerEnded* ended = &frame->endedTracks[frame->ended++];
+                ended->id = track->id;
+                ended->label = track->label;
+                ended->x = track->x;
+                ended->y = track->y;
+                ended->w = track->w;
+                ended->h = track->h;
+                ended->duration = track->updated - track->first;
+            }
+            continue;
+        }
+        if (kept != t)
+            v->tracks[kept] = *track;
+        kept++;
+    }
+    v->count = kept;
+
+    // Unmatched detections start tentative tracks
+    for (unsigned i = 0; i < n && v->count < TRACKER_MAX_TRACKS; i++) {
+        if (detectionUsed[i])
+            continue;
+        Track* track = &v->tracks[v->count++];
+        memset(track, 0, sizeof(*track));
+        track->label = detections->label[i];
+        track->first = timestamp;
+        correct(track, detections, i, timestamp);
+        if (config->minHits <= 1) {
+            track->id = new_id();
+            frame->startedIndex[frame->started++] = i;
+            detections->track[i] = track->id;
+        }
+    }
+
+    for (unsigned t = 0; t < v->count; t++) {
+        const Track* track = &v->tracks[t];
+        if (track->id)
+            Detections_Class_Set(&frame->present, track->label);
+    }
+}
+
+const TrackerFrame* Tracker_Frame(unsigned view) {
+    return &get_view(view)->frame;
+}
+
+int Tracker_Crop(unsigned view, unsigned id) {
+    if (!id)
+        return 0;
+    TrackerView* v = get_view(view);
+    for (unsigned t = 0; t < v->count; t++) {
+        Track* track = &v->tracks[t];
+        if (track->id != id)
+            continue;
+        if (track->cropped)
+            return 0;
+        track->cropped = 1;
+        return 1;
+    }
+    return 0;
+}
+
+float Tracker_Speed(unsigned view, unsigned id) {
+    TrackerView* v = get_view(view);
+    for (unsigned t = 0; id && t < v->count; t++) {
+        const Track* track = &v->tracks[t];
+        if (track->id == id)
+            return sqrtf(track->vx * track->vx + track->vy * track->vy);
+    }
+    return 0;
+}
+
+void Tracker_Reset(void) {
+    memset(views, 0, sizeof(views));
+}
+
+static gboolean status(gpointer data) {
+    unsigned tracks = 0;
+    for (unsigned v = 0; v < SETTINGS_MAX_VIEWS; v++)
+        for (unsigned t = 0; t < views[v].count; t++)
+            if (views[v].tracks[t].id)
+                tracks++;
+    ACAP_STATUS_SetNumber("tracker", "tracks", tracks);
+    ACAP_STATUS_SetNumber("tracker", "total", total);
+    return G_SOURCE_CONTINUE;
+}
+
+void Tracker_Init(void) {
+    Tracker_Reset();
+    g_timeout_add(TRACKER_STATUS_INTERVAL, status, NULL);
+}
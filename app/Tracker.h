@@ -0,0 +1,100 @@
+/**
+ * @file tracker.h
+ * @brief IoU/centroid multi-object tracker on the filtered detections.
+ *
+ * Each view keeps a small set of tracks. Every inferred frame, each track is
+ * moved to the frame time with its constant-velocity estimate and matched
+ * greedily to a detection of the same label: best IoU with the predicted box
+ * first, then nearest center within half the box size for fast or small
+ * objects. Unmatched detections start tentative tracks. A track gets an id
+ * after 'minHits' matches and then coasts through up to 'coast' inferred
+ * frames without a match, so events stay HIGH when the model runs at a
+ * reduced rate or misses a frame.
+ *
+ * Tracker_Update() writes the id into detections->track. The frame summary
+ * (Tracker_Frame()) lists the tracks that started and ended and the classes
+ * held by tracks, including coasting ones. Output uses it for the event gate,
+ * the per-track MQTT messages and one crop per track.
+ *
+ * Status group "tracker": tracks (confirmed tracks now, all views), total
+ * (ids issued since start).
+ */
+
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <stdint.h>
+#include "Detections.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACKER_MAX_TRACKS      64      ///< Per view
+#define TRACKER_MAX_DETECTIONS  64      ///< Detections per frame considered for matching
+
+/**
+ * @brief A track that ended in the last update.
+ */
+typedef struct {
+    unsigned id;
+    int label;
+    float x, y, w, h;       ///< Last estimate, 0..1000
+    double duration;        ///< ms from the first to the last match
+} TrackerEnded;
+
+/**
+ * @brief Outcome of the last Tracker_Update() of a view.
+ */
+typedef struct {
+    DetectionClasses present;               ///< Classes held by confirmed tracks
+    unsigned started;                       ///< Tracks confirmed in this frame
+    unsigned startedIndex[TRACKER_MAX_TRACKS];  ///< Their detection index
+    unsigned ended;                         ///< Tracks dropped in this frame
+    TrackerEnded endedTracks[TRACKER_MAX_TRACKS];
+} TrackerFrame;
+
+/**
+ * @brief Clear all tracks and start the status timer.
+ */
+void Tracker_Init(void);
+
+/**
+ * @brief Track the detections of one inferred frame.
+ *
+ * With the tracker off the view's tracks are dropped without ending events
+ * and every track id is 0.
+ *
+ * @param view       View the frame came from.
+ * @param detections Filtered detections (0..1000). track[] is set.
+ * @param timestamp  Frame time in ms.
+ */
+void Tracker_Update(unsigned view, DetectionList* detections, double timestamp);
+
+/**
+ * @brief Summary of the last update of a view.
+ */
+const TrackerFrame* Tracker_Frame(unsigned view);
+
+/**
+ * @brief Claim the crop export of a track.
+ *
+ * @return 1 the first time it is called for a live track, else 0.
+ */
+int Tracker_Crop(unsigned view, unsigned track);
+
+/**
+ * @brief Center speed of a live track in units (0..1000) per ms, 0 if unknown.
+ */
+float Tracker_Speed(unsigned view, unsigned track);
+
+/**
+ * @brief Drop all tracks without ending events.
+ */
+void Tracker_Reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACKER_H
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <syslog.h>
 #include <stdlib.h>
+#include <string.h>
 #include "Video.h"
 #include "imgutils.h"
 
@@ -10,82 +11,205 @@
 //#define LOG_TRACE(fmt, args...)    { syslog(LOG_INFO, fmt, ## args); }
 #define LOG_TRACE(fmt, args...)    {}
 
-ImgProvider_t* yuvProvider = NULL;
-VdoBuffer* yuvBuffer = NULL;
-ImgProvider_t* rgbProvider = NULL;
-VdoBuffer* rgbBuffer = NULL;
+// A JPEG frame matches a YUV frame this close in VDO time (half a frame at 60 fps)
+#define VIDEO_JPEG_MATCH_US 8000
 
-bool Video_Start_YUV(unsigned int width, unsigned int height) {
-    yuvProvider = createImgProvider(width, height, 2, VDO_FORMAT_YUV);
-    if (!yuvProvider) {
-        LOG_WARN("%s: Could not create image provider\n", __func__);
-		return false;
+// One YUV stream per view; the JPEG stream is single
+ImgProvider_t* yuvProviders[VIDEO_MAX_VIEWS] = { NULL };
+VdoBuffer* yuvBuffers[VIDEO_MAX_VIEWS] = { NULL };
+unsigned yuvViews = 0;
+ImgProvider_t* jpegProvider = NULL;
+VdoBuffer* jpegFrames[VIDEO_JPEG_HISTORY] = { NULL };   // Oldest first
+unsigned jpegCount = 0;
+
+bool Video_Start_YUV(unsigned int width, unsigned int height, const unsigned* channels, unsigned views) {
+	if( views < 1 )
+		views = 1;
+	if( views > VIDEO_MAX_VIEWS )
+		views = VIDEO_MAX_VIEWS;
+	for( unsigned i = 0; i < views; i++ ) {
+		unsigned channel = channels ? channels[i] : 1;
+		ImgProvider_t* provider = createImgProvider(width, height, 2, VDO_FORMAT_YUV, IMG_PROVIDER_LATEST, channel);
+		if (!provider) {
+			LOG_WARN("%s: Could not create image provider for channel %u\n", __func__, channel);
+			Video_Stop_YUV();
+			return false;
+		}
+		if (!startFrameFetch(provider)) {
+			destroyImgProvider(provider);
+			LOG_WARN("%s: Unable to start frame fetch for channel %u\n", __func__, channel);
+			Video_Stop_YUV();
+			return false;
+		}
+		yuvProviders[i] = provider;
+		yuvViews = i + 1;
+		LOG_TRACE("%s: YUV Video %ux%u channel %u\n",__func__,width,height,channel);
 	}
-    if (!startFrameFetch(yuvProvider)) {
-        destroyImgProvider(yuvProvider);
-        LOG_WARN("%s: Unable to start frame fetch\n", __func__);
-		return false;
-    }
-	LOG_TRACE("%s: YUV Video %ux%u\n",__func__,width,height);
 	return true;
 }
 
 void
 Video_Stop_YUV() {
-	if( yuvProvider ) {
-		stopFrameFetch(yuvProvider);
-        destroyImgProvider(yuvProvider);
-    }
-	yuvProvider = NULL;
+	for( unsigned i = 0; i < yuvViews; i++ ) {
+		stopFrameFetch(yuvProviders[i]);
+		destroyImgProvider(yuvProviders[i]);
+		yuvProviders[i] = NULL;
+		yuvBuffers[i] = NULL;
+	}
+	yuvViews = 0;
 }
 
+unsigned
+Video_Views_YUV() {
+	return yuvViews;
+}
+
+// The provider that owns a buffer, or -1
+static int
+buffer_view(VdoBuffer* buffer) {
+	for( unsigned v = 0; buffer && v < yuvViews; v++ )
+		for( unsigned i = 0; i < NUM_VDO_BUFFERS; i++ )
+			if( yuvProviders[v]->vdoBuffers[i] == buffer )
+				return (int)v;
+	return -1;
+}
 
 VdoBuffer*
-Video_Capture_YUV() {
-	if(!yuvProvider) {
+Video_Capture_YUV(unsigned view) {
+	if( view >= yuvViews ) {
 		LOG_TRACE("-");
 		return 0;
 	}
-	if( yuvBuffer )
-		returnFrame(yuvProvider, yuvBuffer);	
-    yuvBuffer = getLastFrameBlocking(yuvProvider);
-    return yuvBuffer;
+	if( yuvBuffers[view] )
+		returnFrame(yuvProviders[view], yuvBuffers[view]);
+	yuvBuffers[view] = getLastFrameBlocking(yuvProviders[view]);
+	return yuvBuffers[view];
+}
+
+VdoBuffer*
+Video_Hold_YUV(unsigned view) {
+	if( view >= yuvViews ) {
+		LOG_TRACE("-");
+		return 0;
+	}
+	if( yuvBuffers[view] ) {
+		returnFrame(yuvProviders[view], yuvBuffers[view]);
+		yuvBuffers[view] = NULL;
+	}
+	return getLastFrameBlocking(yuvProviders[view]);
+}
+
+VdoBuffer**
+Video_Buffers_YUV(unsigned* count) {
+	static VdoBuffer* all[VIDEO_MAX_VIEWS * NUM_VDO_BUFFERS];
+	unsigned n = 0;
+	for( unsigned v = 0; v < yuvViews; v++ )
+		for( unsigned i = 0; i < NUM_VDO_BUFFERS; i++ )
+			all[n++] = yuvProviders[v]->vdoBuffers[i];
+	if( count )
+		*count = n;
+	return n ? all : NULL;
+}
+
+void
+Video_Release_YUV(VdoBuffer* buffer) {
+	int view = buffer_view(buffer);
+	if( view >= 0 )
+		returnFrame(yuvProviders[view], buffer);
+}
+
+int
+Video_View_YUV(VdoBuffer* buffer) {
+	return buffer_view(buffer);
+}
+
+uint64_t
+Video_Capture_Time_YUV(VdoBuffer* buffer) {
+	int view = buffer_view(buffer);
+	return view >= 0 ? getFrameCaptureTime(yuvProviders[view], buffer) : 0;
+}
+
+unsigned
+Video_Skipped_YUV() {
+	unsigned skipped = 0;
+	for( unsigned v = 0; v < yuvViews; v++ )
+		skipped += takeSkippedFrames(yuvProviders[v]);
+	return skipped;
 }
 
-bool Video_Start_RGB(unsigned int width, unsigned int height) {
-    rgbProvider = createImgProvider(width, height, 1, VDO_FORMAT_JPEG);
-    if (!rgbProvider) {
+bool Video_Start_JPEG(unsigned int width, unsigned int height, unsigned channel) {
+	if( jpegProvider )
+		return true;
+    jpegProvider = createImgProvider(width, height, 1, VDO_FORMAT_JPEG, IMG_PROVIDER_LATEST, channel);
+    if (!jpegProvider) {
         LOG_WARN("%s: Could not create image provider\n", __func__);
 		return false;
 	}
-    if (!startFrameFetch(rgbProvider)) {
-        destroyImgProvider(rgbProvider);
+    if (!startFrameFetch(jpegProvider)) {
+        destroyImgProvider(jpegProvider);
+        jpegProvider = NULL;
         LOG_WARN("%s: Unable to start frame fetch\n", __func__);
 		return false;
     }
-	LOG_TRACE("%s: RGB Video %ux%u\n",__func__,width,height);
+	LOG_TRACE("%s: JPEG Video %ux%u channel %u\n",__func__,width,height,channel);
 	return true;
 }
 
 void
-Video_Stop_RGB() {
-	if( rgbProvider ) {
-		stopFrameFetch(rgbProvider);
-        destroyImgProvider(rgbProvider);
+Video_Stop_JPEG() {
+	if( jpegProvider ) {
+		for( unsigned i = 0; i < jpegCount; i++ )
+			returnFrame(jpegProvider, jpegFrames[i]);
+		stopFrameFetch(jpegProvider);
+        destroyImgProvider(jpegProvider);
     }
-	rgbProvider = NULL;
+	jpegProvider = NULL;
+	jpegCount = 0;
 }
 
-VdoBuffer*
-Video_Capture_RGB() {
-	if(!rgbProvider) {
-		LOG_TRACE("-");
-		return 0;
+bool
+Video_Running_JPEG() {
+	return jpegProvider != NULL;
+}
+
+void
+Video_Poll_JPEG() {
+	if( !jpegProvider )
+		return;
+	VdoBuffer* frame;
+	while( (frame = pollFrame(jpegProvider)) ) {
+		if( jpegCount == VIDEO_JPEG_HISTORY ) {
+			returnFrame(jpegProvider, jpegFrames[0]);
+			memmove(jpegFrames, jpegFrames + 1, (VIDEO_JPEG_HISTORY - 1) * sizeof(jpegFrames[0]));
+			jpegCount--;
+		}
+		jpegFrames[jpegCount++] = frame;
+	}
+}
+
+const uint8_t*
+Video_Match_JPEG(VdoBuffer* yuv, size_t* size) {
+	if( size )
+		*size = 0;
+	if( !jpegProvider || !yuv )
+		return NULL;
+	Video_Poll_JPEG();
+	uint64_t target = vdo_frame_get_timestamp(vdo_buffer_get_frame(yuv));
+	VdoBuffer* best = NULL;
+	uint64_t bestDelta = VIDEO_JPEG_MATCH_US;
+	for( unsigned i = 0; i < jpegCount; i++ ) {
+		uint64_t t = vdo_frame_get_timestamp(vdo_buffer_get_frame(jpegFrames[i]));
+		uint64_t delta = t > target ? t - target : target - t;
+		if( delta < bestDelta ) {
+			best = jpegFrames[i];
+			bestDelta = delta;
+		}
 	}
-	if( rgbBuffer )
-		returnFrame(rgbProvider, rgbBuffer);	
-    rgbBuffer = getLastFrameBlocking(rgbProvider);
-    return rgbBuffer;
+	if( !best )
+		return NULL;
+	if( size )
+		*size = vdo_frame_get_size(vdo_buffer_get_frame(best));
+	return (const uint8_t*)vdo_buffer_get_data(best);
 }
 
 
@@ -5,11 +5,37 @@
 #include "vdo-types.h"
 #include "imgprovider.h"
 
-bool Video_Start_YUV(unsigned int width, unsigned int height);
-bool Video_Start_RGB(unsigned int width, unsigned int height);
+#define VIDEO_MAX_VIEWS 4
+
+// One YUV stream per view, on the given VDO channels (NULL: channel 1)
+bool Video_Start_YUV(unsigned int width, unsigned int height, const unsigned* channels, unsigned views);
 void Video_Stop_YUV();
-void Video_Stop_RGB();
-VdoBuffer* Video_Capture_YUV(); 
-VdoBuffer* Video_Capture_RGB();
+unsigned Video_Views_YUV();
+VdoBuffer* Video_Capture_YUV(unsigned view);
+
+// Capture a YUV frame that is kept until Video_Release_YUV() is called.
+// Used when more than one frame is in flight (pipelined model).
+VdoBuffer* Video_Hold_YUV(unsigned view);
+// All buffers the YUV streams can deliver (for zero-copy import)
+VdoBuffer** Video_Buffers_YUV(unsigned* count);
+void Video_Release_YUV(VdoBuffer* buffer);
+// View of a YUV buffer, -1 if it is not from a YUV stream
+int Video_View_YUV(VdoBuffer* buffer);
+// Monotonic ns (as Metrics_Now) when VDO delivered a captured YUV frame, 0 if unknown
+uint64_t Video_Capture_Time_YUV(VdoBuffer* buffer);
+// YUV frames dropped for a newer one since the last call
+unsigned Video_Skipped_YUV();
+
+// Camera encoded JPEG stream of one VDO channel, for crops of the same frames.
+// The last VIDEO_JPEG_HISTORY frames are kept. Main loop only.
+#define VIDEO_JPEG_HISTORY 4
+bool Video_Start_JPEG(unsigned int width, unsigned int height, unsigned channel);
+void Video_Stop_JPEG();
+bool Video_Running_JPEG();
+// Take the frames delivered since the last call and drop the oldest. Call once per frame.
+void Video_Poll_JPEG();
+// The kept JPEG of the same capture as a YUV frame (VDO timestamp), or NULL.
+// Valid until the next Video_Poll_JPEG() or Video_Match_JPEG().
+const uint8_t* Video_Match_JPEG(VdoBuffer* yuv, size_t* size);
 
 #endif
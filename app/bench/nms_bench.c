@@ -0,0 +1,173 @@
+/**
+ * @file nms_bench.c
+ * @brief Host bench: legacy cJSON pairwise NMS vs model_nms().
+ *
+ * Build and run on the development host with "make bench". The bench is built
+ * with a larger DETECTIONS_MAX so that 5000 candidates fit in one list.
+ * Candidates are random boxes clustered around a few objects, similar to what
+ * the decoder emits on a crowded frame with a low objectness threshold.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "cJSON.h"
+#include "Detections.h"
+#include "Model_nms.h"
+
+#define BENCH_CLASSES 20
+#define BENCH_IOU 0.05f
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// ---- Legacy implementation (Model.c before the flat detection list) ----
+
+static float legacy_iou(float x1, float y1, float w1, float h1, float x2, float y2, float w2, float h2) {
+    float xx1 = fmax(x1 - (w1 / 2), x2 - (w2 / 2));
+    float yy1 = fmax(y1 - (h1 / 2), y2 - (h2 / 2));
+    float xx2 = fmin(x1 + (w1 / 2), x2 + (w2 / 2));
+    float yy2 = fmin(y1 + (h1 / 2), y2 + (h2 / 2));
+
+    float inter  = fmax(0, xx2 - xx1) * fmax(0, yy2 - yy1);
+    float union_ = w1 * h1 + w2 * h2 - inter;
+
+    return inter / union_;
+}
+
+static cJSON* legacy_nms(cJSON* list, float nms) {
+    int items = cJSON_GetArraySize(list);
+    if (items < 2)
+        return list;
+    int* keep = malloc(items * sizeof(int));
+    for (int i = 0; i < items; i++)
+        keep[i] = 1;
+    for (int i = 0; i < items; i++) {
+        if (keep[i]) {
+            cJSON* detection = cJSON_GetArrayItem(list, i);
+            float x1 = cJSON_GetObjectItem(detection, "x")->valuedouble;
+            float y1 = cJSON_GetObjectItem(detection, "y")->valuedouble;
+            float w1 = cJSON_GetObjectItem(detection, "w")->valuedouble;
+            float h1 = cJSON_GetObjectItem(detection, "h")->valuedouble;
+            float c1 = cJSON_GetObjectItem(detection, "c")->valuedouble;
+            for (int j = i + 1; j < items; j++) {
+                if (keep[j]) {
+                    cJSON* alternative = cJSON_GetArrayItem(list, j);
+                    float x2 = cJSON_GetObjectItem(alternative, "x")->valuedouble;
+                    float y2 = cJSON_GetObjectItem(alternative, "y")->valuedouble;
+                    float w2 = cJSON_GetObjectItem(alternative, "w")->valuedouble;
+                    float h2 = cJSON_GetObjectItem(alternative, "h")->valuedouble;
+                    float c2 = cJSON_GetObjectItem(alternative, "c")->valuedouble;
+                    float iou_value = legacy_iou(x1, y1, w1, h1, x2, y2, w2, h2);
+                    if (iou_value > nms) {
+                        if (c1 > c2) {
+                            keep[j] = 0;
+                        } else {
+                            keep[i] = 0;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    cJSON* result = cJSON_CreateArray();
+    for (int i = 0; i < items; i++) {
+        if (keep[i])
+            cJSON_AddItemToArray(result, cJSON_Duplicate(cJSON_GetArrayItem(list, i), 1));
+    }
+    free(keep);
+    cJSON_Delete(list);
+    return result;
+}
+
+// ---- Bench ----
+
+static DetectionList source;
+static DetectionList work;
+
+static void generate(unsigned count) {
+    Detections_Clear(&source);
+    unsigned objects = count / 25 + 1;
+    for (unsigned i = 0; i < count; i++) {
+        unsigned object = rand() % objects;
+        srand(object * 7919 + 1);
+        float ox = (rand() % 900) / 1000.0f;
+        float oy = (rand() % 900) / 1000.0f;
+        float ow = 0.02f + (rand() % 80) / 1000.0f;
+        float oh = 0.02f + (rand() % 80) / 1000.0f;
+        int label = rand() % BENCH_CLASSES;
+        srand(i * 31 + count);
+        float jitter = ((rand() % 200) - 100) / 10000.0f;
+        Detections_Add(&source, ox + jitter, oy - jitter, ow, oh,
+                       0.3f + (rand() % 700) / 1000.0f, label, i, 0);
+    }
+}
+
+static cJSON* to_json(const DetectionList* list) {
+    cJSON* arr = cJSON_CreateArray();
+    for (unsigned i = 0; i < list->count; i++) {
+        cJSON* detection = cJSON_CreateObject();
+        cJSON_AddStringToObject(detection, "label", "label");
+        cJSON_AddNumberToObject(detection, "c", list->c[i]);
+        cJSON_AddNumberToObject(detection, "x", list->x[i]);
+        cJSON_AddNumberToObject(detection, "y", list->y[i]);
+        cJSON_AddNumberToObject(detection, "w", list->w[i]);
+        cJSON_AddNumberToObject(detection, "h", list->h[i]);
+        cJSON_AddNumberToObject(detection, "timestamp", 0);
+        cJSON_AddNumberToObject(detection, "refId", list->refId[i]);
+        cJSON_AddItemToArray(arr, detection);
+    }
+    return arr;
+}
+
+static double bench_legacy(unsigned runs, int* kept) {
+    double total = 0;
+    for (unsigned r = 0; r < runs; r++) {
+        // The legacy path also built the cJSON list; only NMS is timed
+        cJSON* list = to_json(&source);
+        double start = now_ms();
+        list = legacy_nms(list, BENCH_IOU);
+        total += now_ms() - start;
+        *kept = cJSON_GetArraySize(list);
+        cJSON_Delete(list);
+    }
+    return total / runs;
+}
+
+static double bench_flat(unsigned runs, const NmsConfig* config, int* kept) {
+    double total = 0;
+    for (unsigned r = 0; r < runs; r++) {
+        memcpy(&work, &source, sizeof(work));
+        double start = now_ms();
+        *kept = model_nms(config, &work);
+        total += now_ms() - start;
+    }
+    return total / runs;
+}
+
+int main(void) {
+    const unsigned sizes[] = { 50, 500, 5000 };
+    NmsConfig agnostic = { BENCH_IOU, 0, MODEL_NMS_DEFAULT_MAX };
+    NmsConfig perClass = { BENCH_IOU, 1, MODEL_NMS_DEFAULT_MAX };
+
+    printf("%10s %14s %14s %14s\n", "candidates", "legacy ms", "agnostic ms", "class ms");
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        unsigned count = sizes[s];
+        unsigned runs = count <= 500 ? 50 : 3;
+        int keptLegacy = 0, keptFlat = 0, keptClass = 0;
+        generate(count);
+        double legacy = bench_legacy(runs, &keptLegacy);
+        double flat = bench_flat(runs, &agnostic, &keptFlat);
+        double flatClass = bench_flat(runs, &perClass, &keptClass);
+        printf("%10u %14.3f %14.3f %14.3f   kept %d / %d / %d\n",
+               count, legacy, flat, flatClass, keptLegacy, keptFlat, keptClass);
+    }
+    return 0;
+}
@@ -0,0 +1,430 @@
+/**
+ * @file replay_bench.c
+ * @brief Host bench: replay output tensors through decode, NMS, filter and event gating.
+ *
+ * Build and run on the development host with "make replay". With
+ * REPLAY=<path> (no extension) the bench reads a device dump, <path>.bin and
+ * <path>.json, written by the "dump" node (Model_dump.h). Without it, the
+ * bench generates synthetic frames for a COCO sized model and uses
+ * settings/settings.json.
+ *
+ * Each frame goes through the same code as on the device: model_decode(),
+ * model_nms(), Filter_Detections() and the Output_events gate. The ACAP
+ * events, MQTT and HTTP are stubbed; a rising class builds its event payload
+ * like Output() does and then drops it. Reported per stage: ns/frame and
+ * heap allocations/frame (malloc, calloc and realloc from the pipeline code,
+ * counted with -Wl,--wrap).
+ *
+ * The replay runs model_decode() on one thread. A second pass times decode
+ * alone with the worker pool at 1, 2 and 4 threads (model_decode_threads()).
+ * Tensors too small for the pool are tiled up to BENCH_SCALING_BOXES boxes
+ * for that pass.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+#include "Detections.h"
+#include "Settings.h"
+#include "Filter.h"
+#include "Model_decode.h"
+#include "Model_nms.h"
+#include "Model_dump.h"
+#include "Output_events.h"
+
+#define BENCH_MAX_CANDIDATES 1024           // MODEL_MAX_CANDIDATES in Model.c
+#define BENCH_DECODER_CONFIDENCE 0.30f      // confidenceThreshold in Model.c
+#define BENCH_SYNTHETIC_FRAMES 100
+#define BENCH_SYNTHETIC_BOXES 6300
+#define BENCH_SYNTHETIC_CLASSES 80
+#define BENCH_SYNTHETIC_OBJECTS 6
+#define BENCH_MIN_FRAMES 2000               // Short dumps are replayed until this many frames
+#define BENCH_SCALING_BOXES 127575          // Tiled tensor size of the thread scaling pass
+#define BENCH_SCALING_DECODES 500
+
+// ---- Allocation counter ----
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static unsigned long allocations = 0;
+
+void* __wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+    __real_free(ptr);
+}
+
+// ---- Stages ----
+
+enum { STAGE_DECODE = 0, STAGE_NMS, STAGE_FILTER, STAGE_EVENTS, STAGE_FRAME, STAGES };
+static const char* stageNames[STAGES] = { "decode", "nms", "filter", "events", "frame" };
+
+typedef struct {
+    uint64_t ns;
+    unsigned long allocations;
+} StageTotal;
+
+static StageTotal totals[STAGES];
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct {
+    uint64_t start;
+    unsigned long allocations;
+} StageMark;
+
+static StageMark mark(void) {
+    StageMark m = { now_ns(), allocations };
+    return m;
+}
+
+static void record(int stage, StageMark m) {
+    totals[stage].ns += now_ns() - m.start;
+    totals[stage].allocations += allocations - m.allocations;
+}
+
+// ---- Input ----
+
+typedef struct {
+    ModelDumpHeader header;
+    size_t tensorSize;
+    unsigned frames;
+    double* timestamps;
+    uint8_t* tensors;
+    cJSON* model;
+    cJSON* settings;
+} Replay;
+
+static char* read_text(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* text = size >= 0 ? malloc(size + 1) : NULL;
+    if (text && fread(text, 1, size, f) != (size_t)size) {
+        free(text);
+        text = NULL;
+    }
+    if (text)
+        text[size] = 0;
+    fclose(f);
+    return text;
+}
+
+static cJSON* read_json(const char* path) {
+    char* text = read_text(path);
+    if (!text)
+        return NULL;
+    cJSON* json = cJSON_Parse(text);
+    free(text);
+    return json;
+}
+
+static int load_dump(const char* base, Replay* replay) {
+    char name[512];
+    snprintf(name, sizeof(name), "%s.json", base);
+    cJSON* sidecar = read_json(name);
+    if (!sidecar) {
+        fprintf(stderr, "Unable to read %s\n", name);
+        return 0;
+    }
+    replay->model = cJSON_DetachItemFromObject(sidecar, "model");
+    replay->settings = cJSON_DetachItemFromObject(sidecar, "settings");
+    cJSON_Delete(sidecar);
+    if (!replay->model) {
+        fprintf(stderr, "%s has no model\n", name);
+        return 0;
+    }
+
+    snprintf(name, sizeof(name), "%s.bin", base);
+    FILE* f = fopen(name, "rb");
+    if (!f || fread(&replay->header, sizeof(replay->header), 1, f) != 1 ||
+        memcmp(replay->header.magic, MODEL_DUMP_MAGIC, sizeof(replay->header.magic)) != 0 ||
+        replay->header.version != MODEL_DUMP_VERSION) {
+        fprintf(stderr, "%s is not a tensor dump\n", name);
+        if (f) fclose(f);
+        return 0;
+    }
+    unsigned channels = replay->header.classes + (replay->header.format & MODEL_DUMP_NO_OBJECTNESS ? 4 : 5);
+    replay->tensorSize = (size_t)replay->header.boxes * channels;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f) - (long)sizeof(replay->header);
+    fseek(f, sizeof(replay->header), SEEK_SET);
+    replay->frames = size > 0 ? size / (sizeof(double) + replay->tensorSize) : 0;
+    replay->timestamps = malloc(replay->frames * sizeof(double) + 1);
+    replay->tensors = malloc(replay->frames * replay->tensorSize + 1);
+    for (unsigned i = 0; i < replay->frames; i++) {
+        if (fread(&replay->timestamps[i], sizeof(double), 1, f) != 1 ||
+            fread(replay->tensors + i * replay->tensorSize, replay->tensorSize, 1, f) != 1) {
+            replay->frames = i;
+            break;
+        }
+    }
+    fclose(f);
+    if (!replay->frames) {
+        fprintf(stderr, "%s has no frames\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+// Background noise plus a few objects moving across the frame, each covered
+// by a cluster of overlapping boxes like a real detector output.
+static void synthesize(Replay* replay) {
+    ModelDumpHeader* h = &replay->header;
+    memcpy(h->magic, MODEL_DUMP_MAGIC, sizeof(h->magic));
+    h->version = MODEL_DUMP_VERSION;
+    h->boxes = BENCH_SYNTHETIC_BOXES;
+    h->classes = BENCH_SYNTHETIC_CLASSES;
+    h->quant = 1.0f / 255;
+    h->zeroPoint = 0;
+    replay->tensorSize = (size_t)h->boxes * (h->classes + 5);
+    replay->frames = BENCH_SYNTHETIC_FRAMES;
+    replay->timestamps = malloc(replay->frames * sizeof(double));
+    replay->tensors = malloc(replay->frames * replay->tensorSize);
+
+    unsigned stride = h->classes + 5;
+    srand(1);
+    for (unsigned f = 0; f < replay->frames; f++) {
+        replay->timestamps[f] = 1700000000000.0 + f * 100.0;
+        uint8_t* tensor = replay->tensors + f * replay->tensorSize;
+        for (size_t i = 0; i < replay->tensorSize; i++)
+            tensor[i] = rand() % 32;
+        for (unsigned o = 0; o < BENCH_SYNTHETIC_OBJECTS; o++) {
+            // Objects come and go so the event gate sees rising and falling edges
+            if ((f / 40 + o) % 3 == 0)
+                continue;
+            int cx = (30 + o * 35 + f) % 220 + 20;
+            int cy = 60 + o * 25;
+            int classId = o % 4;
+            for (unsigned k = 0; k < 12; k++) {
+                uint8_t* box = tensor + ((o * 997 + k * 31 + f * 7) % h->boxes) * stride;
+                box[0] = cx + rand() % 7 - 3;
+                box[1] = cy + rand() % 7 - 3;
+                box[2] = 40 + rand() % 5;
+                box[3] = 60 + rand() % 5;
+                box[4] = 200 + rand() % 50;
+                box[5 + classId] = 200 + rand() % 50;
+            }
+        }
+    }
+
+    replay->model = cJSON_CreateObject();
+    cJSON_AddNumberToObject(replay->model, "objectness", 0.25);
+    cJSON_AddNumberToObject(replay->model, "nms", 0.05);
+    cJSON* labels = cJSON_AddArrayToObject(replay->model, "labels");
+    char label[16];
+    for (unsigned c = 0; c < h->classes; c++) {
+        snprintf(label, sizeof(label), "class%u", c);
+        cJSON_AddItemToArray(labels, cJSON_CreateString(label));
+    }
+    replay->settings = read_json("settings/settings.json");
+}
+
+static double get_double(cJSON* object, const char* name, double fallback) {
+    cJSON* item = object ? cJSON_GetObjectItem(object, name) : NULL;
+    return item && cJSON_IsNumber(item) ? item->valuedouble : fallback;
+}
+
+static DecodeCandidate candidates[BENCH_MAX_CANDIDATES];
+
+// ---- Thread scaling ----
+
+// Repeat the boxes of each frame up to 'boxes' boxes, in the tensor layout
+static uint8_t* tile(const Replay* replay, const DecoderConfig* source, unsigned boxes) {
+    size_t size = (size_t)boxes * source->channels;
+    uint8_t* tiled = malloc(replay->frames * size);
+    if (!tiled)
+        return NULL;
+    for (unsigned f = 0; f < replay->frames; f++) {
+        const uint8_t* from = replay->tensors + f * replay->tensorSize;
+        uint8_t* to = tiled + f * size;
+        for (unsigned b = 0; b < boxes; b++) {
+            unsigned s = b % source->boxes;
+            if (source->format.layout == MODEL_LAYOUT_CHANNELS) {
+                for (unsigned c = 0; c < source->channels; c++)
+                    to[(size_t)c * boxes + b] = from[(size_t)c * source->boxes + s];
+            } else {
+                memcpy(to + (size_t)b * source->stride, from + (size_t)s * source->stride, source->stride);
+            }
+        }
+    }
+    return tiled;
+}
+
+static void scaling(const Replay* replay, const DecoderConfig* source) {
+    static DecoderConfig decoder;
+    const uint8_t* tensors = replay->tensors;
+    uint8_t* tiled = NULL;
+    decoder = *source;
+    if (decoder.boxes < 2 * MODEL_DECODE_MIN_RANGE) {
+        if (!model_decode_setup(&decoder, &source->format, BENCH_SCALING_BOXES, source->classes,
+                                source->quant, replay->header.zeroPoint,
+                                source->objectnessThreshold, source->confidenceThreshold) ||
+            !(tiled = tile(replay, source, BENCH_SCALING_BOXES)))
+            return;
+        tensors = tiled;
+    }
+
+    printf("Decode scaling: %u boxes%s\n", decoder.boxes, tiled ? " (tiled)" : "");
+    printf("%-8s %12s %9s %18s\n", "threads", "ns/frame", "speedup", "candidates/frame");
+    double serial = 0;
+    static const unsigned threadCounts[] = { 1, 2, 4 };
+    for (unsigned t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+        unsigned threads = model_decode_threads(threadCounts[t]);
+        unsigned long count = 0;
+        uint64_t start = now_ns();
+        for (unsigned i = 0; i < BENCH_SCALING_DECODES; i++) {
+            const uint8_t* tensor = tensors + (i % replay->frames) * decoder.tensorSize;
+            count += model_decode(&decoder, tensor, candidates, BENCH_MAX_CANDIDATES);
+        }
+        double ns = (double)(now_ns() - start) / BENCH_SCALING_DECODES;
+        if (t == 0)
+            serial = ns;
+        printf("%-8u %12.0f %8.2fx %18.1f\n", threads, ns, serial / ns, (double)count / BENCH_SCALING_DECODES);
+    }
+    model_decode_cleanup();
+    free(tiled);
+}
+
+// ---- Replay ----
+
+static DetectionList modelDetections;
+static DetectionList processedDetections;
+
+int main(int argc, char** argv) {
+    Replay replay;
+    memset(&replay, 0, sizeof(replay));
+    if (argc > 1 && argv[1][0]) {
+        if (!load_dump(argv[1], &replay))
+            return 1;
+    } else {
+        synthesize(&replay);
+    }
+
+    // The tensor format is recorded in the dump header
+    DecoderFormat format = {
+        replay.header.format & MODEL_DUMP_CHANNELS ? MODEL_LAYOUT_CHANNELS : MODEL_LAYOUT_BOXES,
+        (replay.header.format & MODEL_DUMP_SIGNED) != 0,
+        (replay.header.format & MODEL_DUMP_NO_OBJECTNESS) == 0
+    };
+    static DecoderConfig decoder;
+    if (!model_decode_setup(&decoder, &format, replay.header.boxes, replay.header.classes,
+                            replay.header.quant, replay.header.zeroPoint,
+                            get_double(replay.model, "objectness", 0.25), BENCH_DECODER_CONFIDENCE)) {
+        fprintf(stderr, "Invalid model parameters\n");
+        return 1;
+    }
+    NmsConfig nms = { get_double(replay.model, "nms", 0.05), 0, MODEL_NMS_DEFAULT_MAX };
+    cJSON* nmsMode = cJSON_GetObjectItem(replay.model, "nmsMode");
+    nms.perClass = nmsMode && cJSON_IsString(nmsMode) && strcmp(nmsMode->valuestring, "class") == 0;
+    int maxDetections = (int)get_double(replay.model, "maxDetections", 0);
+    if (maxDetections > 0)
+        nms.maxDetections = maxDetections;
+    Detections_Set_Labels(cJSON_GetObjectItem(replay.model, "labels"));
+
+    Settings settings;
+    Settings_Compile(replay.settings, &settings);
+    OutputEventsConfig events = { settings.prioritizeAccuracy, settings.eventFrames, settings.eventWindow };
+
+    unsigned loops = (BENCH_MIN_FRAMES + replay.frames - 1) / replay.frames;
+    unsigned frames = loops * replay.frames;
+    unsigned long candidateCount = 0, survivorCount = 0, detectionCount = 0, risingCount = 0, fallingCount = 0;
+    int refId = 0;
+
+    for (unsigned loop = 0; loop < loops; loop++) {
+        output_events_reset();
+        for (unsigned f = 0; f < replay.frames; f++) {
+            const uint8_t* tensor = replay.tensors + f * replay.tensorSize;
+            double timestamp = replay.timestamps[f];
+            StageMark frameMark = mark();
+
+            StageMark m = mark();
+            unsigned count = model_decode(&decoder, tensor, candidates, BENCH_MAX_CANDIDATES);
+            Detections_Clear(&modelDetections);
+            for (unsigned i = 0; i < count; i++)
+                Detections_Add(&modelDetections, candidates[i].x, candidates[i].y, candidates[i].w, candidates[i].h,
+                               candidates[i].confidence, candidates[i].classId, refId++, timestamp);
+            record(STAGE_DECODE, m);
+            candidateCount += count;
+
+            m = mark();
+            model_nms(&nms, &modelDetections);
+            record(STAGE_NMS, m);
+            survivorCount += modelDetections.count;
+
+            m = mark();
+            Filter_Detections(&settings, 0, &modelDetections, timestamp, &processedDetections);
+            record(STAGE_FILTER, m);
+            detectionCount += processedDetections.count;
+
+            m = mark();
+            DetectionClasses present = {{0}};
+            unsigned first[DETECTIONS_MAX_CLASSES];
+            for (unsigned i = 0; i < processedDetections.count; i++) {
+                int classId = processedDetections.label[i];
+                if (classId < 0 || classId >= DETECTIONS_MAX_CLASSES)
+                    continue;
+                if (!Detections_Class_Test(&present, classId)) {
+                    Detections_Class_Set(&present, classId);
+                    first[classId] = i;
+                }
+            }
+            DetectionClasses rising = output_events_update(0, &present, timestamp, &events);
+            for (int classId; (classId = Detections_Class_Pop(&rising)) >= 0;) {
+                cJSON* payload = Detections_Item_JSON(&processedDetections, first[classId]);
+                cJSON_AddTrueToObject(payload, "state");
+                cJSON_Delete(payload);
+                risingCount++;
+            }
+            DetectionClasses falling = output_events_expire(0, timestamp, settings.minEventDuration);
+            fallingCount += Detections_Class_Count(&falling);
+            record(STAGE_EVENTS, m);
+
+            record(STAGE_FRAME, frameMark);
+        }
+    }
+
+    printf("Replay: %u frames (%u x %u), %u boxes, %u classes\n",
+           frames, loops, replay.frames, replay.header.boxes, replay.header.classes);
+    printf("Per frame: %.1f candidates, %.1f after NMS, %.1f after filter; events %lu rising, %lu falling\n",
+           (double)candidateCount / frames, (double)survivorCount / frames, (double)detectionCount / frames,
+           risingCount, fallingCount);
+    printf("%-8s %12s %14s\n", "stage", "ns/frame", "allocs/frame");
+    for (int s = 0; s < STAGES; s++)
+        printf("%-8s %12.0f %14.2f\n", stageNames[s],
+               (double)totals[s].ns / frames, (double)totals[s].allocations / frames);
+
+    scaling(&replay, &decoder);
+
+    cJSON_Delete(replay.model);
+    cJSON_Delete(replay.settings);
+    free(replay.timestamps);
+    free(replay.tensors);
+    return 0;
+}
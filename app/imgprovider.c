@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <gmodule.h>
 #include <syslog.h>
+#include <time.h>
 
 #include "vdo-map.h"
 #include <vdo-channel.h>
@@ -91,8 +92,12 @@ static void releaseVdoBuffers(ImgProvider_t* provider);
  */
 static void* threadEntry(void* data);
 
-ImgProvider_t*
-createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFormat format) {
+ImgProvider_t* createImgProvider(unsigned int w,
+                                 unsigned int h,
+                                 unsigned int numFrames,
+                                 VdoFormat format,
+                                 ImgProviderMode mode,
+                                 unsigned int channel) {
     bool mtxInitialized  = false;
     bool condInitialized = false;
 
@@ -104,6 +109,8 @@ createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFor
 
     provider->vdoFormat    = format;
     provider->numAppFrames = numFrames;
+    provider->mode         = mode;
+    provider->channel      = channel ? channel : VDO_CHANNEL;
 
     if (pthread_mutex_init(&provider->frameMutex, NULL)) {
         syslog(LOG_ERR, "%s: Unable to initialize mutex: %s", __func__, strerror(errno));
@@ -305,7 +312,7 @@ bool createStream(ImgProvider_t* provider, unsigned int w, unsigned int h) {
         goto end;
     }
 
-    vdo_map_set_uint32(vdoMap, "channel", VDO_CHANNEL);
+    vdo_map_set_uint32(vdoMap, "channel", provider->channel);
     vdo_map_set_uint32(vdoMap, "format", provider->vdoFormat);
     vdo_map_set_uint32(vdoMap, "width", w);
     vdo_map_set_uint32(vdoMap, "height", h);
@@ -367,7 +374,108 @@ static void releaseVdoBuffers(ImgProvider_t* provider) {
     }
 }
 
+static uint64_t monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void recycleFrame(ImgProvider_t* provider, VdoBuffer* buffer) {
+    GError* error = NULL;
+    if (!vdo_stream_buffer_enqueue(provider->vdoStream, buffer, &error)) {
+        syslog(LOG_WARNING,
+               "%s: Failed enqueueing buffer to vdo: %s",
+               __func__,
+               (error != NULL) ? error->message : "N/A");
+        g_clear_error(&error);
+    }
+}
+
+/**
+ * brief Client side of the IMG_PROVIDER_LATEST ring.
+ *
+ * Only the fetcher writes ringHead and only the client writes ringTail, so
+ * a frame that is already waiting is taken without a lock. frameMutex is
+ * only used to sleep when the ring is empty.
+ */
+static VdoBuffer* getLatestFrame(ImgProvider_t* provider) {
+    unsigned int tail = atomic_load_explicit(&provider->ringTail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&provider->ringHead, memory_order_acquire);
+
+    if (head == tail) {
+        pthread_mutex_lock(&provider->frameMutex);
+        atomic_store(&provider->clientWaiting, true);
+        while ((head = atomic_load(&provider->ringHead)) == tail) {
+            if (pthread_cond_wait(&provider->frameDeliverCond, &provider->frameMutex)) {
+                syslog(LOG_ERR, "%s: Failed to wait on condition: %s", __func__, strerror(errno));
+                atomic_store(&provider->clientWaiting, false);
+                pthread_mutex_unlock(&provider->frameMutex);
+                return NULL;
+            }
+        }
+        atomic_store(&provider->clientWaiting, false);
+        pthread_mutex_unlock(&provider->frameMutex);
+    }
+
+    // Keep the newest frame, superseded ones go straight back to VDO
+    for (; tail != head - 1; tail++) {
+        recycleFrame(provider, provider->ring[tail % NUM_VDO_BUFFERS].buffer);
+        atomic_fetch_add_explicit(&provider->skippedFrames, 1, memory_order_relaxed);
+    }
+    ImgFrame frame = provider->ring[tail % NUM_VDO_BUFFERS];
+    atomic_store_explicit(&provider->ringTail, head, memory_order_release);
+
+    for (size_t i = 0; i < NUM_VDO_BUFFERS; i++) {
+        if (provider->vdoBuffers[i] == frame.buffer) {
+            provider->captureTimes[i] = frame.captureTime;
+            break;
+        }
+    }
+    return frame.buffer;
+}
+
+VdoBuffer* pollFrame(ImgProvider_t* provider) {
+    if (!provider || provider->mode != IMG_PROVIDER_LATEST) {
+        return NULL;
+    }
+    unsigned int tail = atomic_load_explicit(&provider->ringTail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&provider->ringHead, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+    ImgFrame frame = provider->ring[tail % NUM_VDO_BUFFERS];
+    atomic_store_explicit(&provider->ringTail, tail + 1, memory_order_release);
+
+    for (size_t i = 0; i < NUM_VDO_BUFFERS; i++) {
+        if (provider->vdoBuffers[i] == frame.buffer) {
+            provider->captureTimes[i] = frame.captureTime;
+            break;
+        }
+    }
+    return frame.buffer;
+}
+
+uint64_t getFrameCaptureTime(ImgProvider_t* provider, VdoBuffer* buffer) {
+    if (!provider || !buffer) {
+        return 0;
+    }
+    for (size_t i = 0; i < NUM_VDO_BUFFERS; i++) {
+        if (provider->vdoBuffers[i] == buffer) {
+            return provider->captureTimes[i];
+        }
+    }
+    return 0;
+}
+
+unsigned int takeSkippedFrames(ImgProvider_t* provider) {
+    return provider ? atomic_exchange(&provider->skippedFrames, 0) : 0;
+}
+
 VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider) {
+    if (provider->mode == IMG_PROVIDER_LATEST) {
+        return getLatestFrame(provider);
+    }
+
     VdoBuffer* returnBuf = NULL;
     pthread_mutex_lock(&provider->frameMutex);
 
@@ -387,6 +495,11 @@ errorExit:
 }
 
 void returnFrame(ImgProvider_t* provider, VdoBuffer* buffer) {
+    if (provider->mode == IMG_PROVIDER_LATEST) {
+        recycleFrame(provider, buffer);
+        return;
+    }
+
     pthread_mutex_lock(&provider->frameMutex);
 
     g_queue_push_tail(provider->processedFrames, buffer);
@@ -411,6 +524,29 @@ static void* threadEntry(void* data) {
             g_clear_error(&error);
             continue;
         }
+
+        if (provider->mode == IMG_PROVIDER_LATEST) {
+            // Producer side of the ring, see getLatestFrame()
+            unsigned int head = atomic_load_explicit(&provider->ringHead, memory_order_relaxed);
+            unsigned int tail = atomic_load_explicit(&provider->ringTail, memory_order_acquire);
+            if (head - tail >= NUM_VDO_BUFFERS) {
+                // Cannot happen with one ring entry per VDO buffer; keep the flow going
+                recycleFrame(provider, newBuffer);
+                atomic_fetch_add_explicit(&provider->skippedFrames, 1, memory_order_relaxed);
+            } else {
+                provider->ring[head % NUM_VDO_BUFFERS].buffer      = newBuffer;
+                provider->ring[head % NUM_VDO_BUFFERS].captureTime = monotonicNs();
+                atomic_store(&provider->ringHead, head + 1);
+                if (atomic_load(&provider->clientWaiting)) {
+                    pthread_mutex_lock(&provider->frameMutex);
+                    pthread_cond_signal(&provider->frameDeliverCond);
+                    pthread_mutex_unlock(&provider->frameMutex);
+                }
+            }
+            g_object_unref(newBuffer);  // Release the ref from vdo_stream_get_buffer
+            continue;
+        }
+
         pthread_mutex_lock(&provider->frameMutex);
 
         g_queue_push_tail(provider->deliveredFrames, newBuffer);
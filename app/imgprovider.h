@@ -23,12 +23,38 @@
 #include <pthread.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "vdo-stream.h"
 #include "vdo-types.h"
 
 #define NUM_VDO_BUFFERS (8)
 
+/**
+ * brief How frames are handed from the fetcher thread to the client.
+ *
+ * - IMG_PROVIDER_QUEUE: deliveredFrames/processedFrames GQueues under
+ *   frameMutex. The fetcher keeps numAppFrames recent frames and recycles
+ *   the rest when the next frame arrives.
+ * - IMG_PROVIDER_LATEST: single-producer/single-consumer ring over the VDO
+ *   buffers with atomic indices. The fetch takes the newest frame and gives
+ *   every older one back to VDO at once; frames returned by the client go
+ *   back to VDO directly. The client must fetch and return from one thread.
+ */
+typedef enum {
+    IMG_PROVIDER_QUEUE = 0,
+    IMG_PROVIDER_LATEST
+} ImgProviderMode;
+
+/**
+ * brief A frame in the IMG_PROVIDER_LATEST ring.
+ */
+typedef struct {
+    VdoBuffer* buffer;
+    /// CLOCK_MONOTONIC ns when the fetcher got the frame from VDO.
+    uint64_t captureTime;
+} ImgFrame;
+
 /**
  * brief A type representing a provider of frames from VDO.
  *
@@ -39,6 +65,7 @@
 typedef struct ImgProvider {
     /// Stream configuration parameters.
     VdoFormat vdoFormat;
+    unsigned int channel;
 
     /// Vdo stream and buffers handling.
     VdoStream* vdoStream;
@@ -50,6 +77,18 @@ typedef struct ImgProvider {
     /// Number of frames to keep in the deliveredFrames queue.
     unsigned int numAppFrames;
 
+    /// IMG_PROVIDER_LATEST: ring written by the fetcher, read by the client.
+    ImgProviderMode mode;
+    ImgFrame ring[NUM_VDO_BUFFERS];
+    atomic_uint ringHead;
+    atomic_uint ringTail;
+    /// Set while the client sleeps on frameDeliverCond.
+    atomic_bool clientWaiting;
+    /// Capture time per vdoBuffers[] entry, set when the client fetches it.
+    uint64_t captureTimes[NUM_VDO_BUFFERS];
+    /// Frames given back to VDO without being fetched.
+    atomic_uint skippedFrames;
+
     /// To support fetching frames asynchonously with VDO.
     pthread_mutex_t frameMutex;
     pthread_cond_t frameDeliverCond;
@@ -84,12 +123,18 @@ bool chooseStreamResolution(unsigned int reqWidth,
  *
  * param w Requested output image width.
  * param h Requested ouput image height.
- * param numFrames Number of fetched frames to keep.
+ * param numFrames Number of fetched frames to keep (IMG_PROVIDER_QUEUE).
  * param vdoFormat Image format to be output by stream.
+ * param mode How frames are handed to the client.
+ * param channel VDO channel (view area) of the stream.
  * return Pointer to new ImgProvider, or NULL if failed.
  */
-ImgProvider_t*
-createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFormat vdoFormat);
+ImgProvider_t* createImgProvider(unsigned int w,
+                                 unsigned int h,
+                                 unsigned int numFrames,
+                                 VdoFormat vdoFormat,
+                                 ImgProviderMode mode,
+                                 unsigned int channel);
 
 /**
  * brief Release VDO buffers and deallocate provider.
@@ -117,11 +162,42 @@ bool stopFrameFetch(ImgProvider_t* provider);
 /**
  * brief Get the most recent frame the thread has fetched from VDO.
  *
+ * Blocks until a frame is available. With IMG_PROVIDER_LATEST, frames older
+ * than the returned one are recycled to VDO and counted as skipped.
+ *
  * param provider Pointer to an ImgProvider fetching frames.
  * return Pointer to an image buffer on success, otherwise NULL.
  */
 VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider);
 
+/**
+ * brief Take the oldest frame the thread has fetched, without blocking
+ * (IMG_PROVIDER_LATEST).
+ *
+ * No frames are skipped, so a client that keeps a few recent frames sees
+ * every one of them. Return each frame with returnFrame().
+ *
+ * param provider Pointer to an ImgProvider fetching frames.
+ * return Pointer to an image buffer, or NULL if no new frame is waiting.
+ */
+VdoBuffer* pollFrame(ImgProvider_t* provider);
+
+/**
+ * brief Capture time of a fetched frame (IMG_PROVIDER_LATEST).
+ *
+ * param provider Pointer to an ImgProvider fetching frames.
+ * param buffer A buffer returned by getLastFrameBlocking().
+ * return CLOCK_MONOTONIC ns when VDO delivered the frame, 0 if unknown.
+ */
+uint64_t getFrameCaptureTime(ImgProvider_t* provider, VdoBuffer* buffer);
+
+/**
+ * brief Number of frames recycled without being fetched, since the last call.
+ *
+ * param provider Pointer to an ImgProvider fetching frames.
+ */
+unsigned int takeSkippedFrames(ImgProvider_t* provider);
+
 /**
  * brief Release reference to an image buffer.
  *
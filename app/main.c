@@ -17,8 +17,17 @@
 #include "Model.h"
 #include "Video.h"
 #include "cJSON.h"
+#include "Detections.h"
 #include "Output.h"
 #include "MQTT.h"
+#include "Settings.h"
+#include "Scheduler.h"
+#include "Motion.h"
+#include "Tracker.h"
+#include "Metrics.h"
+#include "Filter.h"
+#include "Arena.h"
+#include "Latency.h"
 
 
 #define LOG(fmt, args...)    { syslog(LOG_INFO, fmt, ## args); printf(fmt, ## args);}
@@ -39,16 +48,18 @@ ConfigUpdate( const char *setting, cJSON* data) {
 	LOG_TRACE("<%s\n",__func__);
 	if(!setting || !data)
 		return;
-	char *json = cJSON_PrintUnformatted(data);
-	if( json ) {
-		free(json);
-	}
+	// Called once more with the whole tree after each accepted update
+	if( strcmp(setting, "settings") == 0 )
+		Settings_Update(data);
 	LOG_TRACE("%s>\n",__func__);	
 }
 
 
 VdoMap *capture_VDO_map = NULL;
 
+static DetectionList processedDetections;
+static uint64_t startTime = 0;		// Metrics_Now() at start
+static int firstInference = 0;
 int inferenceCounter = 0;
 unsigned int inferenceAverage = 0;
 
@@ -56,7 +67,6 @@ unsigned int inferenceAverage = 0;
 gboolean
 ImageProcess(gpointer data) {
 	LOG_TRACE("<%s\n",__func__);	
-	const char* label = "Undefined";
     struct timeval startTs, endTs;	
 
 	LOG_TRACE("%s: Start\n",__func__);
@@ -65,21 +75,48 @@ ImageProcess(gpointer data) {
 		return G_SOURCE_REMOVE;
 
 	LOG_TRACE("%s: Capture\n",__func__);
-	VdoBuffer* buffer = Video_Capture_YUV();	
+	uint64_t frameStart = Metrics_Now();
+	unsigned view = Scheduler_Next_View( Video_Views_YUV() );
+	VdoBuffer* buffer = Model_Pipelined() ? Video_Hold_YUV(view) : Video_Capture_YUV(view);	
+	Metrics_Stage( METRICS_CAPTURE, frameStart );
+	Metrics_Count( METRICS_SKIPPED, Video_Skipped_YUV() );
 	
 	if( !buffer ) {
+		Metrics_Count( METRICS_DROPPED, 1 );
 		ACAP_STATUS_SetString("model","status","Error. Check log");
 		ACAP_STATUS_SetBool("model","state", 0);
 		LOG_WARN("Image capture failed\n");
 		return G_SOURCE_REMOVE;
 	}
 
+	// Static scene: skip the frame without running the model
+	static int skipping[VIDEO_MAX_VIEWS];
+	int* viewSkipping = &skipping[view < VIDEO_MAX_VIEWS ? view : 0];
+	if( !Motion_Check(view, buffer) ) {
+		if( Model_Pipelined() ) {
+			Video_Release_YUV(buffer);
+			// The frame in flight would come out stale when motion resumes
+			if( !*viewSkipping )
+				Model_Pipeline_Flush();
+		}
+		*viewSkipping = 1;
+		return G_SOURCE_CONTINUE;
+	}
+	*viewSkipping = 0;
+
 	LOG_TRACE("%s: Image\n",__func__);
     gettimeofday(&startTs, NULL);
-	cJSON* detections = Model_Inference(buffer);
+	const DetectionList* detections = Model_Pipelined() ? Model_Pipeline(buffer) : Model_Inference(buffer);
     gettimeofday(&endTs, NULL);
 	LOG_TRACE("%s: Done\n",__func__);
 
+	if( detections && !firstInference ) {
+		firstInference = 1;
+		int ms = (int)((Metrics_Now() - startTime) / 1000000);
+		ACAP_STATUS_SetNumber("model", "firstInference", ms);
+		LOG("First inference %d ms after start\n", ms);
+	}
+
 	unsigned int inferenceTime = (unsigned int)(((endTs.tv_sec - startTs.tv_sec) * 1000) + ((endTs.tv_usec - startTs.tv_usec) / 1000));
 	inferenceCounter++;
 	inferenceAverage += inferenceTime;
@@ -90,106 +127,38 @@ ImageProcess(gpointer data) {
 	}
 
 	double timestamp = ACAP_DEVICE_Timestamp();
+	// Pipelined detections belong to the frame before, possibly of another view
+	unsigned detectionsView = Model_View();
 
 	//Apply Transform detection data and apply user filters
-	cJSON* processedDetections = cJSON_CreateArray();
-	cJSON* aoi = cJSON_GetObjectItem(settings,"aoi");
-	if(!aoi) {
-		ACAP_STATUS_SetString("model","status","Error. Check log");
-		ACAP_STATUS_SetBool("model","state", 0);
-		LOG_WARN("No aoi settings\n");
-		return G_SOURCE_REMOVE;
-	}
-	unsigned int x1 = cJSON_GetObjectItem(aoi,"x1")?cJSON_GetObjectItem(aoi,"x1")->valueint:100;
-	unsigned int y1 = cJSON_GetObjectItem(aoi,"y1")?cJSON_GetObjectItem(aoi,"y1")->valueint:100;
-	unsigned int x2 = cJSON_GetObjectItem(aoi,"x2")?cJSON_GetObjectItem(aoi,"x2")->valueint:900;
-	unsigned int y2 = cJSON_GetObjectItem(aoi,"y2")?cJSON_GetObjectItem(aoi,"y2")->valueint:900;
-
-	cJSON* size = cJSON_GetObjectItem(settings,"size");
-	if(!size) {
-		ACAP_STATUS_SetString("model","status","Error. Check log");
-		ACAP_STATUS_SetBool("model","state", 0);
-		LOG_WARN("No size settings\n");
-		return G_SOURCE_REMOVE;
+	// User filters (Filter.c)
+	uint64_t filterStart = Metrics_Now();
+	Filter_Detections( Settings_Get(), detectionsView, detections, timestamp, &processedDetections );
+
+	Metrics_Stage( METRICS_FILTER, filterStart );
+	Metrics_Count( METRICS_DETECTIONS, processedDetections.count );
+
+	// Track ids and coasting (Tracker.c)
+	uint64_t trackStart = Metrics_Now();
+	Tracker_Update( detectionsView, &processedDetections, timestamp );
+	Metrics_Stage( METRICS_TRACK, trackStart );
+
+	Scheduler_Activity( detectionsView, processedDetections.count );
+	Motion_Activity( detectionsView, processedDetections.count );
+	uint64_t outputStart = Metrics_Now();
+	Output( &processedDetections, detectionsView );
+	Metrics_Stage( METRICS_OUTPUT, outputStart );
+	double latency = -1;
+	if( detections && Model_Capture_Time() ) {
+		Metrics_Stage( METRICS_CAPTURE_EVENT, Model_Capture_Time() );
+		latency = (Metrics_Now() - Model_Capture_Time()) / 1000000.0;
 	}
-	unsigned int minWidth = cJSON_GetObjectItem(size,"x2")->valueint - cJSON_GetObjectItem(size,"x1")->valueint;
-	unsigned int minHeight = cJSON_GetObjectItem(size,"y2")->valueint - cJSON_GetObjectItem(size,"y1")->valueint;
-
-	int confidenceThreshold = cJSON_GetObjectItem(settings,"confidence")?cJSON_GetObjectItem(settings,"confidence")->valueint:0.5;
-		
-	cJSON* detection = detections->child;
-	while(detection) {
-		unsigned cx = 0;
-		unsigned cy = 0;
-		unsigned width = 0;
-		unsigned height = 0;
-		unsigned c = 0;
-		label = "Undefined";
-		cJSON* property = detection->child;
-		while(property) {
-			if( strcmp("c",property->string) == 0 ) {
-				property->valueint = property->valuedouble * 100;
-				property->valuedouble = property->valueint;
-				c = property->valueint;
-			}
-			if( strcmp("x",property->string) == 0 ) {
-				property->valueint = property->valuedouble * 1000;
-				property->valuedouble = property->valueint;
-				cx += property->valueint;
-			}
-			if( strcmp("y",property->string) == 0 ) {
-				property->valueint = property->valuedouble * 1000;
-				property->valuedouble = property->valueint;
-				cy += property->valueint;
-			}
-			if( strcmp("w",property->string) == 0 ) {
-				property->valueint = property->valuedouble * 1000;
-				width = property->valueint;
-				property->valuedouble = property->valueint;
-				cx += property->valueint / 2;
-			}
-			if( strcmp("h",property->string) == 0 ) {
-				property->valueint = property->valuedouble * 1000;
-				height = property->valueint;
-				property->valuedouble = property->valueint;
-				cy += property->valueint / 2;
-			}
-			if( strcmp("label",property->string) == 0 ) {
-				label = property->valuestring;
-			}
-			property = property->next;
-		}
-		
-		//FILTER DETECTIONS
-		int insert = 0;
-		if( c >= confidenceThreshold && cx >= x1 && cx <= x2 && cy >= y1 && cy <= y2 )
-			insert = 1;
-		if( width < minWidth || height < minHeight )
-			insert = 0;
-		cJSON* ignore = cJSON_GetObjectItem(settings,"ignore");
-		if( insert && ignore && ignore->type == cJSON_Array && cJSON_GetArraySize(ignore) > 0 ) {
-			cJSON* ignoreLabel = ignore->child;
-			while( ignoreLabel && insert ) {
-				if( strcmp( label, ignoreLabel->valuestring) == 0 )
-					insert = 0;
-				ignoreLabel = ignoreLabel->next;
-			}
-		}
-		//Add custom filter here.  Set "insert = 0" if you want to exclude the detection
-
-		if( insert ) {
-			cJSON_AddNumberToObject( detection, "timestamp", timestamp );
-			cJSON_AddItemToArray(processedDetections, cJSON_Duplicate(detection,1));
-		}
-		detection = detection->next;
-	}
-
-	cJSON_Delete( detections );
-
-	Output( processedDetections );
 	Model_Reset();
+	Metrics_Stage( METRICS_FRAME, frameStart );
+	// May switch the model variant, so it runs after the frame is done
+	if( latency >= 0 )
+		Latency_Frame( latency );
 
-	cJSON_Delete(processedDetections);
 	LOG_TRACE("%s>\n",__func__);
 	return G_SOURCE_CONTINUE;
 }
@@ -202,6 +171,24 @@ void HTTP_ENDPOINT_eventsTransition(const ACAP_HTTP_Response response,const ACAP
 
 static GMainLoop *main_loop = NULL;
 
+// The model load (Model_Setup) ran next to the rest of the startup.
+// Called again after each variant switch (Latency.c) with a new model.
+void
+Main_Model_Ready(int ok) {
+	static int started = 0;
+	if( !ok ) {
+		LOG_WARN("Model setup failed\n");
+		return;
+	}
+	unsigned bufferCount = 0;
+	VdoBuffer** buffers = Video_Buffers_YUV(&bufferCount);
+	Model_Import_Buffers(buffers, bufferCount);
+	if( !started ) {
+		started = 1;
+		Scheduler_Start(ImageProcess);
+	}
+}
+
 static gboolean
 signal_handler(gpointer user_data) {
     LOG("Received SIGTERM, initiating shutdown\n");
@@ -236,6 +223,8 @@ void Main_MQTT_Status(int state) {
             cJSON_AddStringToObject(message, "address", ACAP_DEVICE_Prop("IPv4"));
             MQTT_Publish_JSON(topic, message, 0, 1);
             cJSON_Delete(message);
+            Output_MQTT_Connected();
+            Latency_MQTT_Connected();
             break;
         case MQTT_DISCONNECTING:
             sprintf(topic, "connect/%s", ACAP_DEVICE_Prop("serial"));
@@ -247,6 +236,8 @@ void Main_MQTT_Status(int state) {
             break;
         case MQTT_RECONNECTED:
             LOG("%s: Reconnected\n", __func__);
+            Output_MQTT_Connected();
+            Latency_MQTT_Connected();
             break;
         case MQTT_DISCONNECTED:
             LOG("%s: Disconnect\n", __func__);
@@ -300,11 +291,14 @@ Setup_SD_Card() {
 
 int main(void) {
 	setbuf(stdout, NULL);
+	startTime = Metrics_Now();
 	unsigned int videoWidth = 800;
 	unsigned int videoHeight = 600;
 
 	openlog(APP_PACKAGE, LOG_PID|LOG_CONS, LOG_USER);
 
+	// cJSON hooks are installed before any other thread starts
+	Arena_Init();
 	ACAP( APP_PACKAGE, ConfigUpdate );
 	LOG_TRACE("<%s\n",__func__);
 
@@ -320,24 +314,37 @@ int main(void) {
 
 	eventLabelCounter = cJSON_CreateObject();
 
-	model = Model_Setup();
+	// The model setup reads the snapshot (decodeThreads); before the main loop runs the swap is immediate
+	Settings_Update(settings);
+	// Returns once model.json is read; the larod load continues in the background
+	model = Model_Setup(Main_Model_Ready);
+	// The ignore list is compiled against the model labels
+	Settings_Update(settings);
 
 	videoWidth = cJSON_GetObjectItem(model,"videoWidth")?cJSON_GetObjectItem(model,"videoWidth")->valueint:800;
 	videoHeight = cJSON_GetObjectItem(model,"videoHeight")?cJSON_GetObjectItem(model,"videoHeight")->valueint:600;
 
 	if( model ) {
 		ACAP_Set_Config("model", model );
-		if( Video_Start_YUV( videoWidth, videoHeight ) ) {
-			LOG("Video %ux%u started\n",videoWidth,videoHeight);
+		// One YUV stream per view; the views share the model and the larod connection
+		const Settings* config = Settings_Get();
+		unsigned channels[SETTINGS_MAX_VIEWS];
+		for( unsigned v = 0; v < config->viewCount; v++ )
+			channels[v] = config->views[v].channel;
+		if( Video_Start_YUV( videoWidth, videoHeight, channels, config->viewCount ) ) {
+			LOG("Video %ux%u started, %u view(s)\n",videoWidth,videoHeight,Video_Views_YUV());
+			Motion_Init(videoWidth, videoHeight);
 		} else {
 			LOG_WARN("Video stream for image capture failed\n");
 		}
-		g_idle_add(ImageProcess, NULL);
 	} else {
 		LOG_WARN("Model setup failed\n");
 	}
 	ACAP_Set_Config("model",model);
+	Tracker_Init();
 	Output_init();
+	Metrics_Init();
+	Latency_Init();
 	MQTT_Init( Main_MQTT_Status, Main_MQTT_Subscription_Message  );	
 	ACAP_Set_Config("mqtt", MQTT_Settings() );
 	
@@ -360,6 +367,7 @@ int main(void) {
 
 	Main_MQTT_Status(MQTT_DISCONNECTING); //Send graceful disconnect message
 	MQTT_Cleanup();
+	Output_cleanup();
     ACAP_Cleanup();
 	Model_Cleanup();
     closelog();
@@ -52,6 +52,9 @@ def generate_json(platform="A8", image_size=480):
         "classes": 0,
         "objectness": 0.25,
         "nms": 0.05,
+        "nmsMode": "agnostic",
+        "maxDetections": 100,
+        "pipeline": True,
         "path": "model/model.tflite",
         "scaleMode": 0,
         "videoWidth": video_width,